@@ -383,7 +383,8 @@ lws_callback_http_dummy(struct lws *wsi, enum lws_callback_reasons reason,
 			 */
 			wsi->reason_bf &= ~LWS_CB_REASON_AUX_BF__PROXY;
 			if (!lws_get_child(wsi))
-				break;
+				/* the origin is done with us without a length */
+				return -1;
 			if (lws_http_client_read(lws_get_child(wsi), &px,
 						 &lenx) < 0)
 				return -1;
@@ -409,15 +410,43 @@ lws_callback_http_dummy(struct lws *wsi, enum lws_callback_reasons reason,
 			return -1;
 		break;
 
+	case LWS_CALLBACK_COMPLETED_CLIENT_HTTP:
+		if (!lws_get_parent(wsi))
+			break;
+		/*
+		 * We told our client the length, so his connection can go on
+		 * to the next transaction now.  We must do it before we
+		 * return to the event loop, or his next request might come
+		 * while the ah still holds this one.
+		 */
+		if (!wsi->perform_rewrite &&
+		    lws_hdr_total_length(wsi, WSI_TOKEN_HTTP_CONTENT_LENGTH) &&
+		    !lws_http_transaction_completed(lws_get_parent(wsi)))
+			break;
+		/*
+		 * Otherwise closing is the only way to tell our client the
+		 * body ended... we won't be our parent's child any more by the
+		 * time he is writeable, and that makes him close
+		 */
+		lws_get_parent(wsi)->reason_bf |= LWS_CB_REASON_AUX_BF__PROXY;
+		lws_callback_on_writable(lws_get_parent(wsi));
+		break;
+
 	case LWS_CALLBACK_ESTABLISHED_CLIENT_HTTP: {
 		unsigned char *p, *end;
 		char ctype[64], ctlen = 0;
+
+		if (!lws_get_parent(wsi))
+			/* maybe one of our health checks on an origin */
+			return lws_proxy_lb_health_result(wsi);
 	
 		p = (unsigned char *)buf + LWS_PRE;
 		end = p + sizeof(buf) - LWS_PRE;
 
-		if (lws_add_http_header_status(lws_get_parent(wsi),
-					       HTTP_STATUS_OK, &p, end))
+		n = lws_http_client_http_response(wsi);
+		if (!n)
+			n = HTTP_STATUS_OK;
+		if (lws_add_http_header_status(lws_get_parent(wsi), n, &p, end))
 			return 1;
 		if (lws_add_http_header_by_token(lws_get_parent(wsi),
 				WSI_TOKEN_HTTP_SERVER,
@@ -434,6 +463,13 @@ lws_callback_http_dummy(struct lws *wsi, enum lws_callback_reasons reason,
 				return 1;
 		}
 
+		/* the rewriter may change the length, otherwise pass it on */
+		if (!wsi->perform_rewrite &&
+		    lws_hdr_total_length(wsi, WSI_TOKEN_HTTP_CONTENT_LENGTH) &&
+		    lws_add_http_header_content_length(lws_get_parent(wsi),
+					wsi->http.rx_content_length, &p, end))
+			return 1;
+
 		if (lws_finalize_http_header(lws_get_parent(wsi), &p, end))
 			return 1;
 
@@ -447,6 +483,12 @@ lws_callback_http_dummy(struct lws *wsi, enum lws_callback_reasons reason,
 
 		break; }
 
+	case LWS_CALLBACK_HTTP_PROXY_HEALTH_CHECK:
+		if (lws_proxy_lb_health_check(lws_get_vhost(wsi)))
+			lwsl_err("%s: unable to reschedule health checks\n",
+				 __func__);
+		break;
+
 #endif
 
 #ifdef LWS_WITH_CGI
@@ -577,6 +619,9 @@ lws_create_vhost(struct lws_context *context,
 #if LWS_MAX_SMP > 1
 	pthread_mutex_init(&vh->lock, NULL);
 #endif
+#if defined(LWS_WITH_TLS_HANDSHAKE_POOL)
+	pthread_mutex_init(&vh->tls_lock, NULL);
+#endif
 
 	if (!info->protocols)
 		info->protocols = &protocols_dummy[0];
@@ -632,10 +677,43 @@ lws_create_vhost(struct lws_context *context,
 	else
 		vh->timeout_secs_ah_idle = 10;
 
+#if defined(LWS_WITH_HTTP_PROXY)
+	vh->proxy_pool_max_idle = info->proxy_pool_max_idle;
+	if (info->proxy_pool_max_per_origin)
+		vh->proxy_pool_max_per_origin = info->proxy_pool_max_per_origin;
+	else
+		vh->proxy_pool_max_per_origin = 8;
+	if (info->proxy_pool_idle_secs)
+		vh->proxy_pool_idle_secs = info->proxy_pool_idle_secs;
+	else
+		vh->proxy_pool_idle_secs = 4;
+#endif
+
 #if defined(LWS_WITH_TLS)
 	if (info->ecdh_curve)
 		lws_strncpy(vh->ecdh_curve, info->ecdh_curve,
 			    sizeof(vh->ecdh_curve));
+#if !defined(LWS_NO_CLIENT)
+	vh->tls_session_cache_max = info->tls_session_cache_max;
+	if (info->tls_session_timeout)
+		vh->tls_session_timeout = info->tls_session_timeout;
+	else
+		vh->tls_session_timeout = 300;
+#endif
+#if !defined(LWS_NO_SERVER)
+	vh->tls_ticket_key_rotate_secs = info->tls_ticket_key_rotate_secs;
+	if (info->tls_ticket_key_filepath) {
+		n = (int)strlen(info->tls_ticket_key_filepath) + 1;
+		vh->tls_ticket_key_filepath = lws_malloc(n, "vh ticket key");
+		if (vh->tls_ticket_key_filepath) {
+			memcpy(vh->tls_ticket_key_filepath,
+			       info->tls_ticket_key_filepath, n);
+			if (!vh->tls_ticket_key_rotate_secs)
+				vh->tls_ticket_key_rotate_secs = 60;
+		} else
+			lwsl_err("%s: OOM\n", __func__);
+	}
+#endif
 #endif
 
 	/* carefully allocate and take a copy of cert + key paths if present */
@@ -863,6 +941,10 @@ lws_create_vhost(struct lws_context *context,
 				  context->gid) == -1)
 				lwsl_err("unable to chown log file %s\n",
 						info->log_filepath);
+#endif
+#if defined(LWS_WITH_ACCESS_LOG_ASYNC)
+		/* on failure, we just write the lines synchronously */
+		lws_access_log_start_writer(context);
 #endif
 	} else
 		vh->log_fd = (int)LWS_INVALID_FILE;
@@ -880,6 +962,18 @@ lws_create_vhost(struct lws_context *context,
 		goto bail1;
 	}
 
+	if (lws_mount_trie_build(vh)) {
+		lwsl_err("%s: unable to build mount trie\n", __func__);
+		goto bail1;
+	}
+
+	lws_vhost_list_lock(context);
+	if (lws_vhost_index_add(vh)) {
+		lws_vhost_list_unlock(context);
+		lwsl_err("%s: unable to index vhost\n", __func__);
+		goto bail1;
+	}
+
 	while (1) {
 		if (!(*vh1)) {
 			*vh1 = vh;
@@ -887,6 +981,15 @@ lws_create_vhost(struct lws_context *context,
 		}
 		vh1 = &(*vh1)->vhost_next;
 	};
+	lws_vhost_list_unlock(context);
+
+#if defined(LWS_WITH_HTTP_PROXY)
+	/* proxy mounts that spread requests over several origins */
+	if (lws_proxy_lb_create(vh)) {
+		lwsl_err("%s: proxy mount setup failed\n", __func__);
+		goto bail1;
+	}
+#endif
 
 	/* for the case we are adding a vhost much later, after server init */
 
@@ -927,7 +1030,11 @@ lws_init_vhost_client_ssl(const struct lws_context_creation_info *info,
 LWS_VISIBLE void
 lws_cancel_service_pt(struct lws *wsi)
 {
+#if defined(LWS_WITH_PT_QUEUE)
+	lws_pt_queue_signal(&wsi->context->pt[(int)wsi->tsi], 1);
+#else
 	lws_plat_pipe_signal(wsi);
+#endif
 }
 
 LWS_VISIBLE void
@@ -939,8 +1046,12 @@ lws_cancel_service(struct lws_context *context)
 	lwsl_info("%s\n", __func__);
 
 	while (m--) {
+#if defined(LWS_WITH_PT_QUEUE)
+		lws_pt_queue_signal(pt, 1);
+#else
 		if (pt->pipe_wsi)
 			lws_plat_pipe_signal(pt->pipe_wsi);
+#endif
 		pt++;
 	}
 }
@@ -999,6 +1110,7 @@ lws_create_event_pipes(struct lws_context *context)
 static void
 lws_destroy_event_pipe(struct lws *wsi)
 {
+	wsi->context->pt[(int)wsi->tsi].pipe_wsi = NULL;
 	lws_plat_pipe_close(wsi);
 	__remove_wsi_socket_from_fds(wsi);
 	lws_libevent_destroy(wsi);
@@ -1011,6 +1123,7 @@ lws_create_context(struct lws_context_creation_info *info)
 {
 	struct lws_context *context = NULL;
 	struct lws_plat_file_ops *prev;
+	void *p;
 #ifndef LWS_NO_DAEMONIZE
 	int pid_daemon = get_daemonize_pid();
 #endif
@@ -1056,15 +1169,21 @@ lws_create_context(struct lws_context_creation_info *info)
 	if (lws_plat_context_early_init())
 		return NULL;
 
-	context = lws_zalloc(sizeof(struct lws_context), "context");
-	if (!context) {
+	/* some members want to be on their own cache lines */
+	p = lws_zalloc(sizeof(struct lws_context) + LWS_CACHE_LINE - 1,
+		       "context");
+	if (!p) {
 		lwsl_err("No memory for websocket context\n");
 		return NULL;
 	}
+	context = (struct lws_context *)(((lws_intptr_t)p + LWS_CACHE_LINE - 1) &
+					 ~((lws_intptr_t)LWS_CACHE_LINE - 1));
+	context->alloc_base = p;
 	if (info->pt_serv_buf_size)
 		context->pt_serv_buf_size = info->pt_serv_buf_size;
 	else
 		context->pt_serv_buf_size = 4096;
+	context->buffered_out_limit = info->buffered_out_limit;
 
 #if defined(LWS_WITH_HTTP2)
 	context->set = lws_h2_stock_settings;
@@ -1196,10 +1315,33 @@ lws_create_context(struct lws_context_creation_info *info)
 		context->pt[n].tid = n;
 		context->pt[n].ah_list = NULL;
 		context->pt[n].ah_pool_length = 0;
+		context->pt[n].cpu_affinity = info->pt_cpu_affinity ?
+					      info->pt_cpu_affinity[n] : -1;
+		lws_tw_init(&context->pt[n].tw_timeout,
+			    lws_plat_monotonic_us() / 1000000);
+		lws_tw_init(&context->pt[n].tw_hrtimer, lws_plat_monotonic_us());
+#if defined(LWS_ROLE_WS)
+		lws_tw_init(&context->pt[n].tw_ws_ping,
+			    lws_plat_monotonic_us() / 1000000);
+#endif
 
 		lws_pt_mutex_init(&context->pt[n]);
+#if defined(LWS_WITH_PT_QUEUE)
+		if (lws_pt_queue_init(&context->pt[n], info->pt_queue_depth)) {
+			lwsl_err("OOM\n");
+			return NULL;
+		}
+#endif
 	}
 
+#if defined(LWS_WITH_ACCESS_LOG_ASYNC)
+	lws_access_log_init(context, info);
+#endif
+#if defined(LWS_WITH_TLS_HANDSHAKE_POOL)
+	/* on failure, the service threads do the handshakes themselves */
+	lws_tls_hs_pool_init(context, info);
+#endif
+
 	if (info->fd_limit_per_thread)
 		context->fd_limit_per_thread = info->fd_limit_per_thread;
 	else
@@ -1258,6 +1400,11 @@ lws_create_context(struct lws_context_creation_info *info)
 	context->ip_limit_wsi = info->ip_limit_wsi;
 #endif
 
+#if defined(LWS_WITH_ASYNC_DNS)
+	if (lws_async_dns_init(context, info))
+		goto bail;
+#endif
+
 	lwsl_info(" mem: context:         %5lu B (%ld ctx + (%ld thr x %d))\n",
 		  (long)sizeof(struct lws_context) +
 		  (context->count_threads * context->pt_serv_buf_size),
@@ -1325,11 +1472,12 @@ lws_create_context(struct lws_context_creation_info *info)
 #endif
 			lws_free_set_NULL(context->pt[0].fds);
 			lws_plat_context_late_destroy(context);
-			lws_free_set_NULL(context);
+			lws_free(context->alloc_base);
 			return NULL;
 		}
 
 	lws_context_init_extensions(info, context);
+	lws_ws_mask_init();
 
 	lwsl_info(" mem: per-conn:        %5lu bytes + protocol rx buf\n",
 		    (unsigned long)sizeof(struct lws));
@@ -1395,6 +1543,7 @@ lws_context_deprecate(struct lws_context *context, lws_reload_func cb)
 {
 	struct lws_vhost *vh = context->vhost_list, *vh1;
 	struct lws *wsi;
+	int n;
 
 	/*
 	 * "deprecation" means disable the context from accepting any new
@@ -1408,8 +1557,11 @@ lws_context_deprecate(struct lws_context *context, lws_reload_func cb)
 	/* for each vhost, close his listen socket */
 
 	while (vh) {
-		wsi = vh->lserv_wsi;
-		if (wsi) {
+		for (n = 0; n < context->count_threads; n++) {
+			wsi = vh->lserv_wsi[n];
+			if (!wsi)
+				continue;
+
 			wsi->socket_is_permanently_unusable = 1;
 			lws_close_free_wsi(wsi, LWS_CLOSE_STATUS_NOSTATUS, "ctx deprecate");
 			wsi->context->deprecation_pending_listen_close_count++;
@@ -1419,8 +1571,8 @@ lws_context_deprecate(struct lws_context *context, lws_reload_func cb)
 			 */
 			vh1 = context->vhost_list;
 			while (vh1) {
-				if (vh1->lserv_wsi == wsi)
-					vh1->lserv_wsi = NULL;
+				if (vh1->lserv_wsi[n] == wsi)
+					vh1->lserv_wsi[n] = NULL;
 				vh1 = vh1->vhost_next;
 			}
 		}
@@ -1441,6 +1593,18 @@ LWS_VISIBLE void
 lws_context_destroy2(struct lws_context *context);
 
 
+int
+lws_vhost_has_listener(struct lws_vhost *vh)
+{
+	int n;
+
+	for (n = 0; n < vh->context->count_threads; n++)
+		if (vh->lserv_wsi[n])
+			return 1;
+
+	return 0;
+}
+
 void
 lws_vhost_destroy1(struct lws_vhost *vh)
 {
@@ -1455,7 +1619,9 @@ lws_vhost_destroy1(struct lws_vhost *vh)
 	if (vh->being_destroyed)
 		return;
 
+	lws_vhost_list_lock(context);
 	vh->being_destroyed = 1;
+	lws_vhost_list_unlock(context);
 
 	/*
 	 * Are there other vhosts that are piggybacking on our listen socket?
@@ -1464,7 +1630,7 @@ lws_vhost_destroy1(struct lws_vhost *vh)
 	 * vhost and it will get closed.
 	 */
 
-	if (vh->lserv_wsi)
+	if (lws_vhost_has_listener(vh))
 		lws_start_foreach_ll(struct lws_vhost *, v,
 				     context->vhost_list) {
 			if (v != vh &&
@@ -1480,11 +1646,13 @@ lws_vhost_destroy1(struct lws_vhost *vh)
 				 * swap it to a vhost that has the same
 				 * iface + port, but is not closing.
 				 */
-				assert(v->lserv_wsi == NULL);
-				v->lserv_wsi = vh->lserv_wsi;
-				vh->lserv_wsi = NULL;
-				if (v->lserv_wsi)
-					v->lserv_wsi->vhost = v;
+				for (n = 0; n < m; n++) {
+					assert(v->lserv_wsi[n] == NULL);
+					v->lserv_wsi[n] = vh->lserv_wsi[n];
+					vh->lserv_wsi[n] = NULL;
+					if (v->lserv_wsi[n])
+						v->lserv_wsi[n]->vhost = v;
+				}
 
 				lwsl_notice("%s: listen skt from %s to %s\n",
 					    __func__, vh->name, v->name);
@@ -1546,12 +1714,16 @@ lws_vhost_destroy1(struct lws_vhost *vh)
 	 * remove vhost from context list of vhosts
 	 */
 
+	lws_vhost_list_lock(context);
+	lws_vhost_index_del(vh);
+
 	lws_start_foreach_llp(struct lws_vhost **, pv, context->vhost_list) {
 		if (*pv == vh) {
 			*pv = vh->vhost_next;
 			break;
 		}
 	} lws_end_foreach_llp(pv, vhost_next);
+	lws_vhost_list_unlock(context);
 
 	/* add ourselves to the pending destruction list */
 
@@ -1611,7 +1783,17 @@ lws_vhost_destroy2(struct lws_vhost *vh)
 	if (vh->protocol_vh_privs)
 		lws_free(vh->protocol_vh_privs);
 	lws_ssl_SSL_CTX_destroy(vh);
+#if defined(LWS_WITH_TLS) && !defined(LWS_NO_CLIENT)
+	lws_tls_session_cache_destroy(vh);
+#endif
+#if defined(LWS_WITH_TLS) && !defined(LWS_NO_SERVER)
+	memset(vh->tls_ticket_key, 0, sizeof(vh->tls_ticket_key));
+	lws_free_set_NULL(vh->tls_ticket_key_filepath);
+#endif
 	lws_free(vh->same_vh_protocol_list);
+#if defined(LWS_WITH_HTTP_PROXY)
+	lws_proxy_lb_destroy(vh);
+#endif
 #ifdef LWS_WITH_PLUGINS
 	if (LWS_LIBUV_ENABLED(context)) {
 		if (context->plugin_list)
@@ -1630,15 +1812,24 @@ lws_vhost_destroy2(struct lws_vhost *vh)
 #endif
 #endif
 #ifdef LWS_WITH_ACCESS_LOG
-	if (vh->log_fd != (int)LWS_INVALID_FILE)
+	if (vh->log_fd != (int)LWS_INVALID_FILE) {
+#if defined(LWS_WITH_ACCESS_LOG_ASYNC)
+		/* the writer may still have lines for it */
+		lws_access_log_flush(context);
+#endif
 		close(vh->log_fd);
+	}
 #endif
 
 	lws_free_set_NULL(vh->alloc_cert_path);
+	lws_free_set_NULL(vh->mount_trie);
 
 #if LWS_MAX_SMP > 1
        pthread_mutex_destroy(&vh->lock);
 #endif
+#if defined(LWS_WITH_TLS_HANDSHAKE_POOL)
+	pthread_mutex_destroy(&vh->tls_lock);
+#endif
 
 #if defined(LWS_WITH_UNIX_SOCK)
 	if (LWS_UNIX_SOCK_ENABLED(context)) {
@@ -1735,6 +1926,11 @@ lws_context_destroy(struct lws_context *context)
 		lwsl_notice("Worst latency: %s\n", context->worst_latency_info);
 #endif
 
+#if defined(LWS_WITH_TLS_HANDSHAKE_POOL)
+	/* the workers may be using wsi we are about to close */
+	lws_tls_hs_pool_destroy(context);
+#endif
+
 	while (m--) {
 		pt = &context->pt[m];
 		vpt = (volatile struct lws_context_per_thread *)pt;
@@ -1754,6 +1950,10 @@ lws_context_destroy(struct lws_context *context)
 
 			if (wsi->event_pipe)
 				lws_destroy_event_pipe(wsi);
+#if defined(LWS_WITH_ASYNC_DNS)
+			else if (lwsi_role(wsi) == LWSI_ROLE_DNS)
+				lws_async_dns_destroy_wsi(wsi);
+#endif
 			else
 				lws_close_free_wsi(wsi,
 					LWS_CLOSE_STATUS_NOSTATUS_CONTEXT_DESTROY,
@@ -1761,6 +1961,9 @@ lws_context_destroy(struct lws_context *context)
 					/* no protocol close */);
 			n--;
 		}
+#if defined(LWS_WITH_PT_QUEUE)
+		lws_pt_queue_destroy(pt);
+#endif
 		lws_pt_mutex_destroy(pt);
 	}
 
@@ -1797,9 +2000,9 @@ lws_context_destroy(struct lws_context *context)
 		lws_libevent_destroyloop(context, n);
 
 		lws_free_set_NULL(context->pt[n].serv_buf);
+		lws_buflist_pool_destroy(pt);
 
-		while (pt->ah_list)
-			_lws_destroy_ah(pt, pt->ah_list);
+		_lws_destroy_ah_pool(pt);
 	}
 	lws_plat_context_early_destroy(context);
 
@@ -1854,6 +2057,10 @@ lws_context_destroy2(struct lws_context *context)
 		/* removes itself from list */
 		lws_vhost_destroy2(context->vhost_pending_destruction_list);
 
+	lws_vhost_index_destroy(context);
+#if defined(LWS_WITH_ACCESS_LOG_ASYNC)
+	lws_access_log_destroy(context);
+#endif
 
 	lws_stats_log_dump(context);
 
@@ -1872,6 +2079,9 @@ lws_context_destroy2(struct lws_context *context)
 	}
 	lws_free(context->pl_hash_table);
 #endif
+#if defined(LWS_WITH_ASYNC_DNS)
+	lws_async_dns_destroy_cache(context);
+#endif
 
 	if (context->external_baggage_free_on_destroy)
 		free(context->external_baggage_free_on_destroy);
@@ -1882,5 +2092,5 @@ lws_context_destroy2(struct lws_context *context)
        pthread_mutex_destroy(&context->lock);
 #endif
 
-	lws_free(context);
+	lws_free(context->alloc_base);
 }
@@ -101,12 +101,12 @@ lws_ev_initloop(struct lws_context *context, struct ev_loop *loop, int tsi)
 	 * and register a callback for read operations
 	 */
 	while (vh) {
-		if (vh->lserv_wsi) {
-			vh->lserv_wsi->w_read.context = context;
+		if (vh->lserv_wsi[tsi]) {
+			vh->lserv_wsi[tsi]->w_read.context = context;
 			vh->w_accept.context = context;
 
 			ev_io_init(&vh->w_accept.ev_watcher, lws_accept_cb,
-				   vh->lserv_wsi->desc.sockfd, EV_READ);
+				   vh->lserv_wsi[tsi]->desc.sockfd, EV_READ);
 			ev_io_start(loop, &vh->w_accept.ev_watcher);
 
 		}
@@ -163,7 +163,7 @@ lws_libev_destroyloop(struct lws_context *context, int tsi)
 		return;
 
 	while (vh) {
-		if (vh->lserv_wsi)
+		if (vh->lserv_wsi[tsi])
 			ev_io_stop(pt->io_loop_ev, &vh->w_accept.ev_watcher);
 		vh = vh->vhost_next;
 	}
@@ -107,13 +107,15 @@ int tsi)
 	*/
 
 	while (vh) {
-		if (vh->lserv_wsi) {
-			vh->lserv_wsi->w_read.context = context;
-			vh->lserv_wsi->w_read.event_watcher = event_new(
-					loop, vh->lserv_wsi->desc.sockfd,
+		struct lws *lwsi = vh->lserv_wsi[tsi];
+
+		if (lwsi) {
+			lwsi->w_read.context = context;
+			lwsi->w_read.event_watcher = event_new(
+					loop, lwsi->desc.sockfd,
 					(EV_READ | EV_PERSIST), lws_event_cb,
-					&vh->lserv_wsi->w_read);
-			event_add(vh->lserv_wsi->w_read.event_watcher, NULL);
+					&lwsi->w_read);
+			event_add(lwsi->w_read.event_watcher, NULL);
 		}
 		vh = vh->vhost_next;
 	}
@@ -145,9 +147,9 @@ lws_libevent_destroyloop(struct lws_context *context, int tsi)
 	 * Free all events with the listening sockets
 	 */
 	while (vh) {
-		if (vh->lserv_wsi) {
-			event_free(vh->lserv_wsi->w_read.event_watcher);
-			vh->lserv_wsi->w_read.event_watcher = NULL;
+		if (vh->lserv_wsi[tsi]) {
+			event_free(vh->lserv_wsi[tsi]->w_read.event_watcher);
+			vh->lserv_wsi[tsi]->w_read.event_watcher = NULL;
 		}
 		vh = vh->vhost_next;
 	}
@@ -181,7 +181,7 @@ lws_uv_initvhost(struct lws_vhost* vh, struct lws* wsi)
 	if (!LWS_LIBUV_ENABLED(vh->context))
 		return 0;
 	if (!wsi)
-		wsi = vh->lserv_wsi;
+		wsi = vh->lserv_wsi[0];
 	if (!wsi)
 		return 0;
 	if (wsi->w_read.context)
@@ -274,7 +274,8 @@ lws_uv_initloop(struct lws_context *context, uv_loop_t *loop, int tsi)
 	 * initialized until after context creation.
 	 */
 	while (vh) {
-		if (lws_uv_initvhost(vh, vh->lserv_wsi) == -1)
+		if (vh->lserv_wsi[tsi] &&
+		    lws_uv_initvhost(vh, vh->lserv_wsi[tsi]) == -1)
 			return -1;
 		vh = vh->vhost_next;
 	}
@@ -85,6 +85,10 @@ __lws_free_wsi(struct lws *wsi)
 
 	pt = &wsi->context->pt[(int)wsi->tsi];
 
+#if defined(LWS_WITH_PT_QUEUE)
+	lws_pt_queue_forget_wsi(pt, wsi);
+#endif
+
 	/*
 	 * Protocol user data may be allocated either internally by lws
 	 * or by specified the user. We should only free what we allocated.
@@ -94,7 +98,7 @@ __lws_free_wsi(struct lws *wsi)
 		lws_free(wsi->user_space);
 
 	lws_free_set_NULL(wsi->rxflow_buffer);
-	lws_free_set_NULL(wsi->trunc_alloc);
+	lws_drop_buffered_out(wsi);
 	lws_free_set_NULL(wsi->ws);
 	lws_free_set_NULL(wsi->udp);
 
@@ -104,8 +108,8 @@ __lws_free_wsi(struct lws *wsi)
 	lws_header_table_force_to_detachable_state(wsi);
 	__lws_header_table_detach(wsi, 0);
 
-	if (wsi->vhost && wsi->vhost->lserv_wsi == wsi)
-		wsi->vhost->lserv_wsi = NULL;
+	if (wsi->vhost && wsi->vhost->lserv_wsi[(int)wsi->tsi] == wsi)
+		wsi->vhost->lserv_wsi[(int)wsi->tsi] = NULL;
 
 	ah = pt->ah_list;
 	while (ah) {
@@ -128,8 +132,11 @@ __lws_free_wsi(struct lws *wsi)
 	if (wsi->upgraded_to_http2 || wsi->http2_substream) {
 		lws_hpack_destroy_dynamic_header(wsi);
 
-		if (wsi->h2.h2n)
+		if (wsi->h2.h2n) {
+			if (wsi->h2.h2n->sid_index)
+				lws_free(wsi->h2.h2n->sid_index);
 			lws_free_set_NULL(wsi->h2.h2n);
+		}
 	}
 #endif
 
@@ -139,6 +146,13 @@ __lws_free_wsi(struct lws *wsi)
 	__lws_ssl_remove_wsi_from_buffered_list(wsi);
 #endif
 	__lws_remove_from_timeout_list(wsi);
+#if defined(LWS_ROLE_WS)
+	lws_tw_remove(&wsi->context->pt[(int)wsi->tsi].tw_ws_ping,
+		      &wsi->tw_ws_ping);
+#endif
+#if defined(LWS_ROLE_WS) && !defined(LWS_WITHOUT_EXTENSIONS)
+	lws_dll_lws_remove(&wsi->dll_ext_1hz);
+#endif
 
 	lws_libevent_destroy(wsi);
 
@@ -222,7 +236,9 @@ lws_dll_remove(struct lws_dll *d)
 void
 __lws_remove_from_timeout_list(struct lws *wsi)
 {
-	lws_dll_lws_remove(&wsi->dll_timeout);
+	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
+
+	lws_tw_remove(&pt->tw_timeout, &wsi->tw_timeout);
 }
 
 void
@@ -235,92 +251,23 @@ lws_remove_from_timeout_list(struct lws *wsi)
 	lws_pt_unlock(pt);
 }
 
-void
-lws_dll_dump(struct lws_dll_lws *head, const char *title)
-{
-	int n = 0;
-
-	(void)n;
-	lwsl_notice("%s: %s (head.next %p)\n", __func__, title, head->next);
-
-	lws_start_foreach_dll_safe(struct lws_dll_lws *, d, d1, head->next) {
-		struct lws *wsi = lws_container_of(d, struct lws, dll_hrtimer);
-
-		(void)wsi;
-
-		lwsl_notice("  %d: wsi %p: %llu\n", n++, wsi,
-				(unsigned long long)wsi->pending_timer);
-	} lws_end_foreach_dll_safe(d, d1);
-}
-
 void
 __lws_set_timer_usecs(struct lws *wsi, lws_usec_t usecs)
 {
 	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
-	struct lws_dll_lws *dd = &pt->dll_head_hrtimer;
-	struct timeval now;
-	struct lws *wsi1;
-	int bef = 0;
 
 	if (LWS_LIBEV_ENABLED(wsi->context))
 		lwsl_warn("%s: lws hrtimer not implemented for libev\n", __func__);
 	if (LWS_LIBEVENT_ENABLED(wsi->context))
 		lwsl_warn("%s: lws hrtimer not implemented for libevent\n", __func__);
 
-	lws_dll_lws_remove(&wsi->dll_hrtimer);
-
-	if (usecs == LWS_SET_TIMER_USEC_CANCEL)
+	if (usecs == LWS_SET_TIMER_USEC_CANCEL) {
+		lws_tw_remove(&pt->tw_hrtimer, &wsi->tw_hrtimer);
 		return;
-
-	gettimeofday(&now, NULL);
-	wsi->pending_timer = ((now.tv_sec * 1000000ll) + now.tv_usec) + usecs;
-
-	/*
-	 * we sort the hrtimer list with the earliest timeout first
-	 */
-
-	lws_start_foreach_dll_safe(struct lws_dll_lws *, d, d1,
-				   pt->dll_head_hrtimer.next) {
-		dd = d;
-		wsi1 = lws_container_of(d, struct lws, dll_hrtimer);
-
-		if (wsi1->pending_timer >= wsi->pending_timer) {
-			/* d, dprev's next, is >= our time */
-			bef = 1;
-			break;
-		}
-	} lws_end_foreach_dll_safe(d, d1);
-
-	if (bef) {
-		/*
-		 *  we go before dd
-		 *  DDp <-> DD <-> DDn --> DDp <-> us <-> DD <-> DDn
-		 */
-		/* we point forward to dd */
-		wsi->dll_hrtimer.next = dd;
-		/* we point back to what dd used to point back to */
-		wsi->dll_hrtimer.prev = dd->prev;
-		/* DDp points forward to us now */
-		dd->prev->next = &wsi->dll_hrtimer;
-		/* DD points back to us now */
-		dd->prev = &wsi->dll_hrtimer;
-	} else {
-		/*
-		 *  we go after dd
-		 *  DDp <-> DD <-> DDn --> DDp <-> DD <-> us <-> DDn
-		 */
-		/* we point forward to what dd used to point forward to */
-		wsi->dll_hrtimer.next = dd->next;
-		/* we point back to dd */
-		wsi->dll_hrtimer.prev = dd;
-		/* DDn points back to us */
-		if (dd->next)
-			dd->next->prev = &wsi->dll_hrtimer;
-		/* DD points forward to us */
-		dd->next = &wsi->dll_hrtimer;
 	}
 
-//	lws_dll_dump(&pt->dll_head_hrtimer, "after set_timer_usec");
+	lws_tw_add(&pt->tw_hrtimer, &wsi->tw_hrtimer,
+		   lws_plat_monotonic_us() + usecs);
 }
 
 LWS_VISIBLE void
@@ -332,68 +279,67 @@ lws_set_timer_usecs(struct lws *wsi, lws_usec_t usecs)
 lws_usec_t
 __lws_hrtimer_service(struct lws_context_per_thread *pt)
 {
-	struct timeval now;
+	struct lws_dll_lws expired = { NULL, NULL };
+	lws_usec_t t = lws_plat_monotonic_us();
 	struct lws *wsi;
-	lws_usec_t t;
+	uint64_t next;
 
-	gettimeofday(&now, NULL);
-	t = (now.tv_sec * 1000000ll) + now.tv_usec;
+	lws_tw_advance(&pt->tw_hrtimer, t, &expired);
 
-	lws_start_foreach_dll_safe(struct lws_dll_lws *, d, d1,
-				   pt->dll_head_hrtimer.next) {
-		wsi = lws_container_of(d, struct lws, dll_hrtimer);
-
-		/*
-		 * if we met one in the future, we are done, because the list
-		 * is sorted by time in the future.
-		 */
-		if (wsi->pending_timer > t)
-			break;
-
-		lws_set_timer_usecs(wsi, LWS_SET_TIMER_USEC_CANCEL);
+	while (expired.next) {
+		wsi = lws_container_of(expired.next, struct lws,
+				       tw_hrtimer.list);
+		lws_dll_lws_remove(expired.next);
 
 		/* it's time for the timer to be serviced */
 
+#if defined(LWS_WITH_ASYNC_DNS)
+		if (lwsi_role(wsi) == LWSI_ROLE_DNS) {
+			lws_async_dns_timer(wsi);
+			continue;
+		}
+#endif
 		if (wsi->protocol &&
 		    wsi->protocol->callback(wsi, LWS_CALLBACK_TIMER,
 					    wsi->user_space, NULL, 0))
 			__lws_close_free_wsi(wsi, LWS_CLOSE_STATUS_NOSTATUS,
 					     "timer cb errored");
-	} lws_end_foreach_dll_safe(d, d1);
+	}
 
-	/* return an estimate how many us until next timer hit */
+	/*
+	 * return an estimate how many us until next timer hit... it may be
+	 * early, when the wheel just needs to move timers down a level
+	 */
 
-	if (!pt->dll_head_hrtimer.next)
+	next = lws_tw_next(&pt->tw_hrtimer);
+	if (next == LWS_TW_NONE)
 		return LWS_HRTIMER_NOWAIT;
 
-	wsi = lws_container_of(pt->dll_head_hrtimer.next, struct lws, dll_hrtimer);
-
-	gettimeofday(&now, NULL);
-	t = (now.tv_sec * 1000000ll) + now.tv_usec;
-
-	if (wsi->pending_timer < t)
+	t = lws_plat_monotonic_us();
+	if ((lws_usec_t)next < t)
 		return 0;
 
-	return wsi->pending_timer - t;
+	return (lws_usec_t)next - t;
 }
 
 void
 __lws_set_timeout(struct lws *wsi, enum pending_timeout reason, int secs)
 {
 	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
-	time_t now;
-
-	time(&now);
 
 	lwsl_debug("%s: %p: %d secs\n", __func__, wsi, secs);
 	wsi->pending_timeout_limit = secs;
-	wsi->pending_timeout_set = now;
 	wsi->pending_timeout = reason;
 
-	if (!reason)
-		lws_dll_lws_remove(&wsi->dll_timeout);
-	else
-		lws_dll_lws_add_front(&wsi->dll_timeout, &pt->dll_head_timeout);
+	if (!reason) {
+		lws_tw_remove(&pt->tw_timeout, &wsi->tw_timeout);
+		return;
+	}
+
+	/* it times out once more than secs whole seconds have passed */
+
+	lws_tw_add(&pt->tw_timeout, &wsi->tw_timeout,
+		   (lws_plat_monotonic_us() / 1000000) + secs + 1);
 }
 
 LWS_VISIBLE void
@@ -449,7 +395,7 @@ lws_timed_callback_vh_protocol(struct lws_vhost *vh, const struct lws_protocols
 	return 0;
 }
 
-static void
+void
 lws_remove_child_from_any_parent(struct lws *wsi)
 {
 	struct lws **pwsi;
@@ -550,6 +496,11 @@ __lws_close_free_wsi(struct lws *wsi, enum lws_close_status reason, const char *
 	if (!wsi)
 		return;
 
+#if defined(LWS_WITH_TLS_HANDSHAKE_POOL)
+	/* a handshake worker may still be using it */
+	lws_tls_hs_pool_forget(wsi);
+#endif
+
 	lws_access_log(wsi);
 
 	/* we're closing, losing some rx is OK */
@@ -564,6 +515,16 @@ __lws_close_free_wsi(struct lws *wsi, enum lws_close_status reason, const char *
 	lws_free_set_NULL(wsi->client_hostname_copy);
 	/* we are no longer an active client connection that can piggyback */
 	lws_dll_lws_remove(&wsi->dll_active_client_conns);
+#if defined(LWS_WITH_HTTP_PROXY)
+	/* nor an idle one waiting to be reused by a proxy mount */
+	lws_proxy_pool_remove(wsi);
+	/* and if we were busy with an origin, that's over */
+	lws_proxy_upstream_closing(wsi);
+#endif
+#if defined(LWS_WITH_ASYNC_DNS)
+	/* nor waiting for a dns answer */
+	lws_dll_lws_remove(&wsi->dll_adns_wait);
+#endif
 
 	/*
 	 * if we have wsi in our transaction queue, if we are closing we
@@ -666,14 +627,14 @@ __lws_close_free_wsi(struct lws *wsi, enum lws_close_status reason, const char *
 		goto just_kill_connection;
 
 	case LRS_FLUSHING_BEFORE_CLOSE:
-		if (wsi->trunc_len) {
+		if (lws_has_buffered_out(wsi)) {
 			lws_callback_on_writable(wsi);
 			return;
 		}
 		lwsl_info("%p: end LRS_FLUSHING_BEFORE_CLOSE\n", wsi);
 		goto just_kill_connection;
 	default:
-		if (wsi->trunc_len) {
+		if (lws_has_buffered_out(wsi)) {
 			lwsl_info("%p: LRS_FLUSHING_BEFORE_CLOSE\n", wsi);
 			lwsi_set_state(wsi, LRS_FLUSHING_BEFORE_CLOSE);
 			__lws_set_timeout(wsi,
@@ -684,6 +645,7 @@ __lws_close_free_wsi(struct lws *wsi, enum lws_close_status reason, const char *
 	}
 
 	if (lwsi_state(wsi) == LRS_WAITING_CONNECT ||
+	    lwsi_state(wsi) == LRS_WAITING_DNS ||
 	    lwsi_state(wsi) == LRS_H1C_ISSUE_HANDSHAKE)
 		goto just_kill_connection;
 
@@ -820,6 +782,7 @@ just_kill_connection:
 				break;
 			}
 		} lws_end_foreach_llp(w, h2.sibling_list);
+		lws_h2_sid_index_del(wsi->h2.parent_wsi, wsi);
 		wsi->h2.parent_wsi->h2.child_count--;
 		wsi->h2.parent_wsi = NULL;
 		if (wsi->h2.pending_status_body)
@@ -855,6 +818,7 @@ just_kill_connection:
 	}
 
 	if ((lwsi_state(wsi) == LRS_WAITING_SERVER_REPLY ||
+	     lwsi_state(wsi) == LRS_WAITING_DNS ||
 	     lwsi_state(wsi) == LRS_WAITING_CONNECT) && !wsi->already_did_cce)
 		wsi->protocol->callback(wsi,
 				        LWS_CALLBACK_CLIENT_CONNECTION_ERROR,
@@ -870,6 +834,19 @@ just_kill_connection:
 		wsi->told_user_closed = 1;
 	}
 
+#if defined(LWS_WITH_TLS) && !defined(LWS_NO_CLIENT)
+	/*
+	 * A client doesn't wait for the server's half of the tls shutdown
+	 * below, but if its vhost caches sessions, it should still say it is
+	 * closing on purpose: a session whose connection just disappears is
+	 * marked not resumable.
+	 */
+	if (lwsi_role_client(wsi) && lwsi_state_est(wsi) && lws_is_ssl(wsi) &&
+	    wsi->ssl && wsi->vhost && wsi->vhost->tls_session_cache_max &&
+	    !wsi->socket_is_permanently_unusable &&
+	    reason != LWS_CLOSE_STATUS_NOSTATUS_CONTEXT_DESTROY)
+		__lws_tls_shutdown(wsi);
+#endif
 
 #if LWS_POSIX
 	/*
@@ -949,7 +926,7 @@ just_kill_connection:
 	 */
 	__lws_ssl_remove_wsi_from_buffered_list(wsi);
 	__lws_remove_from_timeout_list(wsi);
-	lws_dll_lws_remove(&wsi->dll_hrtimer);
+	lws_tw_remove(&pt->tw_hrtimer, &wsi->tw_hrtimer);
 
 	/* checking return redundant since we anyway close */
 	if (wsi->desc.sockfd != LWS_SOCK_INVALID)
@@ -2137,7 +2114,7 @@ lws_get_ssl(struct lws *wsi)
 LWS_VISIBLE int
 lws_partial_buffered(struct lws *wsi)
 {
-	return !!wsi->trunc_len;
+	return lws_has_buffered_out(wsi);
 }
 
 LWS_VISIBLE size_t
@@ -3152,10 +3129,18 @@ lws_json_dump_context(const struct lws_context *context, char *buf, int len,
 				"\n  {\n"
 				"    \"fds_count\":\"%d\",\n"
 				"    \"ah_pool_inuse\":\"%d\",\n"
+				"    \"ah_pool_high_water\":\"%d\",\n"
+				"    \"ah_pool_free\":\"%d\",\n"
+				"    \"ah_pool_hits\":\"%lu\",\n"
+				"    \"ah_pool_misses\":\"%lu\",\n"
 				"    \"ah_wait_list\":\"%d\"\n"
 				"    }",
 				pt->fds_count,
 				pt->ah_count_in_use,
+				pt->ah_count_in_use_high_water,
+				pt->ah_free_count,
+				pt->ah_pool_hits,
+				pt->ah_pool_misses,
 				pt->ah_wait_list_length);
 	}
 
@@ -3177,8 +3162,9 @@ lws_json_dump_context(const struct lws_context *context, char *buf, int len,
 			buf += lws_json_dump_vhost(vh, buf, end - buf);
 			first = 0;
 		}
-		if (vh->lserv_wsi)
-			listening++;
+		for (n = 0; n < context->count_threads; n++)
+			if (vh->lserv_wsi[n])
+				listening++;
 		vh = vh->vhost_next;
 	}
 
@@ -3219,6 +3205,50 @@ lws_json_dump_context(const struct lws_context *context, char *buf, int len,
 	buf += lws_snprintf(buf, end - buf, ",\n \"cgi_alive\":\"%d\"\n ",
 			cgi_count);
 
+#if defined(LWS_WITH_STATS)
+	{
+		static const char * const hist_names[] = {
+			"ssl_accept_delay_us",
+			"writable_delay_us",
+			"ssl_rx_delay_us",
+		};
+		static const int hist_aggregate[] = {
+			LWSSTATS_MS_SSL_CONNECTIONS_ACCEPTED_DELAY,
+			LWSSTATS_MS_WRITABLE_DELAY,
+			LWSSTATS_MS_SSL_RX_DELAY,
+		};
+		int m = LWSSTATS_US_SSL_ACCEPT_DELAY_P50;
+
+		buf += lws_snprintf(buf, end - buf, ", \"stats\":{");
+		for (n = 0; n < (int)LWS_ARRAY_SIZE(hist_names); n++, m += 3)
+			buf += lws_snprintf(buf, end - buf,
+				"%s\n  \"%s\":{\"total\":\"%llu\", "
+				"\"p50\":\"%llu\", \"p99\":\"%llu\", "
+				"\"p999\":\"%llu\"}", n ? "," : "",
+				hist_names[n],
+				(unsigned long long)lws_stats_value(context,
+							hist_aggregate[n]),
+				(unsigned long long)lws_stats_value(context, m),
+				(unsigned long long)lws_stats_value(context,
+								    m + 1),
+				(unsigned long long)lws_stats_value(context,
+								    m + 2));
+		buf += lws_snprintf(buf, end - buf,
+				",\n  \"worst_writable_delay_us\":\"%llu\",\n"
+				"  \"write_partials\":\"%llu\",\n"
+				"  \"write_queued\":\"%llu\",\n"
+				"  \"buffered_out\":\"%llu\"\n }\n ",
+				(unsigned long long)lws_stats_value(context,
+					LWSSTATS_MS_WORST_WRITABLE_DELAY),
+				(unsigned long long)lws_stats_value(context,
+					LWSSTATS_C_WRITE_PARTIALS),
+				(unsigned long long)lws_stats_value(context,
+					LWSSTATS_C_WRITE_QUEUED),
+				(unsigned long long)lws_stats_value(context,
+					LWSSTATS_B_BUFFERED_OUT));
+	}
+#endif
+
 	buf += lws_snprintf(buf, end - buf, "}");
 
 
@@ -3231,13 +3261,128 @@ lws_json_dump_context(const struct lws_context *context, char *buf, int len,
 
 #if defined(LWS_WITH_STATS)
 
-LWS_VISIBLE LWS_EXTERN uint64_t
-lws_stats_get(struct lws_context *context, int index)
+/*
+ * With more than one service thread, pts can bump each other's stats, so
+ * use relaxed atomics... they're almost always on a cache line the
+ * thread already owns, so it's cheap.  Failing that, the per-pt stats lock.
+ */
+
+#if LWS_MAX_SMP > 1 && defined(__GNUC__)
+#define lws_stats_add(_p, _v) __atomic_fetch_add(_p, _v, __ATOMIC_RELAXED)
+#define lws_stats_load(_p) __atomic_load_n(_p, __ATOMIC_RELAXED)
+#define lws_stats_lock(_pt) (void)(_pt)
+#define lws_stats_unlock(_pt) (void)(_pt)
+#else
+#define lws_stats_add(_p, _v) (*(_p) += (_v))
+#define lws_stats_load(_p) (*(_p))
+#define lws_stats_lock(_pt) lws_pt_stats_lock(_pt)
+#define lws_stats_unlock(_pt) lws_pt_stats_unlock(_pt)
+#endif
+
+static int
+lws_stats_hist_index(uint64_t v)
+{
+	int e = 0;
+
+	if (v < LWS_STATS_HIST_SUB)
+		return (int)v;
+
+	if (v >> (LWS_STATS_HIST_MAX_BIT + 1))
+		return LWS_STATS_HIST_BUCKETS - 1;
+
+	/* e is the index of the top set bit */
+#if defined(__GNUC__)
+	e = 63 - __builtin_clzll(v);
+#else
+	while (v >> (e + 1))
+		e++;
+#endif
+
+	return ((e - LWS_STATS_HIST_SUB_BITS + 1) * LWS_STATS_HIST_SUB) +
+	       (int)((v >> (e - LWS_STATS_HIST_SUB_BITS)) &
+		     (LWS_STATS_HIST_SUB - 1));
+}
+
+/* the largest value that goes in bucket n */
+
+static uint64_t
+lws_stats_hist_value(int n)
+{
+	int e = (n / LWS_STATS_HIST_SUB) + LWS_STATS_HIST_SUB_BITS - 1;
+
+	if (n < LWS_STATS_HIST_SUB)
+		return (uint64_t)n;
+
+	return ((((uint64_t)LWS_STATS_HIST_SUB + (n % LWS_STATS_HIST_SUB)) + 1)
+		<< (e - LWS_STATS_HIST_SUB_BITS)) - 1;
+}
+
+static uint64_t
+lws_stats_percentile(const struct lws_context *context, int hist,
+		     unsigned int permille)
+{
+	uint64_t total = 0, want, sum = 0;
+	uint32_t count;
+	int n, m;
+
+	for (m = 0; m < context->count_threads; m++)
+		for (n = 0; n < LWS_STATS_HIST_BUCKETS; n++)
+			total += lws_stats_load(
+				&context->pt[m].stats.hist[hist][n]);
+
+	if (!total)
+		return 0;
+
+	/* the rank of the sample we want, rounding up */
+	want = ((total * permille) + 999) / 1000;
+
+	for (n = 0; n < LWS_STATS_HIST_BUCKETS; n++) {
+		count = 0;
+		for (m = 0; m < context->count_threads; m++)
+			count += lws_stats_load(
+				&context->pt[m].stats.hist[hist][n]);
+		sum += count;
+		if (sum >= want)
+			return lws_stats_hist_value(n);
+	}
+
+	return lws_stats_hist_value(LWS_STATS_HIST_BUCKETS - 1);
+}
+
+uint64_t
+lws_stats_value(const struct lws_context *context, int index)
 {
-	if (index >= LWSSTATS_SIZE)
+	static const unsigned short permille[] = { 500, 990, 999 };
+	uint64_t v = 0, u;
+	int n;
+
+	if (index < 0 || index >= LWSSTATS_SIZE)
 		return 0;
 
-	return context->lws_stats[index];
+	if (index >= LWS_STATS_COUNTERS) {
+		if (index < LWSSTATS_US_SSL_ACCEPT_DELAY_P50)
+			return 0;
+		n = index - LWSSTATS_US_SSL_ACCEPT_DELAY_P50;
+
+		return lws_stats_percentile(context, n / 3, permille[n % 3]);
+	}
+
+	for (n = 0; n < context->count_threads; n++) {
+		u = lws_stats_load(&context->pt[n].stats.c[index]);
+		if (index == LWSSTATS_MS_WORST_WRITABLE_DELAY) {
+			if (u > v)
+				v = u;
+		} else
+			v += u;
+	}
+
+	return v;
+}
+
+LWS_VISIBLE LWS_EXTERN uint64_t
+lws_stats_get(struct lws_context *context, int index)
+{
+	return lws_stats_value(context, index);
 }
 
 LWS_VISIBLE LWS_EXTERN void
@@ -3314,6 +3459,27 @@ lws_stats_log_dump(struct lws_context *context)
 	lwsl_notice("LWSSTATS_B_PARTIALS_ACCEPTED_PARTS:         %8llu\n",
 		(unsigned long long)lws_stats_get(context,
 					LWSSTATS_B_PARTIALS_ACCEPTED_PARTS));
+	lwsl_notice("LWSSTATS_C_WRITE_QUEUED:                    %8llu\n",
+		(unsigned long long)lws_stats_get(context,
+					LWSSTATS_C_WRITE_QUEUED));
+	lwsl_notice("LWSSTATS_B_WRITE_QUEUED:                    %8llu\n",
+		(unsigned long long)lws_stats_get(context,
+					LWSSTATS_B_WRITE_QUEUED));
+	lwsl_notice("LWSSTATS_B_BUFFERED_OUT:                    %8llu\n",
+		(unsigned long long)lws_stats_get(context,
+					LWSSTATS_B_BUFFERED_OUT));
+	lwsl_notice("LWSSTATS_C_H2_TX_HEADER_BLOCKS:             %8llu\n",
+		(unsigned long long)lws_stats_get(context,
+					LWSSTATS_C_H2_TX_HEADER_BLOCKS));
+	lwsl_notice("LWSSTATS_B_H2_TX_HEADERS:                   %8llu\n",
+		(unsigned long long)lws_stats_get(context,
+					LWSSTATS_B_H2_TX_HEADERS));
+	if (lws_stats_get(context, LWSSTATS_C_H2_TX_HEADER_BLOCKS))
+		lwsl_notice("  Avg h2 header block:                      %8llu\n",
+			(unsigned long long)(lws_stats_get(context,
+					LWSSTATS_B_H2_TX_HEADERS) /
+			lws_stats_get(context,
+					LWSSTATS_C_H2_TX_HEADER_BLOCKS)));
 	lwsl_notice("LWSSTATS_MS_SSL_CONNECTIONS_ACCEPTED_DELAY: %8llums\n",
 		(unsigned long long)lws_stats_get(context,
 			LWSSTATS_MS_SSL_CONNECTIONS_ACCEPTED_DELAY) / 1000);
@@ -3344,6 +3510,27 @@ lws_stats_log_dump(struct lws_context *context)
 			(unsigned long long)(lws_stats_get(context,
 					LWSSTATS_MS_WRITABLE_DELAY) /
 			lws_stats_get(context, LWSSTATS_C_WRITEABLE_CB)));
+	lwsl_notice("  Accept delay p50 / p99 / p999:   %8llu / %llu / %lluus\n",
+		(unsigned long long)lws_stats_get(context,
+				LWSSTATS_US_SSL_ACCEPT_DELAY_P50),
+		(unsigned long long)lws_stats_get(context,
+				LWSSTATS_US_SSL_ACCEPT_DELAY_P99),
+		(unsigned long long)lws_stats_get(context,
+				LWSSTATS_US_SSL_ACCEPT_DELAY_P999));
+	lwsl_notice("  Accept-rx delay p50 / p99 / p999:%8llu / %llu / %lluus\n",
+		(unsigned long long)lws_stats_get(context,
+				LWSSTATS_US_SSL_RX_DELAY_P50),
+		(unsigned long long)lws_stats_get(context,
+				LWSSTATS_US_SSL_RX_DELAY_P99),
+		(unsigned long long)lws_stats_get(context,
+				LWSSTATS_US_SSL_RX_DELAY_P999));
+	lwsl_notice("  Writable delay p50 / p99 / p999: %8llu / %llu / %lluus\n",
+		(unsigned long long)lws_stats_get(context,
+				LWSSTATS_US_WRITABLE_DELAY_P50),
+		(unsigned long long)lws_stats_get(context,
+				LWSSTATS_US_WRITABLE_DELAY_P99),
+		(unsigned long long)lws_stats_get(context,
+				LWSSTATS_US_WRITABLE_DELAY_P999));
 	lwsl_notice("Simultaneous SSL restriction:               %8d/%d/%d\n",
 			context->simultaneous_ssl,
 			context->simultaneous_ssl_restriction,
@@ -3355,16 +3542,17 @@ lws_stats_log_dump(struct lws_context *context)
 	context->updated = 1;
 
 	while (v) {
-		if (v->lserv_wsi) {
-
-			struct lws_context_per_thread *pt =
-					&context->pt[(int)v->lserv_wsi->tsi];
+		for (n = 0; n < context->count_threads; n++) {
+			struct lws_context_per_thread *pt = &context->pt[n];
 			struct lws_pollfd *pfd;
 
-			pfd = &pt->fds[v->lserv_wsi->position_in_fds_table];
+			if (!v->lserv_wsi[n])
+				continue;
 
-			lwsl_notice("  Listen port %d actual POLLIN:   %d\n",
-				    v->listen_port,
+			pfd = &pt->fds[v->lserv_wsi[n]->position_in_fds_table];
+
+			lwsl_notice("  Listen port %d tsi %d actual POLLIN: %d\n",
+				    v->listen_port, n,
 				    (int)pfd->events & LWS_POLLIN);
 		}
 
@@ -3383,6 +3571,11 @@ lws_stats_log_dump(struct lws_context *context)
 		lwsl_notice("  AH in use / max:                  %d / %d\n",
 				pt->ah_count_in_use,
 				context->max_http_header_pool);
+		lwsl_notice("  AH high water / free:             %d / %d\n",
+				pt->ah_count_in_use_high_water,
+				pt->ah_free_count);
+		lwsl_notice("  AH pool hits / misses:            %lu / %lu\n",
+				pt->ah_pool_hits, pt->ah_pool_misses);
 
 		wl = pt->ah_wait_list;
 		while (wl) {
@@ -3440,23 +3633,59 @@ void
 lws_stats_atomic_bump(struct lws_context * context,
 		struct lws_context_per_thread *pt, int index, uint64_t bump)
 {
-	lws_pt_stats_lock(pt);
-	context->lws_stats[index] += bump;
-	if (index != LWSSTATS_C_SERVICE_ENTRY)
+	int hist = -1;
+
+	/* the delay aggregates also have each delay go in a histogram */
+
+	switch (index) {
+	case LWSSTATS_MS_SSL_CONNECTIONS_ACCEPTED_DELAY:
+		hist = LWS_STATS_HIST_SSL_ACCEPT_DELAY;
+		break;
+	case LWSSTATS_MS_WRITABLE_DELAY:
+		hist = LWS_STATS_HIST_WRITABLE_DELAY;
+		break;
+	case LWSSTATS_MS_SSL_RX_DELAY:
+		hist = LWS_STATS_HIST_SSL_RX_DELAY;
+		break;
+	}
+
+	lws_stats_lock(pt);
+	lws_stats_add(&pt->stats.c[index], bump);
+	if (hist >= 0)
+		lws_stats_add(&pt->stats.hist[hist][lws_stats_hist_index(bump)],
+			      1);
+	lws_stats_unlock(pt);
+
+	/* only write it if we have to, it's shared by all the threads */
+	if (index != LWSSTATS_C_SERVICE_ENTRY && !context->updated)
 		context->updated = 1;
-	lws_pt_stats_unlock(pt);
 }
 
 void
 lws_stats_atomic_max(struct lws_context * context,
 		struct lws_context_per_thread *pt, int index, uint64_t val)
 {
-	lws_pt_stats_lock(pt);
-	if (val > context->lws_stats[index]) {
-		context->lws_stats[index] = val;
-		context->updated = 1;
+#if LWS_MAX_SMP > 1 && defined(__GNUC__)
+	uint64_t old = lws_stats_load(&pt->stats.c[index]);
+
+	do {
+		if (val <= old)
+			return;
+	} while (!__atomic_compare_exchange_n(&pt->stats.c[index], &old, val,
+					      1, __ATOMIC_RELAXED,
+					      __ATOMIC_RELAXED));
+#else
+	lws_stats_lock(pt);
+	if (val <= pt->stats.c[index]) {
+		lws_stats_unlock(pt);
+		return;
 	}
-	lws_pt_stats_unlock(pt);
+	pt->stats.c[index] = val;
+	lws_stats_unlock(pt);
+#endif
+
+	if (!context->updated)
+		context->updated = 1;
 }
 
 #endif
@@ -969,6 +969,13 @@ enum lws_callback_reasons {
 	 * do something different now.  Any protocol allocation related
 	 * to the http transaction processing should be destroyed. */
 
+	LWS_CALLBACK_HTTP_PROXY_HEALTH_CHECK			= 76,
+	/**< A vhost with proxy mounts that set proxy_health_path gets this
+	 * in protocols[0] once a second, from lws_timed_callback_vh_protocol().
+	 * Like the rest of the proxying, it's handled in
+	 * lws_callback_http_dummy(), so pass it on to that if protocols[0]
+	 * is your own callback. */
+
 	/* ---------------------------------------------------------------------
 	 * ----- Callbacks related to Server TLS -----
 	 */
@@ -1566,6 +1573,18 @@ enum lws_callback_reasons {
 	 * if the lws_cancel_service[_pt]() call was from a different
 	 * thread. */
 
+	LWS_CALLBACK_PT_MESSAGE					= 75,
+	/**< With LWS_WITH_PT_QUEUE, a message another thread queued with
+	 * lws_pt_post() or lws_pt_post_vhost_protocol() is delivered here,
+	 * serialized in the service thread it was posted to.  in and len
+	 * are the payload pointer and length given when it was posted; the
+	 * payload is the receiver's to free.  If the message was posted to a
+	 * wsi that has closed since, it's delivered to the vhost-protocol
+	 * the wsi had instead, like messages posted to the vhost-protocol,
+	 * where wsi is only good for lws_get_vhost(), lws_get_protocol()
+	 * and lws_get_context().  Returning nonzero from a message posted to
+	 * a wsi closes that wsi. */
+
 	LWS_CALLBACK_CHILD_CLOSING				= 69,
 	/**< Sent to parent to notify them a child is closing / being
 	 * destroyed.  in is the child wsi.
@@ -1601,6 +1620,18 @@ enum lws_callback_reasons {
 	 * and failure.  in points to optional JSON, and len represents the
 	 * connection state using enum lws_cert_update_state */
 
+	LWS_CALLBACK_VHOST_TLS_TICKET_KEY			= 77,
+	/**< A vhost with info.tls_ticket_key_filepath or
+	 * info.tls_ticket_key_rotate_secs set asks protocols[0] for a new
+	 * session ticket key here, when it is created and then every
+	 * rotation period.  \p in points to \p len (LWS_TLS_TICKET_KEY_LEN)
+	 * bytes to fill with a key laid out like the key file.  Return
+	 * nonzero if you filled it, or 0 to have lws read the key file or
+	 * make a random key.  Giving the same key again keeps it current
+	 * without a rotation.  The rotations come from the service thread
+	 * with the context lock held, so don't create or destroy vhosts
+	 * from here. */
+
 
 	/****** add new things just above ---^ ******/
 
@@ -2338,6 +2369,62 @@ int lws_extension_callback_pm_deflate(
 	struct lws *wsi, enum lws_extension_callback_reasons reason,
 	void *user, void *in, size_t len);
 
+#if !defined(LWS_WITHOUT_EXTENSIONS)
+struct lws_pmd_predeflated;
+
+/**
+ * lws_pmd_predeflate() - compress a ws message once for many connections
+ *
+ * \param buf: the message payload
+ * \param len: length of the message payload
+ * \param binary: 0 for a TEXT message, 1 for BINARY
+ * \param window_bits: 9 .. 15, deflate window to compress with
+ * \param level: zlib compression level, 1 .. 9
+ *
+ * When the same message goes to many permessage-deflate connections,
+ * lws_write() compresses it again for every one of them, and each needs its
+ * own deflate state while it's doing it.
+ *
+ * This compresses the message one time into an object that can be sent on
+ * any number of connections by lws_write_pmd_predeflated(), from any service
+ * thread.  Destroy it with lws_pmd_predeflated_destroy() after the last send.
+ *
+ * Returns NULL on OOM or if the arguments are out of range.
+ */
+LWS_VISIBLE LWS_EXTERN struct lws_pmd_predeflated *
+lws_pmd_predeflate(const void *buf, size_t len, int binary, int window_bits,
+		   int level);
+
+/**
+ * lws_write_pmd_predeflated() - send a predeflated message on a connection
+ *
+ * \param wsi: server ws connection
+ * \param pd: message from lws_pmd_predeflate()
+ *
+ * Call from the WRITEABLE callback, like lws_write().  The message goes as
+ * one already-compressed frame.  That is only possible on server connections
+ * with permessage-deflate negotiated, whose deflate state holds no history
+ * at this point, ie, it resets after each message ("client_no_context_takeover"
+ * was negotiated) or nothing was sent with lws_write() yet.  The peer must
+ * also accept a window of \p window_bits.
+ *
+ * Returns 0 if sent, or buffered to send, -1 if the connection should be
+ * closed, or 1 if this connection can't take the predeflated message.  In
+ * that case nothing was sent, and the caller should send the original payload
+ * with lws_write() as usual in this same callback.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_write_pmd_predeflated(struct lws *wsi, struct lws_pmd_predeflated *pd);
+
+/**
+ * lws_pmd_predeflated_destroy() - free a predeflated message
+ *
+ * \param pd: pointer to the message pointer, set to NULL afterwards
+ */
+LWS_VISIBLE LWS_EXTERN void
+lws_pmd_predeflated_destroy(struct lws_pmd_predeflated **pd);
+#endif
+
 /*
  * The internal exts are part of the public abi
  * If we add more extensions, publish the callback here  ------v
@@ -2705,12 +2792,36 @@ enum lws_context_options {
 	 * example the ACME plugin was configured to fetch a cert, this lets
 	 * you bootstrap your vhost from having no cert to start with.
 	 */
+	LWS_SERVER_OPTION_EPOLL					= (1 << 27),
+	/**< (CTX) On Linux, use the built-in epoll() backend for the default
+	 * service loop instead of poll().  Wakeup cost then scales with the
+	 * number of active fds rather than the total number of fds on the
+	 * service thread.  Ignored if an event lib option is also given, or
+	 * if lws was built on a platform without epoll().
+	 */
+	LWS_SERVER_OPTION_SMP_ACCEPT_LOCAL			= (1 << 28),
+	/**< (CTX) On Linux with count_threads > 1, each service thread has
+	 * its own SO_REUSEPORT listen socket for each vhost.  By default a
+	 * connection accepted on any of them is handed to the service thread
+	 * with the fewest fds in use.  With this option, connections stay on
+	 * the service thread whose listen socket accepted them, so the kernel
+	 * does the spreading and a connection never changes threads.
+	 */
 
 	/****** add new things just above ---^ ******/
 };
 
 #define lws_check_opt(c, f) (((c) & (f)) == (f))
 
+/** enum lws_access_log_overflow - what LWS_WITH_ACCESS_LOG_ASYNC does with
+ * an access log line when the service thread's buffer is full */
+enum lws_access_log_overflow {
+	LWS_ALOG_OVERFLOW_DROP,
+	/**< discard the line, the writer thread warns how many it lost */
+	LWS_ALOG_OVERFLOW_WAIT,
+	/**< the service thread waits for the writer thread to make room */
+};
+
 struct lws_plat_file_ops;
 
 /** struct lws_context_creation_info - parameters to create context and /or vhost with
@@ -2887,7 +2998,10 @@ struct lws_context_creation_info {
 	 * less than the interval given here will never send PINGs / expect
 	 * PONGs.  Conversely as soon as the ws connection is established, an
 	 * idle connection will do the PING / PONG roundtrip as soon as
-	 * ws_ping_pong_interval seconds has passed without traffic
+	 * ws_ping_pong_interval seconds has passed without traffic.
+	 * To avoid connections that were established together all sending
+	 * their PINGs in the same second, up to a quarter of the interval
+	 * extra may pass before the PING is sent.
 	 */
 	const struct lws_protocol_vhost_options *headers;
 		/**< VHOST: pointer to optional linked list of per-vhost
@@ -3004,6 +3118,115 @@ struct lws_context_creation_info {
 	/**< VHOST: size of the rx scratch buffer for each stream.  0 =
 	 *	    default (512 bytes).  This affects the RX chunk size
 	 *	    at the callback. */
+	const int *pt_cpu_affinity;
+	/**< CONTEXT: NULL, or an array of .count_threads cpu indexes, one
+	 *	      per service thread, or -1 for no preference.  On Linux
+	 *	      each service thread binds itself to its cpu the first
+	 *	      time it calls lws_service_tsi(), and the thread's listen
+	 *	      sockets ask the kernel to prefer connections arriving on
+	 *	      that cpu (SO_INCOMING_CPU).  Ignored elsewhere. */
+	const char *async_dns_server;
+	/**< CONTEXT: with LWS_WITH_ASYNC_DNS, "ip" or "ip:port" of the dns
+	 *	      server client connections look up their peer address
+	 *	      with.  NULL means the first IPv4 nameserver in
+	 *	      /etc/resolv.conf. */
+	unsigned int async_dns_cache_limit;
+	/**< CONTEXT: with LWS_WITH_ASYNC_DNS, the most names the context
+	 *	      keeps dns answers for, until their TTL runs out.  0 =
+	 *	      default (256). */
+	unsigned int access_log_ring_size;
+	/**< CONTEXT: with LWS_WITH_ACCESS_LOG_ASYNC, bytes each service
+	 *	      thread can hold of access log lines that the writer
+	 *	      thread has not written yet.  0 = default (64KB). */
+	unsigned int access_log_flush_ms;
+	/**< CONTEXT: with LWS_WITH_ACCESS_LOG_ASYNC, the longest the writer
+	 *	      thread leaves lines buffered before writing them.  It
+	 *	      also starts as soon as a buffer is half full.  0 =
+	 *	      default (250ms). */
+	unsigned char access_log_overflow;
+	/**< CONTEXT: with LWS_WITH_ACCESS_LOG_ASYNC, an
+	 *	      enum lws_access_log_overflow saying what to do when a
+	 *	      service thread's buffer is full */
+	unsigned int pt_queue_depth;
+	/**< CONTEXT: with LWS_WITH_PT_QUEUE, how many messages can be
+	 *	      waiting for each service thread, rounded up to a power
+	 *	      of 2.  0 = default (1024). */
+	unsigned int buffered_out_limit;
+	/**< CONTEXT: when a send on a connection was partial, lws buffers
+	 *	      the rest.  While less than this many bytes are buffered,
+	 *	      lws_send_pipe_choked() doesn't report the connection as
+	 *	      choked and the WRITEABLE callback still comes, and what
+	 *	      you write then is queued behind the buffered data.  0 =
+	 *	      default (nothing may be written until the buffered data
+	 *	      has been sent, as before). */
+	unsigned short proxy_pool_max_idle;
+	/**< VHOST: with LWS_WITH_HTTP_PROXY, how many idle keepalive
+	 *	      connections to proxy mount origins the vhost may keep
+	 *	      for reuse by later proxied requests.  0 = default (none,
+	 *	      each proxied request makes its own connection). */
+	unsigned short proxy_pool_max_per_origin;
+	/**< VHOST: with LWS_WITH_HTTP_PROXY, how many of the idle origin
+	 *	      connections may be to the same origin.  0 = default (8) */
+	unsigned int proxy_pool_idle_secs;
+	/**< VHOST: with LWS_WITH_HTTP_PROXY, how long an idle origin
+	 *	      connection may wait in the pool before it is closed.
+	 *	      Keep it below the origin's own keepalive timeout, so the
+	 *	      origin rarely closes one just as it is reused.  0 =
+	 *	      default (4s) */
+	unsigned int tls_session_cache_max;
+	/**< VHOST: how many client tls sessions the vhost remembers, so
+	 *	      later client connections to the same address, port and
+	 *	      SNI can resume them instead of a full handshake.  Only
+	 *	      connections with the same LCCSCF_ALLOW_SELFSIGNED,
+	 *	      LCCSCF_SKIP_SERVER_CERT_HOSTNAME_CHECK and
+	 *	      LCCSCF_ALLOW_EXPIRED flags share sessions, since resuming
+	 *	      one skips checking the server cert.  The
+	 *	      least recently used is dropped to make space.  Client
+	 *	      connections on a vhost with a cache send close_notify
+	 *	      when they are closed, so their session stays resumable.
+	 *	      0 = default (none, every client connection does a full
+	 *	      handshake).  See lws_tls_session_cache_stats() */
+	unsigned int tls_session_timeout;
+	/**< VHOST: how long a remembered client tls session may be
+	 *	      offered, in seconds.  The server may still decline it
+	 *	      before then.  0 = default (300s) */
+	const char *tls_ticket_key_filepath;
+	/**< VHOST: file holding the key server tls session tickets are
+	 *	      encrypted with: a 16-byte key name, a 32-byte HMAC key,
+	 *	      then a 32-byte AES key (a 48-byte file with 16-byte keys
+	 *	      also works).  Give every process serving the vhost the
+	 *	      same file, and a session started on one can be resumed on
+	 *	      any of them.  It's read again every
+	 *	      tls_ticket_key_rotate_secs; when it has changed, new
+	 *	      tickets use the new key and the old one is still accepted
+	 *	      until the next change.  The processes read it at different
+	 *	      times, so a second key the same size may follow the first:
+	 *	      the next key, accepted but not yet used for new tickets.
+	 *	      Stage each key as the next one for a rotation period before
+	 *	      it comes first, and no process sees a ticket under a key it
+	 *	      doesn't have yet.  NULL = default (no key file) */
+	unsigned int tls_ticket_key_rotate_secs;
+	/**< VHOST: how often to take a new session ticket key, in seconds.
+	 *	      Each key comes from LWS_CALLBACK_VHOST_TLS_TICKET_KEY if
+	 *	      protocols[0] provides one, else tls_ticket_key_filepath,
+	 *	      else it's random (which only suits a single process).
+	 *	      0 = default (60s if there is a key file, otherwise lws
+	 *	      leaves the ticket keys to the tls library) */
+	unsigned int tls_server_session_cache_max;
+	/**< VHOST: the most server tls sessions kept in memory, for clients
+	 *	      that resume by session id rather than ticket.  0 =
+	 *	      default (the tls library's own limit).  See
+	 *	      lws_tls_server_session_stats() */
+	unsigned int tls_handshake_threads;
+	/**< CONTEXT: with LWS_WITH_TLS_HANDSHAKE_POOL, how many worker
+	 *	      threads to run the cpu-heavy part of server tls
+	 *	      handshakes on, so a burst of new connections doesn't hold
+	 *	      up the connections the service threads already have.
+	 *	      Vhosts that require a valid client cert, or that set
+	 *	      ssl_info_event_mask, still do their handshakes on the
+	 *	      service thread, and
+	 *	      simultaneous_ssl_restriction applies the same either way.
+	 *	      0 = default (on the service threads) */
 
 	/* Add new things just above here ---^
 	 * This is part of the ABI, don't needlessly break compatibility
@@ -3334,6 +3557,16 @@ enum lws_mount_protocols {
 	LWSMPRO_CALLBACK	= 6, /**< hand by named protocol's callback */
 };
 
+/** enum lws_proxy_lb - how a proxy mount with several origins picks one */
+enum lws_proxy_lb {
+	LWSPLB_LEAST_OUTSTANDING	= 0,
+	/**< the origin with the fewest proxied requests in flight */
+	LWSPLB_HASH			= 1,
+	/**< the same origin for the same proxy_lb_key value, as long as it
+	 * is healthy; requests without the key fall back to least
+	 * outstanding */
+};
+
 /** struct lws_http_mount
  *
  * arguments for mounting something in a vhost's url namespace
@@ -3376,6 +3609,25 @@ struct lws_http_mount {
 	const char *basic_auth_login_file;
 	/**<NULL, or filepath to use to check basic auth logins against */
 
+	const char *proxy_lb_key;
+	/**< for LWSPLB_HASH, a header name like "x-forwarded-for", or
+	 * "cookie:name" for the value of that cookie */
+	const char *proxy_health_path;
+	/**< NULL, or a path like "/healthz" to GET from each origin of a
+	 * proxy mount every proxy_health_secs.  A 2xx or 3xx answer is
+	 * healthy, anything else counts as a failure like a connect error */
+	unsigned short proxy_health_secs;
+	/**< interval between health checks, 0 means 5s */
+	unsigned short proxy_eject_secs;
+	/**< how long a proxy origin that failed gets no requests, 0 means
+	 * 10s.  A passing health check brings it back sooner. */
+	unsigned char proxy_lb;
+	/**< one of enum lws_proxy_lb, for proxy mounts whose origin is a
+	 * comma-separated list, eg, "10.0.0.1:8080/,10.0.0.2:8080/" */
+	unsigned char proxy_max_fails;
+	/**< consecutive connect errors, timeouts or failed health checks
+	 * that eject a proxy origin, 0 means 1 */
+
 	/* Add new things just above here ---^
 	 * This is part of the ABI, don't needlessly break compatibility
 	 *
@@ -3731,6 +3983,53 @@ lws_cancel_service_pt(struct lws *wsi);
 LWS_VISIBLE LWS_EXTERN void
 lws_cancel_service(struct lws_context *context);
 
+#if defined(LWS_WITH_PT_QUEUE)
+/**
+ * lws_pt_post() - Queue a message for a wsi from any thread
+ * \param wsi:	the wsi the message is for
+ * \param payload: opaque pointer delivered as \p in
+ * \param len:	delivered as \p len
+ *
+ * Adds the message to the lock-free queue of the service thread \p wsi
+ * belongs to, and wakes that thread if it is not already due to look at its
+ * queue, so a burst of posts costs the service thread one wakeup.  It gets
+ * a LWS_CALLBACK_PT_MESSAGE callback for each message, in the order they
+ * were posted.
+ *
+ * The caller must know \p wsi is still open while this is running, eg,
+ * because the service thread only closes it after being told to in a
+ * message.  It may close before the message is delivered, see
+ * LWS_CALLBACK_PT_MESSAGE.
+ *
+ * Returns 0 if queued, or nonzero if the queue was full, in which case the
+ * caller still owns \p payload.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_pt_post(struct lws *wsi, void *payload, size_t len);
+
+/**
+ * lws_pt_post_vhost_protocol() - Queue a message for a vhost-protocol from any
+ *				  thread
+ * \param vh:	the vhost
+ * \param prot:	the protocol on \p vh whose callback gets the message
+ * \param tsi:	the service thread index to deliver it on, 0 if not SMP
+ * \param payload: opaque pointer delivered as \p in
+ * \param len:	delivered as \p len
+ *
+ * As lws_pt_post(), but the message goes to the protocol callback with a
+ * wsi that is only good for lws_get_vhost(), lws_get_protocol() and
+ * lws_get_context().  The vhost must still exist when it is delivered.
+ *
+ * Messages still queued when the context is destroyed are delivered during
+ * lws_context_destroy(), after the connections have closed.  Other threads
+ * must have stopped posting by then.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_pt_post_vhost_protocol(struct lws_vhost *vh,
+			   const struct lws_protocols *prot, int tsi,
+			   void *payload, size_t len);
+#endif
+
 /**
  * lws_service_fd() - Service polled socket with something waiting
  * \param context:	Websocket context
@@ -5012,6 +5311,41 @@ lws_write(struct lws *wsi, unsigned char *buf, size_t len,
 #define lws_write_http(wsi, buf, len) \
 	lws_write(wsi, (unsigned char *)(buf), len, LWS_WRITE_HTTP)
 
+/** struct lws_iovec - one piece of a payload for lws_write_iov() */
+struct lws_iovec {
+	const void *base; /**< start of this piece */
+	size_t len; /**< length of this piece */
+};
+
+/** the most pieces one lws_write_iov() can be given */
+#define LWS_WRITE_IOV_MAX 15
+
+/**
+ * lws_write_iov() - lws_write() a payload that is in several pieces
+ * \param wsi:	Websocket instance (available from user callback)
+ * \param iov:	Array of pieces making up the payload, in order
+ * \param count:	How many pieces in iov, up to LWS_WRITE_IOV_MAX
+ * \param protocol:	As for lws_write()
+ *
+ *	This does the same as lws_write() with the pieces in iov one after
+ *	the other in one buffer, but the pieces can be anywhere and don't
+ *	need LWS_PRE in front of them.  It's used with the same rules as
+ *	lws_write(), eg, only from the WRITEABLE callback, and the whole
+ *	payload is one message or one part of a message.
+ *
+ *	On a plain tcp connection with http/1, ws server or raw, lws sends
+ *	the framing and the pieces together with one sendmsg() with no
+ *	copying; anything not accepted is buffered like a truncated
+ *	lws_write().  For tls (so it goes in one record), h2, ws client
+ *	masking or ws extensions, the pieces are first copied into one
+ *	buffer and that is passed to lws_write().
+ *
+ *	Return is as for lws_write().
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_write_iov(struct lws *wsi, const struct lws_iovec *iov, int count,
+	      enum lws_write_protocol protocol);
+
 /* helper for multi-frame ws message flags */
 static inline int
 lws_write_ws_flags(int initial, int is_start, int is_end)
@@ -6011,6 +6345,27 @@ lws_partial_buffered(struct lws *wsi);
 LWS_VISIBLE LWS_EXTERN int LWS_WARN_UNUSED_RESULT
 lws_frame_is_binary(struct lws *wsi);
 
+/**
+ * lws_ws_mask_payload(): apply a ws frame mask to a run of payload
+ *
+ * \param dst: where to put the masked / unmasked data
+ * \param src: the data to mask / unmask, may be the same as dst
+ * \param len: number of bytes to process
+ * \param mask: the 4-byte frame masking key
+ * \param mask_idx: which byte of the mask applies to src[0] (0 - 3)
+ *
+ * Returns the mask_idx that applies to the byte following the run, so a
+ * frame payload can be processed in several pieces.
+ *
+ * lws uses this itself for server rx and client tx; it processes a vector
+ * at a time where the cpu allows it.  Vector units that not every cpu of the
+ * target has, eg, AVX2, are only used after the first lws context has been
+ * created.  dst and src must either be the same or not overlap at all.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_ws_mask_payload(uint8_t *dst, const uint8_t *src, size_t len,
+		    const uint8_t *mask, int mask_idx);
+
 /**
  * lws_is_ssl() - Find out if connection is using SSL
  * \param wsi:	websocket connection to check
@@ -6203,6 +6558,78 @@ lws_tls_cert_updated(struct lws_context *context, const char *certpath,
 		     const char *keypath,
 		     const char *mem_cert, size_t len_mem_cert,
 		     const char *mem_privkey, size_t len_mem_privkey);
+
+/** struct lws_tls_session_cache_stats - the vhost's client tls session cache */
+struct lws_tls_session_cache_stats {
+	unsigned long handshakes; /**< client handshakes completed */
+	unsigned long offered; /**< client connections that offered a session */
+	unsigned long resumed; /**< handshakes the server resumed */
+	unsigned long stored; /**< sessions (or tickets) put in the cache */
+	unsigned long evicted; /**< sessions dropped to make space */
+	unsigned long expired; /**< sessions dropped as too old to offer */
+	unsigned int count; /**< sessions in the cache now */
+};
+
+/**
+ * lws_tls_session_cache_stats() - get the vhost's client session cache stats
+ *
+ * \param vhost: the vhost to query
+ * \param stats: the struct to fill in
+ *
+ * With info.tls_session_cache_max set, client tls connections made on the
+ * vhost remember the server's session (or TLS 1.3 ticket), and offer it
+ * again on later connections to the same address, port and SNI, so they can
+ * skip the full handshake.  The resume rate is resumed / handshakes.
+ *
+ * Returns 0 if \p stats was filled in, or -1 if the vhost has no cache.
+ *
+ * Sessions are only remembered with the OpenSSL backend, with mbedTLS the
+ * cache stays empty.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_tls_session_cache_stats(struct lws_vhost *vhost,
+			    struct lws_tls_session_cache_stats *stats);
+
+/** LWS_TLS_TICKET_KEY_LEN - bytes in a session ticket key: name, HMAC, AES */
+#define LWS_TLS_TICKET_KEY_LEN 80
+
+/** struct lws_tls_server_session_stats - the vhost's server tls resumption */
+struct lws_tls_server_session_stats {
+	unsigned long handshakes; /**< server handshakes completed */
+	unsigned long resumed; /**< handshakes that resumed a session */
+	unsigned long tickets_issued; /**< tickets encrypted with our key */
+	unsigned long tickets_current; /**< tickets back under the current key */
+	unsigned long tickets_previous; /**< tickets back under the previous key,
+					  * accepted and renewed */
+	unsigned long tickets_next; /**< tickets back under the staged next key,
+				      * from a process that already uses it */
+	unsigned long tickets_unknown; /**< tickets under a key we don't have */
+	unsigned long key_rotations; /**< times a new ticket key took over */
+	unsigned long cache_misses; /**< session ids not in the cache */
+	unsigned long cache_timeouts; /**< session ids found but expired */
+	unsigned long cache_full; /**< sessions dropped as the cache was full */
+	unsigned int cached; /**< sessions in the server cache now */
+};
+
+/**
+ * lws_tls_server_session_stats() - get the vhost's server resumption stats
+ *
+ * \param vhost: the tls vhost to query
+ * \param stats: the struct to fill in
+ *
+ * The resume rate is resumed / handshakes.  The ticket counts only move
+ * when lws manages the vhost's ticket keys, ie, info.tls_ticket_key_filepath
+ * or info.tls_ticket_key_rotate_secs was set.  For SNI vhosts sharing a
+ * listen port, tickets and the session cache belong to the vhost that owns
+ * the listen socket.
+ *
+ * Returns 0 if \p stats was filled in, or -1 if the vhost doesn't serve tls.
+ *
+ * With mbedTLS, lws can't manage ticket keys and the cache counts stay 0.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_tls_server_session_stats(struct lws_vhost *vhost,
+			     struct lws_tls_server_session_stats *stats);
 ///@}
 
 /** \defgroup lws_ring LWS Ringbuffer APIs
@@ -7260,6 +7687,8 @@ lejp_get_wildcard(struct lejp_ctx *ctx, int wildcard, char *dest, int len);
  *  _C_ counter
  *  _B_ byte count
  *  _MS_ millisecond count
+ *  _US_ microseconds... the _Pnn ones are percentiles of every delay the
+ *       matching _MS_ aggregate was made from
  */
 
 enum {
@@ -7287,6 +7716,28 @@ enum {
 	LWSSTATS_MS_SSL_RX_DELAY, /**< aggregate delay between ssl accept complete and first RX */
 	LWSSTATS_C_PEER_LIMIT_AH_DENIED, /**< number of times we would have given an ah but for the peer limit */
 	LWSSTATS_C_PEER_LIMIT_WSI_DENIED, /**< number of times we would have given a wsi but for the peer limit */
+	LWSSTATS_C_H2_TX_HEADER_BLOCKS, /**< count of h2 header blocks sent */
+	LWSSTATS_B_H2_TX_HEADERS, /**< aggregate bytes of hpack-encoded h2 header blocks sent */
+	LWSSTATS_C_WRITE_QUEUED, /**< count of writes queued behind a partial write */
+	LWSSTATS_B_WRITE_QUEUED, /**< aggregate bytes of writes queued behind a partial write */
+	LWSSTATS_B_BUFFERED_OUT, /**< bytes currently buffered waiting to be sent */
+
+	/* Add new counters just above here ---^ */
+	LWSSTATS_COUNTERS, /**< how many counters there are, not a stat itself */
+
+	/*
+	 * The percentiles have fixed indexes, so new counters don't renumber
+	 * them.  LWSSTATS_COUNTERS must stay below the first one.
+	 */
+	LWSSTATS_US_SSL_ACCEPT_DELAY_P50 = 64, /**< median delay in accepting ssl connections, in us */
+	LWSSTATS_US_SSL_ACCEPT_DELAY_P99, /**< 99th percentile delay in accepting ssl connections, in us */
+	LWSSTATS_US_SSL_ACCEPT_DELAY_P999, /**< 99.9th percentile delay in accepting ssl connections, in us */
+	LWSSTATS_US_WRITABLE_DELAY_P50, /**< median delay between asking for writable and getting cb, in us */
+	LWSSTATS_US_WRITABLE_DELAY_P99, /**< 99th percentile delay between asking for writable and getting cb, in us */
+	LWSSTATS_US_WRITABLE_DELAY_P999, /**< 99.9th percentile delay between asking for writable and getting cb, in us */
+	LWSSTATS_US_SSL_RX_DELAY_P50, /**< median delay between ssl accept complete and first RX, in us */
+	LWSSTATS_US_SSL_RX_DELAY_P99, /**< 99th percentile delay between ssl accept complete and first RX, in us */
+	LWSSTATS_US_SSL_RX_DELAY_P999, /**< 99.9th percentile delay between ssl accept complete and first RX, in us */
 
 	/* Add new things just above here ---^
 	 * This is part of the ABI, don't needlessly break compatibility */
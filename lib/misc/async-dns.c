@@ -0,0 +1,766 @@
+/*
+ * libwebsockets - asynchronous dns for client connections
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation:
+ *  version 2.1 of the License.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA  02110-1301  USA
+ *
+ * getaddrinfo() blocks the whole service thread while the resolver works.
+ * Instead, each A query goes out on its own udp socket that is serviced in
+ * the event loop like any other wsi, and client connections wait in
+ * LRS_WAITING_DNS until the answer comes.  Then lws_client_connect_2() runs
+ * again for them and finds the address in the cache.
+ *
+ * A socket per query means each one comes from a different random source
+ * port, as well as having a random id, so an off-path attacker has to guess
+ * both to spoof an answer.
+ *
+ * Answers are cached for the whole context, for as long as their TTL.
+ * Numeric addresses and names in /etc/hosts are answered directly.  IPv6
+ * literals and names without a dot still go to getaddrinfo(), since they
+ * depend on resolver config we don't follow, like search domains.
+ */
+
+#include "private-libwebsockets.h"
+
+#define LWS_ADNS_RETRY_US (2 * LWS_USEC_PER_SEC)
+#define LWS_ADNS_TRIES 3
+#define LWS_ADNS_NAME_MAX 253
+#define LWS_ADNS_CACHE_HASH 64
+#define LWS_ADNS_TTL_MAX (24 * 3600)
+
+static uint32_t
+lws_adns_hash(const char *name)
+{
+	uint32_t h = 5381;
+	char c;
+
+	while ((c = *name++)) {
+		if (c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		h = (h * 33) ^ (uint8_t)c;
+	}
+
+	return h % LWS_ADNS_CACHE_HASH;
+}
+
+/* must hold the context lock */
+
+static struct lws_adns_cache **
+lws_adns_cache_find(struct lws_context *context, const char *name)
+{
+	struct lws_adns_cache **pc;
+
+	if (!context->adns_cache)
+		return NULL;
+
+	pc = &context->adns_cache[lws_adns_hash(name)];
+	while (*pc) {
+		if (!strcasecmp((const char *)&(*pc)[1], name))
+			return pc;
+		pc = &(*pc)->next;
+	}
+
+	return NULL;
+}
+
+static void
+lws_adns_cache_unlink(struct lws_context *context, struct lws_adns_cache **pc)
+{
+	struct lws_adns_cache *c = *pc;
+
+	*pc = c->next;
+	lws_free(c);
+	context->adns_cache_count--;
+}
+
+/*
+ * Connections coming back after waiting for the answer take it even if its
+ * TTL already ran out, since it was fresh when it arrived
+ */
+
+static int
+lws_adns_cache_lookup(struct lws_context *context, const char *name,
+		      struct in_addr *addr, int stale_ok)
+{
+	struct lws_adns_cache **pc;
+	int ret = 1;
+
+	lws_context_lock(context);
+
+	pc = lws_adns_cache_find(context, name);
+	if (pc) {
+		if (stale_ok || (*pc)->expires > lws_plat_monotonic_us()) {
+			*addr = (*pc)->addr;
+			ret = 0;
+		} else
+			lws_adns_cache_unlink(context, pc);
+	}
+
+	lws_context_unlock(context);
+
+	return ret;
+}
+
+static void
+lws_adns_cache_add(struct lws_context *context, const char *name,
+		   struct in_addr addr, uint32_t ttl)
+{
+	struct lws_adns_cache **pc, **soonest = NULL, *c;
+	lws_usec_t now = lws_plat_monotonic_us();
+	size_t len = strlen(name);
+	char *p;
+	int n;
+
+	if (ttl > LWS_ADNS_TTL_MAX)
+		ttl = LWS_ADNS_TTL_MAX;
+
+	lws_context_lock(context);
+
+	if (!context->adns_cache) {
+		context->adns_cache = lws_zalloc(sizeof(*pc) *
+						 LWS_ADNS_CACHE_HASH,
+						 "adns cache");
+		if (!context->adns_cache)
+			goto bail;
+	}
+
+	pc = lws_adns_cache_find(context, name);
+	if (pc)
+		lws_adns_cache_unlink(context, pc);
+
+	if (context->adns_cache_count >= context->adns_cache_limit) {
+		/*
+		 * make room by dropping whatever expired, or if nothing did,
+		 * whatever will expire first
+		 */
+		for (n = 0; n < LWS_ADNS_CACHE_HASH; n++) {
+			pc = &context->adns_cache[n];
+			while (*pc) {
+				if ((*pc)->expires <= now) {
+					lws_adns_cache_unlink(context, pc);
+					continue;
+				}
+				if (!soonest || (*pc)->expires < (*soonest)->expires)
+					soonest = pc;
+				pc = &(*pc)->next;
+			}
+		}
+
+		if (context->adns_cache_count >= context->adns_cache_limit &&
+		    soonest)
+			lws_adns_cache_unlink(context, soonest);
+	}
+
+	c = lws_malloc(sizeof(*c) + len + 1, "adns cache entry");
+	if (!c)
+		goto bail;
+
+	c->expires = now + ((lws_usec_t)ttl * LWS_USEC_PER_SEC);
+	c->addr = addr;
+	p = (char *)&c[1];
+	for (n = 0; n <= (int)len; n++)
+		p[n] = (name[n] >= 'A' && name[n] <= 'Z') ?
+				name[n] + ('a' - 'A') : name[n];
+
+	n = lws_adns_hash(name);
+	c->next = context->adns_cache[n];
+	context->adns_cache[n] = c;
+	context->adns_cache_count++;
+
+bail:
+	lws_context_unlock(context);
+}
+
+/* must hold the context lock */
+
+static void
+lws_adns_hosts_free(struct lws_context *context)
+{
+	struct lws_adns_host *h;
+
+	while (context->adns_hosts) {
+		h = context->adns_hosts;
+		context->adns_hosts = h->next;
+		lws_free(h);
+	}
+}
+
+/*
+ * /etc/hosts is parsed into context->adns_hosts, and only parsed again when
+ * its mtime or size changes.  We look at most once a second.
+ */
+
+static void
+lws_adns_hosts_load(struct lws_context *context, time_t now)
+{
+	char line[256], *p, *sp;
+	struct lws_adns_host *h;
+	struct in_addr a;
+	struct stat st;
+	size_t len;
+	FILE *f;
+
+	if (context->adns_hosts_checked == now)
+		return;
+	context->adns_hosts_checked = now;
+
+	if (stat("/etc/hosts", &st)) {
+		lws_adns_hosts_free(context);
+		context->adns_hosts_mtime = 0;
+		context->adns_hosts_size = 0;
+
+		return;
+	}
+
+	if (st.st_mtime == context->adns_hosts_mtime &&
+	    st.st_size == context->adns_hosts_size)
+		return;
+
+	lws_adns_hosts_free(context);
+	context->adns_hosts_mtime = st.st_mtime;
+	context->adns_hosts_size = st.st_size;
+
+	f = fopen("/etc/hosts", "r");
+	if (!f)
+		return;
+
+	while (fgets(line, sizeof(line), f)) {
+		p = strchr(line, '#');
+		if (p)
+			*p = '\0';
+		p = strtok_r(line, " \t\r\n", &sp);
+		if (!p || lws_plat_inet_pton(AF_INET, p, &a) != 1)
+			continue;
+
+		while ((p = strtok_r(NULL, " \t\r\n", &sp))) {
+			len = strlen(p);
+			h = lws_malloc(sizeof(*h) + len + 1, "adns host");
+			if (!h)
+				break;
+			h->addr = a;
+			memcpy(&h[1], p, len + 1);
+			h->next = context->adns_hosts;
+			context->adns_hosts = h;
+		}
+	}
+
+	fclose(f);
+}
+
+static int
+lws_adns_hosts(struct lws_context *context, const char *name,
+	       struct in_addr *addr)
+{
+	struct lws_adns_host *h;
+	int ret = 1;
+
+	lws_context_lock(context);
+
+	lws_adns_hosts_load(context, time(NULL));
+
+	for (h = context->adns_hosts; h && ret; h = h->next)
+		if (!strcasecmp((const char *)&h[1], name)) {
+			*addr = h->addr;
+			ret = 0;
+		}
+
+	lws_context_unlock(context);
+
+	return ret;
+}
+
+/*
+ * decode the possibly compressed name at pos into out, returning the offset
+ * just after it in the packet, or -1 if it's broken
+ */
+
+static int
+lws_adns_name(const uint8_t *pkt, int len, int pos, char *out, int olen)
+{
+	int ret = -1, hops = 0, o = 0, n;
+
+	while (pos < len) {
+		n = pkt[pos];
+		if ((n & 0xc0) == 0xc0) {
+			if (pos + 1 >= len || ++hops > 16)
+				return -1;
+			if (ret < 0)
+				ret = pos + 2;
+			pos = ((n & 0x3f) << 8) | pkt[pos + 1];
+			continue;
+		}
+		if (n & 0xc0)
+			return -1;
+		pos++;
+		if (!n) {
+			out[o] = '\0';
+
+			return ret < 0 ? pos : ret;
+		}
+		if (pos + n > len || o + n + 2 > olen ||
+		    memchr(pkt + pos, '\0', n))
+			return -1;
+		if (o)
+			out[o++] = '.';
+		memcpy(out + o, pkt + pos, n);
+		o += n;
+		pos += n;
+	}
+
+	return -1;
+}
+
+static int
+lws_adns_send(struct lws *wsi, struct lws_adns_query *q)
+{
+	uint8_t pkt[12 + LWS_ADNS_NAME_MAX + 2 + 4], *p = pkt;
+	const char *name = (const char *)&q[1], *dot;
+	size_t n;
+
+	*p++ = q->id >> 8;
+	*p++ = q->id & 0xff;
+	*p++ = 1; /* RD */
+	*p++ = 0;
+	*p++ = 0;
+	*p++ = 1; /* one question */
+	memset(p, 0, 6);
+	p += 6;
+
+	while (*name) {
+		dot = strchr(name, '.');
+		n = dot ? (size_t)(dot - name) : strlen(name);
+		if (!n || n > 63)
+			return 1;
+		*p++ = (uint8_t)n;
+		memcpy(p, name, n);
+		p += n;
+		name += n;
+		if (*name)
+			name++;
+	}
+	*p++ = 0;
+	*p++ = 0;
+	*p++ = 1; /* A */
+	*p++ = 0;
+	*p++ = 1; /* IN */
+
+	q->tries++;
+	lws_set_timer_usecs(wsi, LWS_ADNS_RETRY_US);
+
+	/* if it didn't go, the retry will take care of it */
+	if (send(wsi->desc.sockfd, (char *)pkt, lws_ptr_diff(p, pkt),
+		 MSG_NOSIGNAL) < 0)
+		lwsl_info("%s: send failed %d\n", __func__, LWS_ERRNO);
+
+	return 0;
+}
+
+static void
+lws_adns_destroy_wsi(struct lws *wsi)
+{
+	lws_set_timer_usecs(wsi, LWS_SET_TIMER_USEC_CANCEL);
+	__remove_wsi_socket_from_fds(wsi);
+	lws_libevent_destroy(wsi);
+	compatible_close(wsi->desc.sockfd);
+	wsi->context->count_wsi_allocated--;
+	lws_free(wsi);
+}
+
+/*
+ * we're finished with the query and its socket... either continue connecting
+ * everyone who was waiting for it, or fail them
+ */
+
+static void
+lws_adns_complete(struct lws_adns_query *q, int ok)
+{
+	static const char *cce = "async dns failed";
+	struct lws *w;
+
+	lws_dll_lws_remove(&q->list);
+	lws_adns_destroy_wsi(q->wsi);
+
+	while (q->waiting.next) {
+		w = lws_container_of(q->waiting.next, struct lws,
+				     dll_adns_wait);
+		lws_dll_lws_remove(&w->dll_adns_wait);
+
+		if (ok) {
+			/* on failure, connect_2 closed it already */
+			if (!lws_client_connect_2(w))
+				lwsl_info("%s: %p failed to connect\n",
+					  __func__, w);
+			continue;
+		}
+
+		w->protocol->callback(w, LWS_CALLBACK_CLIENT_CONNECTION_ERROR,
+				      w->user_space, (void *)cce, strlen(cce));
+		w->already_did_cce = 1;
+		lws_close_free_wsi(w, LWS_CLOSE_STATUS_NOSTATUS, "async dns");
+	}
+
+	lws_free(q);
+}
+
+/* returns 0 if it was the answer, and the query and its wsi are gone */
+
+static int
+lws_adns_parse(struct lws *wsi, const uint8_t *pkt, int len)
+{
+	char qn[LWS_ADNS_NAME_MAX + 2], target[LWS_ADNS_NAME_MAX + 2],
+	     owner[LWS_ADNS_NAME_MAX + 2];
+	uint32_t ttl = 0xffffffff, t;
+	struct lws_adns_query *q = (struct lws_adns_query *)wsi->user_space;
+	int pos, p, n, an, pass, type, cls, rdl, found = 0, changed;
+	struct in_addr addr;
+
+	if (len < 12 || !(pkt[2] & 0x80) || ((pkt[4] << 8) | pkt[5]) != 1 ||
+	    ((pkt[0] << 8) | pkt[1]) != q->id)
+		return 1;
+
+	/* it must be an answer to the question we asked */
+
+	pos = lws_adns_name(pkt, len, 12, qn, sizeof(qn));
+	if (pos < 0 || pos + 4 > len || strcasecmp(qn, (const char *)&q[1]))
+		return 1;
+	pos += 4;
+
+	if (pkt[3] & 0xf) {
+		lwsl_info("%s: %s: rcode %d\n", __func__, qn, pkt[3] & 0xf);
+		goto done;
+	}
+
+	/* follow any CNAMEs to the A record, in whatever order they came */
+
+	an = (pkt[6] << 8) | pkt[7];
+	lws_strncpy(target, qn, sizeof(target));
+
+	for (pass = 0; pass < 8 && !found; pass++) {
+		changed = 0;
+		p = pos;
+		for (n = 0; n < an && !found; n++) {
+			p = lws_adns_name(pkt, len, p, owner, sizeof(owner));
+			if (p < 0 || p + 10 > len)
+				goto done;
+			type = (pkt[p] << 8) | pkt[p + 1];
+			cls = (pkt[p + 2] << 8) | pkt[p + 3];
+			t = ((uint32_t)pkt[p + 4] << 24) | (pkt[p + 5] << 16) |
+			    (pkt[p + 6] << 8) | pkt[p + 7];
+			rdl = (pkt[p + 8] << 8) | pkt[p + 9];
+			p += 10;
+			if (p + rdl > len)
+				goto done;
+
+			if (cls == 1 /* IN */ && !strcasecmp(owner, target)) {
+				if (type == 1 /* A */ && rdl == 4) {
+					memcpy(&addr, pkt + p, 4);
+					found = 1;
+				}
+				if (type == 5 /* CNAME */) {
+					if (lws_adns_name(pkt, len, p, target,
+							  sizeof(target)) < 0)
+						goto done;
+					changed = 1;
+				}
+				if (t < ttl)
+					ttl = t;
+			}
+			p += rdl;
+		}
+		if (!changed)
+			break;
+	}
+
+done:
+	if (found)
+		lws_adns_cache_add(wsi->context, qn, addr, ttl);
+	else
+		lwsl_notice("%s: no address for %s\n", __func__, qn);
+
+	lws_adns_complete(q, found);
+
+	return 0;
+}
+
+static int
+rops_handle_POLLIN_dns(struct lws_context_per_thread *pt, struct lws *wsi,
+		       struct lws_pollfd *pollfd)
+{
+	int n;
+
+	/*
+	 * There may be stale or bogus answers queued ahead of ours.  Errors
+	 * are things like an icmp unreachable from the server, we just leave
+	 * the query to retry.
+	 */
+
+	do {
+		n = recv(wsi->desc.sockfd, (char *)pt->serv_buf,
+			 wsi->context->pt_serv_buf_size, 0);
+		if (n > 0 && !lws_adns_parse(wsi, pt->serv_buf, n))
+			return LWS_HPI_RET_DIE;
+	} while (n > 0);
+
+	return LWS_HPI_RET_HANDLED;
+}
+
+static int
+rops_handle_POLLOUT_dns(struct lws *wsi)
+{
+	return LWS_HP_RET_BAIL_OK;
+}
+
+struct lws_role_ops role_ops_dns = {
+	"dns",
+	rops_handle_POLLIN_dns,
+	rops_handle_POLLOUT_dns,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+static int
+lws_adns_create_wsi(struct lws_context *context, int tsi,
+		    struct lws_adns_query *q)
+{
+	lws_sockfd_type fd;
+	struct lws *wsi;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (!lws_socket_is_valid(fd))
+		return 1;
+
+	/*
+	 * connected, so the kernel drops anything not from the server, and
+	 * gives us a random unused source port
+	 */
+
+	if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0 ||
+	    connect(fd, (struct sockaddr *)&context->adns_server,
+		    sizeof(context->adns_server)) < 0)
+		goto bail;
+
+	wsi = lws_zalloc(sizeof(*wsi), "adns wsi");
+	if (!wsi)
+		goto bail;
+
+	wsi->context = context;
+	lws_role_transition(wsi, LWSI_ROLE_DNS, LRS_ESTABLISHED, &role_ops_dns);
+	wsi->tsi = tsi;
+	wsi->desc.sockfd = fd;
+	wsi->user_space = q;
+	wsi->user_space_externally_allocated = 1;
+
+	lws_libuv_accept(wsi, wsi->desc);
+	lws_libev_accept(wsi, wsi->desc);
+	lws_libevent_accept(wsi, wsi->desc);
+
+	if (__insert_wsi_socket_into_fds(context, wsi)) {
+		lws_free(wsi);
+		goto bail;
+	}
+
+	lws_change_pollfd(wsi, 0, LWS_POLLIN);
+	context->count_wsi_allocated++;
+	q->wsi = wsi;
+
+	return 0;
+
+bail:
+	compatible_close(fd);
+
+	return 1;
+}
+
+int
+lws_async_dns_query(struct lws *wsi, const char *name, struct sockaddr_in *sin)
+{
+	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
+	struct lws_adns_query *q = NULL;
+	size_t len = strlen(name);
+	struct lws_dll_lws *d;
+
+	memset(sin, 0, sizeof(*sin));
+	sin->sin_family = AF_INET;
+
+	if (lws_plat_inet_pton(AF_INET, name, &sin->sin_addr) == 1)
+		return LADNS_RESOLVED;
+
+	if (!len || len > LWS_ADNS_NAME_MAX || strchr(name, ':'))
+		return LADNS_USE_GETADDRINFO;
+
+	if (!lws_adns_cache_lookup(wsi->context, name, &sin->sin_addr,
+				   lwsi_state(wsi) == LRS_WAITING_DNS))
+		return LADNS_RESOLVED;
+
+	if (!lws_adns_hosts(wsi->context, name, &sin->sin_addr))
+		return LADNS_RESOLVED;
+
+	if (!strcasecmp(name, "localhost")) {
+		sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		return LADNS_RESOLVED;
+	}
+
+	if (!strchr(name, '.'))
+		return LADNS_USE_GETADDRINFO;
+
+	/* is somebody already asking about it? */
+
+	for (d = pt->adns_queries.next; d && !q; d = d->next) {
+		q = lws_container_of(d, struct lws_adns_query, list);
+		if (strcasecmp((const char *)&q[1], name))
+			q = NULL;
+	}
+
+	if (!q) {
+		q = lws_zalloc(sizeof(*q) + len + 1, "adns query");
+		if (!q)
+			return LADNS_FAILED;
+		memcpy(&q[1], name, len + 1);
+		lws_get_random(wsi->context, &q->id, sizeof(q->id));
+
+		if (lws_adns_create_wsi(wsi->context, wsi->tsi, q)) {
+			lwsl_warn("%s: unable to create dns socket\n",
+				  __func__);
+			lws_free(q);
+			return LADNS_USE_GETADDRINFO;
+		}
+
+		if (lws_adns_send(q->wsi, q)) {
+			lws_adns_destroy_wsi(q->wsi);
+			lws_free(q);
+			return LADNS_FAILED;
+		}
+
+		lws_dll_lws_add_front(&q->list, &pt->adns_queries);
+	}
+
+	lws_dll_lws_add_front(&wsi->dll_adns_wait, &q->waiting);
+
+	return LADNS_WAITING;
+}
+
+/* the query wsi hrtimer: resend, or give up if it's had enough tries */
+
+void
+lws_async_dns_timer(struct lws *wsi)
+{
+	struct lws_adns_query *q = (struct lws_adns_query *)wsi->user_space;
+
+	if (q->tries < LWS_ADNS_TRIES) {
+		lws_adns_send(wsi, q);
+		return;
+	}
+
+	lwsl_notice("%s: no answer for %s\n", __func__, (const char *)&q[1]);
+	lws_adns_complete(q, 0);
+}
+
+/* context destroy found a query wsi... drop the query and its waiters */
+
+void
+lws_async_dns_destroy_wsi(struct lws *wsi)
+{
+	struct lws_adns_query *q = (struct lws_adns_query *)wsi->user_space;
+	struct lws *w;
+
+	lws_dll_lws_remove(&q->list);
+
+	while (q->waiting.next) {
+		w = lws_container_of(q->waiting.next, struct lws,
+				     dll_adns_wait);
+		lws_dll_lws_remove(&w->dll_adns_wait);
+		lws_close_free_wsi(w, LWS_CLOSE_STATUS_NOSTATUS_CONTEXT_DESTROY,
+				   "adns destroy");
+	}
+
+	lws_adns_destroy_wsi(wsi);
+	lws_free(q);
+}
+
+void
+lws_async_dns_destroy_cache(struct lws_context *context)
+{
+	int n;
+
+	lws_adns_hosts_free(context);
+
+	if (!context->adns_cache)
+		return;
+
+	for (n = 0; n < LWS_ADNS_CACHE_HASH; n++)
+		while (context->adns_cache[n])
+			lws_adns_cache_unlink(context, &context->adns_cache[n]);
+
+	lws_free_set_NULL(context->adns_cache);
+}
+
+int
+lws_async_dns_init(struct lws_context *context,
+		   struct lws_context_creation_info *info)
+{
+	struct sockaddr_in *sin = &context->adns_server;
+	char line[128], *p, *sp;
+	struct in_addr a;
+	FILE *f;
+
+	context->adns_cache_limit = info->async_dns_cache_limit ?
+				    info->async_dns_cache_limit : 256;
+
+	memset(sin, 0, sizeof(*sin));
+	sin->sin_family = AF_INET;
+	sin->sin_port = htons(53);
+	sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (info->async_dns_server) {
+		lws_strncpy(line, info->async_dns_server, sizeof(line));
+		p = strchr(line, ':');
+		if (p) {
+			*p++ = '\0';
+			sin->sin_port = htons(atoi(p));
+		}
+		if (lws_plat_inet_pton(AF_INET, line, &sin->sin_addr) != 1) {
+			lwsl_err("%s: bad async_dns_server %s\n", __func__,
+				 info->async_dns_server);
+			return 1;
+		}
+
+		return 0;
+	}
+
+	f = fopen("/etc/resolv.conf", "r");
+	if (!f)
+		return 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		p = strtok_r(line, " \t\r\n", &sp);
+		if (!p || strcmp(p, "nameserver"))
+			continue;
+		p = strtok_r(NULL, " \t\r\n", &sp);
+		if (p && lws_plat_inet_pton(AF_INET, p, &a) == 1) {
+			sin->sin_addr = a;
+			break;
+		}
+	}
+
+	fclose(f);
+
+	return 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * libwebsockets - output buffered on a connection until it can be sent
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation:
+ *  version 2.1 of the License.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA  02110-1301  USA
+ *
+ * A buflist is a chain of segments of output waiting to be sent.  Appending
+ * fills any room left in the last segment, and puts the rest in one new
+ * segment, so the remainder of a partial send is always in one piece (tls
+ * must be given at least what it was given last time, when retrying).
+ *
+ * Segments that fit in LWS_BUFLIST_SLAB come from a small pool of slabs the
+ * pt keeps, so connections that keep getting partial sends don't cost a
+ * malloc and free each time.  Anything bigger is allocated to fit.
+ *
+ * Everything here is only used from the pt's own service thread.
+ */
+
+#include "private-libwebsockets.h"
+
+static struct lws_buflist *
+lws_buflist_seg_alloc(struct lws_context_per_thread *pt, size_t len)
+{
+	struct lws_buflist *b;
+
+	if (len <= LWS_BUFLIST_SLAB && pt->buflist_pool) {
+		b = pt->buflist_pool;
+		pt->buflist_pool = b->next;
+		pt->buflist_pool_count--;
+	} else {
+		if (len < LWS_BUFLIST_SLAB)
+			len = LWS_BUFLIST_SLAB;
+		b = lws_malloc(sizeof(*b) + len, "buflist");
+		if (!b)
+			return NULL;
+		b->size = len;
+	}
+
+	b->next = NULL;
+	b->len = 0;
+	b->pos = 0;
+
+	return b;
+}
+
+static void
+lws_buflist_seg_free(struct lws_context_per_thread *pt, struct lws_buflist *b)
+{
+	if (b->size == LWS_BUFLIST_SLAB &&
+	    pt->buflist_pool_count < LWS_BUFLIST_POOL_MAX) {
+		b->next = pt->buflist_pool;
+		pt->buflist_pool = b;
+		pt->buflist_pool_count++;
+
+		return;
+	}
+
+	lws_free(b);
+}
+
+int
+lws_buflist_append(struct lws_context_per_thread *pt,
+		   struct lws_buflist **head, const uint8_t *buf, size_t len)
+{
+	struct lws_buflist **pb = head, *b = NULL;
+	size_t n;
+
+	while (*pb) {
+		b = *pb;
+		pb = &b->next;
+	}
+
+	if (b && b->size > b->len) {
+		n = b->size - b->len;
+		if (n > len)
+			n = len;
+		memcpy(lws_buflist_data(b) + b->len, buf, n);
+		b->len += n;
+		buf += n;
+		len -= n;
+	}
+
+	if (!len)
+		return 0;
+
+	b = lws_buflist_seg_alloc(pt, len);
+	if (!b)
+		return 1;
+
+	memcpy(lws_buflist_data(b), buf, len);
+	b->len = len;
+	*pb = b;
+
+	return 0;
+}
+
+void
+lws_buflist_use(struct lws_context_per_thread *pt, struct lws_buflist **head,
+		size_t len)
+{
+	struct lws_buflist *b;
+	size_t n;
+
+	while (len && *head) {
+		b = *head;
+		n = b->len - b->pos;
+		if (n > len) {
+			b->pos += len;
+			return;
+		}
+
+		len -= n;
+		*head = b->next;
+		lws_buflist_seg_free(pt, b);
+	}
+}
+
+void
+lws_buflist_destroy_all(struct lws_context_per_thread *pt,
+			struct lws_buflist **head)
+{
+	struct lws_buflist *b;
+
+	while (*head) {
+		b = *head;
+		*head = b->next;
+		lws_buflist_seg_free(pt, b);
+	}
+}
+
+void
+lws_buflist_pool_destroy(struct lws_context_per_thread *pt)
+{
+	struct lws_buflist *b;
+
+	while (pt->buflist_pool) {
+		b = pt->buflist_pool;
+		pt->buflist_pool = b->next;
+		lws_free(b);
+	}
+	pt->buflist_pool_count = 0;
+}
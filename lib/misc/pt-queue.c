@@ -0,0 +1,261 @@
+/*
+ * libwebsockets - messages posted to a service thread from other threads
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation:
+ *  version 2.1 of the License.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA  02110-1301  USA
+ *
+ * Each pt has a bounded queue any thread can add messages to without
+ * taking a lock, see struct lws_pt_queue.  The pt is woken through its
+ * event pipe, which it drains from rops_handle_POLLIN_pipe().
+ *
+ * A burst of posts only writes to the event pipe once: the first post sets
+ * q->signalled, and the pt clears it before it starts taking messages, so
+ * any post it might miss after that signals again.
+ */
+
+#include "private-libwebsockets.h"
+
+#define LWS_PT_QUEUE_DEF_DEPTH 1024
+#define LWS_PT_QUEUE_MAX_DEPTH (1 << 24)
+
+int
+lws_pt_queue_init(struct lws_context_per_thread *pt, unsigned int depth)
+{
+	struct lws_pt_queue *q = &pt->q;
+	size_t n, size = 1;
+
+	if (!depth)
+		depth = LWS_PT_QUEUE_DEF_DEPTH;
+	while (size < depth && size < LWS_PT_QUEUE_MAX_DEPTH)
+		size <<= 1;
+
+	q->msg = lws_zalloc(size * sizeof(*q->msg), "pt queue");
+	if (!q->msg)
+		return 1;
+
+	q->mask = size - 1;
+	q->enq = q->deq = 0;
+	q->signalled = q->cancelled = 0;
+	for (n = 0; n < size; n++)
+		q->msg[n].seq = n;
+
+	return 0;
+}
+
+void
+lws_pt_queue_signal(struct lws_context_per_thread *pt, int cancel)
+{
+	struct lws_pt_queue *q = &pt->q;
+
+	if (cancel)
+		__atomic_store_n(&q->cancelled, 1, __ATOMIC_RELAXED);
+
+	/* our message or cancel must be visible before we look at signalled */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (!__atomic_exchange_n(&q->signalled, 1, __ATOMIC_SEQ_CST) &&
+	    pt->pipe_wsi)
+		lws_plat_pipe_signal(pt->pipe_wsi);
+}
+
+static int
+lws_pt_queue_post(struct lws_context_per_thread *pt, struct lws *wsi,
+		  struct lws_vhost *vh, const struct lws_protocols *prot,
+		  void *payload, size_t len)
+{
+	struct lws_pt_queue *q = &pt->q;
+	struct lws_pt_msg *m;
+	size_t pos, seq;
+
+	if (!q->msg)
+		return 1;
+
+	pos = __atomic_load_n(&q->enq, __ATOMIC_RELAXED);
+	for (;;) {
+		m = &q->msg[pos & q->mask];
+		seq = __atomic_load_n(&m->seq, __ATOMIC_ACQUIRE);
+
+		if (seq == pos) {
+			/* free for pos... try to claim it */
+			if (__atomic_compare_exchange_n(&q->enq, &pos, pos + 1,
+							1, __ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+			/* another producer got there first, pos is updated */
+			continue;
+		}
+
+		if ((ssize_t)(seq - pos) < 0)
+			/* still holding the message from a lap ago: full */
+			return 1;
+
+		/* another producer claimed pos already */
+		pos = __atomic_load_n(&q->enq, __ATOMIC_RELAXED);
+	}
+
+	m->wsi = wsi;
+	m->vh = vh;
+	m->prot = prot;
+	m->payload = payload;
+	m->len = len;
+	__atomic_store_n(&m->seq, pos + 1, __ATOMIC_RELEASE);
+
+	lws_pt_queue_signal(pt, 0);
+
+	return 0;
+}
+
+LWS_VISIBLE int
+lws_pt_post(struct lws *wsi, void *payload, size_t len)
+{
+	return lws_pt_queue_post(&wsi->context->pt[(int)wsi->tsi], wsi, NULL,
+				 NULL, payload, len);
+}
+
+LWS_VISIBLE int
+lws_pt_post_vhost_protocol(struct lws_vhost *vh,
+			   const struct lws_protocols *prot, int tsi,
+			   void *payload, size_t len)
+{
+	if (tsi < 0 || tsi >= vh->context->count_threads)
+		return 1;
+
+	return lws_pt_queue_post(&vh->context->pt[tsi], NULL, vh, prot,
+				 payload, len);
+}
+
+void
+lws_pt_queue_forget_wsi(struct lws_context_per_thread *pt, struct lws *wsi)
+{
+	struct lws_pt_queue *q = &pt->q;
+	struct lws_pt_msg *m;
+	size_t pos, enq;
+
+	if (!q->msg)
+		return;
+
+	/*
+	 * Anything posted to wsi is published by now, so messages we can't
+	 * take yet are for someone else.
+	 */
+	enq = __atomic_load_n(&q->enq, __ATOMIC_ACQUIRE);
+	for (pos = q->deq; pos != enq; pos++) {
+		m = &q->msg[pos & q->mask];
+		if (__atomic_load_n(&m->seq, __ATOMIC_ACQUIRE) != pos + 1 ||
+		    m->wsi != wsi)
+			continue;
+
+		m->wsi = NULL;
+		m->vh = wsi->vhost;
+		m->prot = wsi->protocol;
+		if (!m->prot && wsi->vhost)
+			m->prot = &wsi->vhost->protocols[0];
+	}
+}
+
+/* take up to max messages, return how many */
+
+static size_t
+lws_pt_queue_drain(struct lws_context_per_thread *pt, size_t max)
+{
+	struct lws_pt_queue *q = &pt->q;
+	struct lws_pt_msg *m, msg;
+	struct lws fake;
+	size_t n = 0;
+	char fake_init = 0;
+
+	while (n < max) {
+		m = &q->msg[q->deq & q->mask];
+		if (__atomic_load_n(&m->seq, __ATOMIC_ACQUIRE) != q->deq + 1)
+			break;
+
+		/* take a copy and give the cell back before the callback */
+		msg = *m;
+		__atomic_store_n(&m->seq, q->deq + q->mask + 1,
+				 __ATOMIC_RELEASE);
+		q->deq++;
+		n++;
+
+		if (msg.wsi) {
+			if (msg.wsi->protocol &&
+			    msg.wsi->protocol->callback(msg.wsi,
+					LWS_CALLBACK_PT_MESSAGE,
+					msg.wsi->user_space, msg.payload,
+					msg.len))
+				lws_close_free_wsi(msg.wsi,
+						   LWS_CLOSE_STATUS_NOSTATUS,
+						   "pt message");
+			continue;
+		}
+
+		if (!msg.vh || !msg.prot || !msg.prot->callback) {
+			lwsl_err("%s: dropping message with no vhost-protocol\n",
+				 __func__);
+			continue;
+		}
+
+		if (!fake_init) {
+			memset(&fake, 0, sizeof(fake));
+			fake.tsi = pt->tid;
+			fake_init = 1;
+		}
+		fake.context = msg.vh->context;
+		fake.vhost = msg.vh;
+		fake.protocol = msg.prot;
+
+		msg.prot->callback(&fake, LWS_CALLBACK_PT_MESSAGE, NULL,
+				   msg.payload, msg.len);
+	}
+
+	return n;
+}
+
+int
+lws_pt_queue_service(struct lws_context_per_thread *pt)
+{
+	struct lws_pt_queue *q = &pt->q;
+
+	if (!q->msg)
+		return 1;
+
+	/* from here, a new post wakes us again */
+	__atomic_store_n(&q->signalled, 0, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	/*
+	 * Don't let producers keep us here forever... if we took a whole
+	 * queue's worth, come back after the other fds had their turn.
+	 */
+	if (lws_pt_queue_drain(pt, q->mask + 1) == q->mask + 1)
+		lws_pt_queue_signal(pt, 0);
+
+	return __atomic_exchange_n(&q->cancelled, 0, __ATOMIC_SEQ_CST);
+}
+
+void
+lws_pt_queue_destroy(struct lws_context_per_thread *pt)
+{
+	struct lws_pt_queue *q = &pt->q;
+
+	if (!q->msg)
+		return;
+
+	/* the connections are closed, so these go to the vhost-protocols */
+	lws_pt_queue_drain(pt, (size_t)-1);
+
+	lws_free_set_NULL(q->msg);
+}
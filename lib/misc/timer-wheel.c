@@ -0,0 +1,221 @@
+/*
+ * libwebsockets - hierarchical timer wheel
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation:
+ *  version 2.1 of the License.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA  02110-1301  USA
+ *
+ * Each pt has one of these for wsi timeouts, ticking in seconds, and one
+ * for hrtimers, ticking in us, both on the monotonic clock.
+ *
+ * A timer lives on level L of the wheel when the highest LWS_TW_BITS-bit
+ * digit in which its expiry differs from tw->now is digit L, in the slot
+ * given by its digit L.  So level 0 holds timers due in the current turn of
+ * level 0, and so on up.  When tw->now reaches the start of a slot on a
+ * higher level, its timers are added again and fall to a lower level.
+ * Timers too far out for the top level wait on tw->overflow, which is looked
+ * at each time the top level turns.
+ *
+ * A bitmap per level of the slots in use lets lws_tw_advance() jump
+ * straight between the ticks where there is something to do, and lets
+ * lws_tw_next() say when that is.
+ */
+
+#include "private-libwebsockets.h"
+
+#define LWS_TW_MASK ((uint64_t)LWS_TW_SLOTS - 1)
+#define LWS_TW_SPAN_BITS (LWS_TW_LEVELS * LWS_TW_BITS)
+
+static int
+lws_tw_lowest_bit(uint64_t v)
+{
+#if defined(__GNUC__)
+	return __builtin_ctzll(v);
+#else
+	int n = 0;
+
+	while (!(v & 1)) {
+		v >>= 1;
+		n++;
+	}
+
+	return n;
+#endif
+}
+
+void
+lws_tw_init(struct lws_timer_wheel *tw, uint64_t now)
+{
+	memset(tw, 0, sizeof(*tw));
+	tw->now = now;
+}
+
+static void
+lws_tw_unlink(struct lws_timer_wheel *tw, struct lws_tw_timer *t)
+{
+	int level = t->where / LWS_TW_SLOTS, slot = t->where % LWS_TW_SLOTS;
+
+	lws_dll_lws_remove(&t->list);
+
+	if (t->where == LWS_TW_DETACHED)
+		/* expired and waiting on the caller's list */
+		return;
+
+	tw->count--;
+
+	if (t->where != LWS_TW_OVERFLOW && !tw->slot[level][slot].next)
+		tw->occupied[level] &= ~((uint64_t)1 << slot);
+}
+
+void
+lws_tw_remove(struct lws_timer_wheel *tw, struct lws_tw_timer *t)
+{
+	if (t->list.prev)
+		lws_tw_unlink(tw, t);
+}
+
+void
+lws_tw_add(struct lws_timer_wheel *tw, struct lws_tw_timer *t, uint64_t at)
+{
+	struct lws_dll_lws *head = &tw->overflow;
+	uint64_t x;
+	int level = 0, slot;
+
+	if (t->list.prev)
+		lws_tw_unlink(tw, t);
+
+	if (at < tw->now)
+		at = tw->now;
+	t->at = at;
+
+	x = at ^ tw->now;
+	while (x > LWS_TW_MASK) {
+		x >>= LWS_TW_BITS;
+		level++;
+	}
+
+	if (level >= LWS_TW_LEVELS)
+		t->where = LWS_TW_OVERFLOW;
+	else {
+		slot = (int)((at >> (level * LWS_TW_BITS)) & LWS_TW_MASK);
+		head = &tw->slot[level][slot];
+		tw->occupied[level] |= (uint64_t)1 << slot;
+		t->where = (uint16_t)((level * LWS_TW_SLOTS) + slot);
+	}
+
+	lws_dll_lws_add_front(&t->list, head);
+	tw->count++;
+}
+
+uint64_t
+lws_tw_next(struct lws_timer_wheel *tw)
+{
+	uint64_t next = LWS_TW_NONE, t, m;
+	int level, shift;
+
+	for (level = 0; level < LWS_TW_LEVELS; level++) {
+		shift = level * LWS_TW_BITS;
+		m = tw->occupied[level] &
+		    (~(uint64_t)0 << ((tw->now >> shift) & LWS_TW_MASK));
+		if (!m)
+			continue;
+
+		/* the start of the first slot in use from here on */
+
+		t = (tw->now & ~((LWS_TW_MASK << shift) | (((uint64_t)1 << shift) - 1))) |
+		    ((uint64_t)lws_tw_lowest_bit(m) << shift);
+		if (t < tw->now)
+			/* we are already inside it */
+			t = tw->now;
+		if (t < next)
+			next = t;
+	}
+
+	if (tw->overflow.next) {
+		m = ((uint64_t)1 << LWS_TW_SPAN_BITS) - 1;
+		t = tw->now & m ? (tw->now | m) + 1 : tw->now;
+		if (t < next)
+			next = t;
+	}
+
+	return next;
+}
+
+static void
+lws_tw_cascade(struct lws_timer_wheel *tw, struct lws_dll_lws *head)
+{
+	struct lws_tw_timer *t;
+
+	while (head->next) {
+		t = lws_container_of(head->next, struct lws_tw_timer, list);
+		lws_dll_lws_remove(&t->list);
+		tw->count--;
+		lws_tw_add(tw, t, t->at);
+	}
+}
+
+void
+lws_tw_advance(struct lws_timer_wheel *tw, uint64_t to,
+	       struct lws_dll_lws *expired)
+{
+	struct lws_dll_lws *head;
+	struct lws_tw_timer *t;
+	uint64_t next;
+	int level, slot;
+
+	while (tw->count) {
+		next = lws_tw_next(tw);
+		if (next > to)
+			break;
+
+		tw->now = next;
+
+		/* from the top down, slots we have reached fall a level */
+
+		if (tw->overflow.next &&
+		    !(next & (((uint64_t)1 << LWS_TW_SPAN_BITS) - 1)))
+			lws_tw_cascade(tw, &tw->overflow);
+
+		for (level = LWS_TW_LEVELS - 1; level > 0; level--) {
+			slot = (int)((next >> (level * LWS_TW_BITS)) &
+				     LWS_TW_MASK);
+			if (!(tw->occupied[level] & ((uint64_t)1 << slot)))
+				continue;
+
+			tw->occupied[level] &= ~((uint64_t)1 << slot);
+			lws_tw_cascade(tw, &tw->slot[level][slot]);
+		}
+
+		/* whatever is on level 0 for this tick has expired */
+
+		slot = (int)(next & LWS_TW_MASK);
+		head = &tw->slot[0][slot];
+		tw->occupied[0] &= ~((uint64_t)1 << slot);
+		while (head->next) {
+			t = lws_container_of(head->next, struct lws_tw_timer,
+					     list);
+			lws_dll_lws_remove(&t->list);
+			tw->count--;
+			t->where = LWS_TW_DETACHED;
+			lws_dll_lws_add_front(&t->list, expired);
+		}
+
+		tw->now = next + 1;
+	}
+
+	if (tw->now <= to)
+		tw->now = to + 1;
+}
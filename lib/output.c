@@ -22,85 +22,54 @@
 #include "private-libwebsockets.h"
 
 /*
- * notice this returns number of bytes consumed, or -1
+ * the most we will try to send in one go on wsi, see .tx_packet_size
  */
-int lws_issue_raw(struct lws *wsi, unsigned char *buf, size_t len)
+static size_t
+lws_send_limit(struct lws *wsi)
 {
-	struct lws_context *context = lws_get_context(wsi);
-	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
-	size_t real_len = len;
-	unsigned int n;
-#if !defined(LWS_WITHOUT_EXTENSIONS)
-	int m;
-#endif
+	size_t n;
 
-	// lwsl_hexdump_notice(buf, len);
-
-	/*
-	 * Detect if we got called twice without going through the
-	 * event loop to handle pending.  This would be caused by either
-	 * back-to-back writes in one WRITABLE (illegal) or calling lws_write()
-	 * from outside the WRITABLE callback (illegal).
-	 */
-	if (wsi->could_have_pending) {
-		lwsl_hexdump_level(LLL_ERR, buf, len);
-		lwsl_err("** %p: vh: %s, prot: %s, "
-			 "Illegal back-to-back write of %lu detected...\n",
-			 wsi, wsi->vhost->name, wsi->protocol->name,
-			 (unsigned long)len);
-		// assert(0);
-
-		return -1;
+	if (wsi->protocol->tx_packet_size)
+		n = wsi->protocol->tx_packet_size;
+	else {
+		n = wsi->protocol->rx_buffer_size;
+		if (!n)
+			n = wsi->context->pt_serv_buf_size;
 	}
 
-	lws_stats_atomic_bump(wsi->context, pt, LWSSTATS_C_API_WRITE, 1);
-
-	if (!len)
-		return 0;
-	/* just ignore sends after we cleared the truncation buffer */
-	if (lwsi_state(wsi) == LRS_FLUSHING_BEFORE_CLOSE && !wsi->trunc_len)
-		return (int)len;
-
-	if (wsi->trunc_len && (buf < wsi->trunc_alloc ||
-	    buf > (wsi->trunc_alloc + wsi->trunc_len + wsi->trunc_offset))) {
-		lwsl_hexdump_level(LLL_ERR, buf, len);
-		lwsl_err("** %p: vh: %s, prot: %s, Sending new %lu, pending truncated ...\n"
-			 "   It's illegal to do an lws_write outside of\n"
-			 "   the writable callback: fix your code\n",
-			 wsi, wsi->vhost->name, wsi->protocol->name,
-			 (unsigned long)len);
-		assert(0);
+	return n + LWS_PRE + 4;
+}
 
-		return -1;
-	}
+/*
+ * send what we can of buf on the connection right now, returns how much
+ * that was, or -1 for a fatal error
+ */
+static int
+lws_issue_raw_send(struct lws *wsi, unsigned char *buf, size_t len)
+{
+	struct lws_context *context = lws_get_context(wsi);
+	int n;
 #if !defined(LWS_WITHOUT_EXTENSIONS)
+	int m;
+
 	m = lws_ext_cb_active(wsi, LWS_EXT_CB_PACKET_TX_DO_SEND, &buf, (int)len);
 	if (m < 0)
 		return -1;
-	if (m) /* handled */ {
-		n = m;
-		goto handle_truncated_send;
-	}
+	if (m) /* handled */
+		return m;
 #endif
 	if (!wsi->http2_substream && !lws_socket_is_valid(wsi->desc.sockfd))
 		lwsl_warn("** error invalid sock but expected to send\n");
 
 	/* limit sending */
-	if (wsi->protocol->tx_packet_size)
-		n = (int)wsi->protocol->tx_packet_size;
-	else {
-		n = (int)wsi->protocol->rx_buffer_size;
-		if (!n)
-			n = context->pt_serv_buf_size;
-	}
-	n += LWS_PRE + 4;
-	if (n > len)
+	n = (int)lws_send_limit(wsi);
+	if ((size_t)n > len)
 		n = (int)len;
 
 	/* nope, send it on the socket directly */
 	lws_latency_pre(context, wsi);
 	n = lws_ssl_capable_write(wsi, buf, n);
-	lws_latency(context, wsi, "send lws_issue_raw", n, n == len);
+	lws_latency(context, wsi, "send lws_issue_raw", n, (size_t)n == len);
 
 	/* something got written, it can have been truncated now */
 	wsi->could_have_pending = 1;
@@ -119,32 +88,89 @@ int lws_issue_raw(struct lws *wsi, unsigned char *buf, size_t len)
 		n = 0;
 		break;
 	}
-#if !defined(LWS_WITHOUT_EXTENSIONS)
-handle_truncated_send:
-#endif
+
+	return n;
+}
+
+/*
+ * notice this returns number of bytes consumed, or -1
+ */
+int lws_issue_raw(struct lws *wsi, unsigned char *buf, size_t len)
+{
+	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
+	size_t real_len = len;
+	int n;
+
+	// lwsl_hexdump_notice(buf, len);
+
 	/*
-	 * we were already handling a truncated send?
+	 * Detect if we got called twice without going through the
+	 * event loop to handle pending.  This would be caused by either
+	 * back-to-back writes in one WRITABLE (illegal) or calling lws_write()
+	 * from outside the WRITABLE callback (illegal).
 	 */
-	if (wsi->trunc_len) {
-		lwsl_info("%p partial adv %d (vs %ld)\n", wsi, n, (long)real_len);
-		wsi->trunc_offset += n;
-		wsi->trunc_len -= n;
-
-		if (!wsi->trunc_len) {
-			lwsl_info("** %p partial send completed\n", wsi);
-			/* done with it, but don't free it */
-			n = (int)real_len;
-			if (lwsi_state(wsi) == LRS_FLUSHING_BEFORE_CLOSE) {
-				lwsl_info("** %p signalling to close now\n", wsi);
-				return -1; /* retry closing now */
-			}
+	if (wsi->could_have_pending) {
+		lwsl_hexdump_level(LLL_ERR, buf, len);
+		lwsl_err("** %p: vh: %s, prot: %s, "
+			 "Illegal back-to-back write of %lu detected...\n",
+			 wsi, wsi->vhost->name, wsi->protocol->name,
+			 (unsigned long)len);
+		// assert(0);
+
+		return -1;
+	}
+
+	lws_stats_atomic_bump(wsi->context, pt, LWSSTATS_C_API_WRITE, 1);
+
+	if (!len)
+		return 0;
+	/* just ignore sends after we cleared the truncation buffer */
+	if (lwsi_state(wsi) == LRS_FLUSHING_BEFORE_CLOSE &&
+	    !lws_has_buffered_out(wsi))
+		return (int)len;
+
+	if (lws_has_buffered_out(wsi)) {
+		/*
+		 * Something is still waiting to go out.  While less than
+		 * context->buffered_out_limit is waiting, we can queue more
+		 * behind it (lws_send_pipe_choked() said it was OK), past
+		 * that it's the user's mistake.
+		 */
+		if (lws_wsi_is_udp(wsi) ||
+		    wsi->buflist_out_len >= wsi->context->buffered_out_limit) {
+			lwsl_hexdump_level(LLL_ERR, buf, len);
+			lwsl_err("** %p: vh: %s, prot: %s, Sending new %lu, pending truncated ...\n"
+				 "   It's illegal to do an lws_write outside of\n"
+				 "   the writable callback: fix your code\n",
+				 wsi, wsi->vhost->name, wsi->protocol->name,
+				 (unsigned long)len);
+			assert(0);
+
+			return -1;
 		}
-		/* always callback on writeable */
-		lws_callback_on_writable(wsi);
 
-		return n;
+		if (lws_buflist_append(pt, &wsi->buflist_out, buf, len)) {
+			lwsl_err("queued send: unable to buffer %lu\n",
+				 (unsigned long)len);
+			return -1;
+		}
+		wsi->buflist_out_len += (unsigned int)len;
+		wsi->could_have_pending = 1;
+
+		lws_stats_atomic_bump(wsi->context, pt,
+				      LWSSTATS_C_WRITE_QUEUED, 1);
+		lws_stats_atomic_bump(wsi->context, pt,
+				      LWSSTATS_B_WRITE_QUEUED, len);
+		lws_stats_atomic_bump(wsi->context, pt,
+				      LWSSTATS_B_BUFFERED_OUT, len);
+
+		return (int)len;
 	}
 
+	n = lws_issue_raw_send(wsi, buf, len);
+	if (n < 0)
+		return -1;
+
 	if ((unsigned int)n == real_len)
 		/* what we just sent went out cleanly */
 		return n;
@@ -159,26 +185,14 @@ handle_truncated_send:
 	lws_stats_atomic_bump(wsi->context, pt, LWSSTATS_C_WRITE_PARTIALS, 1);
 	lws_stats_atomic_bump(wsi->context, pt, LWSSTATS_B_PARTIALS_ACCEPTED_PARTS, n);
 
-	/*
-	 *  - if we still have a suitable malloc lying around, use it
-	 *  - or, if too small, reallocate it
-	 *  - or, if no buffer, create it
-	 */
-	if (!wsi->trunc_alloc || real_len - n > wsi->trunc_alloc_len) {
-		lws_free(wsi->trunc_alloc);
-
-		wsi->trunc_alloc_len = (unsigned int)(real_len - n);
-		wsi->trunc_alloc = lws_malloc(real_len - n,
-					      "truncated send alloc");
-		if (!wsi->trunc_alloc) {
-			lwsl_err("truncated send: unable to malloc %lu\n",
-				 (unsigned long)(real_len - n));
-			return -1;
-		}
+	if (lws_buflist_append(pt, &wsi->buflist_out, buf + n, real_len - n)) {
+		lwsl_err("truncated send: unable to buffer %lu\n",
+			 (unsigned long)(real_len - n));
+		return -1;
 	}
-	wsi->trunc_offset = 0;
-	wsi->trunc_len = (unsigned int)(real_len - n);
-	memcpy(wsi->trunc_alloc, buf + n, real_len - n);
+	wsi->buflist_out_len = (unsigned int)(real_len - n);
+	lws_stats_atomic_bump(wsi->context, pt, LWSSTATS_B_BUFFERED_OUT,
+			      real_len - n);
 
 	if (lws_wsi_is_udp(wsi)) {
 		/* stash original destination for fulfilling UDP partials */
@@ -192,6 +206,142 @@ handle_truncated_send:
 	return (int)real_len;
 }
 
+#if LWS_POSIX && !defined(_WIN32) && !defined(LWS_WITH_ESP32) && \
+    !defined(LWS_PLAT_OPTEE)
+#define LWS_BUFLIST_IOV 16
+
+/*
+ * send what we can of the count pieces in iov on a plain tcp connection in
+ * one syscall.  Returns how much was sent, or -1 for a fatal error.
+ *
+ * The default limit from .rx_buffer_size is about tls records and doesn't
+ * apply here, but if the protocol set .tx_packet_size we stick to it.
+ */
+static int
+lws_issue_raw_sendmsg(struct lws *wsi, struct iovec *iov, int count)
+{
+	size_t limit = lws_send_limit(wsi), t = 0;
+	struct msghdr mh;
+	int n;
+
+	for (n = 0; n < count && wsi->protocol->tx_packet_size; n++) {
+		if (t + iov[n].iov_len >= limit) {
+			iov[n].iov_len = limit - t;
+			count = n + 1;
+			break;
+		}
+		t += iov[n].iov_len;
+	}
+
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_iov = iov;
+	mh.msg_iovlen = count;
+
+	n = sendmsg(wsi->desc.sockfd, &mh, MSG_NOSIGNAL);
+	wsi->could_have_pending = 1;
+	if (n >= 0)
+		return n;
+
+	if (LWS_ERRNO == LWS_EAGAIN || LWS_ERRNO == LWS_EWOULDBLOCK ||
+	    LWS_ERRNO == LWS_EINTR)
+		return 0;
+
+	wsi->socket_is_permanently_unusable = 1;
+
+	return -1;
+}
+
+/*
+ * A plain tcp connection can take everything buffered in one syscall,
+ * anything with tls or an extension doing the sending goes a segment at a
+ * time through lws_issue_raw_send()
+ */
+static int
+lws_flush_buffered_out_vectored(struct lws *wsi)
+{
+	struct iovec iov[LWS_BUFLIST_IOV];
+	struct lws_buflist *b = wsi->buflist_out;
+	int n = 0;
+
+	while (b && n < (int)LWS_ARRAY_SIZE(iov)) {
+		iov[n].iov_base = lws_buflist_data(b) + b->pos;
+		iov[n].iov_len = b->len - b->pos;
+		b = b->next;
+		n++;
+	}
+
+	return lws_issue_raw_sendmsg(wsi, iov, n);
+}
+#endif
+
+/*
+ * Try to send what is buffered on wsi.  Returns -1 if the connection should
+ * be closed now, either because of an error or because we were only waiting
+ * for it to drain before closing.
+ */
+int
+lws_flush_buffered_out(struct lws *wsi)
+{
+	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
+	struct lws_buflist *b = wsi->buflist_out;
+	int n;
+
+	if (!b)
+		return 0;
+
+#if LWS_POSIX && !defined(_WIN32) && !defined(LWS_WITH_ESP32) && \
+    !defined(LWS_PLAT_OPTEE)
+	if (!lws_wsi_is_udp(wsi) && !wsi->http2_substream &&
+#if defined(LWS_WITH_TLS)
+	    !wsi->ssl &&
+#endif
+#if !defined(LWS_WITHOUT_EXTENSIONS)
+	    !wsi->count_act_ext &&
+#endif
+	    b->next)
+		n = lws_flush_buffered_out_vectored(wsi);
+	else
+#endif
+		n = lws_issue_raw_send(wsi, lws_buflist_data(b) + b->pos,
+				       b->len - b->pos);
+	if (n < 0)
+		return -1;
+
+	lwsl_info("%p partial adv %d (vs %u)\n", wsi, n, wsi->buflist_out_len);
+	lws_buflist_use(pt, &wsi->buflist_out, n);
+	wsi->buflist_out_len -= n;
+	lws_stats_atomic_bump(wsi->context, pt, LWSSTATS_B_BUFFERED_OUT,
+			      -(uint64_t)n);
+
+	if (!wsi->buflist_out) {
+		lwsl_info("** %p partial send completed\n", wsi);
+		if (lwsi_state(wsi) == LRS_FLUSHING_BEFORE_CLOSE) {
+			lwsl_info("** %p signalling to close now\n", wsi);
+			return -1; /* retry closing now */
+		}
+
+		return 0;
+	}
+
+	lws_callback_on_writable(wsi);
+
+	return 0;
+}
+
+void
+lws_drop_buffered_out(struct lws *wsi)
+{
+	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
+
+	if (!wsi->buflist_out)
+		return;
+
+	lws_stats_atomic_bump(wsi->context, pt, LWSSTATS_B_BUFFERED_OUT,
+			      -(uint64_t)wsi->buflist_out_len);
+	lws_buflist_destroy_all(pt, &wsi->buflist_out);
+	wsi->buflist_out_len = 0;
+}
+
 LWS_VISIBLE int lws_write(struct lws *wsi, unsigned char *buf, size_t len,
 			  enum lws_write_protocol wp)
 {
@@ -231,11 +381,202 @@ LWS_VISIBLE int lws_write(struct lws *wsi, unsigned char *buf, size_t len,
 		wsi->vhost->conn_stats.tx += len;
 
 	assert(wsi->pops);
-	assert(wsi->pops->write_role_protocol);
+
+	/* roles like raw have no framing of their own */
+	if (!wsi->pops->write_role_protocol)
+		return lws_issue_raw(wsi, buf, len);
 
 	return wsi->pops->write_role_protocol(wsi, buf, len, &wp);
 }
 
+#if LWS_POSIX && !defined(_WIN32) && !defined(LWS_WITH_ESP32) && \
+    !defined(LWS_PLAT_OPTEE)
+/*
+ * On a plain tcp connection with nothing already waiting to go out, the
+ * role's framing and the user's pieces go out together in one syscall,
+ * whatever isn't taken is buffered like any other partial.
+ *
+ * Returns LWS_WRITE_IOV_COPY if the role can't frame the payload without
+ * having it in one writable buffer.
+ */
+#define LWS_WRITE_IOV_COPY -2
+
+static int
+lws_write_iov_gathered(struct lws *wsi, const struct lws_iovec *iov, int count,
+		       size_t len, enum lws_write_protocol wp)
+{
+	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
+	struct iovec v[LWS_WRITE_IOV_MAX + 1];
+	unsigned char hdr[LWS_PRE];
+	size_t sent, skip;
+	int n, m, hl = 0;
+
+	if (wsi->parent_carries_io || lws_wsi_is_udp(wsi) ||
+	    wsi->http2_substream || wsi->could_have_pending ||
+	    lws_has_buffered_out(wsi) || lwsi_state(wsi) ==
+						LRS_FLUSHING_BEFORE_CLOSE ||
+#if defined(LWS_WITH_TLS)
+	    wsi->ssl ||
+#endif
+#if !defined(LWS_WITHOUT_EXTENSIONS)
+	    wsi->count_act_ext ||
+#endif
+	    !lws_socket_is_valid(wsi->desc.sockfd))
+		return LWS_WRITE_IOV_COPY;
+
+	assert(wsi->pops);
+
+	if (wsi->pops->write_role_protocol_iov) {
+		hl = wsi->pops->write_role_protocol_iov(wsi, hdr, len, &wp);
+		if (hl < 0)
+			return LWS_WRITE_IOV_COPY;
+	} else
+		if (wsi->pops->write_role_protocol)
+			/* the role has framing, but can't do it like this */
+			return LWS_WRITE_IOV_COPY;
+
+	lws_stats_atomic_bump(wsi->context, pt, LWSSTATS_C_API_LWS_WRITE, 1);
+	lws_stats_atomic_bump(wsi->context, pt, LWSSTATS_B_WRITE, len);
+	lws_stats_atomic_bump(wsi->context, pt, LWSSTATS_C_API_WRITE, 1);
+#ifdef LWS_WITH_ACCESS_LOG
+	wsi->access_log.sent += len;
+#endif
+	if (wsi->vhost)
+		wsi->vhost->conn_stats.tx += len;
+
+	if (!len && !hl)
+		return 0;
+
+	m = 0;
+	if (hl) {
+		v[m].iov_base = &hdr[sizeof(hdr) - hl];
+		v[m++].iov_len = hl;
+	}
+	for (n = 0; n < count; n++)
+		if (iov[n].len) {
+			v[m].iov_base = (void *)iov[n].base;
+			v[m++].iov_len = iov[n].len;
+		}
+
+	n = lws_issue_raw_sendmsg(wsi, v, m);
+	if (n < 0)
+		return -1;
+
+	if ((size_t)n == len + hl)
+		return (int)len;
+
+	/*
+	 * Newly truncated send, buffer whatever of the header and each piece
+	 * didn't go
+	 */
+	lws_stats_atomic_bump(wsi->context, pt, LWSSTATS_C_WRITE_PARTIALS, 1);
+	lws_stats_atomic_bump(wsi->context, pt,
+			      LWSSTATS_B_PARTIALS_ACCEPTED_PARTS, n);
+
+	wsi->buflist_out_len = (unsigned int)(len + hl - n);
+	lws_stats_atomic_bump(wsi->context, pt, LWSSTATS_B_BUFFERED_OUT,
+			      wsi->buflist_out_len);
+
+	sent = n;
+	if (sent < (size_t)hl &&
+	    lws_buflist_append(pt, &wsi->buflist_out,
+			       &hdr[sizeof(hdr) - hl + sent], hl - sent))
+		goto oom;
+	sent = sent > (size_t)hl ? sent - hl : 0;
+
+	for (n = 0; n < count; n++) {
+		skip = sent < iov[n].len ? sent : iov[n].len;
+		sent -= skip;
+		if (skip != iov[n].len &&
+		    lws_buflist_append(pt, &wsi->buflist_out,
+				       (const uint8_t *)iov[n].base + skip,
+				       iov[n].len - skip))
+			goto oom;
+	}
+
+	lws_callback_on_writable(wsi);
+
+	return (int)len;
+
+oom:
+	lwsl_err("%s: unable to buffer partial\n", __func__);
+	lws_drop_buffered_out(wsi);
+
+	return -1;
+}
+#endif
+
+LWS_VISIBLE int
+lws_write_iov(struct lws *wsi, const struct lws_iovec *iov, int count,
+	      enum lws_write_protocol wp)
+{
+	unsigned char stack[LWS_PRE + 2048], *buf = stack, *p;
+	size_t len = 0;
+	int n;
+
+	if (count < 0 || count > LWS_WRITE_IOV_MAX) {
+		lwsl_err("%s: bad iov count %d\n", __func__, count);
+		return -1;
+	}
+
+	for (n = 0; n < count; n++)
+		len += iov[n].len;
+
+#if LWS_POSIX && !defined(_WIN32) && !defined(LWS_WITH_ESP32) && \
+    !defined(LWS_PLAT_OPTEE)
+	n = lws_write_iov_gathered(wsi, iov, count, len, wp);
+	if (n != LWS_WRITE_IOV_COPY)
+		return n;
+#endif
+
+	/*
+	 * tls, extensions, client masking, h2... everything else needs the
+	 * payload in one buffer with LWS_PRE in front of it, so tls gets it
+	 * as one record and the rest can work on it in place
+	 */
+
+	if (len > sizeof(stack) - LWS_PRE) {
+		buf = lws_malloc(LWS_PRE + len, "write_iov");
+		if (!buf)
+			return -1;
+	}
+
+	p = buf + LWS_PRE;
+	for (n = 0; n < count; n++) {
+		memcpy(p, iov[n].base, iov[n].len);
+		p += iov[n].len;
+	}
+
+	n = lws_write(wsi, buf + LWS_PRE, len, wp);
+
+	if (buf != stack)
+		lws_free(buf);
+
+	return n;
+}
+
+#if defined(LWS_HAVE_SYS_SENDFILE_H)
+/*
+ * Plaintext http/1 file transfers from a real platform fd can be handed to
+ * the kernel in one go.  Anything that has to see or transform the payload
+ * (tls, h2 framing, chunking, PROCESS_HTML, ranges) or isn't backed by a
+ * real fd (zip, romfs or user fops) takes the read + write path instead.
+ */
+static int
+lws_http_file_can_sendfile(struct lws *wsi)
+{
+	return wsi->http.fop_fd->fops == &wsi->context->fops_platform &&
+	       !lws_is_ssl(wsi) && !lwsi_role_h2(wsi) &&
+	       !wsi->http2_substream && !wsi->sending_chunked &&
+	       !wsi->interpreting && !wsi->parent_carries_io &&
+	       !wsi->no_sendfile
+#if defined(LWS_WITH_RANGES)
+	       && !wsi->http.range.count_ranges
+#endif
+	       ;
+}
+#endif
+
 LWS_VISIBLE int lws_serve_http_file_fragment(struct lws *wsi)
 {
 	struct lws_context *context = wsi->context;
@@ -252,10 +593,8 @@ LWS_VISIBLE int lws_serve_http_file_fragment(struct lws *wsi)
 
 	do {
 
-		if (wsi->trunc_len) {
-			if (lws_issue_raw(wsi, wsi->trunc_alloc +
-					  wsi->trunc_offset,
-					  wsi->trunc_len) < 0) {
+		if (lws_has_buffered_out(wsi)) {
+			if (lws_flush_buffered_out(wsi) < 0) {
 				lwsl_info("%s: closing\n", __func__);
 				goto file_had_it;
 			}
@@ -265,6 +604,39 @@ LWS_VISIBLE int lws_serve_http_file_fragment(struct lws *wsi)
 		if (wsi->http.filepos == wsi->http.filelen)
 			goto all_sent;
 
+#if defined(LWS_HAVE_SYS_SENDFILE_H)
+		if (lws_http_file_can_sendfile(wsi)) {
+			poss = wsi->http.filelen - wsi->http.filepos;
+			if (wsi->protocol->tx_packet_size &&
+			    poss > wsi->protocol->tx_packet_size)
+				poss = wsi->protocol->tx_packet_size;
+
+			n = lws_plat_sendfile(wsi, wsi->http.fop_fd, poss);
+			if (n == -1)
+				goto file_had_it;
+			if (n != -2) {
+				if (n) {
+					lws_set_timeout(wsi,
+						PENDING_TIMEOUT_HTTP_CONTENT,
+						context->timeout_secs);
+					lws_stats_atomic_bump(context, pt,
+							LWSSTATS_B_WRITE, n);
+#ifdef LWS_WITH_ACCESS_LOG
+					wsi->access_log.sent += n;
+#endif
+					if (wsi->vhost)
+						wsi->vhost->conn_stats.tx += n;
+					wsi->http.filepos += n;
+				}
+
+				goto all_sent;
+			}
+
+			/* eg, fs without sendfile support... do it by hand */
+			wsi->no_sendfile = 1;
+		}
+#endif
+
 		n = 0;
 
 		pstart = pt->serv_buf + LWS_H2_FRAME_HEADER_LENGTH;
@@ -426,7 +798,8 @@ LWS_VISIBLE int lws_serve_http_file_fragment(struct lws *wsi)
 		}
 
 all_sent:
-		if ((!wsi->trunc_len && wsi->http.filepos >= wsi->http.filelen)
+		if ((!lws_has_buffered_out(wsi) &&
+		     wsi->http.filepos >= wsi->http.filelen)
 #if defined(LWS_WITH_RANGES)
 		    || finished)
 #else
@@ -520,7 +893,7 @@ lws_ssl_capable_write_no_ssl(struct lws *wsi, unsigned char *buf, int len)
 
 #if LWS_POSIX
 	if (lws_wsi_is_udp(wsi)) {
-		if (wsi->trunc_len)
+		if (lws_has_buffered_out(wsi))
 			n = sendto(wsi->desc.sockfd, buf, len, 0, &wsi->udp->sa_pending, wsi->udp->salen_pending);
 		else
 			n = sendto(wsi->desc.sockfd, buf, len, 0, &wsi->udp->sa, wsi->udp->salen);
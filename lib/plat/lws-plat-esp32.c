@@ -28,6 +28,7 @@
 
 #include <lwip/sockets.h>
 #include <esp_task_wdt.h>
+#include <esp_timer.h>
 
 int
 lws_plat_socket_offset(void)
@@ -39,6 +40,13 @@ lws_plat_socket_offset(void)
  * included from libwebsockets.c for unix builds
  */
 
+lws_usec_t
+lws_plat_monotonic_us(void)
+{
+	/* us since boot, unaffected by sntp setting the time */
+	return (lws_usec_t)esp_timer_get_time();
+}
+
 unsigned long long time_in_microseconds(void)
 {
 	struct timeval tv;
@@ -82,9 +90,13 @@ lws_send_pipe_choked(struct lws *wsi)
 	/* the fact we checked implies we avoided back-to-back writes */
 	wsi_eff->could_have_pending = 0;
 
-	/* treat the fact we got a truncated send pending as if we're choked */
-	if (wsi_eff->trunc_len)
-		return 1;
+	/*
+	 * treat the fact we got a truncated send pending as if we're choked,
+	 * unless there's still room to queue more writes behind it
+	 */
+	if (lws_has_buffered_out(wsi_eff))
+		return wsi_eff->buflist_out_len >=
+				wsi_eff->context->buffered_out_limit;
 
 	FD_ZERO(&writefds);
 	FD_SET(wsi_eff->desc.sockfd - LWIP_SOCKET_OFFSET, &writefds);
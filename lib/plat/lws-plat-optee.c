@@ -33,6 +33,12 @@ unsigned long long time_in_microseconds(void)
 {
 	return ((unsigned long long)time(NULL)) * 1000000;
 }
+
+lws_usec_t
+lws_plat_monotonic_us(void)
+{
+	return (lws_usec_t)time_in_microseconds();
+}
 #if 0
 LWS_VISIBLE int
 lws_get_random(struct lws_context *context, void *buf, int len)
@@ -54,15 +60,19 @@ lws_send_pipe_choked(struct lws *wsi)
 	/* the fact we checked implies we avoided back-to-back writes */
 	wsi_eff->could_have_pending = 0;
 
-	/* treat the fact we got a truncated send pending as if we're choked */
-	if (wsi_eff->trunc_len)
-		return 1;
+	/*
+	 * treat the fact we got a truncated send pending as if we're choked,
+	 * unless there's still room to queue more writes behind it
+	 */
+	if (lws_has_buffered_out(wsi_eff))
+		return wsi_eff->buflist_out_len >=
+				wsi_eff->context->buffered_out_limit;
 
 #if 0
 	struct lws_pollfd fds;
 
 	/* treat the fact we got a truncated send pending as if we're choked */
-	if (wsi->trunc_len)
+	if (lws_has_buffered_out(wsi))
 		return 1;
 
 	fds.fd = wsi->desc.sockfd;
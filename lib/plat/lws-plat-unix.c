@@ -19,6 +19,10 @@
  *  MA  02110-1301  USA
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+/* for sched_setaffinity() */
+#define _GNU_SOURCE
+#endif
 #include "private-libwebsockets.h"
 
 #include <pwd.h>
@@ -28,6 +32,15 @@
 #include <dlfcn.h>
 #endif
 #include <dirent.h>
+#if defined(__linux__)
+#include <sched.h>
+#endif
+#if defined(LWS_HAVE_SYS_SENDFILE_H)
+#include <sys/sendfile.h>
+#endif
+#if defined(LWS_HAVE_SYS_EVENTFD_H)
+#include <sys/eventfd.h>
+#endif
 
 int
 lws_plat_socket_offset(void)
@@ -40,13 +53,34 @@ lws_plat_pipe_create(struct lws *wsi)
 {
 	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
 
+#if defined(LWS_HAVE_SYS_EVENTFD_H)
+	/*
+	 * an eventfd is just a counter, so it can't fill up and one read
+	 * collects any number of signals
+	 */
+	pt->dummy_pipe_fds[0] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	pt->dummy_pipe_fds[1] = -1;
+
+	return pt->dummy_pipe_fds[0] < 0;
+#else
 	return pipe(pt->dummy_pipe_fds);
+#endif
 }
 
 int
 lws_plat_pipe_signal(struct lws *wsi)
 {
 	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
+#if defined(LWS_HAVE_SYS_EVENTFD_H)
+	uint64_t one = 1;
+	int n;
+
+	n = write(pt->dummy_pipe_fds[0], &one, sizeof(one));
+
+	lwsl_debug("%s: fd %d %d\n", __func__, pt->dummy_pipe_fds[0], n);
+
+	return n != sizeof(one);
+#else
 	char buf = 0;
 	int n;
 
@@ -55,6 +89,7 @@ lws_plat_pipe_signal(struct lws *wsi)
 	lwsl_debug("%s: fd %d %d\n", __func__, pt->dummy_pipe_fds[1], n);
 
 	return n != 1;
+#endif
 }
 
 void
@@ -85,6 +120,20 @@ unsigned long long time_in_microseconds(void)
 	return ((unsigned long long)tv.tv_sec * 1000000LL) + tv.tv_usec;
 }
 
+lws_usec_t
+lws_plat_monotonic_us(void)
+{
+#if defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	if (!clock_gettime(CLOCK_MONOTONIC, &ts))
+		return ((lws_usec_t)ts.tv_sec * 1000000LL) +
+		       (ts.tv_nsec / 1000);
+#endif
+
+	return (lws_usec_t)time_in_microseconds();
+}
+
 LWS_VISIBLE int
 lws_get_random(struct lws_context *context, void *buf, int len)
 {
@@ -104,9 +153,13 @@ lws_send_pipe_choked(struct lws *wsi)
 	/* the fact we checked implies we avoided back-to-back writes */
 	wsi_eff->could_have_pending = 0;
 
-	/* treat the fact we got a truncated send pending as if we're choked */
-	if (wsi_eff->trunc_len)
-		return 1;
+	/*
+	 * treat the fact we got a truncated send pending as if we're choked,
+	 * unless there's still room to queue more writes behind it
+	 */
+	if (lws_has_buffered_out(wsi_eff))
+		return wsi_eff->buflist_out_len >=
+				wsi_eff->context->buffered_out_limit;
 
 	fds.fd = wsi_eff->desc.sockfd;
 	fds.events = POLLOUT;
@@ -150,6 +203,139 @@ LWS_VISIBLE void lwsl_emit_syslog(int level, const char *line)
 	syslog(syslog_level, "%s", line);
 }
 
+#if defined(LWS_HAVE_SYS_EPOLL_H)
+static int
+lws_plat_epoll_ctl(struct lws_context_per_thread *pt, int op, int fd,
+		   int events)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	if (events & LWS_POLLIN)
+		ev.events |= EPOLLIN;
+	if (events & LWS_POLLOUT)
+		ev.events |= EPOLLOUT;
+	ev.data.fd = fd;
+
+	return epoll_ctl(pt->epoll_fd, op, fd, &ev);
+}
+
+/*
+ * Service the batch of events returned by epoll_wait().  We still hand
+ * lws_service_fd_tsi() the fd's real pollfd from pt->fds, so everything
+ * downstream sees exactly what it would have seen with poll().
+ */
+
+static int
+_lws_plat_epoll_service(struct lws_context *context,
+			struct lws_context_per_thread *pt, int count, int forced)
+{
+	struct epoll_event *ev;
+	struct lws_pollfd *pfd;
+	struct lws *wsi;
+	int n, m, fd;
+
+	pt->epoll_batch_count = count;
+
+	for (pt->epoll_batch_pos = 0;
+	     pt->epoll_batch_pos < pt->epoll_batch_count;
+	     pt->epoll_batch_pos++) {
+		ev = &pt->epoll_events[pt->epoll_batch_pos];
+
+		/* -1 means he was closed by someone earlier in the batch */
+		if (ev->data.fd < 0)
+			continue;
+
+		wsi = wsi_from_fd(context, ev->data.fd);
+		if (!wsi || wsi->position_in_fds_table < 0)
+			continue;
+
+		pfd = &pt->fds[wsi->position_in_fds_table];
+		/*
+		 * forced service may already have faked POLLIN on him, keep
+		 * it.  Otherwise drop anything left over from earlier waits.
+		 *
+		 * On Linux EPOLLIN / OUT / HUP / ERR have the same values as
+		 * their POLL* counterparts.
+		 */
+		if (!forced)
+			pfd->revents = 0;
+		pfd->revents |= ev->events & (EPOLLIN | EPOLLOUT |
+					      EPOLLHUP | EPOLLERR);
+
+		m = lws_service_fd_tsi(context, pfd, pt->tid);
+		if (m < 0) {
+			pt->epoll_batch_count = 0;
+			return -1;
+		}
+		/*
+		 * 1 doesn't always mean he closed... if he is still there,
+		 * don't leave his revents for the next forced scan to find
+		 */
+		if (m) {
+			wsi = wsi_from_fd(context, ev->data.fd);
+			if (wsi && wsi->position_in_fds_table >= 0)
+				pt->fds[wsi->position_in_fds_table].revents = 0;
+		}
+	}
+
+	pt->epoll_batch_count = 0;
+
+	if (!forced)
+		return 0;
+
+	/*
+	 * Forced service marks revents directly in pt->fds, without the
+	 * kernel knowing anything about it... we have to look for them
+	 */
+	for (n = 0; n < (int)pt->fds_count; n++) {
+		if (!pt->fds[n].revents)
+			continue;
+
+		fd = pt->fds[n].fd;
+		m = lws_service_fd_tsi(context, &pt->fds[n], pt->tid);
+		if (m < 0)
+			return -1;
+		if (!m)
+			continue;
+		/*
+		 * if he closed, somebody else was moved into his slot, retry
+		 * it.  Otherwise he is still here with his revents set.
+		 */
+		if (n < (int)pt->fds_count && pt->fds[n].fd == fd)
+			pt->fds[n].revents = 0;
+		else
+			n--;
+	}
+
+	return 0;
+}
+#endif
+
+#if defined(__linux__)
+/*
+ * Called from the service thread itself, the first time it services its pt
+ */
+static void
+lws_plat_apply_cpu_affinity(struct lws_context_per_thread *pt)
+{
+	cpu_set_t set;
+
+	pt->cpu_affinity_applied = 1;
+
+	CPU_ZERO(&set);
+	CPU_SET(pt->cpu_affinity, &set);
+	if (sched_setaffinity(0, sizeof(set), &set)) {
+		lwsl_warn("%s: tsi %d: unable to bind to cpu %d\n", __func__,
+			  pt->tid, pt->cpu_affinity);
+		return;
+	}
+
+	lwsl_info("%s: tsi %d bound to cpu %d\n", __func__, pt->tid,
+		  pt->cpu_affinity);
+}
+#endif
+
 LWS_VISIBLE LWS_EXTERN int
 _lws_plat_service_tsi(struct lws_context *context, int timeout_ms, int tsi)
 {
@@ -171,6 +357,11 @@ _lws_plat_service_tsi(struct lws_context *context, int timeout_ms, int tsi)
 	if (timeout_ms < 0)
 		goto faked_service;
 
+#if defined(__linux__)
+	if (pt->cpu_affinity >= 0 && !pt->cpu_affinity_applied)
+		lws_plat_apply_cpu_affinity(pt);
+#endif
+
 	lws_libev_run(context, tsi);
 	lws_libuv_run(context, tsi);
 	lws_libevent_run(context, tsi);
@@ -211,7 +402,13 @@ _lws_plat_service_tsi(struct lws_context *context, int timeout_ms, int tsi)
 
 	vpt->inside_poll = 1;
 	lws_memory_barrier();
-	n = poll(pt->fds, pt->fds_count, timeout_ms);
+#if defined(LWS_HAVE_SYS_EPOLL_H)
+	if (context->use_epoll)
+		n = epoll_wait(pt->epoll_fd, pt->epoll_events,
+			       LWS_EPOLL_EVENTS_PER_WAIT, timeout_ms);
+	else
+#endif
+		n = poll(pt->fds, pt->fds_count, timeout_ms);
 	vpt->inside_poll = 0;
 	lws_memory_barrier();
 
@@ -276,6 +473,11 @@ faked_service:
 		} else
 			c = n;
 
+#if defined(LWS_HAVE_SYS_EPOLL_H)
+	if (context->use_epoll)
+		return _lws_plat_epoll_service(context, pt, n < 0 ? 0 : n, m);
+#endif
+
 	/* any socket with events to service? */
 	for (n = 0; n < (int)pt->fds_count && c; n++) {
 		if (!pt->fds[n].revents)
@@ -628,6 +830,18 @@ lws_plat_context_late_destroy(struct lws_context *context)
 	if (context->lws_lookup)
 		lws_free(context->lws_lookup);
 
+#if defined(LWS_HAVE_SYS_EPOLL_H)
+	if (context->use_epoll) {
+		int n;
+
+		for (n = 0; n < context->count_threads; n++) {
+			close(context->pt[n].epoll_fd);
+			lws_free_set_NULL(context->pt[n].epoll_events);
+		}
+		context->use_epoll = 0;
+	}
+#endif
+
 	if (!context->fd_random)
 		lwsl_err("ZERO RANDOM FD\n");
 	if (context->fd_random != LWS_INVALID_FILE)
@@ -721,6 +935,14 @@ lws_plat_insert_socket_into_fds(struct lws_context *context, struct lws *wsi)
 	lws_libuv_io(wsi, LWS_EV_START | LWS_EV_READ);
 	lws_libevent_io(wsi, LWS_EV_START | LWS_EV_READ);
 
+#if defined(LWS_HAVE_SYS_EPOLL_H)
+	if (context->use_epoll &&
+	    lws_plat_epoll_ctl(pt, EPOLL_CTL_ADD, wsi->desc.sockfd,
+			pt->fds[wsi->position_in_fds_table].events))
+		lwsl_err("%s: epoll add of fd %d failed: errno %d\n",
+			 __func__, wsi->desc.sockfd, LWS_ERRNO);
+#endif
+
 	pt->fds[pt->fds_count++].revents = 0;
 }
 
@@ -734,6 +956,23 @@ lws_plat_delete_socket_from_fds(struct lws_context *context,
 	lws_libuv_io(wsi, LWS_EV_STOP | LWS_EV_READ | LWS_EV_WRITE);
 	lws_libevent_io(wsi, LWS_EV_STOP | LWS_EV_READ | LWS_EV_WRITE);
 
+#if defined(LWS_HAVE_SYS_EPOLL_H)
+	if (context->use_epoll) {
+		int n;
+
+		lws_plat_epoll_ctl(pt, EPOLL_CTL_DEL, wsi->desc.sockfd, 0);
+
+		/*
+		 * if we are inside a batch, any events still to come for
+		 * this fd are stale... the fd may even get reused for a new
+		 * connection before we reach them
+		 */
+		for (n = pt->epoll_batch_pos + 1; n < pt->epoll_batch_count; n++)
+			if (pt->epoll_events[n].data.fd == wsi->desc.sockfd)
+				pt->epoll_events[n].data.fd = -1;
+	}
+#endif
+
 	pt->fds_count--;
 }
 
@@ -750,6 +989,16 @@ LWS_VISIBLE int
 lws_plat_change_pollfd(struct lws_context *context,
 		      struct lws *wsi, struct lws_pollfd *pfd)
 {
+#if defined(LWS_HAVE_SYS_EPOLL_H)
+	if (context->use_epoll &&
+	    lws_plat_epoll_ctl(&context->pt[(int)wsi->tsi], EPOLL_CTL_MOD,
+			       pfd->fd, pfd->events)) {
+		lwsl_err("%s: epoll mod of fd %d failed: errno %d\n",
+			 __func__, pfd->fd, LWS_ERRNO);
+		return 1;
+	}
+#endif
+
 	return 0;
 }
 
@@ -868,6 +1117,75 @@ _lws_plat_file_write(lws_fop_fd_t fop_fd, lws_filepos_t *amount,
 	return 0;
 }
 
+#if defined(LWS_HAVE_SYS_SENDFILE_H)
+/*
+ * Send up to len bytes from the file's current position straight to the
+ * wsi socket without bouncing them through userspace.
+ *
+ * Returns the number of bytes sent, 0 if the socket can't take any right now,
+ * -2 if this file / socket combination can't use sendfile() and the caller
+ * should fall back to read + write, or -1 on a fatal error.
+ */
+int
+lws_plat_sendfile(struct lws *wsi, lws_fop_fd_t fop_fd, lws_filepos_t len)
+{
+	ssize_t n;
+
+	n = sendfile(wsi->desc.sockfd, (int)fop_fd->fd, NULL, (size_t)len);
+	if (n < 0) {
+		if (LWS_ERRNO == LWS_EAGAIN || LWS_ERRNO == LWS_EWOULDBLOCK ||
+		    LWS_ERRNO == LWS_EINTR)
+			return 0;
+		if (LWS_ERRNO == EINVAL || LWS_ERRNO == ENOSYS)
+			return -2;
+
+		lwsl_info("%s: sendfile failed: errno %d\n", __func__,
+			  LWS_ERRNO);
+
+		return -1;
+	}
+
+	fop_fd->pos += n;
+
+	return (int)n;
+}
+#endif
+
+#if defined(LWS_HAVE_SYS_EPOLL_H)
+static int
+lws_plat_epoll_init(struct lws_context *context)
+{
+	struct lws_context_per_thread *pt;
+	int n;
+
+	for (n = 0; n < context->count_threads; n++) {
+		pt = &context->pt[n];
+		pt->epoll_events = lws_malloc(sizeof(struct epoll_event) *
+					      LWS_EPOLL_EVENTS_PER_WAIT,
+					      "epoll events");
+		pt->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if (!pt->epoll_events || pt->epoll_fd < 0) {
+			lwsl_err("%s: unable to create epoll set\n", __func__);
+			goto bail;
+		}
+	}
+
+	context->use_epoll = 1;
+	lwsl_info(" Using epoll service backend\n");
+
+	return 0;
+
+bail:
+	do {
+		if (context->pt[n].epoll_fd >= 0)
+			close(context->pt[n].epoll_fd);
+		lws_free_set_NULL(context->pt[n].epoll_events);
+	} while (n--);
+
+	return 1;
+}
+#endif
+
 LWS_VISIBLE int
 lws_plat_init(struct lws_context *context,
 	      struct lws_context_creation_info *info)
@@ -898,6 +1216,16 @@ lws_plat_init(struct lws_context *context,
 	(void)lws_libuv_init_fd_table(context);
 	(void)lws_libevent_init_fd_table(context);
 
+#if defined(LWS_HAVE_SYS_EPOLL_H)
+	if (lws_check_opt(context->options, LWS_SERVER_OPTION_EPOLL) &&
+	    !LWS_LIBEV_ENABLED(context) && !LWS_LIBUV_ENABLED(context) &&
+	    !LWS_LIBEVENT_ENABLED(context) && lws_plat_epoll_init(context))
+		return 1;
+#else
+	if (lws_check_opt(context->options, LWS_SERVER_OPTION_EPOLL))
+		lwsl_notice("epoll not available on this platform, using poll\n");
+#endif
+
 #ifdef LWS_WITH_PLUGINS
 	if (info->plugin_dirs)
 		lws_plat_plugins_init(context, info->plugin_dirs);
@@ -56,6 +56,22 @@ time_in_microseconds()
 	return (datetime.QuadPart - DELTA_EPOCH_IN_MICROSECS) / 10;
 }
 
+lws_usec_t
+lws_plat_monotonic_us(void)
+{
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+
+	if (!freq.QuadPart && !QueryPerformanceFrequency(&freq))
+		return (lws_usec_t)time_in_microseconds();
+
+	QueryPerformanceCounter(&count);
+
+	return (lws_usec_t)((count.QuadPart / freq.QuadPart) * 1000000) +
+	       (lws_usec_t)(((count.QuadPart % freq.QuadPart) * 1000000) /
+			    freq.QuadPart);
+}
+
 #ifdef _WIN32_WCE
 time_t time(time_t *t)
 {
@@ -143,9 +159,13 @@ lws_send_pipe_choked(struct lws *wsi)
 	/* the fact we checked implies we avoided back-to-back writes */
 	wsi_eff->could_have_pending = 0;
 
-	/* treat the fact we got a truncated send pending as if we're choked */
-	if (wsi_eff->trunc_len)
-		return 1;
+	/*
+	 * treat the fact we got a truncated send pending as if we're choked,
+	 * unless there's still room to queue more writes behind it
+	 */
+	if (lws_has_buffered_out(wsi_eff))
+		return wsi_eff->buflist_out_len >=
+				wsi_eff->context->buffered_out_limit;
 
 	return (int)wsi_eff->sock_send_blocking;
 }
@@ -240,7 +260,7 @@ _lws_plat_service_tsi(struct lws_context *context, int timeout_ms, int tsi)
 		/*
 		 * any wsi has truncated, force him signalled
 		 */
-		if (wsi->trunc_len)
+		if (lws_has_buffered_out(wsi))
 			WSASetEvent(pt->events[0]);
 	}
 
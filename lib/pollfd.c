@@ -201,7 +201,7 @@ bail:
 
 #ifndef LWS_NO_SERVER
 /*
- * Enable or disable listen sockets on this pt globally...
+ * Enable or disable this pt's listen sockets globally...
  * it's modulated according to the pt having space for a new accept.
  */
 static void
@@ -212,12 +212,12 @@ lws_accept_modulation(struct lws_context *context,
 	struct lws_pollargs pa1;
 
 	while (vh) {
-		if (vh->lserv_wsi) {
+		if (vh->lserv_wsi[pt->tid]) {
 			if (allow)
-				_lws_change_pollfd(vh->lserv_wsi,
+				_lws_change_pollfd(vh->lserv_wsi[pt->tid],
 					   0, LWS_POLLIN, &pa1);
 			else
-				_lws_change_pollfd(vh->lserv_wsi,
+				_lws_change_pollfd(vh->lserv_wsi[pt->tid],
 					   LWS_POLLIN, 0, &pa1);
 		}
 		vh = vh->vhost_next;
@@ -251,7 +251,8 @@ __insert_wsi_socket_into_fds(struct lws_context *context, struct lws *wsi)
 #endif
 
 	assert(wsi);
-	assert(wsi->event_pipe || wsi->vhost);
+	assert(wsi->event_pipe || wsi->vhost ||
+	       lwsi_role(wsi) == LWSI_ROLE_DNS);
 	assert(lws_socket_is_valid(wsi->desc.sockfd));
 
 	if (wsi->vhost &&
@@ -302,7 +303,8 @@ __remove_wsi_socket_from_fds(struct lws *wsi)
 	int v;
 	int m, ret = 0;
 
-	if (wsi->parent_carries_io) {
+	if (wsi->parent_carries_io || wsi->position_in_fds_table < 0) {
+		/* no fds entry of our own, or it was already taken out */
 		lws_same_vh_protocol_remove(wsi);
 		return 0;
 	}
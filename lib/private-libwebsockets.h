@@ -168,6 +168,9 @@ int fork(void);
 #include <arpa/inet.h>
 #include <poll.h>
 #endif
+#if defined(LWS_HAVE_SYS_EPOLL_H)
+#include <sys/epoll.h>
+#endif
 #if defined(LWS_WITH_LIBEV)
 #include <ev.h>
 #endif
@@ -409,6 +412,26 @@ extern "C" {
 
 #define LWS_H2_RX_SCRATCH_SIZE 512
 
+#ifndef LWS_EPOLL_EVENTS_PER_WAIT
+#define LWS_EPOLL_EVENTS_PER_WAIT 128
+#endif
+
+/*
+ * Put a struct on cache lines of its own, like this:
+ * struct LWS_CACHE_ALIGNED name { ... }.  The context is allocated aligned
+ * to LWS_CACHE_LINE so it holds for members of the context too.
+ */
+#ifndef LWS_CACHE_LINE
+#define LWS_CACHE_LINE 64
+#endif
+#if defined(_MSC_VER)
+#define LWS_CACHE_ALIGNED __declspec(align(LWS_CACHE_LINE))
+#elif defined(__GNUC__)
+#define LWS_CACHE_ALIGNED __attribute__((aligned(LWS_CACHE_LINE)))
+#else
+#define LWS_CACHE_ALIGNED
+#endif
+
 /*
  * Choose the SSL backend
  */
@@ -426,17 +449,30 @@ struct lws_tls_mbed_bio {
 };
 struct lws_tls_mbed_x509 {
 
+};
+struct lws_tls_mbed_session {
+
 };
 typedef struct lws_tls_mbed_conn lws_tls_conn;
 typedef struct lws_tls_mbed_ctx lws_tls_ctx;
 typedef struct lws_tls_mbed_bio lws_tls_bio;
 typedef struct lws_tls_mbed_x509 lws_tls_x509;
+typedef struct lws_tls_mbed_session lws_tls_session;
 #else
 typedef SSL lws_tls_conn;
 typedef SSL_CTX lws_tls_ctx;
 typedef BIO lws_tls_bio;
 typedef X509 lws_tls_x509;
+typedef SSL_SESSION lws_tls_session;
 #endif
+
+/* a server session ticket key, as laid out in the key file */
+struct lws_tls_ticket_key {
+	uint8_t name[16];
+	uint8_t hmac[32];
+	uint8_t aes[32];
+	uint8_t len; /* of the hmac and aes keys, 16 or 32 */
+};
 #endif
 
 /*
@@ -541,6 +577,7 @@ enum lwsi_role {
 	LWSI_ROLE_EVENT_PIPE	=				  (3 << _RS),
 	LWSI_ROLE_RAW_FILE	=		  LWSIFR_P_RAW  | (4 << _RS),
 	LWSI_ROLE_RAW_SOCKET	=		  LWSIFR_P_RAW  | (5 << _RS),
+	LWSI_ROLE_DNS		=				  (6 << _RS),
 
 	LWSI_ROLE_MASK		=			     (0xffff << _RS),
 	LWSI_ROLE_PROTOCOL_MASK	=			     (0x00f0 << _RS),
@@ -601,6 +638,7 @@ enum lwsi_state {
 
 	LRS_UNCONNECTED				= LWSIFS_NOT_EST | 0,
 	LRS_WAITING_CONNECT			= LWSIFS_NOT_EST | 1,
+	LRS_WAITING_DNS				= LWSIFS_NOT_EST | 30,
 
 	/* Phase 2: establishing intermediaries on top of transport */
 
@@ -692,11 +730,19 @@ struct lws_role_ops {
 	 * ws-over-h2 is upgraded from h2 like this.
 	 */
 	int (*check_upgrades)(struct lws *wsi);
+	/*
+	 * role-specific framing for lws_write_iov(): put the header for a
+	 * len-byte payload at the end of the LWS_PRE-byte hdr and return its
+	 * length, or -1 if the payload has to be copied into one buffer and
+	 * go through write_role_protocol.
+	 */
+	int (*write_role_protocol_iov)(struct lws *wsi, unsigned char *hdr,
+				       size_t len, enum lws_write_protocol *wp);
 };
 
 extern struct lws_role_ops role_ops_h1, role_ops_h2, role_ops_raw,
 			       role_ops_ws, role_ops_cgi, role_ops_listen,
-			       role_ops_pipe;
+			       role_ops_pipe, role_ops_dns;
 
 enum {
 	LWS_HP_RET_BAIL_OK,
@@ -928,6 +974,8 @@ struct allocated_headers {
 	char initial_handshake_hash_base64[30];
 #endif
 
+	/* members from pos onwards are zeroed when the ah is recycled */
+
 	uint32_t pos;
 	uint32_t http_response;
 	uint32_t current_token_limit;
@@ -949,6 +997,201 @@ struct allocated_headers {
 
 #define LWS_HRTIMER_NOWAIT (0x7fffffffffffffffll)
 
+/*
+ * hierarchical timer wheel, see misc/timer-wheel.c
+ */
+
+#if defined(LWS_WITH_ESP32)
+#define LWS_TW_BITS 4
+#else
+#define LWS_TW_BITS 6
+#endif
+#define LWS_TW_SLOTS (1 << LWS_TW_BITS)
+#define LWS_TW_LEVELS (36 / LWS_TW_BITS)
+#define LWS_TW_OVERFLOW (LWS_TW_LEVELS * LWS_TW_SLOTS)
+#define LWS_TW_DETACHED (LWS_TW_OVERFLOW + 1)
+#define LWS_TW_NONE (~(uint64_t)0)
+
+struct lws_tw_timer {
+	struct lws_dll_lws list;
+	uint64_t at; /* expiry, in ticks */
+	uint16_t where; /* level * LWS_TW_SLOTS + slot, or OVERFLOW / DETACHED */
+};
+
+struct lws_timer_wheel {
+	struct lws_dll_lws slot[LWS_TW_LEVELS][LWS_TW_SLOTS];
+	struct lws_dll_lws overflow;
+	uint64_t occupied[LWS_TW_LEVELS]; /* bitmap of slots in use */
+	uint64_t now; /* next tick to be expired */
+	uint32_t count;
+};
+
+LWS_EXTERN void
+lws_tw_init(struct lws_timer_wheel *tw, uint64_t now);
+LWS_EXTERN void
+lws_tw_add(struct lws_timer_wheel *tw, struct lws_tw_timer *t, uint64_t at);
+LWS_EXTERN void
+lws_tw_remove(struct lws_timer_wheel *tw, struct lws_tw_timer *t);
+LWS_EXTERN uint64_t
+lws_tw_next(struct lws_timer_wheel *tw);
+LWS_EXTERN void
+lws_tw_advance(struct lws_timer_wheel *tw, uint64_t to,
+	       struct lws_dll_lws *expired);
+
+#if defined(LWS_WITH_STATS)
+/*
+ * LWSSTATS_ indexes below this are counters kept per-pt and summed when
+ * read, the ones from LWSSTATS_US_SSL_ACCEPT_DELAY_P50 are percentiles
+ * computed from the histograms
+ */
+#define LWS_STATS_COUNTERS LWSSTATS_COUNTERS
+
+/*
+ * Delay histograms, in us, with 16 linear buckets in each power of two
+ * above 16us, so any value is placed to within 1/16 (6%).  Values of 2^36us
+ * (19h) or more share the last bucket.
+ */
+#define LWS_STATS_HIST_SUB_BITS 4
+#define LWS_STATS_HIST_SUB (1 << LWS_STATS_HIST_SUB_BITS)
+#define LWS_STATS_HIST_MAX_BIT 35
+#define LWS_STATS_HIST_BUCKETS ((LWS_STATS_HIST_MAX_BIT - \
+				 LWS_STATS_HIST_SUB_BITS + 2) * \
+				LWS_STATS_HIST_SUB)
+
+enum {
+	LWS_STATS_HIST_SSL_ACCEPT_DELAY,
+	LWS_STATS_HIST_WRITABLE_DELAY,
+	LWS_STATS_HIST_SSL_RX_DELAY,
+
+	LWS_STATS_HIST_COUNT
+};
+
+/*
+ * Each pt's own stats.  Other threads may bump them too, eg, when the
+ * listening pt gives a new connection to another pt, so with LWS_MAX_SMP > 1
+ * they are updated with relaxed atomics.  But normally only the owning
+ * thread touches them, so unlike one set of stats for the context, the
+ * cache lines don't bounce between cpus... as long as they don't share a
+ * line with another pt's stats or anything else.
+ */
+
+struct LWS_CACHE_ALIGNED lws_pt_stats {
+	uint64_t c[LWS_STATS_COUNTERS];
+	uint32_t hist[LWS_STATS_HIST_COUNT][LWS_STATS_HIST_BUCKETS];
+};
+#endif
+
+#if defined(LWS_WITH_ACCESS_LOG_ASYNC)
+/*
+ * Access log lines a service thread has finished with, waiting for the
+ * writer thread.  head and tail count bytes ever added and written, so the
+ * ring offset is the count modulo size.  Each line is a struct lws_alog_rec
+ * followed by the text, padded to keep the next rec aligned; a line never
+ * wraps, the space left at the end is filled with a rec for fd -1 instead.
+ */
+
+struct lws_alog_rec {
+	int fd;
+	int len;
+};
+
+struct lws_alog_ring {
+	pthread_mutex_t lock;
+	pthread_cond_t space; /* signalled when the writer moved tail */
+	char *buf;
+	size_t size;
+	size_t head; /* protected by lock */
+	size_t tail; /* protected by lock */
+	unsigned int dropped; /* protected by lock */
+	char kicked; /* writer woken since we passed half full */
+};
+#endif
+
+#if defined(LWS_WITH_TLS_HANDSHAKE_POOL)
+/*
+ * Worker threads that run the server tls accept for the service threads.
+ * While the pool owns a wsi, its pt doesn't poll it: it is queued, then a
+ * worker runs the accept on it, then it waits on its pt's done list until
+ * the pt finishes it off.  Only the pt changes its state back to NONE.
+ */
+
+enum lws_tls_hs_state {
+	LWS_TLS_HS_NONE,
+	LWS_TLS_HS_QUEUED,
+	LWS_TLS_HS_RUNNING,
+	LWS_TLS_HS_DONE,
+};
+
+#define LWS_TLS_HS_POOL_MAX_THREADS 64
+
+struct lws_tls_hs_pool {
+	pthread_mutex_t lock; /* protects the lists and wsi tls_hs_state */
+	pthread_mutex_t vh_lock; /* vhost_list and the vhost index, for SNI */
+	pthread_cond_t work; /* a wsi was queued, or we are stopping */
+	pthread_cond_t done; /* a worker finished with a wsi */
+	pthread_t *threads;
+	struct lws_dll_lws queue; /* wsi waiting for a worker, oldest first */
+	struct lws_dll_lws *queue_tail;
+	int count_threads; /* 0 = handshakes run on the service threads */
+	char stop;
+};
+#endif
+
+/*
+ * One segment of output waiting to go out on a connection, the data follows
+ * the struct.  pos of the len bytes in it have been sent already.  Segments
+ * of LWS_BUFLIST_SLAB go back to a pool on the pt when they're done with.
+ */
+
+struct lws_buflist {
+	struct lws_buflist *next;
+	size_t size; /* room for data */
+	size_t len; /* data in it */
+	size_t pos; /* data already sent */
+};
+
+#define LWS_BUFLIST_SLAB 4096
+#define LWS_BUFLIST_POOL_MAX 64 /* free slabs kept by each pt */
+#define lws_buflist_data(_b) ((uint8_t *)(_b) + sizeof(struct lws_buflist))
+#define lws_has_buffered_out(_wsi) (!!(_wsi)->buflist_out)
+
+#if defined(LWS_WITH_PT_QUEUE)
+/*
+ * Bounded MPSC queue of messages for a pt (Vyukov's bounded queue, with one
+ * consumer).  A cell's seq says whose turn it is: pos means free for the
+ * producer claiming position pos, pos + 1 means holding the message for the
+ * service thread to take at pos.  Producers claim positions by CAS on enq,
+ * only the service thread touches deq.
+ *
+ * signalled is set by whoever wakes the pt, and cleared by the pt before it
+ * looks at the queue, so only the first post after that wakes it again.
+ *
+ * Posting to a wsi requires it to stay open during the post, so when the pt
+ * frees a wsi, every message for it is already published and can be turned
+ * into one for the vhost-protocol it had.
+ */
+
+struct lws_pt_msg {
+	size_t seq;
+	struct lws *wsi; /* NULL if for the vhost-protocol */
+	struct lws_vhost *vh; /* only set if wsi is NULL */
+	const struct lws_protocols *prot; /* only set if wsi is NULL */
+	void *payload;
+	size_t len;
+};
+
+struct lws_pt_queue {
+	struct lws_pt_msg *msg;
+	size_t mask;
+	char _pad0[64];
+	size_t enq; /* producers */
+	char _pad1[64];
+	size_t deq; /* service thread */
+	char signalled;
+	char cancelled; /* lws_cancel_service() was called too */
+};
+#endif
+
 /*
  * so we can have n connections being serviced simultaneously,
  * these things need to be isolated per-thread.
@@ -963,8 +1206,14 @@ struct lws_context_per_thread {
 	volatile struct lws_foreign_thread_pollfd * volatile foreign_pfd_list;
 	struct lws *rx_draining_ext_list;
 	struct lws *tx_draining_ext_list;
-	struct lws_dll_lws dll_head_timeout;
-	struct lws_dll_lws dll_head_hrtimer;
+	struct lws_timer_wheel tw_timeout; /* in seconds */
+	struct lws_timer_wheel tw_hrtimer; /* in us */
+#if defined(LWS_ROLE_WS)
+	struct lws_timer_wheel tw_ws_ping; /* in seconds */
+#endif
+#if defined(LWS_ROLE_WS) && !defined(LWS_WITHOUT_EXTENSIONS)
+	struct lws_dll_lws ext_1hz_list; /* wsi with active extensions */
+#endif
 #if defined(LWS_WITH_LIBUV) || defined(LWS_WITH_LIBEVENT)
 	struct lws_context *context;
 #endif
@@ -973,6 +1222,7 @@ struct lws_context_per_thread {
 #endif
 	void *http_header_data;
 	struct allocated_headers *ah_list;
+	struct allocated_headers *ah_free_list; /* detached ahs kept for reuse */
 	struct lws *ah_wait_list;
 #if defined(LWS_HAVE_PTHREAD_H)
 	const char *last_lock_reason;
@@ -994,13 +1244,28 @@ struct lws_context_per_thread {
 #if defined(LWS_WITH_LIBEVENT)
 	struct event_base *io_loop_event_base;
 #endif
+#if defined(LWS_HAVE_SYS_EPOLL_H)
+	/*
+	 * epoll backend: the pt->fds table is still maintained as usual, the
+	 * epoll set just tells us which of its entries have events.  The
+	 * pos / count pair describe the batch currently being serviced, so a
+	 * close during the batch can void stale events for its fd.
+	 */
+	struct epoll_event *epoll_events;
+	int epoll_fd;
+	int epoll_batch_pos;
+	int epoll_batch_count;
+#endif
 #if defined(LWS_WITH_LIBEV) || defined(LWS_WITH_LIBUV) || defined(LWS_WITH_LIBEVENT)
 	struct lws_signal_watcher w_sigint;
 	unsigned char ev_loop_foreign:1;
 	unsigned char event_loop_destroy_processing_done:1;
 #endif
 
+	time_t last_timeout_check_s;
 	unsigned long count_conns;
+	unsigned long ah_pool_hits; /* ah attach reused one from free list */
+	unsigned long ah_pool_misses; /* ah attach had to allocate */
 	/*
 	 * usable by anything in the service code, but only if the scope
 	 * does not last longer than the service action (since next service
@@ -1012,16 +1277,40 @@ struct lws_context_per_thread {
 #endif
 	lws_sockfd_type dummy_pipe_fds[2];
 	struct lws *pipe_wsi;
+	struct lws_buflist *buflist_pool; /* free LWS_BUFLIST_SLAB segments */
+#if defined(LWS_WITH_ASYNC_DNS)
+	struct lws_dll_lws adns_queries; /* queries waiting for an answer */
+#endif
+#if defined(LWS_WITH_ACCESS_LOG_ASYNC)
+	struct lws_alog_ring alog;
+#endif
+#if defined(LWS_WITH_STATS)
+	struct lws_pt_stats stats;
+#endif
+#if defined(LWS_WITH_PT_QUEUE)
+	struct lws_pt_queue q;
+#endif
+#if defined(LWS_WITH_TLS_HANDSHAKE_POOL)
+	struct lws_dll_lws tls_hs_done; /* protected by context tls_hs.lock */
+#endif
 
 	volatile unsigned char inside_poll;
 	volatile unsigned char foreign_spinlock;
 
 	unsigned int fds_count;
+	unsigned int buflist_pool_count;
+#if defined(LWS_ROLE_WS)
+	unsigned int ws_ping_spread; /* rotates the extra delay on each ping */
+#endif
 	uint32_t ah_pool_length;
+	int cpu_affinity; /* cpu to bind the service thread to, or -1 */
 
 	short ah_count_in_use;
+	short ah_count_in_use_high_water;
+	short ah_free_count;
 	unsigned char tid;
 	unsigned char lock_depth;
+	unsigned char cpu_affinity_applied:1;
 #if LWS_MAX_SMP > 1
 	pthread_t lock_owner;
 #endif
@@ -1061,6 +1350,45 @@ struct lws_timed_vh_protocol {
 	int reason;
 };
 
+#if defined(LWS_WITH_HTTP_PROXY)
+enum lws_pxlb_result {
+	LWSPXLB_OK,		/* the origin answered */
+	LWSPXLB_FAILED,		/* connect error, timeout or failed check */
+	LWSPXLB_ABANDONED,	/* we went away, not the origin's fault */
+};
+
+struct lws_proxy_balancer;
+
+struct lws_proxy_backend {
+	struct lws_proxy_balancer *lb;
+	char origin[128];	/* host[:port]/path, as in a proxy mount */
+	char address[96];
+	time_t ejected_until;
+	time_t next_check;
+	uint32_t hash;
+	unsigned int outstanding;
+	int port;
+	unsigned char fails;
+	unsigned char ssl:1;
+	unsigned char checking:1;
+};
+
+/* one of these per vhost proxy mount that lists several origins */
+
+struct lws_proxy_balancer {
+	struct lws_proxy_balancer *next;
+	const struct lws_http_mount *mount;
+	struct lws_proxy_backend *be; /* allocated along with us */
+	const char *cookie; /* LWSPLB_HASH on this cookie, or ... */
+	int token; /* ... on this header, or -1 */
+	int count;
+	int rr;
+	unsigned short health_secs;
+	unsigned short eject_secs;
+	unsigned char max_fails;
+};
+#endif
+
 /*
  * virtual host -related context information
  *   vhostwide SSL context
@@ -1087,6 +1415,9 @@ struct lws_vhost {
 #if LWS_MAX_SMP > 1
 	pthread_mutex_t lock;
 #endif
+#if defined(LWS_WITH_TLS_HANDSHAKE_POOL)
+	pthread_mutex_t tls_lock; /* ticket keys and tls server stats */
+#endif
 #if defined(LWS_WITH_HTTP2)
 	struct http2_settings set;
 #endif
@@ -1102,7 +1433,9 @@ struct lws_vhost {
 	struct lws_context *context;
 	struct lws_vhost *vhost_next;
 	const struct lws_http_mount *mount_list;
-	struct lws *lserv_wsi;
+	struct lws_mount_trie *mount_trie;
+	struct lws_mount_trie_hit *mount_trie_hits;
+	struct lws *lserv_wsi[LWS_MAX_SMP]; /* listen wsi, indexed by tsi */
 	const char *name;
 	const char *iface;
 	char *alloc_cert_path;
@@ -1116,8 +1449,17 @@ struct lws_vhost {
 	const struct lws_protocol_vhost_options *headers;
 	struct lws **same_vh_protocol_list;
 	struct lws_vhost *no_listener_vhost_list;
+	struct lws_vhost *vh_name_next; /* context name hash chain */
 #if !defined(LWS_NO_CLIENT)
 	struct lws_dll_lws dll_active_client_conns;
+#endif
+#if defined(LWS_WITH_HTTP_PROXY)
+	struct lws_dll_lws dll_proxy_pool; /* idle origin conns, newest first */
+	unsigned int proxy_pool_idle_secs;
+	unsigned short proxy_pool_max_idle;
+	unsigned short proxy_pool_max_per_origin;
+	unsigned short proxy_pool_count;
+	struct lws_proxy_balancer *proxy_lb_list;
 #endif
 	const char *error_document_404;
 #if defined(LWS_WITH_TLS)
@@ -1125,6 +1467,21 @@ struct lws_vhost {
 	lws_tls_ctx *ssl_client_ctx;
 	struct lws_tls_ss_pieces *ss; /* for acme tls certs */
 	char ecdh_curve[16];
+#if !defined(LWS_NO_CLIENT)
+	struct lws_dll_lws tls_sessions; /* most recently used first */
+	struct lws_tls_session_cache_stats tls_session_stats;
+	unsigned int tls_session_cache_max;
+	unsigned int tls_session_timeout;
+#endif
+#if !defined(LWS_NO_SERVER)
+	struct lws_tls_ticket_key tls_ticket_key[3]; /* current, previous, next */
+	struct lws_tls_server_session_stats tls_server_stats;
+	char *tls_ticket_key_filepath;
+	time_t tls_ticket_key_next;
+	unsigned int tls_ticket_key_rotate_secs;
+	char tls_ticket_keys; /* how many of current and previous are set */
+	char tls_ticket_key_staged; /* next is set */
+#endif
 #endif
 #if defined(LWS_WITH_MBEDTLS)
 	lws_tls_x509 *x509_client_CA;
@@ -1142,6 +1499,7 @@ struct lws_vhost {
 	unsigned int socks_proxy_port;
 #endif
 	unsigned int options;
+	unsigned int vh_seq; /* creation order, ie, position in vhost_list */
 	int count_protocols;
 	int ka_time;
 	int ka_probes;
@@ -1163,11 +1521,38 @@ struct lws_vhost {
 	unsigned int being_destroyed:1;
 	unsigned int skipped_certs:1;
 	unsigned int acme_challenge:1;
+	unsigned int indexed:1;
 
 	unsigned char default_protocol_index;
 	unsigned char raw_protocol_index;
 };
 
+/*
+ * The vhost's mount_list compiled into a byte trie on the mountpoints, so
+ * lws_find_mount() only walks the uri once.  Node 0 is the root; mounts
+ * ending at a node are chained through mount_trie_hits[], whose index is the
+ * mount's position in mount_list.  Links are index + 1, so 0 means none.
+ */
+
+struct lws_mount_trie {
+	uint32_t child;
+	uint32_t sibling;
+	uint32_t hit;
+	unsigned char c;
+};
+
+struct lws_mount_trie_hit {
+	const struct lws_http_mount *m;
+	uint32_t next;
+};
+
+/* the first vhost in vhost_list on a given port, for lws_select_vhost() */
+
+struct lws_vhost_port_first {
+	struct lws_vhost *vh;
+	int port;
+};
+
 struct lws_deferred_free
 {
 	struct lws_deferred_free *next;
@@ -1203,6 +1588,41 @@ struct lws_peer {
 };
 #endif
 
+#if defined(LWS_WITH_ASYNC_DNS)
+/*
+ * async dns, see misc/async-dns.c
+ */
+
+struct lws_adns_cache {
+	struct lws_adns_cache *next; /* hash chain */
+	lws_usec_t expires; /* monotonic */
+	struct in_addr addr;
+	/* lowercase name follows */
+};
+
+struct lws_adns_host {
+	struct lws_adns_host *next;
+	struct in_addr addr;
+	/* name follows */
+};
+
+struct lws_adns_query {
+	struct lws_dll_lws list; /* pt->adns_queries */
+	struct lws_dll_lws waiting; /* wsi->dll_adns_wait of those waiting */
+	struct lws *wsi; /* the udp socket this query goes out on */
+	uint16_t id;
+	uint8_t tries;
+	/* name follows */
+};
+
+enum {
+	LADNS_RESOLVED,
+	LADNS_WAITING,
+	LADNS_FAILED,
+	LADNS_USE_GETADDRINFO,
+};
+#endif
+
 #if defined(LWS_WITH_LIBUV)
 /*
  * All "static" (per-pt or per-context) uv handles must
@@ -1230,8 +1650,8 @@ struct lws_peer {
  */
 
 struct lws_context {
+	void *alloc_base; /* what we got from lws_zalloc() for the context */
 	time_t last_timeout_check_s;
-	time_t last_ws_ping_pong_check_s;
 	time_t last_cert_check_s;
 	time_t time_up;
 	time_t time_discontiguity;
@@ -1259,6 +1679,8 @@ struct lws_context {
 	struct lws_vhost *vhost_list;
 	struct lws_vhost *no_listener_vhost_list;
 	struct lws_vhost *vhost_pending_destruction_list;
+	struct lws_vhost **vh_name_hash; /* vhosts hashed by name */
+	struct lws_vhost_port_first *vh_port_first;
 	struct lws_plugin *plugin_list;
 	struct lws_deferred_free *deferred_free_list;
 #if defined(LWS_WITH_PEER_LIMITS)
@@ -1266,6 +1688,30 @@ struct lws_context {
 	struct lws_peer *peer_wait_list;
 	time_t next_cull;
 #endif
+#if defined(LWS_WITH_ASYNC_DNS)
+	struct lws_adns_cache **adns_cache; /* protected by context->lock */
+	struct sockaddr_in adns_server;
+	uint32_t adns_cache_count; /* protected by context->lock */
+	uint32_t adns_cache_limit;
+	struct lws_adns_host *adns_hosts; /* protected by context->lock */
+	time_t adns_hosts_mtime;
+	time_t adns_hosts_checked;
+	off_t adns_hosts_size;
+#endif
+#if defined(LWS_WITH_ACCESS_LOG_ASYNC)
+	pthread_t alog_thread;
+	pthread_mutex_t alog_lock; /* held while anyone is writing the rings */
+	pthread_cond_t alog_cond; /* wakes the writer thread */
+	time_t alog_last_warn; /* protected by alog_lock */
+	unsigned int alog_dropped; /* protected by alog_lock */
+	unsigned int alog_flush_ms;
+	unsigned char alog_overflow;
+	char alog_thread_running;
+	char alog_thread_stop;
+#endif
+#if defined(LWS_WITH_TLS_HANDSHAKE_POOL)
+	struct lws_tls_hs_pool tls_hs;
+#endif
 
 	void *external_baggage_free_on_destroy;
 	const struct lws_token_limits *token_limits;
@@ -1301,7 +1747,6 @@ struct lws_context {
 #endif
 
 #if defined(LWS_WITH_STATS)
-	uint64_t lws_stats[LWSSTATS_SIZE];
 	uint64_t last_dump;
 	int updated;
 #endif
@@ -1325,9 +1770,14 @@ struct lws_context {
 	unsigned int fd_limit_per_thread;
 	unsigned int timeout_secs;
 	unsigned int pt_serv_buf_size;
+	unsigned int buffered_out_limit;
 	int max_http_header_data;
 	int simultaneous_ssl_restriction;
 	int simultaneous_ssl;
+	int count_vh_port_first;
+	uint32_t vh_name_hash_elements;
+	uint32_t count_vh_indexed;
+	unsigned int vh_seq;
 #if defined(LWS_WITH_PEER_LIMITS)
 	uint32_t pl_hash_elements;	/* protected by context->lock */
 	uint32_t count_peers;		/* protected by context->lock */
@@ -1340,6 +1790,7 @@ struct lws_context {
 	unsigned int requested_kill:1;
 	unsigned int protocol_init_done:1;
 	unsigned int ssl_gate_accepts:1;
+	unsigned int use_epoll:1;
 	unsigned int doing_protocol_init;
 	unsigned int done_protocol_destroy_cb;
 	/*
@@ -1751,6 +2202,38 @@ struct hpack_dynamic_table {
 	uint16_t num_entries;
 };
 
+/*
+ * Our hpack encoder's view of the peer decoder's dynamic table.
+ *
+ * Entries added while a header block is being built stay pending until the
+ * block is actually written, so a block that is abandoned never desyncs us
+ * from the peer.
+ */
+
+#define LWS_H2_HPACK_ENC_TABLE_MAX	4096
+#define LWS_H2_HPACK_ENC_MAX_PENDING	16
+
+struct hpack_enc_dt_entry {
+	char *nv; /* malloc'd, name followed by value, no terminators */
+	uint16_t name_len;
+	uint16_t value_len;
+};
+
+struct hpack_enc_dynamic_table {
+	struct hpack_enc_dt_entry *entries; /* malloc'd ring */
+	struct hpack_enc_dt_entry pending[LWS_H2_HPACK_ENC_MAX_PENDING];
+	uint32_t size; /* name + value + 32 for each entry, per RFC7541 */
+	uint32_t max;
+	uint32_t pending_size;
+	uint16_t pos; /* where the next entry goes in the ring */
+	uint16_t used_entries;
+	uint16_t num_entries;
+	uint8_t count_pending;
+
+	unsigned int size_update:1;
+	unsigned int in_block:1; /* headers added since the last block went */
+};
+
 enum lws_h2_protocol_send_type {
 	LWS_PPS_NONE,
 	LWS_H2_PPS_MY_SETTINGS,
@@ -1806,12 +2289,14 @@ struct lws_h2_ghost_sid {
 struct lws_h2_netconn {
 	struct http2_settings set;
 	struct hpack_dynamic_table hpack_dyn_table;
+	struct hpack_enc_dynamic_table hpack_enc_table;
 	uint8_t	ping_payload[8];
 	uint8_t one_setting[LWS_H2_SETTINGS_LEN];
 	char goaway_str[32]; /* for rx */
 	struct lws *swsi;
 	struct lws_h2_protocol_send *pps; /* linked list */
 	char *rx_scratch;
+	struct lws **sid_index; /* malloc'd, open addressed by sid */
 
 	enum http2_hpack_state hpack;
 	enum http2_hpack_type hpack_type;
@@ -1846,6 +2331,7 @@ struct lws_h2_netconn {
 
 	uint32_t rx_scratch_pos;
 	uint32_t rx_scratch_len;
+	uint32_t sid_index_count;
 
 	uint16_t hpack_pos;
 
@@ -1858,6 +2344,7 @@ struct lws_h2_netconn {
 	char first_hdr_char;
 	uint8_t hpack_m;
 	uint8_t ext_count;
+	uint8_t sid_index_bits;
 };
 
 struct _lws_h2_related {
@@ -1903,7 +2390,7 @@ struct _lws_websocket_related {
 	uint8_t ping_payload_buf[128 - 3 + LWS_PRE];
 	uint8_t mask[4];
 
-	time_t time_next_ping_check;
+	time_t time_next_ping_check; /* monotonic secs of last traffic */
 	size_t rx_packet_length;
 	uint32_t rx_ubuf_head;
 	uint32_t rx_ubuf_alloc;
@@ -2051,8 +2538,11 @@ struct lws {
 	const struct lws_protocols *protocol;
 	struct lws **same_vh_protocol_prev, *same_vh_protocol_next;
 
-	struct lws_dll_lws dll_timeout;
-	struct lws_dll_lws dll_hrtimer;
+	struct lws_tw_timer tw_timeout;
+	struct lws_tw_timer tw_hrtimer;
+#if defined(LWS_ROLE_WS)
+	struct lws_tw_timer tw_ws_ping;
+#endif
 #if defined(LWS_WITH_PEER_LIMITS)
 	struct lws_peer *peer;
 #endif
@@ -2066,17 +2556,28 @@ struct lws {
 	struct lws_dll_lws dll_active_client_conns;
 	struct lws_dll_lws dll_client_transaction_queue_head;
 	struct lws_dll_lws dll_client_transaction_queue;
+#if defined(LWS_WITH_ASYNC_DNS)
+	struct lws_dll_lws dll_adns_wait;
+#endif
+#endif
+#if defined(LWS_WITH_HTTP_PROXY)
+	struct lws_dll_lws dll_proxy_pool;
+	struct lws_proxy_backend *px_backend; /* lb origin we're talking to */
+#endif
+#if defined(LWS_WITH_TLS_HANDSHAKE_POOL)
+	struct lws_dll_lws dll_tls_hs; /* pool queue, or our pt's done list */
 #endif
 	void *user_space;
 	void *opaque_parent_data;
 	/* rxflow handling */
 	unsigned char *rxflow_buffer;
 	/* truncated send handling */
-	unsigned char *trunc_alloc; /* non-NULL means buffering in progress */
+	struct lws_buflist *buflist_out; /* non-NULL means buffering in progress */
 
 #if !defined(LWS_WITHOUT_EXTENSIONS)
 	const struct lws_extension *active_extensions[LWS_MAX_EXTENSIONS_ACTIVE];
 	void *act_ext_user[LWS_MAX_EXTENSIONS_ACTIVE];
+	struct lws_dll_lws dll_ext_1hz; /* on pt ext_1hz_list */
 #endif
 #if defined(LWS_WITH_TLS)
 	lws_tls_conn *ssl;
@@ -2100,10 +2601,6 @@ struct lws {
 
 	struct lws_role_ops *pops;
 
-	lws_usec_t pending_timer;
-
-	time_t pending_timeout_set;
-
 	lws_wsi_state_t	wsistate;
 	lws_wsi_state_t wsistate_pre_close;
 
@@ -2112,9 +2609,7 @@ struct lws {
 	uint32_t rxflow_len;
 	uint32_t rxflow_pos;
 	uint32_t preamble_rx_len;
-	unsigned int trunc_alloc_len; /* size of malloc */
-	unsigned int trunc_offset; /* where we are in terms of spilling */
-	unsigned int trunc_len; /* how much is buffered */
+	unsigned int buflist_out_len; /* how much is buffered */
 #ifndef LWS_NO_CLIENT
 	int chunk_remaining;
 #endif
@@ -2136,6 +2631,7 @@ struct lws {
 	unsigned int favoured_pollin:1;
 	unsigned int sending_chunked:1;
 	unsigned int interpreting:1;
+	unsigned int no_sendfile:1;
 	unsigned int already_did_cce:1;
 	unsigned int told_user_closed:1;
 	unsigned int waiting_to_send_close_frame:1;
@@ -2170,6 +2666,8 @@ struct lws {
 #endif
 #ifdef LWS_WITH_HTTP_PROXY
 	unsigned int perform_rewrite:1;
+	unsigned int proxy_upstream:1; /* client conn for a proxy mount */
+	unsigned int proxy_reused:1; /* upstream conn came from the pool */
 #endif
 #if !defined(LWS_WITHOUT_EXTENSIONS)
 	unsigned int extension_data_pending:1;
@@ -2213,6 +2711,15 @@ struct lws {
 #endif
 #if defined(LWS_WITH_STATS) && defined(LWS_WITH_TLS)
 	char seen_rx;
+#endif
+#if defined(LWS_WITH_TLS)
+	/* not bitfields: a handshake pool thread may write these */
+	char tls_ticket; /* key a ticket came back under + 1, 4 if unknown */
+#endif
+#if defined(LWS_WITH_TLS_HANDSHAKE_POOL)
+	char tls_hs_state; /* enum lws_tls_hs_state */
+	char tls_hs_result; /* what the accept said on the pool thread */
+	char tls_hs_hangup; /* out of the fds, close when the pool is done */
 #endif
 	uint8_t ws_over_h2_count;
 	/* volatile to make sure code is aware other thread can change */
@@ -2241,6 +2748,9 @@ __lws_close_free_wsi(struct lws *wsi, enum lws_close_status, const char *caller)
 LWS_EXTERN void
 __lws_free_wsi(struct lws *wsi);
 
+LWS_EXTERN void
+lws_remove_child_from_any_parent(struct lws *wsi);
+
 LWS_EXTERN int
 __remove_wsi_socket_from_fds(struct lws *wsi);
 LWS_EXTERN int
@@ -2319,7 +2829,15 @@ lws_client_reset(struct lws **wsi, int ssl, const char *address, int port,
 		 const char *path, const char *host);
 
 LWS_EXTERN struct lws * LWS_WARN_UNUSED_RESULT
-lws_create_new_server_wsi(struct lws_vhost *vhost);
+lws_create_new_server_wsi(struct lws_vhost *vhost, int fixed_tsi);
+
+LWS_EXTERN struct lws *
+_lws_adopt_descriptor_vhost(struct lws_vhost *vh, lws_adoption_type type,
+			    lws_sock_file_fd_type fd, const char *vh_prot_name,
+			    struct lws *parent, int fixed_tsi);
+
+LWS_EXTERN int
+lws_vhost_has_listener(struct lws_vhost *vh);
 
 LWS_EXTERN char * LWS_WARN_UNUSED_RESULT
 lws_generate_client_handshake(struct lws *wsi, char *pkt);
@@ -2332,6 +2850,8 @@ lws_client_connect_via_info2(struct lws *wsi);
 
 LWS_EXTERN int
 _lws_destroy_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah);
+LWS_EXTERN void
+_lws_destroy_ah_pool(struct lws_context_per_thread *pt);
 
 LWS_EXTERN void
 lws_client_stash_destroy(struct lws *wsi);
@@ -2353,11 +2873,17 @@ lws_ext_cb_active(struct lws *wsi, int reason, void *buf, int len);
 LWS_EXTERN int
 lws_ext_cb_all_exts(struct lws_context *context, struct lws *wsi, int reason,
 		    void *arg, int len);
+LWS_EXTERN void
+lws_ext_1hz_track(struct lws *wsi);
+LWS_EXTERN void
+lws_ext_1hz_service(struct lws_context_per_thread *pt, time_t now);
 
 #else
 #define lws_any_extension_handled(_a, _b, _c, _d) (0)
 #define lws_ext_cb_active(_a, _b, _c, _d) (0)
 #define lws_ext_cb_all_exts(_a, _b, _c, _d, _e) (0)
+#define lws_ext_1hz_track(_a)
+#define lws_ext_1hz_service(_a, _b)
 #define lws_issue_raw_ext_access lws_issue_raw
 #define lws_context_init_extensions(_a, _b)
 #endif
@@ -2368,6 +2894,13 @@ lws_client_interpret_server_handshake(struct lws *wsi);
 LWS_EXTERN int LWS_WARN_UNUSED_RESULT
 lws_ws_rx_sm(struct lws *wsi, unsigned char c);
 
+#if defined(LWS_ROLE_WS)
+LWS_EXTERN void
+lws_ws_mask_init(void);
+#else
+#define lws_ws_mask_init()
+#endif
+
 LWS_EXTERN int
 lws_payload_until_length_exhausted(struct lws *wsi, unsigned char **buf, size_t *len);
 
@@ -2399,6 +2932,10 @@ LWS_EXTERN int lws_h2_frame_write(struct lws *wsi, int type, int flags,
 				     unsigned char *buf);
 LWS_EXTERN struct lws *
 lws_h2_wsi_from_id(struct lws *wsi, unsigned int sid);
+LWS_EXTERN int
+lws_h2_sid_index_add(struct lws *parent_wsi, struct lws *wsi);
+LWS_EXTERN void
+lws_h2_sid_index_del(struct lws *parent_wsi, struct lws *wsi);
 LWS_EXTERN int lws_hpack_interpret(struct lws *wsi,
 				   unsigned char c);
 LWS_EXTERN int
@@ -2421,6 +2958,10 @@ LWS_EXTERN void
 lws_hpack_destroy_dynamic_header(struct lws *wsi);
 LWS_EXTERN int
 lws_hpack_dynamic_size(struct lws *wsi, int size);
+LWS_EXTERN void
+lws_hpack_enc_table_size(struct lws *wsi, uint32_t size);
+LWS_EXTERN void
+lws_hpack_enc_commit(struct lws *wsi);
 LWS_EXTERN int
 lws_h2_goaway(struct lws *wsi, uint32_t err, const char *reason);
 LWS_EXTERN int
@@ -2494,6 +3035,14 @@ int lws_context_init_server(struct lws_context_creation_info *info,
 			    struct lws_vhost *vhost);
 LWS_EXTERN struct lws_vhost *
 lws_select_vhost(struct lws_context *context, int port, const char *servername);
+LWS_EXTERN int
+lws_vhost_index_add(struct lws_vhost *vh);
+LWS_EXTERN void
+lws_vhost_index_del(struct lws_vhost *vh);
+LWS_EXTERN void
+lws_vhost_index_destroy(struct lws_context *context);
+LWS_EXTERN int
+lws_mount_trie_build(struct lws_vhost *vh);
 LWS_EXTERN int LWS_WARN_UNUSED_RESULT
 lws_interpret_incoming_packet(struct lws *wsi, unsigned char **buf, size_t len);
 LWS_EXTERN void
@@ -2501,6 +3050,10 @@ lws_server_get_canonical_hostname(struct lws_context *context,
 				  struct lws_context_creation_info *info);
 #else
 #define lws_context_init_server(_a, _b) (0)
+#define lws_vhost_index_add(_a) (0)
+#define lws_vhost_index_del(_a)
+#define lws_vhost_index_destroy(_a)
+#define lws_mount_trie_build(_a) (0)
 #define lws_interpret_incoming_packet(_a, _b, _c) (0)
 #define lws_server_get_canonical_hostname(_a, _b)
 #endif
@@ -2534,6 +3087,7 @@ LWS_EXTERN void lwsl_emit_stderr(int level, const char *line);
 #define lws_ssl_anybody_has_buffered_read_tsi(_a, _b) (0)
 #define lws_tls_check_all_cert_lifetimes(_a)
 #define lws_tls_acme_sni_cert_destroy(_a)
+#define lws_tls_ticket_keys_check(_a, _b)
 #else
 #define LWS_SSL_ENABLED(context) (context->use_ssl)
 
@@ -2604,9 +3158,24 @@ lws_context_init_server_ssl(struct lws_context_creation_info *info,
 			    struct lws_vhost *vhost);
 void
 lws_tls_acme_sni_cert_destroy(struct lws_vhost *vhost);
+LWS_EXTERN int
+lws_tls_ticket_key_rotate(struct lws_vhost *vh);
+LWS_EXTERN int
+lws_tls_ticket_key_find(struct lws_vhost *vh, const uint8_t *name,
+			struct lws_tls_ticket_key *key);
+LWS_EXTERN void
+lws_tls_ticket_keys_check(struct lws_context *context, time_t now);
+LWS_EXTERN void
+lws_tls_server_handshake_done(struct lws *wsi, int resumed);
+LWS_EXTERN int
+lws_tls_server_ticket_keys_enable(struct lws_vhost *vh);
+LWS_EXTERN void
+lws_tls_server_session_cache_stats(struct lws_vhost *vh,
+				   struct lws_tls_server_session_stats *stats);
 #else
 #define lws_context_init_server_ssl(_a, _b) (0)
 #define lws_tls_acme_sni_cert_destroy(_a)
+#define lws_tls_ticket_keys_check(_a, _b)
 #endif
 LWS_EXTERN void
 lws_ssl_destroy(struct lws_vhost *vhost);
@@ -2627,6 +3196,30 @@ lws_tls_server_new_nonblocking(struct lws *wsi, lws_sockfd_type accept_fd);
 
 LWS_EXTERN enum lws_ssl_capable_status
 lws_tls_server_accept(struct lws *wsi);
+LWS_EXTERN int
+lws_tls_server_accept_poll(struct lws *wsi, int n);
+#if !defined(LWS_WITH_MBEDTLS)
+LWS_EXTERN enum lws_ssl_capable_status
+lws_tls_server_accept_step(struct lws *wsi);
+#endif
+#if defined(LWS_WITH_TLS_HANDSHAKE_POOL)
+LWS_EXTERN int
+lws_tls_server_accept_resume(struct lws *wsi, int n);
+LWS_EXTERN int
+lws_tls_hs_pool_init(struct lws_context *context,
+		     const struct lws_context_creation_info *info);
+LWS_EXTERN int
+lws_tls_hs_pool_queue(struct lws *wsi);
+LWS_EXTERN void
+lws_tls_hs_pool_service(struct lws_context *context,
+			struct lws_context_per_thread *pt);
+LWS_EXTERN void
+lws_tls_hs_pool_forget(struct lws *wsi);
+LWS_EXTERN int
+lws_tls_hs_pool_hangup(struct lws *wsi);
+LWS_EXTERN void
+lws_tls_hs_pool_destroy(struct lws_context *context);
+#endif
 
 LWS_EXTERN enum lws_ssl_capable_status
 lws_tls_server_abort_connection(struct lws *wsi);
@@ -2639,6 +3232,21 @@ lws_tls_client_connect(struct lws *wsi);
 LWS_EXTERN int
 lws_tls_client_confirm_peer_cert(struct lws *wsi, char *ebuf, int ebuf_len);
 LWS_EXTERN int
+lws_tls_session_key(struct lws *wsi, const char *sni, char *key, int len);
+LWS_EXTERN int
+lws_tls_session_offer(struct lws *wsi, const char *key);
+LWS_EXTERN int
+lws_tls_session_store(struct lws_vhost *vh, const char *key,
+		      lws_tls_session *session);
+LWS_EXTERN void
+lws_tls_session_handshake_done(struct lws *wsi, int resumed);
+LWS_EXTERN void
+lws_tls_session_cache_destroy(struct lws_vhost *vh);
+LWS_EXTERN int
+lws_tls_session_set(struct lws *wsi, lws_tls_session *session);
+LWS_EXTERN void
+lws_tls_session_free(lws_tls_session *session);
+LWS_EXTERN int
 lws_tls_client_create_vhost_context(struct lws_vhost *vh,
 				    struct lws_context_creation_info *info,
 				    const char *cipher_list,
@@ -2753,6 +3361,47 @@ lws_vhost_unlock(struct lws_vhost *vhost)
 #define lws_pt_stats_unlock(_a) (void)(_a)
 #endif
 
+#if defined(LWS_WITH_TLS_HANDSHAKE_POOL)
+/*
+ * The handshake pool threads use the ticket keys and count the server tls
+ * stats from inside SSL_accept(), so they need a real lock even without SMP
+ */
+static LWS_INLINE void
+lws_vhost_tls_lock(struct lws_vhost *vhost)
+{
+	pthread_mutex_lock(&vhost->tls_lock);
+}
+
+static LWS_INLINE void
+lws_vhost_tls_unlock(struct lws_vhost *vhost)
+{
+	pthread_mutex_unlock(&vhost->tls_lock);
+}
+
+/*
+ * SNI on the pool threads looks through vhost_list and the vhost index, so
+ * while the pool is running the service thread changes them under this
+ */
+static LWS_INLINE void
+lws_vhost_list_lock(struct lws_context *context)
+{
+	if (context->tls_hs.threads)
+		pthread_mutex_lock(&context->tls_hs.vh_lock);
+}
+
+static LWS_INLINE void
+lws_vhost_list_unlock(struct lws_context *context)
+{
+	if (context->tls_hs.threads)
+		pthread_mutex_unlock(&context->tls_hs.vh_lock);
+}
+#else
+#define lws_vhost_tls_lock(_a) lws_vhost_lock(_a)
+#define lws_vhost_tls_unlock(_a) lws_vhost_unlock(_a)
+#define lws_vhost_list_lock(_a) (void)(_a)
+#define lws_vhost_list_unlock(_a) (void)(_a)
+#endif
+
 LWS_EXTERN int LWS_WARN_UNUSED_RESULT
 lws_ssl_capable_read_no_ssl(struct lws *wsi, unsigned char *buf, int len);
 
@@ -2790,6 +3439,35 @@ LWS_EXTERN void
 lws_rewrite_destroy(struct lws_rewrite *r);
 LWS_EXTERN int
 lws_rewrite_parse(struct lws_rewrite *r, const unsigned char *in, int in_len);
+LWS_EXTERN int
+lws_client_rewrite_create(struct lws *wsi, const char *from, const char *to);
+LWS_EXTERN struct lws *
+lws_proxy_pool_take(struct lws *parent,
+		    const struct lws_client_connect_info *i);
+LWS_EXTERN int
+lws_proxy_pool_park(struct lws *wsi);
+LWS_EXTERN void
+lws_proxy_pool_remove(struct lws *wsi);
+LWS_EXTERN int
+lws_proxy_lb_create(struct lws_vhost *vh);
+LWS_EXTERN void
+lws_proxy_lb_destroy(struct lws_vhost *vh);
+LWS_EXTERN int
+lws_proxy_lb_pick(struct lws *wsi, const struct lws_http_mount *m,
+		  struct lws_proxy_backend **pbe);
+LWS_EXTERN void
+lws_proxy_lb_done(struct lws_vhost *vh, struct lws_proxy_backend *be,
+		  enum lws_pxlb_result result);
+LWS_EXTERN void
+lws_proxy_lb_release(struct lws *wsi, enum lws_pxlb_result result);
+LWS_EXTERN int
+lws_proxy_lb_health_check(struct lws_vhost *vh);
+LWS_EXTERN int
+lws_proxy_lb_health_result(struct lws *wsi);
+LWS_EXTERN void
+lws_proxy_upstream_closing(struct lws *wsi);
+LWS_EXTERN int
+lws_http_proxy_retry(struct lws *wsi, struct lws_proxy_backend *be);
 #endif
 
 #ifndef LWS_NO_CLIENT
@@ -2843,6 +3521,47 @@ lws_prepare_access_log_info(struct lws *wsi, char *uri_ptr, int meth);
 #define lws_access_log(_a)
 #endif
 
+#if defined(LWS_WITH_ACCESS_LOG_ASYNC)
+LWS_EXTERN int
+lws_access_log_init(struct lws_context *context,
+		    const struct lws_context_creation_info *info);
+LWS_EXTERN int
+lws_access_log_start_writer(struct lws_context *context);
+LWS_EXTERN void
+lws_access_log_flush(struct lws_context *context);
+LWS_EXTERN void
+lws_access_log_destroy(struct lws_context *context);
+#endif
+
+LWS_EXTERN int
+lws_buflist_append(struct lws_context_per_thread *pt,
+		   struct lws_buflist **head, const uint8_t *buf, size_t len);
+LWS_EXTERN void
+lws_buflist_use(struct lws_context_per_thread *pt, struct lws_buflist **head,
+		size_t len);
+LWS_EXTERN void
+lws_buflist_destroy_all(struct lws_context_per_thread *pt,
+			struct lws_buflist **head);
+LWS_EXTERN void
+lws_buflist_pool_destroy(struct lws_context_per_thread *pt);
+LWS_EXTERN int
+lws_flush_buffered_out(struct lws *wsi);
+LWS_EXTERN void
+lws_drop_buffered_out(struct lws *wsi);
+
+#if defined(LWS_WITH_PT_QUEUE)
+LWS_EXTERN int
+lws_pt_queue_init(struct lws_context_per_thread *pt, unsigned int depth);
+LWS_EXTERN void
+lws_pt_queue_signal(struct lws_context_per_thread *pt, int cancel);
+LWS_EXTERN int
+lws_pt_queue_service(struct lws_context_per_thread *pt);
+LWS_EXTERN void
+lws_pt_queue_forget_wsi(struct lws_context_per_thread *pt, struct lws *wsi);
+LWS_EXTERN void
+lws_pt_queue_destroy(struct lws_context_per_thread *pt);
+#endif
+
 LWS_EXTERN int
 lws_cgi_kill_terminated(struct lws_context_per_thread *pt);
 
@@ -2903,6 +3622,10 @@ lws_plat_service_periodic(struct lws_context *context);
 LWS_EXTERN int
 lws_plat_change_pollfd(struct lws_context *context, struct lws *wsi,
 		       struct lws_pollfd *pfd);
+#if defined(LWS_HAVE_SYS_SENDFILE_H)
+LWS_EXTERN int
+lws_plat_sendfile(struct lws *wsi, lws_fop_fd_t fop_fd, lws_filepos_t len);
+#endif
 LWS_EXTERN void
 lws_add_wsi_to_draining_ext_list(struct lws *wsi);
 LWS_EXTERN void
@@ -2926,6 +3649,8 @@ LWS_EXTERN void
 lws_plat_drop_app_privileges(struct lws_context_creation_info *info);
 LWS_EXTERN unsigned long long
 time_in_microseconds(void);
+LWS_EXTERN lws_usec_t
+lws_plat_monotonic_us(void);
 LWS_EXTERN const char * LWS_WARN_UNUSED_RESULT
 lws_plat_inet_ntop(int af, const void *src, char *dst, int cnt);
 LWS_EXTERN int LWS_WARN_UNUSED_RESULT
@@ -2952,6 +3677,8 @@ lws_stats_atomic_bump(struct lws_context * context,
 void
 lws_stats_atomic_max(struct lws_context * context,
 		struct lws_context_per_thread *pt, int index, uint64_t val);
+LWS_EXTERN uint64_t
+lws_stats_value(const struct lws_context *context, int index);
 #else
 static inline uint64_t lws_stats_atomic_bump(struct lws_context * context,
 		struct lws_context_per_thread *pt, int index, uint64_t bump) {
@@ -2981,6 +3708,20 @@ lws_peer_add_wsi(struct lws_context *context, struct lws_peer *peer,
 		 struct lws *wsi);
 #endif
 
+#if defined(LWS_WITH_ASYNC_DNS)
+int
+lws_async_dns_init(struct lws_context *context,
+		   struct lws_context_creation_info *info);
+int
+lws_async_dns_query(struct lws *wsi, const char *name, struct sockaddr_in *sin);
+void
+lws_async_dns_timer(struct lws *wsi);
+void
+lws_async_dns_destroy_wsi(struct lws *wsi);
+void
+lws_async_dns_destroy_cache(struct lws_context *context);
+#endif
+
 
 void
 __lws_remove_from_timeout_list(struct lws *wsi);
@@ -56,6 +56,14 @@ lws_handshake_client(struct lws *wsi, unsigned char **buf, size_t len)
 		if (wsi->rxflow_buffer)
 			wsi->rxflow_pos++;
 
+		/* consume payload bytes efficiently */
+		if (wsi->lws_rx_parse_state ==
+		    LWS_RXPS_PAYLOAD_UNTIL_LENGTH_EXHAUSTED) {
+			m = lws_payload_until_length_exhausted(wsi, buf, &len);
+			if (wsi->rxflow_buffer)
+				wsi->rxflow_pos += m;
+		}
+
 		if (lws_client_rx_sm(wsi, *(*buf)++)) {
 			lwsl_debug("client_rx_sm exited\n");
 			return -1;
@@ -324,6 +324,14 @@ lws_h1_server_socket_service(struct lws *wsi, struct lws_pollfd *pollfd)
 			case 0:
 				lwsl_info("%s: read 0 len a\n",
 					   __func__);
+				/*
+				 * If the peer hung up before sending anything
+				 * of a new request, eg, idle between keepalive
+				 * transactions, there is nothing left to do
+				 * for it... don't sit on the ah until timeout
+				 */
+				if (!wsi->hdr_parsing_completed && !ah->pos)
+					goto fail;
 				wsi->seen_zero_length_recv = 1;
 				lws_change_pollfd(wsi, LWS_POLLIN, 0);
 				 goto try_pollout;
@@ -697,6 +705,15 @@ rops_write_role_protocol_h1(struct lws *wsi, unsigned char *buf, size_t len,
 	return lws_issue_raw(wsi, (unsigned char *)buf, len);
 }
 
+static int
+rops_write_role_protocol_iov_h1(struct lws *wsi, unsigned char *hdr,
+				size_t len, enum lws_write_protocol *wp)
+{
+	/* no framing, the payload goes out as it is */
+
+	return 0;
+}
+
 struct lws_role_ops role_ops_h1 = {
 	"h1",
 	rops_handle_POLLIN_h1,
@@ -706,5 +723,6 @@ struct lws_role_ops role_ops_h1 = {
 	NULL,
 	NULL,
 	rops_write_role_protocol_h1,
-	NULL
+	NULL,
+	rops_write_role_protocol_iov_h1
 };
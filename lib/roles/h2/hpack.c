@@ -666,15 +666,29 @@ bail:
 	return 1;
 }
 
+static void
+lws_h2_enc_discard_pending(struct hpack_enc_dynamic_table *enc);
+
 void
 lws_hpack_destroy_dynamic_header(struct lws *wsi)
 {
+	struct hpack_enc_dynamic_table *enc;
 	struct hpack_dynamic_table *dyn;
 	int n;
 
 	if (!wsi->h2.h2n)
 		return;
 
+	enc = &wsi->h2.h2n->hpack_enc_table;
+	lws_h2_enc_discard_pending(enc);
+	if (enc->entries) {
+		for (n = 0; n < enc->num_entries; n++)
+			if (enc->entries[n].nv)
+				lws_free_set_NULL(enc->entries[n].nv);
+
+		lws_free_set_NULL(enc->entries);
+	}
+
 	dyn = &wsi->h2.h2n->hpack_dyn_table;
 
 	if (!dyn->entries)
@@ -1323,11 +1337,348 @@ lws_h2_num(int starting_bits, unsigned long num,
 	return 0;
 }
 
-int lws_add_http2_header_by_name(struct lws *wsi, const unsigned char *name,
-				 const unsigned char *value, int length,
-				 unsigned char **p, unsigned char *end)
+static int
+lws_h2_int(unsigned char flags, int starting_bits, unsigned long num,
+	   unsigned char **p, unsigned char *end)
 {
-	int len;
+	if (end - *p < 6)
+		return 1;
+
+	*((*p)++) = flags | lws_h2_num_start(starting_bits, num);
+
+	return lws_h2_num(starting_bits, num, p, end);
+}
+
+static int
+lws_h2_huff_len(const unsigned char *s, int len)
+{
+	int n, bits = 0;
+
+	for (n = 0; n < len; n++)
+		bits += huftable_encode_len[s[n]];
+
+	return (bits + 7) >> 3;
+}
+
+static void
+lws_h2_huff_encode(const unsigned char *s, int len, unsigned char *d)
+{
+	uint64_t acc = 0;
+	int n, bits = 0;
+
+	for (n = 0; n < len; n++) {
+		acc = (acc << huftable_encode_len[s[n]]) |
+		      huftable_encode_code[s[n]];
+		bits += huftable_encode_len[s[n]];
+		while (bits >= 8) {
+			bits -= 8;
+			*d++ = (unsigned char)(acc >> bits);
+		}
+	}
+
+	/* pad out the last byte with the msbs of EOS, which are all 1 */
+
+	if (bits)
+		*d = (unsigned char)((acc << (8 - bits)) | (0xff >> bits));
+}
+
+/*
+ * string literal, huffman coded if that comes out any shorter
+ */
+
+static int
+lws_h2_str(const unsigned char *s, int len, unsigned char **p,
+	   unsigned char *end)
+{
+	int hlen = lws_h2_huff_len(s, len);
+
+	if (end - *p < len + 6)
+		return 1;
+
+	if (hlen < len) {
+		*((*p)++) = 0x80 | lws_h2_num_start(7, hlen);
+		if (lws_h2_num(7, hlen, p, end))
+			return 1;
+		lws_h2_huff_encode(s, len, *p);
+		*p += hlen;
+
+		return 0;
+	}
+
+	*((*p)++) = lws_h2_num_start(7, len);
+	if (lws_h2_num(7, len, p, end))
+		return 1;
+	memcpy(*p, s, len);
+	*p += len;
+
+	return 0;
+}
+
+/*
+ * Returns the first static table index using this header name, or 0, and sets
+ * *full to the index of an entry matching the value too, if there is one.
+ */
+
+static int
+lws_h2_static_find(int token, const unsigned char *name, int len,
+		   const unsigned char *value, int length, int *full)
+{
+	const char *s;
+	int n, idx = 0;
+
+	*full = 0;
+
+	for (n = 1; n < (int)ARRAY_SIZE(static_token); n++) {
+		if (token >= 0) {
+			if (static_token[n] != token) {
+				if (idx)
+					break;
+				continue;
+			}
+		} else {
+			s = (const char *)lws_token_to_string(static_token[n]);
+			if (static_hdr_len[n] != len || !s ||
+			    strncmp(s, (const char *)name, len)) {
+				if (idx)
+					break;
+				continue;
+			}
+		}
+
+		if (!idx)
+			idx = n;
+
+		if (n < (int)ARRAY_SIZE(http2_canned) && http2_canned[n][0] &&
+		    (int)strlen(http2_canned[n]) == length &&
+		    !strncmp(http2_canned[n], (const char *)value, length)) {
+			*full = n;
+			break;
+		}
+	}
+
+	return idx;
+}
+
+/*
+ * How to send a literal with this static name index... 0 = add it to the
+ * dynamic table, 1 = don't bother since the value is unlikely to come again,
+ * 2 = never index it, even at intermediaries.
+ */
+
+static int
+lws_h2_enc_policy(int sidx)
+{
+	switch (sidx) {
+	case 23: /* authorization */
+	case 32: /* cookie */
+	case 49: /* proxy-authorization */
+	case 55: /* set-cookie */
+		return 2;
+
+	case 4: /* :path */
+	case 5:
+	case 21: /* age */
+	case 28: /* content-length */
+	case 30: /* content-range */
+	case 33: /* date */
+	case 34: /* etag */
+	case 36: /* expires */
+	case 40: /* if-modified-since */
+	case 41: /* if-none-match */
+	case 44: /* last-modified */
+	case 46: /* location */
+	case 50: /* range */
+	case 51: /* referer */
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Look for the header in the part of the dynamic table the peer will still
+ * have when it decodes this header, ie, after it has also added whatever is
+ * pending from earlier in the same block.
+ */
+
+static int
+lws_h2_enc_dyn_find(struct hpack_enc_dynamic_table *enc,
+		    const unsigned char *name, int len,
+		    const unsigned char *value, int length, int *name_idx)
+{
+	uint32_t used = enc->pending_size;
+	struct hpack_enc_dt_entry *e;
+	int n, idx;
+
+	*name_idx = 0;
+
+	for (n = 0; n < enc->used_entries; n++) {
+		e = &enc->entries[(enc->pos + enc->num_entries - 1 - n) %
+				  enc->num_entries];
+		used += e->name_len + e->value_len + 32;
+		if (used > enc->max)
+			break;
+
+		if (e->name_len != len || memcmp(e->nv, name, len))
+			continue;
+
+		idx = (int)ARRAY_SIZE(static_token) + enc->count_pending + n;
+		if (e->value_len == length &&
+		    !memcmp(e->nv + len, value, length))
+			return idx;
+
+		if (!*name_idx)
+			*name_idx = idx;
+	}
+
+	return 0;
+}
+
+static void
+lws_h2_enc_dyn_evict(struct hpack_enc_dynamic_table *enc, uint32_t need)
+{
+	struct hpack_enc_dt_entry *e;
+
+	while (enc->used_entries && enc->size + need > enc->max) {
+		e = &enc->entries[(enc->pos + enc->num_entries -
+				   enc->used_entries) % enc->num_entries];
+		enc->size -= e->name_len + e->value_len + 32;
+		lws_free_set_NULL(e->nv);
+		enc->used_entries--;
+	}
+}
+
+static void
+lws_h2_enc_discard_pending(struct hpack_enc_dynamic_table *enc)
+{
+	int n;
+
+	for (n = 0; n < enc->count_pending; n++)
+		lws_free_set_NULL(enc->pending[n].nv);
+
+	enc->count_pending = 0;
+	enc->pending_size = 0;
+}
+
+static int
+lws_h2_enc_pending_add(struct hpack_enc_dynamic_table *enc,
+		       const unsigned char *name, int len,
+		       const unsigned char *value, int length)
+{
+	uint32_t esize = len + length + 32;
+	struct hpack_enc_dt_entry *e;
+
+	/* big entries would just flush out the ones that repeat */
+
+	if (esize > enc->max / 4 ||
+	    enc->count_pending == LWS_H2_HPACK_ENC_MAX_PENDING)
+		return 1;
+
+	if (!enc->entries) {
+		enc->num_entries = LWS_H2_HPACK_ENC_TABLE_MAX / 32;
+		enc->entries = lws_zalloc(sizeof(*enc->entries) *
+					  enc->num_entries, "hpack enc dyn");
+		if (!enc->entries)
+			return 1;
+	}
+
+	e = &enc->pending[enc->count_pending];
+	e->nv = lws_malloc(len + length + 1, "hpack enc nv");
+	if (!e->nv)
+		return 1;
+
+	memcpy(e->nv, name, len);
+	memcpy(e->nv + len, value, length);
+	e->name_len = len;
+	e->value_len = length;
+
+	enc->count_pending++;
+	enc->pending_size += esize;
+
+	return 0;
+}
+
+/*
+ * The header block has been sent, so the peer will add what we asked it to
+ * as well... follow suit
+ */
+
+void
+lws_hpack_enc_commit(struct lws *wsi)
+{
+	struct lws *nwsi = lws_get_network_wsi(wsi);
+	struct hpack_enc_dynamic_table *enc;
+	struct hpack_enc_dt_entry *e;
+	uint32_t esize;
+	int n;
+
+	if (!nwsi->h2.h2n)
+		return;
+
+	enc = &nwsi->h2.h2n->hpack_enc_table;
+	enc->size_update = 0;
+	enc->in_block = 0;
+
+	for (n = 0; n < enc->count_pending; n++) {
+		e = &enc->pending[n];
+		esize = e->name_len + e->value_len + 32;
+
+		lws_h2_enc_dyn_evict(enc, esize);
+		if (esize > enc->max) {
+			lws_free_set_NULL(e->nv);
+			continue;
+		}
+
+		enc->entries[enc->pos] = *e;
+		enc->pos = (enc->pos + 1) % enc->num_entries;
+		enc->used_entries++;
+		enc->size += esize;
+		e->nv = NULL;
+	}
+
+	enc->count_pending = 0;
+	enc->pending_size = 0;
+}
+
+/*
+ * The peer told us how big its decoder dynamic table may be... we use up to
+ * LWS_H2_HPACK_ENC_TABLE_MAX of it, and must tell it at the start of the next
+ * header block if that changed what we are using.
+ */
+
+void
+lws_hpack_enc_table_size(struct lws *wsi, uint32_t size)
+{
+	struct lws *nwsi = lws_get_network_wsi(wsi);
+	struct hpack_enc_dynamic_table *enc;
+
+	if (!nwsi->h2.h2n)
+		return;
+
+	enc = &nwsi->h2.h2n->hpack_enc_table;
+
+	if (size > LWS_H2_HPACK_ENC_TABLE_MAX)
+		size = LWS_H2_HPACK_ENC_TABLE_MAX;
+
+	if (size == enc->max)
+		return;
+
+	lwsl_info("%s: encoder table %u -> %u\n", __func__, enc->max, size);
+
+	enc->max = size;
+	enc->size_update = 1;
+	lws_h2_enc_dyn_evict(enc, 0);
+}
+
+static int
+lws_h2_enc_header(struct lws *wsi, int token, const unsigned char *name,
+		  const unsigned char *value, int length,
+		  unsigned char **p, unsigned char *end)
+{
+	struct lws *nwsi = lws_get_network_wsi(wsi);
+	struct hpack_enc_dynamic_table *enc = NULL;
+	int len, sidx, full, idx, policy;
+	static const unsigned char flags[] = { 0x40, 0x00, 0x10 };
 
 	lwsl_header("%s: %p  %s:%s\n", __func__, *p, name, value);
 
@@ -1346,24 +1697,62 @@ int lws_add_http2_header_by_name(struct lws *wsi, const unsigned char *name,
 	if (end - *p < len + length + 8)
 		return 1;
 
-	*((*p)++) = 0; /* literal hdr, literal name,  */
+	if (nwsi->h2.h2n)
+		enc = &nwsi->h2.h2n->hpack_enc_table;
 
-	*((*p)++) = 0 | lws_h2_num_start(7, len); /* non-HUF */
-	if (lws_h2_num(7, len, p, end))
-		return 1;
-	memcpy(*p, name, len);
-	*p += len;
+	sidx = lws_h2_static_find(token, name, len, value, length, &full);
 
-	*((*p)++) = 0 | lws_h2_num_start(7, length); /* non-HUF */
-	if (lws_h2_num(7, length, p, end))
-		return 1;
+	/*
+	 * The first header since the last block was sent starts a new block,
+	 * which must open with any table size update, whatever the header is
+	 * (trailers have no pseudo-headers).  :status or :method can only come
+	 * first in a block too, so if one of those turns up with a block still
+	 * open, that one was never sent and what it left pending is void.
+	 */
+
+	if (enc && (!enc->in_block || sidx == 2 || sidx == 8)) {
+		lws_h2_enc_discard_pending(enc);
+		if (enc->size_update &&
+		    lws_h2_int(0x20, 5, enc->max, p, end))
+			return 1;
+		enc->in_block = 1;
+	}
+
+	if (full) /* static table has both name and value */
+		return lws_h2_int(0x80, 7, full, p, end);
 
-	memcpy(*p, value, length);
-	*p += length;
+	idx = 0;
+	if (enc && enc->max) {
+		full = lws_h2_enc_dyn_find(enc, name, len, value, length, &idx);
+		if (full)
+			return lws_h2_int(0x80, 7, full, p, end);
+	}
 
-	//lwsl_hexdump(op, *p -op);
+	if (sidx)
+		idx = sidx;
 
-	return 0;
+	policy = lws_h2_enc_policy(sidx);
+	if (!policy && (!enc ||
+	    lws_h2_enc_pending_add(enc, name, len, value, length)))
+		policy = 1;
+
+	if (idx) {
+		if (lws_h2_int(flags[policy], policy ? 4 : 6, idx, p, end))
+			return 1;
+	} else {
+		*((*p)++) = flags[policy]; /* literal name */
+		if (lws_h2_str(name, len, p, end))
+			return 1;
+	}
+
+	return lws_h2_str(value, length, p, end);
+}
+
+int lws_add_http2_header_by_name(struct lws *wsi, const unsigned char *name,
+				 const unsigned char *value, int length,
+				 unsigned char **p, unsigned char *end)
+{
+	return lws_h2_enc_header(wsi, -1, name, value, length, p, end);
 }
 
 int lws_add_http2_header_by_token(struct lws *wsi, enum lws_token_indexes token,
@@ -1376,9 +1765,8 @@ int lws_add_http2_header_by_token(struct lws *wsi, enum lws_token_indexes token,
 	if (!name)
 		return 1;
 
-	return lws_add_http2_header_by_name(wsi, name, value, length, p, end);
+	return lws_h2_enc_header(wsi, token, name, value, length, p, end);
 }
-
 int lws_add_http2_header_status(struct lws *wsi, unsigned int code,
 				unsigned char **p, unsigned char *end)
 {
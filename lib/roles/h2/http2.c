@@ -132,6 +132,7 @@ lws_h2_new_pps(enum lws_h2_protocol_send_type type)
 void lws_h2_init(struct lws *wsi)
 {
 	wsi->h2.h2n->set = wsi->vhost->set;
+	wsi->h2.h2n->hpack_enc_table.max = LWS_H2_HPACK_ENC_TABLE_MAX;
 }
 
 void
@@ -175,7 +176,8 @@ lws_wsi_server_new(struct lws_vhost *vh, struct lws *parent_wsi,
 		lwsl_notice("reached concurrent stream limit\n");
 		return NULL;
 	}
-	wsi = lws_create_new_server_wsi(vh);
+	/* streams are serviced by the network connection's thread */
+	wsi = lws_create_new_server_wsi(vh, parent_wsi->tsi);
 	if (!wsi) {
 		lwsl_notice("new server wsi failed (vh %p)\n", vh);
 		return NULL;
@@ -193,6 +195,8 @@ lws_wsi_server_new(struct lws_vhost *vh, struct lws *parent_wsi,
 	/* first child is now the new guy */
 	parent_wsi->h2.child_list = wsi;
 	parent_wsi->h2.child_count++;
+	if (lws_h2_sid_index_add(parent_wsi, wsi))
+		goto bail1;
 
 	wsi->h2.my_priority = 16;
 	wsi->h2.tx_cr = nwsi->h2.h2n->set.s[H2SET_INITIAL_WINDOW_SIZE];
@@ -216,6 +220,7 @@ lws_wsi_server_new(struct lws_vhost *vh, struct lws *parent_wsi,
 
 bail1:
 	/* undo the insert */
+	lws_h2_sid_index_del(parent_wsi, wsi);
 	parent_wsi->h2.child_list = wsi->h2.sibling_list;
 	parent_wsi->h2.child_count--;
 
@@ -309,30 +314,138 @@ int lws_h2_issue_preface(struct lws *wsi)
 	return 0;
 }
 
-struct lws *
-lws_h2_wsi_from_id(struct lws *parent_wsi, unsigned int sid)
+/*
+ * Each network connection keeps an open addressed hash of its streams by sid,
+ * so finding the stream a frame is for doesn't depend on how many streams
+ * are open.  Deletion shifts later entries in the same run back, so no
+ * tombstones are needed.
+ */
+
+static uint32_t
+lws_h2_sid_hash(struct lws_h2_netconn *h2n, unsigned int sid)
 {
-	lws_start_foreach_ll(struct lws *, wsi, parent_wsi->h2.child_list) {
-		if (wsi->h2.my_sid == sid)
-			return wsi;
-	} lws_end_foreach_ll(wsi, h2.sibling_list);
+	return (sid * 2654435761u) >> (32 - h2n->sid_index_bits);
+}
 
-	return NULL;
+static int
+lws_h2_sid_index_resize(struct lws_h2_netconn *h2n, int bits)
+{
+	struct lws **old = h2n->sid_index;
+	uint32_t n, h, old_size = old ? 1u << h2n->sid_index_bits : 0;
+
+	h2n->sid_index = lws_zalloc(sizeof(struct lws *) << bits,
+				    "h2 sid index");
+	if (!h2n->sid_index) {
+		h2n->sid_index = old;
+
+		return 1;
+	}
+	h2n->sid_index_bits = (uint8_t)bits;
+
+	for (n = 0; n < old_size; n++) {
+		if (!old[n])
+			continue;
+		h = lws_h2_sid_hash(h2n, old[n]->h2.my_sid);
+		while (h2n->sid_index[h])
+			h = (h + 1) & ((1u << bits) - 1);
+		h2n->sid_index[h] = old[n];
+	}
+
+	lws_free(old);
+
+	return 0;
 }
 
-int lws_remove_server_child_wsi(struct lws_context *context, struct lws *wsi)
+int
+lws_h2_sid_index_add(struct lws *parent_wsi, struct lws *wsi)
 {
-	lws_start_foreach_llp(struct lws **, w, wsi->h2.child_list) {
-		if (*w == wsi) {
-			*w = wsi->h2.sibling_list;
-			(wsi->h2.parent_wsi)->h2.child_count--;
-			return 0;
-		}
-	} lws_end_foreach_llp(w, h2.sibling_list);
+	struct lws_h2_netconn *h2n = parent_wsi->h2.h2n;
+	uint32_t h, mask;
+
+	if (!h2n)
+		return 0;
 
-	lwsl_err("%s: can't find %p\n", __func__, wsi);
+	/* keep it no more than half full */
 
-	return 1;
+	if (!h2n->sid_index || (h2n->sid_index_count + 1) * 2 >
+				(1u << h2n->sid_index_bits))
+		if (lws_h2_sid_index_resize(h2n, h2n->sid_index ?
+					h2n->sid_index_bits + 1 : 4) &&
+		    (!h2n->sid_index ||
+		     h2n->sid_index_count + 1 >= (1u << h2n->sid_index_bits)))
+			return 1;
+
+	mask = (1u << h2n->sid_index_bits) - 1;
+	h = lws_h2_sid_hash(h2n, wsi->h2.my_sid);
+	while (h2n->sid_index[h])
+		h = (h + 1) & mask;
+
+	h2n->sid_index[h] = wsi;
+	h2n->sid_index_count++;
+
+	return 0;
+}
+
+void
+lws_h2_sid_index_del(struct lws *parent_wsi, struct lws *wsi)
+{
+	struct lws_h2_netconn *h2n = parent_wsi->h2.h2n;
+	uint32_t i, j, k, mask;
+
+	if (!h2n || !h2n->sid_index)
+		return;
+
+	mask = (1u << h2n->sid_index_bits) - 1;
+	i = lws_h2_sid_hash(h2n, wsi->h2.my_sid);
+	while (h2n->sid_index[i] != wsi) {
+		if (!h2n->sid_index[i])
+			return; /* not indexed */
+		i = (i + 1) & mask;
+	}
+
+	/* close the gap by pulling back anything that probed past it */
+
+	j = i;
+	while (1) {
+		j = (j + 1) & mask;
+		if (!h2n->sid_index[j])
+			break;
+		k = lws_h2_sid_hash(h2n, h2n->sid_index[j]->h2.my_sid);
+		if (((j - k) & mask) < ((j - i) & mask))
+			continue; /* its home is between the gap and it */
+		h2n->sid_index[i] = h2n->sid_index[j];
+		i = j;
+	}
+
+	h2n->sid_index[i] = NULL;
+	h2n->sid_index_count--;
+}
+
+struct lws *
+lws_h2_wsi_from_id(struct lws *parent_wsi, unsigned int sid)
+{
+	struct lws_h2_netconn *h2n = parent_wsi->h2.h2n;
+	uint32_t h, mask;
+
+	if (!h2n || !h2n->sid_index) {
+		lws_start_foreach_ll(struct lws *, wsi,
+				     parent_wsi->h2.child_list) {
+			if (wsi->h2.my_sid == sid)
+				return wsi;
+		} lws_end_foreach_ll(wsi, h2.sibling_list);
+
+		return NULL;
+	}
+
+	mask = (1u << h2n->sid_index_bits) - 1;
+	h = lws_h2_sid_hash(h2n, sid);
+	while (h2n->sid_index[h]) {
+		if (h2n->sid_index[h]->h2.my_sid == sid)
+			return h2n->sid_index[h];
+		h = (h + 1) & mask;
+	}
+
+	return NULL;
 }
 
 void
@@ -420,6 +533,7 @@ lws_h2_settings(struct lws *wsi, struct http2_settings *settings,
 
 		switch (a) {
 		case H2SET_HEADER_TABLE_SIZE:
+			lws_hpack_enc_table_size(nwsi, b);
 			break;
 		case H2SET_ENABLE_PUSH:
 			if (b > 1) {
@@ -1513,6 +1627,19 @@ lws_h2_parse_end_of_frame(struct lws *wsi)
 			/* it helps, but won't change sendability for anyone */
 			break;
 
+		if (h2n->sid) {
+			/*
+			 * a stream's own credit only affects that stream, and
+			 * only if it was stalled waiting for some
+			 */
+			if (eff_wsi->h2.skint && lws_h2_tx_cr_get(eff_wsi)) {
+				lwsl_info("%s: %p: skint\n", __func__, eff_wsi);
+				eff_wsi->h2.skint = 0;
+				lws_callback_on_writable(eff_wsi);
+			}
+			break;
+		}
+
 		/*
 		 * It did change sendability... for us and any children waiting
 		 * on us... reassess blockage for all children first
@@ -1978,7 +2105,11 @@ lws_h2_client_handshake(struct lws *wsi)
 	int sid = nwsi->h2.h2n->highest_sid_opened + 2;
 
 	nwsi->h2.h2n->highest_sid_opened = sid;
+	/* it may already be indexed if it was migrated on to sid 1 */
+	lws_h2_sid_index_del(wsi->h2.parent_wsi, wsi);
 	wsi->h2.my_sid = sid;
+	if (lws_h2_sid_index_add(wsi->h2.parent_wsi, wsi))
+		return 1;
 
 	lwsl_info("%s: CLIENT_WAITING_TO_SEND_HEADERS: pollout (sid %d)\n",
 			__func__, wsi->h2.my_sid);
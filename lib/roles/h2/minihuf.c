@@ -514,5 +514,25 @@ again:
 
 	fprintf(stderr, "All decode OK\n");
 
+	/*
+	 * Emit the literal table itself too, for the hpack encoder
+	 */
+
+	fprintf(stdout, "\n/* huffman code and length for each literal */\n"
+			"static const unsigned int huftable_encode_code[] = {");
+	for (n = 0; n < ARRAY_SIZE(huf_literal); n++) {
+		if (!(n & 3))
+			fprintf(stdout, "\n\t");
+		fprintf(stdout, "0x%08x, ", huf_literal[n].code);
+	}
+	fprintf(stdout, "\n};\n\nstatic const unsigned char "
+			"huftable_encode_len[] = {");
+	for (n = 0; n < ARRAY_SIZE(huf_literal); n++) {
+		if (!(n & 7))
+			fprintf(stdout, "\n\t");
+		fprintf(stdout, "%2d, ", huf_literal[n].len);
+	}
+	fprintf(stdout, "\n};\n");
+
 	return 0;
 }
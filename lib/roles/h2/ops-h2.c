@@ -104,7 +104,7 @@ rops_handle_POLLIN_h2(struct lws_context_per_thread *pt, struct lws *wsi,
 
 	if (wsi->http2_substream || wsi->upgraded_to_http2) {
 		wsi1 = lws_get_network_wsi(wsi);
-		if (wsi1 && wsi1->trunc_len)
+		if (wsi1 && lws_has_buffered_out(wsi1))
 			/* We cannot deal with any kind of new RX
 			 * because we are dealing with a partial send
 			 * (new RX may trigger new http_action() that
@@ -399,6 +399,7 @@ static int
 rops_write_role_protocol_h2(struct lws *wsi, unsigned char *buf, size_t len,
 			    enum lws_write_protocol *wp)
 {
+	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
 	unsigned char flags = 0;
 	int n;
 
@@ -467,6 +468,17 @@ rops_write_role_protocol_h2(struct lws *wsi, unsigned char *buf, size_t len,
 		wsi->h2.send_END_STREAM = 1;
 	}
 
+	if (n != LWS_H2_FRAME_TYPE_DATA) {
+		/* the peer will act on any hpack table inserts in there */
+		lws_hpack_enc_commit(wsi);
+
+		lws_stats_atomic_bump(wsi->context, pt,
+				      LWSSTATS_B_H2_TX_HEADERS, len);
+		if (flags & LWS_H2_FLAG_END_HEADERS)
+			lws_stats_atomic_bump(wsi->context, pt,
+					LWSSTATS_C_H2_TX_HEADER_BLOCKS, 1);
+	}
+
 	return lws_h2_frame_write(wsi, n, flags, wsi->h2.my_sid,
 				  (int)len, buf);
 }
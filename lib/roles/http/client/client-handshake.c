@@ -32,7 +32,10 @@ lws_client_connect_2(struct lws *wsi)
 	struct lws_context_per_thread *pt = &context->pt[(int)wsi->tsi];
 	const char *cce = "", *iface, *adsin, *meth;
 	struct lws *wsi_piggyback = NULL;
-	struct addrinfo *result;
+	struct addrinfo *result, ai_dns;
+#if defined(LWS_WITH_ASYNC_DNS)
+	struct sockaddr_in sin_dns;
+#endif
 	struct lws_pollfd pfd;
 	ssize_t plen = 0;
 	const char *ads;
@@ -56,9 +59,16 @@ lws_client_connect_2(struct lws *wsi)
 		goto oom4;
 	}
 
+	meth = lws_hdr_simple_ptr(wsi, _WSI_TOKEN_CLIENT_METHOD);
+
+#if defined(LWS_WITH_ASYNC_DNS)
+	if (lwsi_state(wsi) == LRS_WAITING_DNS)
+		/* back with our address, we already chose our own connection */
+		goto create_new_conn;
+#endif
+
 	/* we can only piggyback GET */
 
-	meth = lws_hdr_simple_ptr(wsi, _WSI_TOKEN_CLIENT_METHOD);
 	if (meth && strcmp(meth, "GET"))
 		goto create_new_conn;
 
@@ -219,7 +229,35 @@ create_new_conn:
 
        lwsl_info("%s: %p: address %s\n", __func__, wsi, ads);
 
-       n = lws_getaddrinfo46(wsi, ads, &result);
+#if defined(LWS_WITH_ASYNC_DNS)
+	switch (lws_async_dns_query(wsi, ads, &sin_dns)) {
+	case LADNS_WAITING:
+		/* we'll be called again when the answer comes */
+		if (lwsi_state(wsi) != LRS_WAITING_DNS) {
+			lwsi_set_state(wsi, LRS_WAITING_DNS);
+			lws_set_timeout(wsi,
+					PENDING_TIMEOUT_AWAITING_CONNECT_RESPONSE,
+					AWAITING_TIMEOUT);
+		}
+		return wsi;
+	case LADNS_FAILED:
+		cce = "async dns failed";
+		goto oom4;
+	case LADNS_RESOLVED:
+		memset(&ai_dns, 0, sizeof(ai_dns));
+		ai_dns.ai_family = AF_INET;
+		ai_dns.ai_addr = (struct sockaddr *)&sin_dns;
+		ai_dns.ai_addrlen = sizeof(sin_dns);
+		result = &ai_dns;
+		n = 0;
+		break;
+	default:
+		n = lws_getaddrinfo46(wsi, ads, &result);
+		break;
+	}
+#else
+	n = lws_getaddrinfo46(wsi, ads, &result);
+#endif
 
 #ifdef LWS_WITH_IPV6
 	if (wsi->ipv6) {
@@ -260,7 +298,8 @@ create_new_conn:
 			break;
 		default:
 			lwsl_err("Unknown address family\n");
-			freeaddrinfo(result);
+			if (result != &ai_dns)
+				freeaddrinfo(result);
 			cce = "unknown address family";
 			goto oom4;
 		}
@@ -306,7 +345,7 @@ create_new_conn:
 		}
 
 		if (!p) {
-			if (result)
+			if (result && result != &ai_dns)
 				freeaddrinfo(result);
 			lwsl_err("Couldn't identify address\n");
 			cce = "unable to lookup address";
@@ -318,7 +357,7 @@ create_new_conn:
 		bzero(&sa46.sa4.sin_zero, 8);
 	}
 
-	if (result)
+	if (result && result != &ai_dns)
 		freeaddrinfo(result);
 
 	/* now we decided on ipv4 or ipv6, set the port */
@@ -550,6 +589,11 @@ send_hs:
 	return wsi;
 
 oom4:
+#if defined(LWS_WITH_ASYNC_DNS)
+	if (lwsi_state(wsi) == LRS_WAITING_DNS)
+		/* the user already has this wsi, it has to close normally */
+		goto failed;
+#endif
 	/* we're closing, losing some rx is OK */
 	lws_header_table_force_to_detachable_state(wsi);
 
@@ -824,6 +868,22 @@ html_parser_cb(const hubbub_token *token, void *pw)
 
 	return HUBBUB_OK;
 }
+
+/*
+ * the rewriter's parser state is per-document, so a proxy conn that is
+ * reused for another transaction needs a fresh one
+ */
+
+int
+lws_client_rewrite_create(struct lws *wsi, const char *from, const char *to)
+{
+	if (wsi->rw)
+		lws_rewrite_destroy(wsi->rw);
+
+	wsi->rw = lws_rewrite_create(wsi, html_parser_cb, from, to);
+
+	return !wsi->rw;
+}
 #endif
 
 static char *
@@ -1021,9 +1081,8 @@ lws_client_connect_via_info(struct lws_client_connect_info *i)
 	}
 #ifdef LWS_WITH_HTTP_PROXY
 	if (i->uri_replace_to)
-		wsi->rw = lws_rewrite_create(wsi, html_parser_cb,
-					     i->uri_replace_from,
-					     i->uri_replace_to);
+		lws_client_rewrite_create(wsi, i->uri_replace_from,
+					  i->uri_replace_to);
 #endif
 
 	return wsi;
@@ -525,6 +525,19 @@ bail3:
 		lws_close_free_wsi(wsi, LWS_CLOSE_STATUS_NOSTATUS, "cbail3");
 		return -1;
 
+	case LRS_IDLING:
+		/*
+		 * nothing should come from the server between transactions,
+		 * so anything here means it is closing the connection
+		 */
+		if (!(pollfd->revents & (LWS_POLLIN | LWS_POLLHUP)))
+			break;
+
+		lwsl_info("%s: %p: server closed idle conn\n", __func__, wsi);
+		wsi->already_did_cce = 1;
+		lws_close_free_wsi(wsi, LWS_CLOSE_STATUS_NOSTATUS, "idle hup");
+		return -1;
+
 	default:
 		break;
 	}
@@ -549,6 +562,15 @@ lws_http_transaction_completed_client(struct lws *wsi)
 		return -1;
 	}
 
+#if defined(LWS_WITH_HTTP_PROXY)
+	/* the origin answered us fine */
+	lws_proxy_lb_release(wsi, LWSPXLB_OK);
+
+	/* a proxy mount's connection to the origin may be kept for reuse */
+	if (wsi->proxy_upstream && wsi_eff == wsi)
+		return lws_proxy_pool_park(wsi);
+#endif
+
 	/*
 	 * Are we constitutionally capable of having a queue, ie, we are on
 	 * the "active client connections" list?
@@ -838,7 +860,9 @@ lws_client_interpret_server_handshake(struct lws *wsi)
 
 #ifdef LWS_WITH_HTTP_PROXY
 		wsi->perform_rewrite = 0;
-		if (lws_hdr_total_length(wsi, WSI_TOKEN_HTTP_CONTENT_TYPE)) {
+		/* only proxy connections that asked for it have a rewriter */
+		if (wsi->rw &&
+		    lws_hdr_total_length(wsi, WSI_TOKEN_HTTP_CONTENT_TYPE)) {
 			if (!strncmp(lws_hdr_simple_ptr(wsi,
 						WSI_TOKEN_HTTP_CONTENT_TYPE),
 						"text/html", 9))
@@ -917,6 +941,21 @@ lws_client_interpret_server_handshake(struct lws *wsi)
 
 		lwsl_info("%s: client connection up\n", __func__);
 
+		/*
+		 * If there's no body coming, the transaction is already over
+		 * and nothing else is going to tell us so
+		 */
+		if (w == wsi && !wsi->chunked && !wsi->http.rx_content_length &&
+		    (lws_hdr_total_length(wsi, WSI_TOKEN_HTTP_CONTENT_LENGTH) ||
+		     ah->http_response == HTTP_STATUS_NO_CONTENT ||
+		     ah->http_response == HTTP_STATUS_NOT_MODIFIED) &&
+		    lws_http_transaction_completed_client(wsi)) {
+			lws_close_free_wsi(wsi, LWS_CLOSE_STATUS_NOSTATUS,
+					   "zero length done");
+
+			return 1;
+		}
+
 		return 0;
 	}
 
@@ -21,6 +21,10 @@
 
 #include "private-libwebsockets.h"
 
+#if defined(LWS_WITH_ACCESS_LOG_ASYNC)
+#include <sys/uio.h>
+#endif
+
 /*
  * Produce Apache-compatible log string for wsi, like this:
  *
@@ -122,6 +126,344 @@ lws_prepare_access_log_info(struct lws *wsi, char *uri_ptr, int meth)
 	}
 }
 
+#if defined(LWS_WITH_ACCESS_LOG_ASYNC)
+
+/*
+ * The service threads only copy each finished line into their pt's ring.
+ * One writer thread per context writes them out with writev(), every
+ * alog_flush_ms or as soon as a ring gets half full, so a slow log disk
+ * no longer adds to the service threads' latency.
+ *
+ * A vhost created later may start the writer while the service threads are
+ * already logging, so each ring's buf is only set or looked at under the
+ * ring's lock, and alog_thread_running only under alog_lock.
+ */
+
+#define LWS_ALOG_ALIGN(_n) (((_n) + sizeof(struct lws_alog_rec) - 1) & \
+			    ~(sizeof(struct lws_alog_rec) - 1))
+#define LWS_ALOG_IOV 128
+
+/* returns nonzero if the ring isn't there (yet) and the caller must write */
+
+static int
+lws_alog_append(struct lws_context *context, struct lws_context_per_thread *pt,
+		int fd, const char *line, int len)
+{
+	size_t need = sizeof(struct lws_alog_rec) + LWS_ALOG_ALIGN(len), off,
+	       room;
+	struct lws_alog_ring *r = &pt->alog;
+	struct lws_alog_rec *rec;
+	int kick = 0;
+
+	pthread_mutex_lock(&r->lock);
+
+	if (!r->buf) {
+		pthread_mutex_unlock(&r->lock);
+
+		return 1;
+	}
+
+	for (;;) {
+		off = r->head % r->size;
+		room = r->size - off;
+		/* if it won't fit before the end, the end is wasted too */
+		if (need + (need > room ? room : 0) <=
+		    r->size - (r->head - r->tail))
+			break;
+
+		if (context->alog_overflow != LWS_ALOG_OVERFLOW_WAIT) {
+			r->dropped++;
+			kick = !r->kicked;
+			r->kicked = 1;
+			pthread_mutex_unlock(&r->lock);
+			if (kick)
+				pthread_cond_signal(&context->alog_cond);
+
+			return 0;
+		}
+
+		r->kicked = 1;
+		pthread_cond_signal(&context->alog_cond);
+		pthread_cond_wait(&r->space, &r->lock);
+	}
+
+	if (need > room) {
+		rec = (struct lws_alog_rec *)(r->buf + off);
+		rec->fd = -1;
+		rec->len = (int)(room - sizeof(*rec));
+		r->head += room;
+		off = 0;
+	}
+
+	rec = (struct lws_alog_rec *)(r->buf + off);
+	rec->fd = fd;
+	rec->len = len;
+	memcpy(rec + 1, line, len);
+	r->head += need;
+
+	if (!r->kicked && r->head - r->tail > r->size / 2) {
+		r->kicked = 1;
+		kick = 1;
+	}
+
+	pthread_mutex_unlock(&r->lock);
+
+	if (kick)
+		pthread_cond_signal(&context->alog_cond);
+
+	return 0;
+}
+
+static void
+lws_alog_writev(int fd, struct iovec *iov, int n)
+{
+	ssize_t w;
+
+	while (n) {
+		w = writev(fd, iov, n);
+		if (w < 0) {
+			if (errno == EINTR)
+				continue;
+			lwsl_err("Failed to write log\n");
+			return;
+		}
+
+		while (n && (size_t)w >= iov->iov_len) {
+			w -= iov->iov_len;
+			iov++;
+			n--;
+		}
+		if (n) {
+			iov->iov_base = (char *)iov->iov_base + w;
+			iov->iov_len -= w;
+		}
+	}
+}
+
+/* call with context->alog_lock held, returns nonzero if it was kicked again */
+
+static int
+lws_alog_drain_ring(struct lws_context *context, struct lws_alog_ring *r)
+{
+	struct iovec iov[LWS_ALOG_IOV];
+	struct lws_alog_rec *rec;
+	unsigned int dropped;
+	size_t t, h;
+	int fd = -1, n, kicked;
+
+	pthread_mutex_lock(&r->lock);
+	t = r->tail;
+	h = r->head;
+	dropped = r->dropped;
+	r->dropped = 0;
+	pthread_mutex_unlock(&r->lock);
+
+	context->alog_dropped += dropped;
+
+
+	while (t != h) {
+		/* lines for the same log that are contiguous in the ring */
+		n = 0;
+		while (t != h && n < LWS_ALOG_IOV) {
+			rec = (struct lws_alog_rec *)(r->buf + (t % r->size));
+			if (rec->fd != -1) {
+				if (n && rec->fd != fd)
+					break;
+				fd = rec->fd;
+				iov[n].iov_base = rec + 1;
+				iov[n++].iov_len = rec->len;
+			}
+			t += sizeof(*rec) + LWS_ALOG_ALIGN(rec->len);
+		}
+
+		if (n)
+			lws_alog_writev(fd, iov, n);
+
+		pthread_mutex_lock(&r->lock);
+		r->tail = t;
+		pthread_cond_broadcast(&r->space);
+		pthread_mutex_unlock(&r->lock);
+	}
+
+	pthread_mutex_lock(&r->lock);
+	kicked = r->head - r->tail > r->size / 2;
+	r->kicked = (char)kicked;
+	pthread_mutex_unlock(&r->lock);
+
+	return kicked;
+}
+
+static int
+lws_alog_drain(struct lws_context *context)
+{
+	time_t now = time(NULL);
+	int n, again = 0;
+
+	for (n = 0; n < context->count_threads; n++)
+		again |= lws_alog_drain_ring(context, &context->pt[n].alog);
+
+	/* at most one complaint a second */
+
+	if (context->alog_dropped && now != context->alog_last_warn) {
+		lwsl_warn("access log buffer full, dropped %u lines\n",
+			  context->alog_dropped);
+		context->alog_dropped = 0;
+		context->alog_last_warn = now;
+	}
+
+	return again;
+}
+
+static void *
+lws_alog_writer(void *d)
+{
+	struct lws_context *context = (struct lws_context *)d;
+	struct timespec ts;
+
+	pthread_mutex_lock(&context->alog_lock);
+
+	while (!context->alog_thread_stop) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += context->alog_flush_ms / 1000;
+		ts.tv_nsec += (context->alog_flush_ms % 1000) * 1000000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&context->alog_cond,
+				       &context->alog_lock, &ts);
+
+		while (lws_alog_drain(context))
+			;
+	}
+
+	context->alog_last_warn = 0;
+	lws_alog_drain(context);
+
+	pthread_mutex_unlock(&context->alog_lock);
+
+	return NULL;
+}
+
+int
+lws_access_log_init(struct lws_context *context,
+		    const struct lws_context_creation_info *info)
+{
+	size_t size = info->access_log_ring_size;
+	int n;
+
+	if (!size)
+		size = 65536;
+	if (size < 4096)
+		size = 4096; /* comfortably more than one line */
+	size = LWS_ALOG_ALIGN(size);
+
+	context->alog_flush_ms = info->access_log_flush_ms ?
+				 info->access_log_flush_ms : 250;
+	context->alog_overflow = info->access_log_overflow;
+
+	pthread_mutex_init(&context->alog_lock, NULL);
+	pthread_cond_init(&context->alog_cond, NULL);
+
+	for (n = 0; n < context->count_threads; n++) {
+		pthread_mutex_init(&context->pt[n].alog.lock, NULL);
+		pthread_cond_init(&context->pt[n].alog.space, NULL);
+		context->pt[n].alog.size = size;
+	}
+
+	return 0;
+}
+
+/*
+ * the writer thread and the rings only appear once a vhost opens an access
+ * log, until then (or if we can't start it) lines are written directly
+ */
+
+int
+lws_access_log_start_writer(struct lws_context *context)
+{
+	char *buf[LWS_MAX_SMP];
+	int n, ret = 0;
+
+	pthread_mutex_lock(&context->alog_lock);
+
+	if (context->alog_thread_running)
+		goto done;
+
+	memset(buf, 0, sizeof(buf));
+	for (n = 0; n < context->count_threads; n++) {
+		buf[n] = lws_malloc(context->pt[n].alog.size, "access log ring");
+		if (!buf[n])
+			goto bail;
+	}
+
+	/* it can't look at the rings until we let go of alog_lock */
+	if (pthread_create(&context->alog_thread, NULL, lws_alog_writer,
+			   context))
+		goto bail;
+
+	context->alog_thread_running = 1;
+
+	/* the service threads start using each ring from here */
+	for (n = 0; n < context->count_threads; n++) {
+		pthread_mutex_lock(&context->pt[n].alog.lock);
+		context->pt[n].alog.buf = buf[n];
+		pthread_mutex_unlock(&context->pt[n].alog.lock);
+	}
+
+	goto done;
+
+bail:
+	lwsl_warn("%s: writing access logs synchronously\n", __func__);
+	for (n = 0; n < context->count_threads; n++)
+		lws_free(buf[n]);
+	ret = 1;
+
+done:
+	pthread_mutex_unlock(&context->alog_lock);
+
+	return ret;
+}
+
+/* write out everything buffered so far, before a log fd is closed */
+
+void
+lws_access_log_flush(struct lws_context *context)
+{
+	pthread_mutex_lock(&context->alog_lock);
+	if (context->alog_thread_running)
+		lws_alog_drain(context);
+	pthread_mutex_unlock(&context->alog_lock);
+}
+
+void
+lws_access_log_destroy(struct lws_context *context)
+{
+	int n;
+
+	if (!context->alog_flush_ms)
+		return; /* never initialized */
+
+	pthread_mutex_lock(&context->alog_lock);
+	n = context->alog_thread_running;
+	context->alog_thread_running = 0;
+	context->alog_thread_stop = 1;
+	pthread_cond_signal(&context->alog_cond);
+	pthread_mutex_unlock(&context->alog_lock);
+
+	if (n)
+		pthread_join(context->alog_thread, NULL);
+
+	for (n = 0; n < context->count_threads; n++) {
+		lws_free_set_NULL(context->pt[n].alog.buf);
+		pthread_cond_destroy(&context->pt[n].alog.space);
+		pthread_mutex_destroy(&context->pt[n].alog.lock);
+	}
+
+	pthread_cond_destroy(&context->alog_cond);
+	pthread_mutex_destroy(&context->alog_lock);
+}
+#endif
 
 int
 lws_access_log(struct lws *wsi)
@@ -160,6 +502,10 @@ lws_access_log(struct lws *wsi)
 		p[sizeof(ass) - 6 - l] = '\0';
 	l += lws_snprintf(ass + l, sizeof(ass) - 1 - l, "\" \"%s\"\n", p);
 
+#if defined(LWS_WITH_ACCESS_LOG_ASYNC)
+	if (lws_alog_append(wsi->context, &wsi->context->pt[(int)wsi->tsi],
+			    wsi->vhost->log_fd, ass, l))
+#endif
 	if (write(wsi->vhost->log_fd, ass, l) != l)
 		lwsl_err("Failed to write log\n");
 
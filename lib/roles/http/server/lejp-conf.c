@@ -102,6 +102,20 @@ static const char * const paths_vhosts[] = {
 	"vhosts[].client-cert-required",
 	"vhosts[].ignore-missing-cert",
 	"vhosts[].error-document-404",
+	"vhosts[].proxy-pool-max-idle",
+	"vhosts[].proxy-pool-max-per-origin",
+	"vhosts[].proxy-pool-idle-secs",
+	"vhosts[].mounts[].proxy-lb",
+	"vhosts[].mounts[].proxy-lb-key",
+	"vhosts[].mounts[].proxy-health-path",
+	"vhosts[].mounts[].proxy-health-secs",
+	"vhosts[].mounts[].proxy-eject-secs",
+	"vhosts[].mounts[].proxy-max-fails",
+	"vhosts[].tls-session-cache-max",
+	"vhosts[].tls-session-timeout",
+	"vhosts[].tls-ticket-key-filepath",
+	"vhosts[].tls-ticket-key-rotate-secs",
+	"vhosts[].tls-server-session-cache-max",
 };
 
 enum lejp_vhost_paths {
@@ -152,6 +166,20 @@ enum lejp_vhost_paths {
 	LEJPVP_FLAG_CLIENT_CERT_REQUIRED,
 	LEJPVP_IGNORE_MISSING_CERT,
 	LEJPVP_ERROR_DOCUMENT_404,
+	LEJPVP_PROXY_POOL_MAX_IDLE,
+	LEJPVP_PROXY_POOL_MAX_PER_ORIGIN,
+	LEJPVP_PROXY_POOL_IDLE_SECS,
+	LEJPVP_MOUNT_PROXY_LB,
+	LEJPVP_MOUNT_PROXY_LB_KEY,
+	LEJPVP_MOUNT_PROXY_HEALTH_PATH,
+	LEJPVP_MOUNT_PROXY_HEALTH_SECS,
+	LEJPVP_MOUNT_PROXY_EJECT_SECS,
+	LEJPVP_MOUNT_PROXY_MAX_FAILS,
+	LEJPVP_TLS_SESSION_CACHE_MAX,
+	LEJPVP_TLS_SESSION_TIMEOUT,
+	LEJPVP_TLS_TICKET_KEY_FILEPATH,
+	LEJPVP_TLS_TICKET_KEY_ROTATE_SECS,
+	LEJPVP_TLS_SERVER_SESSION_CACHE_MAX,
 };
 
 static const char * const parser_errs[] = {
@@ -725,6 +753,56 @@ lejp_vhosts_cb(struct lejp_ctx *ctx, char reason)
 		a->info->error_document_404 = a->p;
 		break;
 
+	case LEJPVP_PROXY_POOL_MAX_IDLE:
+		a->info->proxy_pool_max_idle = atoi(ctx->buf);
+		return 0;
+	case LEJPVP_PROXY_POOL_MAX_PER_ORIGIN:
+		a->info->proxy_pool_max_per_origin = atoi(ctx->buf);
+		return 0;
+	case LEJPVP_PROXY_POOL_IDLE_SECS:
+		a->info->proxy_pool_idle_secs = atoi(ctx->buf);
+		return 0;
+	case LEJPVP_MOUNT_PROXY_LB:
+		if (!strcmp(ctx->buf, "hash"))
+			a->m.proxy_lb = LWSPLB_HASH;
+		else if (!strcmp(ctx->buf, "least-outstanding"))
+			a->m.proxy_lb = LWSPLB_LEAST_OUTSTANDING;
+		else {
+			lwsl_err("unknown proxy-lb %s\n", ctx->buf);
+			return 1;
+		}
+		return 0;
+	case LEJPVP_MOUNT_PROXY_LB_KEY:
+		a->m.proxy_lb_key = a->p;
+		break;
+	case LEJPVP_MOUNT_PROXY_HEALTH_PATH:
+		a->m.proxy_health_path = a->p;
+		break;
+	case LEJPVP_MOUNT_PROXY_HEALTH_SECS:
+		a->m.proxy_health_secs = atoi(ctx->buf);
+		return 0;
+	case LEJPVP_MOUNT_PROXY_EJECT_SECS:
+		a->m.proxy_eject_secs = atoi(ctx->buf);
+		return 0;
+	case LEJPVP_MOUNT_PROXY_MAX_FAILS:
+		a->m.proxy_max_fails = atoi(ctx->buf);
+		return 0;
+	case LEJPVP_TLS_SESSION_CACHE_MAX:
+		a->info->tls_session_cache_max = atoi(ctx->buf);
+		return 0;
+	case LEJPVP_TLS_SESSION_TIMEOUT:
+		a->info->tls_session_timeout = atoi(ctx->buf);
+		return 0;
+	case LEJPVP_TLS_TICKET_KEY_FILEPATH:
+		a->info->tls_ticket_key_filepath = a->p;
+		break;
+	case LEJPVP_TLS_TICKET_KEY_ROTATE_SECS:
+		a->info->tls_ticket_key_rotate_secs = atoi(ctx->buf);
+		return 0;
+	case LEJPVP_TLS_SERVER_SESSION_CACHE_MAX:
+		a->info->tls_server_session_cache_max = atoi(ctx->buf);
+		return 0;
+
 	case LEJPVP_SSL_OPTION_SET:
 		a->info->ssl_options_set |= atol(ctx->buf);
 		return 0;
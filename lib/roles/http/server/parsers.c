@@ -27,23 +27,45 @@ static const unsigned char lextable[] = {
 
 #define FAIL_CHAR 0x08
 
+/*
+ * Detached ahs are kept on a per-pt free list and reset in place on the next
+ * attach, so keep-alive traffic doesn't churn two allocations per request.
+ * Since at most max_http_header_pool can be in use, that's also the most the
+ * free list can ever hold.
+ */
+
 static struct allocated_headers *
 _lws_create_ah(struct lws_context_per_thread *pt, ah_data_idx_t data_size)
 {
-	struct allocated_headers *ah = lws_zalloc(sizeof(*ah), "ah struct");
-
-	if (!ah)
-		return NULL;
-
-	ah->data = lws_malloc(data_size, "ah data");
-	if (!ah->data) {
-		lws_free(ah);
+	struct allocated_headers *ah = pt->ah_free_list;
+
+	if (ah) {
+		pt->ah_free_list = ah->next;
+		pt->ah_free_count--;
+		pt->ah_pool_hits++;
+
+		/* rx and data are only read after being written */
+		ah->wsi = NULL;
+		ah->assigned = 0;
+		memset(&ah->pos, 0, sizeof(*ah) -
+			offsetof(struct allocated_headers, pos));
+	} else {
+		ah = lws_zalloc(sizeof(*ah), "ah struct");
+		if (!ah)
+			return NULL;
+
+		ah->data = lws_malloc(data_size, "ah data");
+		if (!ah->data) {
+			lws_free(ah);
 
-		return NULL;
+			return NULL;
+		}
+		ah->data_length = data_size;
+		pt->ah_pool_misses++;
 	}
+
 	ah->next = pt->ah_list;
 	pt->ah_list = ah;
-	ah->data_length = data_size;
 	pt->ah_pool_length++;
 
 	lwsl_info("%s: created ah %p (size %d): pool length %d\n", __func__,
@@ -52,18 +74,13 @@ _lws_create_ah(struct lws_context_per_thread *pt, ah_data_idx_t data_size)
 	return ah;
 }
 
-int
-_lws_destroy_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah)
+static int
+_lws_unlink_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah)
 {
 	lws_start_foreach_llp(struct allocated_headers **, a, pt->ah_list) {
 		if ((*a) == ah) {
 			*a = ah->next;
 			pt->ah_pool_length--;
-			lwsl_info("%s: freed ah %p : pool length %d\n",
-				    __func__, ah, pt->ah_pool_length);
-			if (ah->data)
-				lws_free(ah->data);
-			lws_free(ah);
 
 			return 0;
 		}
@@ -72,6 +89,60 @@ _lws_destroy_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah)
 	return 1;
 }
 
+static void
+_lws_free_ah(struct allocated_headers *ah)
+{
+	if (ah->data)
+		lws_free(ah->data);
+	lws_free(ah);
+}
+
+int
+_lws_destroy_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah)
+{
+	if (_lws_unlink_ah(pt, ah))
+		return 1;
+
+	lwsl_info("%s: freed ah %p : pool length %d\n", __func__, ah,
+		  pt->ah_pool_length);
+	_lws_free_ah(ah);
+
+	return 0;
+}
+
+static int
+_lws_recycle_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah)
+{
+	if (_lws_unlink_ah(pt, ah))
+		return 1;
+
+	ah->in_use = 0;
+	ah->next = pt->ah_free_list;
+	pt->ah_free_list = ah;
+	pt->ah_free_count++;
+
+	lwsl_info("%s: recycled ah %p : pool length %d, free %d\n", __func__,
+		  ah, pt->ah_pool_length, pt->ah_free_count);
+
+	return 0;
+}
+
+void
+_lws_destroy_ah_pool(struct lws_context_per_thread *pt)
+{
+	struct allocated_headers *ah;
+
+	while (pt->ah_list)
+		_lws_destroy_ah(pt, pt->ah_list);
+
+	while (pt->ah_free_list) {
+		ah = pt->ah_free_list;
+		pt->ah_free_list = ah->next;
+		_lws_free_ah(ah);
+	}
+	pt->ah_free_count = 0;
+}
+
 void
 _lws_header_table_reset(struct allocated_headers *ah)
 {
@@ -250,6 +321,8 @@ lws_header_table_attach(struct lws *wsi, int autoservice)
 	wsi->ah->in_use = 1;
 	wsi->ah->wsi = wsi; /* mark our owner */
 	pt->ah_count_in_use++;
+	if (pt->ah_count_in_use > pt->ah_count_in_use_high_water)
+		pt->ah_count_in_use_high_water = pt->ah_count_in_use;
 
 #if defined(LWS_WITH_PEER_LIMITS)
 	if (wsi->peer)
@@ -452,7 +525,7 @@ bail:
 
 nobody_usable_waiting:
 	lwsl_info("%s: nobody usable waiting\n", __func__);
-	_lws_destroy_ah(pt, ah);
+	_lws_recycle_ah(pt, ah);
 	pt->ah_count_in_use--;
 
 	goto bail;
@@ -882,6 +955,102 @@ static const unsigned char methods[] = {
 	WSI_TOKEN_HEAD_URI,
 };
 
+/*
+ * Bytes in the URI that lws_parse_urldecode() (or the end of the URI) has to
+ * see one at a time, anything else is copied as it is
+ */
+static const uint8_t uri_special[256] = {
+	[0] = 1, ['\x0d'] = 1, [' '] = 1, ['%'] = 1, ['&'] = 1, [';'] = 1,
+	['='] = 1, ['+'] = 1, ['/'] = 1, ['?'] = 1,
+};
+
+/*
+ * how far into p until a CR or NUL, or len if neither... looks at a word at
+ * a time until one contains either
+ */
+static size_t
+lws_parse_scan_eol(const unsigned char *p, size_t len)
+{
+	const size_t ones = (size_t)-1 / 0xff, highs = ones * 0x80,
+		     crs = ones * 0x0d;
+	size_t n = 0, w, x;
+
+	while (n + sizeof(w) <= len) {
+		memcpy(&w, p + n, sizeof(w));
+		x = w ^ crs;
+		if (((w - ones) & ~w & highs) || ((x - ones) & ~x & highs))
+			break;
+		n += sizeof(w);
+	}
+
+	while (n < len && p[n] && p[n] != '\x0d')
+		n++;
+
+	return n;
+}
+
+/*
+ * Most of a request is header values (and the URI), where almost every byte
+ * just gets copied into the ah, or stuff we are skipping.  Take as long a run
+ * of those as we can in one go, stopping before anything the bytewise parser
+ * has to act on, or where a limit would be reached.  Returns how many bytes
+ * of buf were dealt with.
+ */
+static int
+lws_parse_run(struct lws *wsi, const unsigned char *buf, int len)
+{
+	struct allocated_headers *ah = wsi->ah;
+	struct lws_fragments *frag;
+	const unsigned char *p;
+	size_t n, room;
+	unsigned int m;
+
+	if (ah->parser_state == WSI_TOKEN_SKIPPING) {
+		p = memchr(buf, '\x0d', len);
+
+		return p ? lws_ptr_diff(p, buf) : len;
+	}
+
+	/* everything else that isn't collecting a header is bytewise */
+	if (ah->parser_state >= WSI_TOKEN_COUNT ||
+	    ah->parser_state == WSI_TOKEN_CHALLENGE)
+		return 0;
+
+	/* the optional initial space swallow is left to the bytewise parser */
+	if (!ah->frags[ah->frag_index[ah->parser_state]].len)
+		return 0;
+
+	frag = &ah->frags[ah->nfrag];
+	if (frag->len >= ah->current_token_limit ||
+	    ah->pos >= (unsigned int)wsi->context->max_http_header_data)
+		return 0;
+	room = ah->current_token_limit - frag->len;
+	if (room > wsi->context->max_http_header_data - ah->pos)
+		room = wsi->context->max_http_header_data - ah->pos;
+	if ((size_t)len > room)
+		len = (int)room;
+
+	for (m = 0; m < ARRAY_SIZE(methods); m++)
+		if (ah->parser_state == methods[m])
+			break;
+
+	if (m == ARRAY_SIZE(methods))
+		n = lws_parse_scan_eol(buf, len);
+	else {
+		/* the URI, unless we're in the middle of a %xx or /./ etc */
+		if (ah->ups != URIPS_IDLE || ah->ues != URIES_IDLE)
+			return 0;
+		for (n = 0; n < (size_t)len && !uri_special[buf[n]]; n++)
+			;
+	}
+
+	memcpy(ah->data + ah->pos, buf, n);
+	ah->pos += (unsigned int)n;
+	frag->len += (uint16_t)n;
+
+	return (int)n;
+}
+
 /*
  * possible returns:, -1 fail, 0 ok or 2, transition to raw
  */
@@ -898,6 +1067,14 @@ lws_parse(struct lws *wsi, unsigned char *buf, int *len)
 	assert(wsi->ah);
 
 	do {
+		if (ah->parser_state != WSI_TOKEN_NAME_PART) {
+			n = lws_parse_run(wsi, buf, *len);
+			buf += n;
+			*len -= n;
+			if (!*len)
+				break;
+		}
+
 		(*len)--;
 		c = *buf++;
 
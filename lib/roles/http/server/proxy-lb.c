@@ -0,0 +1,497 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010-2018 Andy Green <andy@warmcat.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation:
+ *  version 2.1 of the License.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA  02110-1301  USA
+ *
+ * A proxy mount's origin may be a comma-separated list of origins, which
+ * the requests to the mount are spread over.
+ *
+ * Each origin counts how many proxied requests it has in flight, for
+ * LWSPLB_LEAST_OUTSTANDING, and how many times in a row it failed us, by a
+ * connect error or timing out before it answered.  After max_fails of those
+ * it gets no requests for eject_secs.  A connection from the proxy pool the
+ * origin closes before answering doesn't count: the request is retried once
+ * on a new connection.  If the mount has a proxy_health_path, we also GET that
+ * from each origin every health_secs, off a once-a-second vhost timed
+ * callback; a failed check counts like a failed request, and a passing one
+ * brings an ejected origin back straight away.
+ *
+ * LWSPLB_HASH uses rendezvous hashing: each request goes to the healthy
+ * origin with the highest hash of its key mixed with the origin's own hash,
+ * so a key always gets the same origin, and when an origin is ejected only
+ * the keys that were going to it move.
+ */
+
+#include "private-libwebsockets.h"
+
+static uint32_t
+lws_proxy_lb_fnv(const char *p, int len)
+{
+	uint32_t h = 0x811c9dc5;
+
+	while (len--)
+		h = (h ^ (uint8_t)*p++) * 16777619;
+
+	return h;
+}
+
+static uint32_t
+lws_proxy_lb_mix(uint32_t h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+
+	return h;
+}
+
+static int
+lws_proxy_lb_token(const char *name)
+{
+	const unsigned char *t;
+	size_t len = strlen(name);
+	int n;
+
+	for (n = 0; n < WSI_TOKEN_COUNT; n++) {
+		t = lws_token_to_string(n);
+		if (t && !strncasecmp((const char *)t, name, len) &&
+		    (t[len] == ':' || !t[len]))
+			return n;
+	}
+
+	return -1;
+}
+
+/* find the hash of the request's key, if it has one */
+
+static int
+lws_proxy_lb_key(struct lws *wsi, struct lws_proxy_balancer *lb, uint32_t *hash)
+{
+	const char *p, *e;
+	size_t cl;
+
+	if (lb->token >= 0) {
+		if (!lws_hdr_total_length(wsi, lb->token))
+			return 1;
+		p = lws_hdr_simple_ptr(wsi, lb->token);
+		*hash = lws_proxy_lb_fnv(p, (int)strlen(p));
+
+		return 0;
+	}
+
+	if (!lb->cookie ||
+	    !lws_hdr_total_length(wsi, WSI_TOKEN_HTTP_COOKIE))
+		return 1;
+
+	cl = strlen(lb->cookie);
+	p = lws_hdr_simple_ptr(wsi, WSI_TOKEN_HTTP_COOKIE);
+	while (p) {
+		while (*p == ' ')
+			p++;
+		if (!strncmp(p, lb->cookie, cl) && p[cl] == '=') {
+			p += cl + 1;
+			e = strchr(p, ';');
+			*hash = lws_proxy_lb_fnv(p, e ? lws_ptr_diff(e, p) :
+							(int)strlen(p));
+
+			return 0;
+		}
+		p = strchr(p, ';');
+		if (p)
+			p++;
+	}
+
+	return 1;
+}
+
+static int
+lws_proxy_lb_add(struct lws_proxy_balancer *lb, const char *p, int n, int ssl)
+{
+	struct lws_proxy_backend *be = &lb->be[lb->count];
+	char *pcolon, *pslash;
+	int m;
+
+	while (n && *p == ' ') {
+		p++;
+		n--;
+	}
+	while (n && p[n - 1] == ' ')
+		n--;
+	if (!n)
+		return 0;
+
+	if (n >= (int)sizeof(be->origin))
+		n = sizeof(be->origin) - 1;
+	memcpy(be->origin, p, n);
+	be->origin[n] = '\0';
+
+	pcolon = strchr(be->origin, ':');
+	pslash = strchr(be->origin, '/');
+	if (!pslash) {
+		lwsl_err("Proxy mount origin '%s' must have /\n", be->origin);
+		return 1;
+	}
+	if (pcolon > pslash)
+		pcolon = NULL;
+
+	m = lws_ptr_diff(pcolon ? pcolon : pslash, be->origin);
+	if (m >= (int)sizeof(be->address))
+		m = sizeof(be->address) - 1;
+	memcpy(be->address, be->origin, m);
+	be->address[m] = '\0';
+
+	be->port = ssl ? 443 : 80;
+	if (pcolon)
+		be->port = atoi(pcolon + 1);
+	be->ssl = !!ssl;
+	be->hash = lws_proxy_lb_fnv(be->origin, (int)strlen(be->origin));
+	be->lb = lb;
+	lb->count++;
+
+	return 0;
+}
+
+int
+lws_proxy_lb_create(struct lws_vhost *vh)
+{
+	const struct lws_http_mount *m;
+	struct lws_proxy_balancer *lb;
+	const char *p, *q;
+	int n, health = 0;
+
+	for (m = vh->mount_list; m; m = m->mount_next) {
+		if ((m->origin_protocol != LWSMPRO_HTTP &&
+		     m->origin_protocol != LWSMPRO_HTTPS) ||
+		    (!strchr(m->origin, ',') && !m->proxy_health_path))
+			continue;
+
+		n = 1;
+		for (p = m->origin; *p; p++)
+			if (*p == ',')
+				n++;
+
+		lb = lws_zalloc(sizeof(*lb) + n * sizeof(*lb->be), "proxy lb");
+		if (!lb)
+			return 1;
+
+		lb->be = (struct lws_proxy_backend *)&lb[1];
+		lb->mount = m;
+		lb->token = -1;
+		lb->health_secs = m->proxy_health_secs ? m->proxy_health_secs : 5;
+		lb->eject_secs = m->proxy_eject_secs ? m->proxy_eject_secs : 10;
+		lb->max_fails = m->proxy_max_fails ? m->proxy_max_fails : 1;
+		lb->next = vh->proxy_lb_list;
+		vh->proxy_lb_list = lb;
+
+		if (m->proxy_lb == LWSPLB_HASH && m->proxy_lb_key) {
+			if (!strncmp(m->proxy_lb_key, "cookie:", 7))
+				lb->cookie = m->proxy_lb_key + 7;
+			else {
+				lb->token = lws_proxy_lb_token(m->proxy_lb_key);
+				if (lb->token < 0)
+					lwsl_err("%s: unknown proxy_lb_key "
+						 "header %s\n", __func__,
+						 m->proxy_lb_key);
+			}
+		}
+
+		p = m->origin;
+		do {
+			q = strchr(p, ',');
+			n = q ? lws_ptr_diff(q, p) : (int)strlen(p);
+			if (lws_proxy_lb_add(lb, p, n,
+					m->origin_protocol == LWSMPRO_HTTPS))
+				return 1;
+			if (q)
+				p = q + 1;
+		} while (q);
+
+		if (!lb->count) {
+			lwsl_err("%s: proxy mount %s has no origin\n", __func__,
+				 m->mountpoint);
+			return 1;
+		}
+
+		if (m->proxy_health_path)
+			health = 1;
+
+		lwsl_notice("   proxy mount %s: %d origins\n", m->mountpoint,
+			    lb->count);
+	}
+
+	if (!health)
+		return 0;
+
+	return lws_timed_callback_vh_protocol(vh, &vh->protocols[0],
+				LWS_CALLBACK_HTTP_PROXY_HEALTH_CHECK, 1);
+}
+
+void
+lws_proxy_lb_destroy(struct lws_vhost *vh)
+{
+	struct lws_proxy_balancer *lb;
+
+	while (vh->proxy_lb_list) {
+		lb = vh->proxy_lb_list;
+		vh->proxy_lb_list = lb->next;
+		lws_free(lb);
+	}
+}
+
+int
+lws_proxy_lb_pick(struct lws *wsi, const struct lws_http_mount *m,
+		  struct lws_proxy_backend **pbe)
+{
+	struct lws_proxy_backend *be, *best = NULL;
+	struct lws_vhost *vh = wsi->vhost;
+	uint32_t key = 0, score, best_score = 0;
+	time_t now = lws_now_secs();
+	struct lws_proxy_balancer *lb;
+	int n, hashed;
+
+	*pbe = NULL;
+
+	for (lb = vh->proxy_lb_list; lb && lb->mount != m; lb = lb->next)
+		;
+	if (!lb)
+		/* not one of ours, just proxy to the origin */
+		return 0;
+
+	hashed = m->proxy_lb == LWSPLB_HASH && !lws_proxy_lb_key(wsi, lb, &key);
+
+	lws_vhost_lock(vh);
+
+	for (n = 0; n < lb->count; n++) {
+		/* start somewhere different each time to share out ties */
+		be = &lb->be[(lb->rr + n) % lb->count];
+		if (be->ejected_until > now)
+			continue;
+
+		if (hashed) {
+			score = lws_proxy_lb_mix(key ^ be->hash);
+			if (best && score <= best_score)
+				continue;
+			best_score = score;
+		} else
+			if (best && be->outstanding >= best->outstanding)
+				continue;
+
+		best = be;
+	}
+	lb->rr++;
+
+	if (best)
+		best->outstanding++;
+
+	lws_vhost_unlock(vh);
+
+	*pbe = best;
+
+	return !best;
+}
+
+/* must hold the vhost lock */
+
+static void
+__lws_proxy_lb_done(struct lws_proxy_backend *be, enum lws_pxlb_result result)
+{
+	time_t now = lws_now_secs();
+
+	if (be->outstanding)
+		be->outstanding--;
+
+	switch (result) {
+	case LWSPXLB_OK:
+		if (be->ejected_until > now)
+			lwsl_notice("%s: origin %s is back\n", __func__,
+				    be->origin);
+		be->fails = 0;
+		be->ejected_until = 0;
+		break;
+
+	case LWSPXLB_FAILED:
+		if (be->fails < 255)
+			be->fails++;
+		if (be->fails < be->lb->max_fails)
+			break;
+		if (be->ejected_until <= now)
+			lwsl_warn("%s: ejecting origin %s for %ds\n", __func__,
+				  be->origin, be->lb->eject_secs);
+		be->ejected_until = now + be->lb->eject_secs;
+		break;
+
+	default:
+		break;
+	}
+}
+
+void
+lws_proxy_lb_done(struct lws_vhost *vh, struct lws_proxy_backend *be,
+		  enum lws_pxlb_result result)
+{
+	lws_vhost_lock(vh);
+	__lws_proxy_lb_done(be, result);
+	lws_vhost_unlock(vh);
+}
+
+void
+lws_proxy_lb_release(struct lws *wsi, enum lws_pxlb_result result)
+{
+	struct lws_proxy_backend *be = wsi->px_backend;
+
+	if (!be)
+		return;
+
+	wsi->px_backend = NULL;
+
+	lws_vhost_lock(wsi->vhost);
+	if (!wsi->proxy_upstream)
+		/* it was a health check */
+		be->checking = 0;
+	__lws_proxy_lb_done(be, result);
+	lws_vhost_unlock(wsi->vhost);
+}
+
+int
+lws_proxy_lb_health_check(struct lws_vhost *vh)
+{
+	struct lws_client_connect_info i;
+	struct lws_proxy_backend *be;
+	time_t now = lws_now_secs();
+	struct lws_proxy_balancer *lb;
+	struct lws *cwsi;
+	int n;
+
+	for (lb = vh->proxy_lb_list; lb; lb = lb->next) {
+		if (!lb->mount->proxy_health_path)
+			continue;
+
+		for (n = 0; n < lb->count; n++) {
+			be = &lb->be[n];
+			if (be->checking || now < be->next_check)
+				continue;
+			be->next_check = now + lb->health_secs;
+
+			memset(&i, 0, sizeof(i));
+			i.context = vh->context;
+			i.vhost = vh;
+			i.address = be->address;
+			i.port = be->port;
+			i.ssl_connection = be->ssl ? LCCSCF_USE_SSL : 0;
+			i.path = lb->mount->proxy_health_path;
+			i.host = be->address;
+			i.method = "GET";
+
+			lws_vhost_lock(vh);
+			be->checking = 1;
+			be->outstanding++;
+			lws_vhost_unlock(vh);
+
+			cwsi = lws_client_connect_via_info(&i);
+			if (!cwsi) {
+				lws_vhost_lock(vh);
+				be->checking = 0;
+				__lws_proxy_lb_done(be, LWSPXLB_FAILED);
+				lws_vhost_unlock(vh);
+				continue;
+			}
+			cwsi->px_backend = be;
+		}
+	}
+
+	/* come back in a second to see who is due next */
+
+	return lws_timed_callback_vh_protocol(vh, &vh->protocols[0],
+				LWS_CALLBACK_HTTP_PROXY_HEALTH_CHECK, 1);
+}
+
+int
+lws_proxy_lb_health_result(struct lws *wsi)
+{
+	int n = lws_http_client_http_response(wsi);
+
+	if (!wsi->px_backend || wsi->proxy_upstream)
+		return 0;
+
+	lwsl_info("%s: %s: %d\n", __func__, wsi->px_backend->origin, n);
+	lws_proxy_lb_release(wsi, n >= 200 && n < 400 ? LWSPXLB_OK :
+						       LWSPXLB_FAILED);
+
+	/* that's all we wanted from it */
+
+	return -1;
+}
+
+void
+lws_proxy_upstream_closing(struct lws *wsi)
+{
+	struct lws *parent = wsi->parent;
+	struct lws_proxy_backend *be;
+	int failed;
+
+	if (!wsi->proxy_upstream && !wsi->px_backend)
+		return;
+
+	/*
+	 * The origin failed us if it hung up, or we gave up on it, before it
+	 * answered... unless it's our client that went away first.
+	 */
+	failed = lwsi_state(wsi) != LRS_ESTABLISHED &&
+		 (!wsi->proxy_upstream || parent);
+
+	if (failed && wsi->proxy_upstream && wsi->proxy_reused) {
+		/*
+		 * We took it from the proxy pool, and the origin hung up
+		 * before answering.  Most likely its idle timeout got there
+		 * just before our request did, which says nothing about its
+		 * health.  So don't count it, and try once more on a new
+		 * connection, which keeps our place in be->outstanding.
+		 */
+		be = wsi->px_backend;
+		wsi->px_backend = NULL;
+		wsi->proxy_upstream = 0;
+		wsi->proxy_reused = 0;
+		/* we're not telling anybody about it */
+		wsi->already_did_cce = 1;
+
+		lwsl_info("%s: %p: pooled conn to origin closed, retrying\n",
+			  __func__, wsi);
+		if (!lws_http_proxy_retry(parent, be))
+			return;
+	} else {
+		lws_proxy_lb_release(wsi, failed ? LWSPXLB_FAILED :
+						   LWSPXLB_ABANDONED);
+
+		if (!wsi->proxy_upstream || !failed)
+			return;
+		wsi->proxy_upstream = 0;
+	}
+
+	/* let our client know, rather than leave him waiting */
+
+	lwsl_notice("%s: %p: origin failed before answering\n", __func__,
+		    wsi);
+	if (lws_return_http_status(parent, HTTP_STATUS_BAD_GATEWAY, NULL) ||
+	    lws_http_transaction_completed(parent)) {
+		/* we won't be his child by then, and that makes him close */
+		parent->reason_bf |= LWS_CB_REASON_AUX_BF__PROXY;
+		lws_callback_on_writable(parent);
+	}
+}
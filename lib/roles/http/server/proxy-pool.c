@@ -0,0 +1,243 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010-2018 Andy Green <andy@warmcat.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation:
+ *  version 2.1 of the License.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA  02110-1301  USA
+ *
+ * When a proxy mount's client connection to the origin finishes a keepalive
+ * transaction, instead of closing it we can park it on the vhost, without
+ * an ah, and give it to the next request proxied to the same origin.  That
+ * saves the next request the connect (and any tls handshake) to the origin.
+ *
+ * The pool is newest-first, so the connections that get reused are the ones
+ * least likely to have been timed out by the origin, and the oldest ones are
+ * evicted when the pool is full.
+ */
+
+#include "private-libwebsockets.h"
+
+static int
+lws_proxy_pool_same_origin(struct lws *w, const char *address, int port,
+			   int ssl)
+{
+#if defined(LWS_WITH_TLS)
+	if ((w->use_ssl & LCCSCF_USE_SSL) != (ssl & LCCSCF_USE_SSL))
+		return 0;
+#endif
+
+	return w->c_port == port && !strcmp(w->client_hostname_copy, address);
+}
+
+void
+lws_proxy_pool_remove(struct lws *wsi)
+{
+	struct lws_vhost *vh = wsi->vhost;
+
+	if (!vh || lws_dll_is_null(&wsi->dll_proxy_pool))
+		return;
+
+	lws_vhost_lock(vh);
+	lws_dll_lws_remove(&wsi->dll_proxy_pool);
+	vh->proxy_pool_count--;
+	lws_vhost_unlock(vh);
+}
+
+int
+lws_proxy_pool_park(struct lws *wsi)
+{
+	struct lws *evict = NULL, *oldest = NULL, *oldest_same = NULL;
+	struct lws_vhost *vh = wsi->vhost;
+	int n = 0, reuse;
+	char *p;
+
+	p = lws_hdr_simple_ptr(wsi, WSI_TOKEN_CONNECTION);
+	reuse = vh->proxy_pool_max_idle && wsi->client_hostname_copy &&
+		!wsi->redirects && !wsi->client_h2_alpn &&
+		!wsi->client_h2_substream &&
+		wsi->http.connection_type == HTTP_CONNECTION_KEEP_ALIVE &&
+		!wsi->dll_client_transaction_queue_head.next &&
+		(!p || strcasecmp(p, "close"));
+
+	/* the parent has had everything from us, we belong to nobody now */
+
+	lws_remove_child_from_any_parent(wsi);
+	if (wsi->rw) {
+		lws_rewrite_destroy(wsi->rw);
+		wsi->rw = NULL;
+	}
+
+	/* we are no longer somewhere other client conns may pipeline */
+	lws_vhost_lock(vh);
+	lws_dll_lws_remove(&wsi->dll_active_client_conns);
+	lws_vhost_unlock(vh);
+
+	lws_header_table_force_to_detachable_state(wsi);
+	lws_header_table_detach(wsi, 0);
+	wsi->hdr_parsing_completed = 0;
+	lwsi_set_state(wsi, LRS_IDLING);
+	/* the pool closing us is not a connection error */
+	wsi->already_did_cce = 1;
+
+	if (!reuse) {
+		/*
+		 * We are somewhere deep in our own rx handling, so rather than
+		 * close here, stay idle (which closes if the origin hangs up
+		 * first) and get closed shortly
+		 */
+		lws_set_timeout(wsi, PENDING_TIMEOUT_CLIENT_CONN_IDLE,
+				LWS_TO_KILL_ASYNC);
+
+		return 0;
+	}
+
+	/*
+	 * We leave POLLIN enabled while we are idle, if the origin closes on
+	 * us, we will see it in LRS_IDLING and close too
+	 */
+	lws_set_timeout(wsi, PENDING_TIMEOUT_CLIENT_CONN_IDLE,
+			vh->proxy_pool_idle_secs);
+
+	lws_vhost_lock(vh);
+
+	lws_start_foreach_dll_safe(struct lws_dll_lws *, d, d1,
+				   vh->dll_proxy_pool.next) {
+		struct lws *w = lws_container_of(d, struct lws,
+						 dll_proxy_pool);
+
+		if (lws_proxy_pool_same_origin(w, wsi->client_hostname_copy,
+					       wsi->c_port, wsi->use_ssl)) {
+			oldest_same = w;
+			n++;
+		}
+		oldest = w;
+	} lws_end_foreach_dll_safe(d, d1);
+
+	if (n >= vh->proxy_pool_max_per_origin)
+		evict = oldest_same;
+	else
+		if (vh->proxy_pool_count >= vh->proxy_pool_max_idle)
+			evict = oldest;
+
+	lws_dll_lws_add_front(&wsi->dll_proxy_pool, &vh->dll_proxy_pool);
+	vh->proxy_pool_count++;
+
+	lws_vhost_unlock(vh);
+
+	lwsl_info("%s: parked %p (%s:%u), pool %d\n", __func__, wsi,
+		  wsi->client_hostname_copy, wsi->c_port, vh->proxy_pool_count);
+
+	if (evict)
+		lws_close_free_wsi(evict, LWS_CLOSE_STATUS_NOSTATUS,
+				   "proxy pool full");
+
+	return 0;
+}
+
+struct lws *
+lws_proxy_pool_take(struct lws *parent, const struct lws_client_connect_info *i)
+{
+	struct lws_vhost *vh = parent->vhost;
+	struct lws_context_per_thread *pt;
+	struct lws *w = NULL;
+
+	if (!vh->proxy_pool_count)
+		return NULL;
+
+	lws_vhost_lock(vh);
+
+	lws_start_foreach_dll_safe(struct lws_dll_lws *, d, d1,
+				   vh->dll_proxy_pool.next) {
+		struct lws *ww = lws_container_of(d, struct lws,
+						  dll_proxy_pool);
+
+		if (lws_proxy_pool_same_origin(ww, i->address, i->port,
+					       i->ssl_connection)) {
+			w = ww;
+			break;
+		}
+	} lws_end_foreach_dll_safe(d, d1);
+
+	/*
+	 * If there are no ah free, leave it in the pool and let the caller
+	 * make a new connection that can wait for an ah in the usual way
+	 */
+	if (w) {
+		pt = &w->context->pt[(int)w->tsi];
+		if (pt->ah_count_in_use == w->context->max_http_header_pool)
+			w = NULL;
+	}
+	if (!w) {
+		lws_vhost_unlock(vh);
+
+		return NULL;
+	}
+
+	lws_dll_lws_remove(&w->dll_proxy_pool);
+	vh->proxy_pool_count--;
+
+	lws_vhost_unlock(vh);
+
+	if (lws_header_table_attach(w, 0)) {
+		lwsl_notice("%s: unable to get ah\n", __func__);
+		goto bail;
+	}
+
+	if (lws_hdr_simple_create(w, _WSI_TOKEN_CLIENT_PEER_ADDRESS,
+				  i->address) ||
+	    lws_hdr_simple_create(w, _WSI_TOKEN_CLIENT_URI, i->path) ||
+	    lws_hdr_simple_create(w, _WSI_TOKEN_CLIENT_HOST, i->host) ||
+	    lws_hdr_simple_create(w, _WSI_TOKEN_CLIENT_METHOD, i->method))
+		goto bail;
+	if (i->origin &&
+	    lws_hdr_simple_create(w, _WSI_TOKEN_CLIENT_ORIGIN, i->origin))
+		goto bail;
+	if (i->uri_replace_to &&
+	    lws_client_rewrite_create(w, i->uri_replace_from,
+				      i->uri_replace_to))
+		goto bail;
+
+	/* start the next transaction as if we were new */
+
+	w->already_did_cce = 0;
+	w->chunked = 0;
+	w->client_rx_avail = 0;
+	w->perform_rewrite = 0;
+	w->http.rx_content_length = 0;
+	w->http.rx_content_remain = 0;
+	if (w->user_space && !w->user_space_externally_allocated &&
+	    w->protocol->per_session_data_size)
+		memset(w->user_space, 0, w->protocol->per_session_data_size);
+
+	w->parent = parent;
+	w->sibling_list = parent->child_list;
+	parent->child_list = w;
+
+	lwsl_info("%s: reusing %p (%s:%u) for %p\n", __func__, w,
+		  w->client_hostname_copy, w->c_port, parent);
+
+	lwsi_set_state(w, LRS_H1C_ISSUE_HANDSHAKE2);
+	lws_set_timeout(w, PENDING_TIMEOUT_AWAITING_CLIENT_HS_SEND,
+			w->context->timeout_secs);
+	lws_callback_on_writable(w);
+
+	return w;
+
+bail:
+	lws_close_free_wsi(w, LWS_CLOSE_STATUS_NOSTATUS, "proxy pool take");
+
+	return NULL;
+}
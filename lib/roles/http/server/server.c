@@ -69,7 +69,7 @@ lws_context_init_server(struct lws_context_creation_info *info,
 			if (((!vhost->iface && !vh->iface) ||
 			    (vhost->iface && vh->iface &&
 			    !strcmp(vhost->iface, vh->iface))) &&
-			   vh->lserv_wsi
+			   lws_vhost_has_listener(vh)
 			) {
 				lwsl_notice(" using listen skt from vhost %s\n",
 					    vh->name);
@@ -209,13 +209,26 @@ done_list:
 #else
 		n = n1;
 #endif
-		if (n && vhost->context->count_threads > 1)
+		/* with the option, other processes may share the port too */
+		if ((n && vhost->context->count_threads > 1) || n1)
 			if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT,
 					(const void *)&opt, sizeof(opt)) < 0) {
 				compatible_close(sockfd);
 				return -1;
 			}
 #endif
+#if defined(__linux__) && defined(SO_INCOMING_CPU)
+		/*
+		 * if this thread has a cpu affinity, prefer to have connections
+		 * arriving on that cpu handed to its listen socket
+		 */
+		n = vhost->context->pt[m].cpu_affinity;
+		if (n >= 0 && vhost->context->count_threads > 1 &&
+		    setsockopt(sockfd, SOL_SOCKET, SO_INCOMING_CPU,
+			       (const void *)&n, sizeof(n)) < 0)
+			lwsl_info("%s: SO_INCOMING_CPU %d failed\n",
+				  __func__, n);
+#endif
 #endif
 		lws_plat_set_socket_options(vhost, sockfd);
 
@@ -231,7 +244,17 @@ done_list:
 			compatible_close(sockfd);
 			goto deal;
 		}
-		vhost->listen_port = is;
+		if (vhost->listen_port != is) {
+			/* binding to port 0 picked one, move us in the index */
+			lws_vhost_list_lock(vhost->context);
+			lws_vhost_index_del(vhost);
+			vhost->listen_port = is;
+			if (lws_vhost_index_add(vhost)) {
+				lws_vhost_list_unlock(vhost->context);
+				goto bail;
+			}
+			lws_vhost_list_unlock(vhost->context);
+		}
 
 		lwsl_debug("%s: lws_socket_bind says %d\n", __func__, is);
 #endif
@@ -261,13 +284,13 @@ done_list:
 		}
 
 		vhost->context->count_wsi_allocated++;
-		vhost->lserv_wsi = wsi;
+		vhost->lserv_wsi[m] = wsi;
 
 #if LWS_POSIX
 		n = listen(wsi->desc.sockfd, LWS_SOMAXCONN);
 		if (n < 0) {
 			lwsl_err("listen failed with error %d\n", LWS_ERRNO);
-			vhost->lserv_wsi = NULL;
+			vhost->lserv_wsi[m] = NULL;
 			vhost->context->count_wsi_allocated--;
 			__remove_wsi_socket_from_fds(wsi);
 			goto bail;
@@ -291,12 +314,189 @@ bail:
 	return -1;
 }
 
+/*
+ * The context keeps its vhosts in a chained hash on their name, so picking
+ * the vhost for an SNI servername or Host: header doesn't have to walk the
+ * whole vhost_list.  Each chain is kept in vhost_list order, so the first
+ * match in a chain is the same one the list walk would have found.
+ *
+ * The listen port isn't part of the key, since a vhost's listen_port may
+ * change if it binds later on; lookups compare it instead.  The first vhost
+ * on each port is tracked separately for the last-chance match.
+ */
+
+static uint32_t
+lws_vhost_name_hash(const char *name, size_t len)
+{
+	uint32_t h = 2166136261u; /* FNV-1a */
+
+	while (len--)
+		h = (h ^ (uint8_t)*name++) * 16777619u;
+
+	return h;
+}
+
+static void
+lws_vhost_name_hash_insert(struct lws_vhost **table, uint32_t elements,
+			   struct lws_vhost *vh)
+{
+	struct lws_vhost **pv = &table[lws_vhost_name_hash(vh->name,
+				strlen(vh->name)) & (elements - 1)];
+
+	while (*pv && (*pv)->vh_seq < vh->vh_seq)
+		pv = &(*pv)->vh_name_next;
+
+	vh->vh_name_next = *pv;
+	*pv = vh;
+}
+
+static struct lws_vhost *
+lws_vhost_name_lookup(struct lws_context *context, int port, const char *name,
+		      size_t len)
+{
+	struct lws_vhost *vh;
+
+	if (!context->vh_name_hash)
+		return NULL;
+
+	vh = context->vh_name_hash[lws_vhost_name_hash(name, len) &
+				   (context->vh_name_hash_elements - 1)];
+	while (vh) {
+		if (vh->listen_port == port && !strncmp(vh->name, name, len) &&
+		    !vh->name[len])
+			return vh;
+		vh = vh->vh_name_next;
+	}
+
+	return NULL;
+}
+
+int
+lws_vhost_index_add(struct lws_vhost *vh)
+{
+	struct lws_context *context = vh->context;
+	struct lws_vhost_port_first *pf;
+	struct lws_vhost **table, *v;
+	uint32_t n, elements;
+	int m;
+
+	if (vh->indexed)
+		return 0;
+
+	if (!vh->vh_seq)
+		vh->vh_seq = ++context->vh_seq;
+
+	/* keep the chains short by growing the hash as vhosts are added */
+
+	if (context->count_vh_indexed >= context->vh_name_hash_elements) {
+		elements = context->vh_name_hash_elements ?
+			   context->vh_name_hash_elements * 4 : 64;
+		table = lws_zalloc(sizeof(*table) * elements, "vh name hash");
+		if (!table)
+			return 1;
+
+		for (n = 0; n < context->vh_name_hash_elements; n++)
+			while (context->vh_name_hash[n]) {
+				v = context->vh_name_hash[n];
+				context->vh_name_hash[n] = v->vh_name_next;
+				lws_vhost_name_hash_insert(table, elements, v);
+			}
+
+		lws_free(context->vh_name_hash);
+		context->vh_name_hash = table;
+		context->vh_name_hash_elements = elements;
+	}
+
+	for (m = 0; m < context->count_vh_port_first; m++) {
+		pf = &context->vh_port_first[m];
+		if (pf->port == vh->listen_port) {
+			if (vh->vh_seq < pf->vh->vh_seq)
+				pf->vh = vh;
+			goto insert;
+		}
+	}
+
+	/* first vhost we have seen on this port */
+
+	pf = lws_realloc(context->vh_port_first, sizeof(*pf) * (m + 1),
+			 "vh port first");
+	if (!pf)
+		return 1;
+	context->vh_port_first = pf;
+	pf[m].port = vh->listen_port;
+	pf[m].vh = vh;
+	context->count_vh_port_first++;
+
+insert:
+	lws_vhost_name_hash_insert(context->vh_name_hash,
+				   context->vh_name_hash_elements, vh);
+	context->count_vh_indexed++;
+	vh->indexed = 1;
+
+	return 0;
+}
+
+void
+lws_vhost_index_del(struct lws_vhost *vh)
+{
+	struct lws_context *context = vh->context;
+	struct lws_vhost_port_first *pf;
+	struct lws_vhost *v;
+	int m;
+
+	if (!vh->indexed)
+		return;
+
+	lws_start_foreach_llp(struct lws_vhost **, pv,
+			      context->vh_name_hash[lws_vhost_name_hash(vh->name,
+				strlen(vh->name)) &
+				(context->vh_name_hash_elements - 1)]) {
+		if (*pv == vh) {
+			*pv = vh->vh_name_next;
+			break;
+		}
+	} lws_end_foreach_llp(pv, vh_name_next);
+
+	vh->vh_name_next = NULL;
+	vh->indexed = 0;
+	context->count_vh_indexed--;
+
+	for (m = 0; m < context->count_vh_port_first; m++) {
+		pf = &context->vh_port_first[m];
+		if (pf->vh != vh)
+			continue;
+
+		/* we were first on the port, so the next one is after us */
+
+		v = vh->vhost_next;
+		while (v && (!v->indexed || v->listen_port != pf->port))
+			v = v->vhost_next;
+
+		if (v)
+			pf->vh = v;
+		else
+			*pf = context->vh_port_first[
+					--context->count_vh_port_first];
+		break;
+	}
+}
+
+void
+lws_vhost_index_destroy(struct lws_context *context)
+{
+	lws_free_set_NULL(context->vh_name_hash);
+	lws_free_set_NULL(context->vh_port_first);
+	context->vh_name_hash_elements = 0;
+	context->count_vh_indexed = 0;
+	context->count_vh_port_first = 0;
+}
+
 struct lws_vhost *
 lws_select_vhost(struct lws_context *context, int port, const char *servername)
 {
-	struct lws_vhost *vhost = context->vhost_list;
+	struct lws_vhost *vhost, *best = NULL;
 	const char *p;
-	int n, m, colon;
+	int n, colon;
 
 	n = (int)strlen(servername);
 	colon = n;
@@ -306,13 +506,10 @@ lws_select_vhost(struct lws_context *context, int port, const char *servername)
 
 	/* Priotity 1: first try exact matches */
 
-	while (vhost) {
-		if (port == vhost->listen_port &&
-		    !strncmp(vhost->name, servername, colon)) {
-			lwsl_info("SNI: Found: %s\n", servername);
-			return vhost;
-		}
-		vhost = vhost->vhost_next;
+	vhost = lws_vhost_name_lookup(context, port, servername, colon);
+	if (vhost) {
+		lwsl_info("SNI: Found: %s\n", servername);
+		return vhost;
 	}
 
 	/*
@@ -321,32 +518,34 @@ lws_select_vhost(struct lws_context *context, int port, const char *servername)
 	 * which is reasonable.  If exact match exists we already chose it and
 	 * never reach here.  SSL will still fail it if the cert doesn't allow
 	 * *.x.com.
+	 *
+	 * Look up each suffix following a '.', and take whichever match
+	 * comes first in vhost_list.
 	 */
-	vhost = context->vhost_list;
-	while (vhost) {
-		m = (int)strlen(vhost->name);
-		if (port == vhost->listen_port &&
-		    m <= (colon - 2) &&
-		    servername[colon - m - 1] == '.' &&
-		    !strncmp(vhost->name, servername + colon - m, m)) {
-			lwsl_info("SNI: Found %s on wildcard: %s\n",
-				    servername, vhost->name);
-			return vhost;
-		}
-		vhost = vhost->vhost_next;
+	for (n = 1; n < colon - 1; n++) {
+		if (servername[n] != '.')
+			continue;
+
+		vhost = lws_vhost_name_lookup(context, port, servername + n + 1,
+					      colon - n - 1);
+		if (vhost && (!best || vhost->vh_seq < best->vh_seq))
+			best = vhost;
+	}
+	if (best) {
+		lwsl_info("SNI: Found %s on wildcard: %s\n",
+			    servername, best->name);
+		return best;
 	}
 
 	/* Priority 3: match the first vhost on our port */
 
-	vhost = context->vhost_list;
-	while (vhost) {
-		if (port == vhost->listen_port) {
+	for (n = 0; n < context->count_vh_port_first; n++)
+		if (context->vh_port_first[n].port == port) {
+			vhost = context->vh_port_first[n].vh;
 			lwsl_info("vhost match to %s based on port %d\n",
 					vhost->name, port);
 			return vhost;
 		}
-		vhost = vhost->vhost_next;
-	}
 
 	/* no match */
 
@@ -661,36 +860,142 @@ bail:
 	return -1;
 }
 
+int
+lws_mount_trie_build(struct lws_vhost *vh)
+{
+	const struct lws_http_mount *hm;
+	struct lws_mount_trie *t;
+	uint32_t nodes = 1, hits = 0, n, child;
+	int d;
+
+	for (hm = vh->mount_list; hm; hm = hm->mount_next) {
+		nodes += hm->mountpoint_len;
+		hits++;
+	}
+
+	if (!hits)
+		return 0;
+
+	t = lws_zalloc((sizeof(*t) * nodes) +
+		       (sizeof(*vh->mount_trie_hits) * hits), "mount trie");
+	if (!t)
+		return 1;
+
+	vh->mount_trie = t;
+	vh->mount_trie_hits = (struct lws_mount_trie_hit *)&t[nodes];
+
+	nodes = 1;
+	hits = 0;
+	for (hm = vh->mount_list; hm; hm = hm->mount_next, hits++) {
+		n = 0;
+		for (d = 0; d < hm->mountpoint_len; d++) {
+			/* a mountpoint shorter than its mountpoint_len... */
+			if (!hm->mountpoint[d])
+				break;
+
+			child = t[n].child;
+			while (child && t[child - 1].c !=
+					(unsigned char)hm->mountpoint[d])
+				child = t[child - 1].sibling;
+
+			if (!child) {
+				child = ++nodes;
+				t[child - 1].c = (unsigned char)hm->mountpoint[d];
+				t[child - 1].sibling = t[n].child;
+				t[n].child = child;
+			}
+			n = child - 1;
+		}
+		/* ...can never match, so leave it out */
+		if (d != hm->mountpoint_len)
+			continue;
+
+		vh->mount_trie_hits[hits].m = hm;
+		vh->mount_trie_hits[hits].next = t[n].hit;
+		t[n].hit = hits + 1;
+	}
+
+	return 0;
+}
+
 const struct lws_http_mount *
 lws_find_mount(struct lws *wsi, const char *uri_ptr, int uri_len)
 {
-	const struct lws_http_mount *hm, *hit = NULL;
-	int best = 0;
-
-	hm = wsi->vhost->mount_list;
-	while (hm) {
-		if (uri_len >= hm->mountpoint_len &&
-		    !strncmp(uri_ptr, hm->mountpoint, hm->mountpoint_len) &&
-		    (uri_ptr[hm->mountpoint_len] == '\0' ||
-		     uri_ptr[hm->mountpoint_len] == '/' ||
-		     hm->mountpoint_len == 1)
-		    ) {
-			if (hm->origin_protocol == LWSMPRO_CALLBACK ||
-			    ((hm->origin_protocol == LWSMPRO_CGI ||
-			     lws_hdr_total_length(wsi, WSI_TOKEN_GET_URI) ||
-			     (wsi->http2_substream &&
-				lws_hdr_total_length(wsi,
-						WSI_TOKEN_HTTP_COLON_PATH)) ||
-			     hm->protocol) &&
-			    hm->mountpoint_len > best)) {
+	const struct lws_mount_trie *t = wsi->vhost->mount_trie;
+	const struct lws_mount_trie_hit *hits = wsi->vhost->mount_trie_hits;
+	uint32_t matched[256], n = 0, h, child;
+	int d = 0, m = 0, cb = -1, hit = -1, best = 0, any;
+
+	if (!t || !uri_ptr)
+		return NULL;
+
+	/*
+	 * Walk the uri down the trie, collecting the nodes where a mountpoint
+	 * ends and the uri is at a path boundary.  mountpoint_len is an
+	 * unsigned char, so there can't be more than 256 of them.
+	 */
+
+	while (1) {
+		if (t[n].hit && (uri_ptr[d] == '\0' || uri_ptr[d] == '/' ||
+				 d == 1))
+			matched[m++] = n;
+
+		if (d == uri_len)
+			break;
+
+		child = t[n].child;
+		while (child && t[child - 1].c != (unsigned char)uri_ptr[d])
+			child = t[child - 1].sibling;
+		if (!child)
+			break;
+
+		n = child - 1;
+		d++;
+	}
+
+	/*
+	 * A matching callback mount is always taken, so the one last in
+	 * mount_list wins... unless a longer, qualifying mount follows it in
+	 * the list.  Otherwise it's the longest qualifying mount, with ties
+	 * going to the one first in the list.
+	 */
+
+	for (n = 0; n < (uint32_t)m; n++)
+		for (h = t[matched[n]].hit; h; h = hits[h - 1].next)
+			if (hits[h - 1].m->origin_protocol ==
+						LWSMPRO_CALLBACK &&
+			    (int)h - 1 > cb)
+				cb = h - 1;
+
+	if (cb >= 0)
+		best = hits[cb].m->mountpoint_len;
+
+	any = lws_hdr_total_length(wsi, WSI_TOKEN_GET_URI) ||
+	      (wsi->http2_substream &&
+	       lws_hdr_total_length(wsi, WSI_TOKEN_HTTP_COLON_PATH));
+
+	for (n = 0; n < (uint32_t)m; n++)
+		for (h = t[matched[n]].hit; h; h = hits[h - 1].next) {
+			const struct lws_http_mount *hm = hits[h - 1].m;
+
+			if ((int)h - 1 < cb ||
+			    hm->origin_protocol == LWSMPRO_CALLBACK ||
+			    !(any || hm->origin_protocol == LWSMPRO_CGI ||
+			      hm->protocol))
+				continue;
+
+			if (hm->mountpoint_len > best ||
+			    (hit >= 0 && hm->mountpoint_len == best &&
+			     (int)h - 1 < hit)) {
 				best = hm->mountpoint_len;
-				hit = hm;
+				hit = h - 1;
 			}
 		}
-		hm = hm->mount_next;
-	}
 
-	return hit;
+	if (hit < 0)
+		hit = cb;
+
+	return hit < 0 ? NULL : hits[hit].m;
 }
 
 #if LWS_POSIX
@@ -846,6 +1151,141 @@ lws_http_get_uri_and_method(struct lws *wsi, char **puri_ptr, int *puri_len)
 	return -1;
 }
 
+#if defined(LWS_WITH_HTTP_PROXY)
+/*
+ * Start the client connection to be's origin (or the mount's only origin if
+ * be is NULL) for wsi's request to the proxy mount hit.  Unless fresh, an
+ * idle pooled connection to the origin is used if there is one.
+ */
+
+static int
+lws_http_proxy_connect(struct lws *wsi, const struct lws_http_mount *hit,
+		       const char *uri_ptr, struct lws_proxy_backend *be,
+		       int fresh)
+{
+	struct lws_client_connect_info i;
+	char ads[96], rpath[256], *pcolon, *pslash, *p;
+	const char *origin = hit->origin;
+	struct lws *cwsi = NULL;
+	int n, na;
+
+	if (be)
+		origin = be->origin;
+
+	memset(&i, 0, sizeof(i));
+	i.context = lws_get_context(wsi);
+	i.vhost = wsi->vhost;
+
+	pcolon = strchr(origin, ':');
+	pslash = strchr(origin, '/');
+	if (!pslash) {
+		lwsl_err("Proxy mount origin '%s' must have /\n", origin);
+		return -1;
+	}
+	if (pcolon > pslash)
+		pcolon = NULL;
+
+	if (pcolon)
+		n = pcolon - origin;
+	else
+		n = pslash - origin;
+
+	if (n >= (int)sizeof(ads) - 2)
+		n = sizeof(ads) - 2;
+
+	memcpy(ads, origin, n);
+	ads[n] = '\0';
+
+	i.address = ads;
+	i.port = 80;
+	if (hit->origin_protocol == LWSMPRO_HTTPS) {
+		i.port = 443;
+		i.ssl_connection = 1;
+	}
+	if (pcolon)
+		i.port = atoi(pcolon + 1);
+
+	lws_snprintf(rpath, sizeof(rpath) - 1, "/%s/%s", pslash + 1,
+		     uri_ptr + hit->mountpoint_len);
+	lws_clean_url(rpath);
+	na = lws_hdr_total_length(wsi, WSI_TOKEN_HTTP_URI_ARGS);
+	if (na) {
+		p = rpath + strlen(rpath);
+		*p++ = '?';
+		lws_hdr_copy(wsi, p, &rpath[sizeof(rpath) - 1] - p,
+			     WSI_TOKEN_HTTP_URI_ARGS);
+		while (--na) {
+			if (*p == '\0')
+				*p = '&';
+			p++;
+		}
+	}
+
+	i.path = rpath;
+	i.host = i.address;
+	i.origin = NULL;
+	i.method = "GET";
+	i.parent_wsi = wsi;
+	i.uri_replace_from = origin;
+	i.uri_replace_to = hit->mountpoint;
+
+	lwsl_notice("proxying to %s port %d url %s, ssl %d, "
+		    "from %s, to %s\n",
+		    i.address, i.port, i.path, i.ssl_connection,
+		    i.uri_replace_from, i.uri_replace_to);
+
+	/* an idle connection to the origin we can use? */
+	if (!fresh)
+		cwsi = lws_proxy_pool_take(wsi, &i);
+	if (cwsi)
+		cwsi->proxy_reused = 1;
+	else {
+		cwsi = lws_client_connect_via_info(&i);
+		if (!cwsi) {
+			lwsl_err("proxy connect fail\n");
+			if (be)
+				lws_proxy_lb_done(wsi->vhost, be,
+						  LWSPXLB_FAILED);
+			return 1;
+		}
+	}
+	cwsi->proxy_upstream = 1;
+	cwsi->px_backend = be;
+
+	return 0;
+}
+
+/*
+ * A connection we took from the proxy pool for wsi's request was closed
+ * before the origin answered.  Make the request again to the same origin, on
+ * a new connection.
+ */
+
+int
+lws_http_proxy_retry(struct lws *wsi, struct lws_proxy_backend *be)
+{
+	const struct lws_http_mount *hit;
+	char *uri_ptr = NULL;
+	int uri_len = 0;
+
+	if (lws_http_get_uri_and_method(wsi, &uri_ptr, &uri_len) < 0)
+		goto bail;
+
+	hit = lws_find_mount(wsi, uri_ptr, uri_len);
+	if (!hit || (hit->origin_protocol != LWSMPRO_HTTPS &&
+		     hit->origin_protocol != LWSMPRO_HTTP))
+		goto bail;
+
+	return lws_http_proxy_connect(wsi, hit, uri_ptr, be, 1);
+
+bail:
+	if (be)
+		lws_proxy_lb_done(wsi->vhost, be, LWSPXLB_ABANDONED);
+
+	return 1;
+}
+#endif
+
 int
 lws_http_action(struct lws *wsi)
 {
@@ -1121,79 +1561,19 @@ lws_http_action(struct lws *wsi)
 
 	if (hit->origin_protocol == LWSMPRO_HTTPS ||
 	    hit->origin_protocol == LWSMPRO_HTTP)  {
-		struct lws_client_connect_info i;
-		char ads[96], rpath[256], *pcolon, *pslash, *p;
-		int n, na;
+		struct lws_proxy_backend *be;
 
-		memset(&i, 0, sizeof(i));
-		i.context = lws_get_context(wsi);
+		/* if the mount has several origins, choose one */
+		if (lws_proxy_lb_pick(wsi, hit, &be)) {
+			lwsl_notice("no healthy origin for %s\n",
+				    hit->mountpoint);
+			lws_return_http_status(wsi,
+					HTTP_STATUS_SERVICE_UNAVAILABLE, NULL);
 
-		pcolon = strchr(hit->origin, ':');
-		pslash = strchr(hit->origin, '/');
-		if (!pslash) {
-			lwsl_err("Proxy mount origin '%s' must have /\n",
-				 hit->origin);
-			return -1;
-		}
-		if (pcolon > pslash)
-			pcolon = NULL;
-		
-		if (pcolon)
-			n = pcolon - hit->origin;
-		else
-			n = pslash - hit->origin;
-
-		if (n >= (int)sizeof(ads) - 2)
-			n = sizeof(ads) - 2;
-
-		memcpy(ads, hit->origin, n);
-		ads[n] = '\0';
-
-		i.address = ads;
-		i.port = 80;
-		if (hit->origin_protocol == LWSMPRO_HTTPS) { 
-			i.port = 443;
-			i.ssl_connection = 1;
-		}
-		if (pcolon)
-			i.port = atoi(pcolon + 1);
-		
-		lws_snprintf(rpath, sizeof(rpath) - 1, "/%s/%s", pslash + 1,
-			     uri_ptr + hit->mountpoint_len);
-		lws_clean_url(rpath);
-		na = lws_hdr_total_length(wsi, WSI_TOKEN_HTTP_URI_ARGS);
-		if (na) {
-			p = rpath + strlen(rpath);
-			*p++ = '?';
-			lws_hdr_copy(wsi, p, &rpath[sizeof(rpath) - 1] - p,
-				     WSI_TOKEN_HTTP_URI_ARGS);
-			while (--na) {
-				if (*p == '\0')
-					*p = '&';
-				p++;
-			}
-		}
-				
-
-		i.path = rpath;
-		i.host = i.address;
-		i.origin = NULL;
-		i.method = "GET";
-		i.parent_wsi = wsi;
-		i.uri_replace_from = hit->origin;
-		i.uri_replace_to = hit->mountpoint;
-
-		lwsl_notice("proxying to %s port %d url %s, ssl %d, "
-			    "from %s, to %s\n",
-			    i.address, i.port, i.path, i.ssl_connection,
-			    i.uri_replace_from, i.uri_replace_to);
-	
-		if (!lws_client_connect_via_info(&i)) {
-			lwsl_err("proxy connect fail\n");
-			return 1;
+			return lws_http_transaction_completed(wsi);
 		}
 
-		return 0;
+		return lws_http_proxy_connect(wsi, hit, uri_ptr, be, 0);
 	}
 #endif
 
@@ -1594,7 +1974,8 @@ upgrade_h2c:
 			return 1;
 		}
 
-		lwsi_set_state(wsi, LRS_H2_AWAIT_PREFACE);
+		lws_role_transition(wsi, LWSI_ROLE_H2_SERVER,
+				    LRS_H2_AWAIT_PREFACE, &role_ops_h2);
 		wsi->upgraded_to_http2 = 1;
 
 		return 0;
@@ -1639,10 +2020,13 @@ lws_get_idlest_tsi(struct lws_context *context)
 }
 
 struct lws *
-lws_create_new_server_wsi(struct lws_vhost *vhost)
+lws_create_new_server_wsi(struct lws_vhost *vhost, int fixed_tsi)
 {
 	struct lws *new_wsi;
-	int n = lws_get_idlest_tsi(vhost->context);
+	int n = fixed_tsi;
+
+	if (n < 0)
+		n = lws_get_idlest_tsi(vhost->context);
 
 	if (n < 0) {
 		lwsl_err("no space for new conn\n");
@@ -1806,10 +2190,10 @@ lws_http_transaction_completed(struct lws *wsi)
 
 /* if not a socket, it's a raw, non-ssl file descriptor */
 
-LWS_VISIBLE struct lws *
-lws_adopt_descriptor_vhost(struct lws_vhost *vh, lws_adoption_type type,
-			   lws_sock_file_fd_type fd, const char *vh_prot_name,
-			   struct lws *parent)
+struct lws *
+_lws_adopt_descriptor_vhost(struct lws_vhost *vh, lws_adoption_type type,
+			    lws_sock_file_fd_type fd, const char *vh_prot_name,
+			    struct lws *parent, int fixed_tsi)
 {
 	struct lws_context *context = vh->context;
 	struct lws *new_wsi;
@@ -1833,7 +2217,7 @@ lws_adopt_descriptor_vhost(struct lws_vhost *vh, lws_adoption_type type,
 	}
 #endif
 
-	new_wsi = lws_create_new_server_wsi(vh);
+	new_wsi = lws_create_new_server_wsi(vh, fixed_tsi);
 	if (!new_wsi) {
 		if (type & LWS_ADOPT_SOCKET && !(type & LWS_ADOPT_WS_PARENTIO))
 			compatible_close(fd.sockfd);
@@ -2019,6 +2403,15 @@ bail:
 	return NULL;
 }
 
+LWS_VISIBLE struct lws *
+lws_adopt_descriptor_vhost(struct lws_vhost *vh, lws_adoption_type type,
+			   lws_sock_file_fd_type fd, const char *vh_prot_name,
+			   struct lws *parent)
+{
+	return _lws_adopt_descriptor_vhost(vh, type, fd, vh_prot_name, parent,
+					   -1);
+}
+
 LWS_VISIBLE struct lws *
 lws_adopt_socket_vhost(struct lws_vhost *vh, lws_sockfd_type accept_fd)
 {
@@ -2347,6 +2740,7 @@ lws_serve_http_file(struct lws *wsi, const char *file, const char *content_type,
 	}
 
 	wsi->http.filepos = 0;
+	wsi->no_sendfile = 0;
 	lwsi_set_state(wsi, LRS_ISSUING_FILE);
 
 	lws_callback_on_writable(wsi);
@@ -28,7 +28,7 @@ rops_handle_POLLIN_listen(struct lws_context_per_thread *pt, struct lws *wsi,
 	struct lws_context *context = wsi->context;
 	lws_sockfd_type accept_fd = LWS_SOCK_INVALID;
 	lws_sock_file_fd_type fd;
-	int opts = LWS_ADOPT_SOCKET | LWS_ADOPT_ALLOW_SSL;
+	int opts = LWS_ADOPT_SOCKET | LWS_ADOPT_ALLOW_SSL, tsi;
 	struct sockaddr_storage cli_addr;
 	socklen_t clilen;
 
@@ -122,9 +122,19 @@ rops_handle_POLLIN_listen(struct lws_context_per_thread *pt, struct lws *wsi,
 		else
 			opts = LWS_ADOPT_SOCKET;
 
+		/*
+		 * with SMP_ACCEPT_LOCAL, the new connection stays on the
+		 * service thread that owns the listen socket, if it has room
+		 */
+		tsi = -1;
+		if (lws_check_opt(context->options,
+				  LWS_SERVER_OPTION_SMP_ACCEPT_LOCAL) &&
+		    pt->fds_count < context->fd_limit_per_thread - 1)
+			tsi = pt->tid;
+
 		fd.sockfd = accept_fd;
-		cwsi = lws_adopt_descriptor_vhost(wsi->vhost, opts, fd,
-						NULL, NULL);
+		cwsi = _lws_adopt_descriptor_vhost(wsi->vhost, opts, fd,
+						   NULL, NULL, tsi);
 		if (!cwsi)
 			/* already closed cleanly as necessary */
 			return LWS_HPI_RET_DIE;
@@ -36,8 +36,27 @@ rops_handle_POLLIN_pipe(struct lws_context_per_thread *pt, struct lws *wsi,
 	 */
 	n = read(wsi->desc.sockfd, s, sizeof(s));
 	(void)n;
-	if (n < 0)
+	if (n < 0 && LWS_ERRNO != LWS_EAGAIN)
 		return LWS_HPI_RET_CLOSE_HANDLED;
+#endif
+#if defined(LWS_WITH_PT_QUEUE)
+	/*
+	 * deliver what other threads posted to us, and unless somebody
+	 * called lws_cancel_service() too, that is all the wakeup was for
+	 */
+#if defined(LWS_WITH_TLS_HANDSHAKE_POOL)
+	n = lws_pt_queue_service(pt);
+	/*
+	 * tls handshakes the pool finished for us wake us the same way...
+	 * look for them only after the queue rearmed the wakeup
+	 */
+	lws_tls_hs_pool_service(wsi->context, pt);
+	if (!n)
+		return LWS_HPI_RET_HANDLED;
+#else
+	if (!lws_pt_queue_service(pt))
+		return LWS_HPI_RET_HANDLED;
+#endif
 #endif
 	/*
 	 * the poll() wait, or the event loop for libuv etc is a
@@ -31,14 +31,15 @@ rops_handle_POLLIN_raw(struct lws_context_per_thread *pt, struct lws *wsi,
 	case LWSI_ROLE_RAW_SOCKET:
 		/* pending truncated sends have uber priority */
 
-		if (wsi->trunc_len) {
+		if (lws_has_buffered_out(wsi)) {
 			if (!(pollfd->revents & LWS_POLLOUT))
 				break;
 
-			if (lws_issue_raw(wsi, wsi->trunc_alloc +
-					       wsi->trunc_offset,
-					  wsi->trunc_len) < 0)
+			if (lws_flush_buffered_out(wsi) < 0)
 				goto fail;
+			if (!lws_has_buffered_out(wsi))
+				/* the user gets his writeable next time */
+				lws_callback_on_writable(wsi);
 			/*
 			 * we can't afford to allow input processing to send
 			 * something new, so spin around he event loop until
@@ -150,8 +151,7 @@ try_pollout:
 	return LWS_HPI_RET_HANDLED;
 
 fail:
-	lws_close_free_wsi(wsi, LWS_CLOSE_STATUS_NOSTATUS, "raw svc fail");
-
+	/* the caller closes it */
 	return LWS_HPI_RET_CLOSE_HANDLED;
 }
 
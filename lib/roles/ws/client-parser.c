@@ -164,7 +164,7 @@ int lws_client_rx_sm(struct lws *wsi, unsigned char c)
 			wsi->lws_rx_parse_state = LWS_RXPS_04_FRAME_HDR_LEN64_8;
 			break;
 		default:
-			wsi->ws->rx_packet_length = c;
+			wsi->ws->rx_packet_length = c & 0x7f;
 			if (wsi->ws->this_frame_masked)
 				wsi->lws_rx_parse_state =
 						LWS_RXPS_07_COLLECT_FRAME_KEY_1;
@@ -292,6 +292,7 @@ int lws_client_rx_sm(struct lws *wsi, unsigned char c)
 		wsi->ws->mask[3] = c;
 		if (c)
 			wsi->ws->all_zero_nonce = 0;
+		wsi->ws->mask_idx = 0;
 
 		if (wsi->ws->rx_packet_length)
 			wsi->lws_rx_parse_state =
@@ -558,12 +559,8 @@ utf8_fail:
 		if (callback_action == LWS_CALLBACK_CLIENT_RECEIVE_PONG)
 			lwsl_info("Client doing pong callback\n");
 
-		if (
-				/* coverity says dead code otherwise */
 #if !defined(LWS_WITHOUT_EXTENSIONS)
-				n &&
-#endif
-				eff_buf.token_len)
+		if (n && eff_buf.token_len)
 			/* extension had more... main loop will come back
 			 * we want callback to be done with this set, if so,
 			 * because lws_is_final() hides it was final until the
@@ -571,6 +568,7 @@ utf8_fail:
 			 */
 			lws_add_wsi_to_draining_ext_list(wsi);
 		else
+#endif
 			lws_remove_wsi_from_draining_ext_list(wsi);
 
 		if (lwsi_state(wsi) == LRS_RETURNED_CLOSE ||
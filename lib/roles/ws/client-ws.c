@@ -493,6 +493,8 @@ check_extensions:
 		n = 0;
 	}
 
+	lws_ext_1hz_track(wsi);
+
 check_accept:
 #endif
 
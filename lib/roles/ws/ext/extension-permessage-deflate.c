@@ -478,3 +478,155 @@ lws_extension_callback_pm_deflate(struct lws_context *context,
 	return 0;
 }
 
+LWS_VISIBLE struct lws_pmd_predeflated *
+lws_pmd_predeflate(const void *buf, size_t len, int binary, int window_bits,
+		   int level)
+{
+	struct lws_pmd_predeflated *pd;
+	size_t alloc, pre;
+	z_stream zs;
+	uint8_t *p;
+	int n;
+
+	if (window_bits < 9 || window_bits > 15)
+		return NULL;
+
+	memset(&zs, 0, sizeof(zs));
+	if (deflateInit2(&zs, level, Z_DEFLATED, -window_bits,
+			 LWS_ZLIB_MEMLEVEL, Z_DEFAULT_STRATEGY) != Z_OK)
+		return NULL;
+
+	pd = lws_zalloc(sizeof(*pd), "pmd predeflated");
+	if (!pd)
+		goto bail;
+	pd->window_bits = window_bits;
+
+	/*
+	 * Leave room in front for the biggest ws header, and some slack at
+	 * the end for the sync flush marker
+	 */
+	alloc = 10 + deflateBound(&zs, (uLong)len) + 16;
+	pd->frame = lws_malloc(alloc, "pmd predeflated frame");
+	if (!pd->frame)
+		goto bail1;
+
+	zs.next_in = (unsigned char *)buf;
+	zs.avail_in = (uInt)len;
+	zs.next_out = pd->frame + 10;
+	zs.avail_out = (uInt)(alloc - 10);
+
+	do {
+		if (!zs.avail_out) {
+			n = lws_ptr_diff(zs.next_out, pd->frame);
+			p = lws_realloc(pd->frame, alloc * 2,
+					"pmd predeflated frame");
+			if (!p)
+				goto bail1;
+			pd->frame = p;
+			zs.next_out = p + n;
+			zs.avail_out = (uInt)alloc;
+			alloc *= 2;
+		}
+		if (deflate(&zs, Z_SYNC_FLUSH) == Z_STREAM_ERROR)
+			goto bail1;
+	} while (zs.avail_in || !zs.avail_out);
+
+	/* the message always ends with the 00 00 FF FF the receiver restores */
+
+	len = lws_ptr_diff(zs.next_out, pd->frame + 10) - 4;
+
+	/* the header never changes, since server frames aren't masked */
+
+	pre = len < 126 ? 2 : (len < 65536 ? 4 : 10);
+	p = pd->frame + 10 - pre;
+	p[0] = 0x80 | 0x40 | (binary ? LWSWSOPC_BINARY_FRAME :
+				       LWSWSOPC_TEXT_FRAME);
+	switch (pre) {
+	case 2:
+		p[1] = (uint8_t)len;
+		break;
+	case 4:
+		p[1] = 126;
+		p[2] = (uint8_t)(len >> 8);
+		p[3] = (uint8_t)len;
+		break;
+	default:
+		p[1] = 127;
+		for (n = 0; n < 8; n++)
+			p[2 + n] = (uint8_t)((uint64_t)len >> (8 * (7 - n)));
+		break;
+	}
+	memmove(pd->frame, p, pre + len);
+	pd->frame_len = pre + len;
+
+	(void)deflateEnd(&zs);
+
+	return pd;
+
+bail1:
+	lws_free(pd->frame);
+	lws_free(pd);
+bail:
+	(void)deflateEnd(&zs);
+
+	return NULL;
+}
+
+LWS_VISIBLE void
+lws_pmd_predeflated_destroy(struct lws_pmd_predeflated **ppd)
+{
+	if (!*ppd)
+		return;
+
+	lws_free((*ppd)->frame);
+	lws_free_set_NULL(*ppd);
+}
+
+LWS_VISIBLE int
+lws_write_pmd_predeflated(struct lws *wsi, struct lws_pmd_predeflated *pd)
+{
+	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
+	struct lws_ext_pm_deflate_priv *priv;
+
+	/*
+	 * It can only go as it is on a server ws connection with nothing
+	 * but permessage-deflate active, when we are between messages
+	 */
+
+	if (!lwsi_role_ws(wsi) || lwsi_role_client(wsi) ||
+	    lwsi_role_h2_ENCAPSULATION(wsi) || wsi->parent_carries_io ||
+	    lwsi_state(wsi) != LRS_ESTABLISHED || wsi->count_act_ext != 1 ||
+	    wsi->active_extensions[0]->callback !=
+					lws_extension_callback_pm_deflate ||
+	    wsi->ws->inside_frame || wsi->ws->tx_draining_ext ||
+	    wsi->ws->stashed_write_pending)
+		return 1;
+
+	priv = (struct lws_ext_pm_deflate_priv *)wsi->act_ext_user[0];
+
+	/*
+	 * Our deflate stream for this connection must not be holding any
+	 * history, since what it sends after this can no longer refer back to
+	 * it correctly.  And the receiver must accept our window size.
+	 */
+
+	if (!priv || priv->tx_init ||
+	    pd->window_bits > priv->args[PMD_SERVER_MAX_WINDOW_BITS])
+		return 1;
+
+	lws_restart_ws_ping_pong_timer(wsi);
+
+	lws_stats_atomic_bump(wsi->context, pt, LWSSTATS_C_API_LWS_WRITE, 1);
+	lws_stats_atomic_bump(wsi->context, pt, LWSSTATS_B_WRITE,
+			      pd->frame_len);
+#ifdef LWS_WITH_ACCESS_LOG
+	wsi->access_log.sent += pd->frame_len;
+#endif
+	if (wsi->vhost)
+		wsi->vhost->conn_stats.tx += pd->frame_len;
+
+	if (lws_issue_raw(wsi, pd->frame, pd->frame_len) < 0)
+		return -1;
+
+	return 0;
+}
@@ -17,6 +17,15 @@ enum arg_indexes {
 	PMD_ARG_COUNT
 };
 
+/* one message compressed up front, to be sent as it is on many connections */
+
+struct lws_pmd_predeflated {
+	unsigned char *frame; /* ws header + compressed payload */
+	size_t frame_len;
+
+	unsigned char window_bits;
+};
+
 struct lws_ext_pm_deflate_priv {
 	z_stream rx;
 	z_stream tx;
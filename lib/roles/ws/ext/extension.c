@@ -182,6 +182,34 @@ int lws_ext_cb_active(struct lws *wsi, int reason, void *arg, int len)
 	return handled;
 }
 
+/*
+ * Active extensions get LWS_EXT_CB_1HZ once a second with the time in len, as
+ * they did from the old timeout walk.  Timeouts are kept on the pt timer wheel
+ * now, so what they return no longer holds off the wsi's timeout.
+ */
+
+void
+lws_ext_1hz_track(struct lws *wsi)
+{
+	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
+
+	if (!wsi->count_act_ext || wsi->dll_ext_1hz.prev)
+		return;
+
+	lws_dll_lws_add_front(&wsi->dll_ext_1hz, &pt->ext_1hz_list);
+}
+
+void
+lws_ext_1hz_service(struct lws_context_per_thread *pt, time_t now)
+{
+	lws_start_foreach_dll_safe(struct lws_dll_lws *, d, d1,
+				   pt->ext_1hz_list.next) {
+		struct lws *wsi = lws_container_of(d, struct lws, dll_ext_1hz);
+
+		lws_ext_cb_active(wsi, LWS_EXT_CB_1HZ, NULL, (int)now);
+	} lws_end_foreach_dll_safe(d, d1);
+}
+
 int lws_ext_cb_all_exts(struct lws_context *context, struct lws *wsi,
 			int reason, void *arg, int len)
 {
@@ -279,7 +307,7 @@ lws_issue_raw_ext_access(struct lws *wsi, unsigned char *buf, size_t len)
 		 * Or we had to hold on to some of it?
 		 */
 
-		if (!lws_send_pipe_choked(wsi) && !wsi->trunc_len)
+		if (!lws_send_pipe_choked(wsi) && !lws_has_buffered_out(wsi))
 			/* no we could add more, lets's do that */
 			continue;
 
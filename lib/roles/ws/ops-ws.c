@@ -505,14 +505,12 @@ drain_extension:
 		if (rx_draining_ext && eff_buf.token_len == 0)
 			goto already_done;
 
-		if (
 #if !defined(LWS_WITHOUT_EXTENSIONS)
-		    n &&
-#endif
-		    eff_buf.token_len)
+		if (n && eff_buf.token_len)
 			/* extension had more... main loop will come back */
 			lws_add_wsi_to_draining_ext_list(wsi);
 		else
+#endif
 			lws_remove_wsi_from_draining_ext_list(wsi);
 
 		if (eff_buf.token_len > 0 ||
@@ -601,14 +599,49 @@ lws_remove_wsi_from_draining_ext_list(struct lws *wsi)
 	wsi->ws->rx_draining_ext_list = NULL;
 }
 
+/*
+ * Each idle ws connection has a timer on its own pt's ping wheel, due when
+ * ws_ping_pong_interval has passed since its last traffic.  Traffic just
+ * records the time, when the timer comes up we either ask for a PING or arm
+ * it again from the last traffic.  So a busy connection costs one wheel op
+ * per interval, not one per packet.
+ *
+ * Each arming adds a little extra delay, rotating up to a quarter of the
+ * interval, so connections that were established together don't all come
+ * due in the same second.
+ */
+
+static void
+__lws_ws_ping_schedule(struct lws *wsi)
+{
+	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
+	unsigned int interval = wsi->context->ws_ping_pong_interval;
+
+	lws_tw_add(&pt->tw_ws_ping, &wsi->tw_ws_ping,
+		   (uint64_t)wsi->ws->time_next_ping_check + interval + 1 +
+		   (pt->ws_ping_spread++ % ((interval / 4) + 1)));
+}
+
 LWS_EXTERN void
 lws_restart_ws_ping_pong_timer(struct lws *wsi)
 {
+	struct lws_context_per_thread *pt;
+
 	if (!wsi->context->ws_ping_pong_interval ||
 	    !lwsi_role_ws(wsi))
 		return;
 
-	wsi->ws->time_next_ping_check = (time_t)lws_now_secs();
+	wsi->ws->time_next_ping_check =
+			(time_t)(lws_plat_monotonic_us() / 1000000);
+
+	if (wsi->tw_ws_ping.list.prev)
+		/* already armed, it will see the new time when it comes up */
+		return;
+
+	pt = &wsi->context->pt[(int)wsi->tsi];
+	lws_pt_lock(pt, __func__);
+	__lws_ws_ping_schedule(wsi);
+	lws_pt_unlock(pt);
 }
 
 static int
@@ -632,14 +665,16 @@ lws_0405_frame_mask_generate(struct lws *wsi)
 
 /* Once we reach LWS_RXPS_PAYLOAD_UNTIL_LENGTH_EXHAUSTED, we know how much
  * to expect in that state and can deal with it in bulk more efficiently.
+ *
+ * This is used by both the server and client rx parsers.
  */
 
 int
 lws_payload_until_length_exhausted(struct lws *wsi, unsigned char **buf,
 				   size_t *len)
 {
-	unsigned char *buffer = *buf, mask[4];
-	int buffer_size, n;
+	unsigned char *buffer = *buf;
+	int buffer_size;
 	unsigned int avail;
 	char *rx_ubuf;
 
@@ -663,27 +698,13 @@ lws_payload_until_length_exhausted(struct lws *wsi, unsigned char **buf,
 
 	avail--;
 	rx_ubuf = wsi->ws->rx_ubuf + LWS_PRE + wsi->ws->rx_ubuf_head;
-	if (wsi->ws->all_zero_nonce)
+	if (wsi->ws->all_zero_nonce ||
+	    (lwsi_role_client(wsi) && !wsi->ws->this_frame_masked))
 		memcpy(rx_ubuf, buffer, avail);
-	else {
-
-		for (n = 0; n < 4; n++)
-			mask[n] = wsi->ws->mask[(wsi->ws->mask_idx + n) & 3];
-
-		/* deal with 4-byte chunks using unwrapped loop */
-		n = avail >> 2;
-		while (n--) {
-			*(rx_ubuf++) = *(buffer++) ^ mask[0];
-			*(rx_ubuf++) = *(buffer++) ^ mask[1];
-			*(rx_ubuf++) = *(buffer++) ^ mask[2];
-			*(rx_ubuf++) = *(buffer++) ^ mask[3];
-		}
-		/* and the remaining bytes bytewise */
-		for (n = 0; n < (int)(avail & 3); n++)
-			*(rx_ubuf++) = *(buffer++) ^ mask[n];
-
-		wsi->ws->mask_idx = (wsi->ws->mask_idx + avail) & 3;
-	}
+	else
+		wsi->ws->mask_idx = lws_ws_mask_payload((uint8_t *)rx_ubuf,
+					buffer, avail, wsi->ws->mask,
+					wsi->ws->mask_idx);
 
 	(*buf) += avail;
 	wsi->ws->rx_ubuf_head += avail;
@@ -901,7 +922,7 @@ rops_handle_POLLIN_ws(struct lws_context_per_thread *pt, struct lws *wsi,
 #if defined(LWS_WITH_HTTP2)
 	if (wsi->http2_substream || wsi->upgraded_to_http2) {
 		wsi1 = lws_get_network_wsi(wsi);
-		if (wsi1 && wsi1->trunc_len)
+		if (wsi1 && lws_has_buffered_out(wsi1))
 			/* We cannot deal with any kind of new RX
 			 * because we are dealing with a partial send
 			 * (new RX may trigger new http_action() that
@@ -1389,50 +1410,48 @@ int rops_handle_POLLOUT_ws(struct lws *wsi)
 static int
 rops_periodic_checks_ws(struct lws_context *context, int tsi, time_t now)
 {
-	struct lws_vhost *vh;
+	struct lws_context_per_thread *pt = &context->pt[tsi];
+	struct lws_dll_lws expired = { NULL, NULL };
+	struct lws *wsi;
+	time_t mono;
+
+	lws_ext_1hz_service(pt, now);
 
-	if (!context->ws_ping_pong_interval ||
-	    context->last_ws_ping_pong_check_s >= now + 10)
+	if (!context->ws_ping_pong_interval)
 		return 0;
 
-	vh = context->vhost_list;
-	context->last_ws_ping_pong_check_s = now;
-
-	while (vh) {
-		int n;
-
-		lws_vhost_lock(vh);
-
-		for (n = 0; n < vh->count_protocols; n++) {
-			struct lws *wsi = vh->same_vh_protocol_list[n];
-
-			while (wsi) {
-				if (lwsi_role_ws(wsi) &&
-				    !wsi->socket_is_permanently_unusable &&
-				    !wsi->ws->send_check_ping &&
-				    wsi->ws->time_next_ping_check &&
-				    lws_compare_time_t(context, now,
-					wsi->ws->time_next_ping_check) >
-				       context->ws_ping_pong_interval) {
-
-					lwsl_info("req pp on wsi %p\n",
-						  wsi);
-					wsi->ws->send_check_ping = 1;
-					lws_set_timeout(wsi,
-					PENDING_TIMEOUT_WS_PONG_CHECK_SEND_PING,
-						context->timeout_secs);
-					lws_callback_on_writable(wsi);
-					wsi->ws->time_next_ping_check =
-						now;
-				}
-				wsi = wsi->same_vh_protocol_next;
-			}
+	mono = (time_t)(lws_plat_monotonic_us() / 1000000);
+
+	lws_pt_lock(pt, __func__);
+
+	lws_tw_advance(&pt->tw_ws_ping, (uint64_t)mono, &expired);
+	while (expired.next) {
+		wsi = lws_container_of(expired.next, struct lws,
+				       tw_ws_ping.list);
+		lws_dll_lws_remove(expired.next);
+
+		if (!lwsi_role_ws(wsi) || wsi->socket_is_permanently_unusable)
+			continue;
+
+		if (!wsi->ws->send_check_ping &&
+		    mono - wsi->ws->time_next_ping_check >
+					context->ws_ping_pong_interval) {
+
+			lwsl_info("req pp on wsi %p\n", wsi);
+			wsi->ws->send_check_ping = 1;
+			lws_set_timeout(wsi,
+				PENDING_TIMEOUT_WS_PONG_CHECK_SEND_PING,
+				context->timeout_secs);
+			lws_callback_on_writable(wsi);
+			wsi->ws->time_next_ping_check = mono;
 		}
 
-		lws_vhost_unlock(vh);
-		vh = vh->vhost_next;
+		/* go again from the last traffic, or the PING we asked for */
+		__lws_ws_ping_schedule(wsi);
 	}
 
+	lws_pt_unlock(pt);
+
 	return 0;
 }
 
@@ -1522,9 +1541,8 @@ rops_close_role_ws(struct lws_context_per_thread *pt, struct lws *wsi)
 	}
 	lws_free_set_NULL(wsi->ws->rx_ubuf);
 
-	if (wsi->trunc_alloc)
-		/* not going to be completed... nuke it */
-		lws_free_set_NULL(wsi->trunc_alloc);
+	/* not going to be completed... nuke it */
+	lws_drop_buffered_out(wsi);
 
 	wsi->ws->ping_payload_len = 0;
 	wsi->ws->ping_pending_flag = 0;
@@ -1532,6 +1550,84 @@ rops_close_role_ws(struct lws_context_per_thread *pt, struct lws *wsi)
 	return 0;
 }
 
+/*
+ * write the ws frame header for a len-byte payload so it ends at end, returns
+ * its length or -1 if wp isn't something we can frame
+ */
+static int
+lws_ws_frame_header(unsigned char *end, enum lws_write_protocol wp, size_t len,
+		    unsigned char is_masked_bit)
+{
+	int n, pre;
+
+	switch (wp & 0xf) {
+	case LWS_WRITE_TEXT:
+		n = LWSWSOPC_TEXT_FRAME;
+		break;
+	case LWS_WRITE_BINARY:
+		n = LWSWSOPC_BINARY_FRAME;
+		break;
+	case LWS_WRITE_CONTINUATION:
+		n = LWSWSOPC_CONTINUATION;
+		break;
+
+	case LWS_WRITE_CLOSE:
+		n = LWSWSOPC_CLOSE;
+		break;
+	case LWS_WRITE_PING:
+		n = LWSWSOPC_PING;
+		break;
+	case LWS_WRITE_PONG:
+		n = LWSWSOPC_PONG;
+		break;
+	default:
+		lwsl_warn("lws_write: unknown write opc / wp\n");
+		return -1;
+	}
+
+	if (!(wp & LWS_WRITE_NO_FIN))
+		n |= 1 << 7;
+
+	if (len < 126) {
+		pre = 2;
+		end[-pre] = n;
+		end[-pre + 1] = (unsigned char)(len | is_masked_bit);
+
+		return pre;
+	}
+
+	if (len < 65536) {
+		pre = 4;
+		end[-pre] = n;
+		end[-pre + 1] = 126 | is_masked_bit;
+		end[-pre + 2] = (unsigned char)(len >> 8);
+		end[-pre + 3] = (unsigned char)len;
+
+		return pre;
+	}
+
+	pre = 10;
+	end[-pre] = n;
+	end[-pre + 1] = 127 | is_masked_bit;
+#if defined __LP64__
+	end[-pre + 2] = (len >> 56) & 0x7f;
+	end[-pre + 3] = len >> 48;
+	end[-pre + 4] = len >> 40;
+	end[-pre + 5] = len >> 32;
+#else
+	end[-pre + 2] = 0;
+	end[-pre + 3] = 0;
+	end[-pre + 4] = 0;
+	end[-pre + 5] = 0;
+#endif
+	end[-pre + 6] = (unsigned char)(len >> 24);
+	end[-pre + 7] = (unsigned char)(len >> 16);
+	end[-pre + 8] = (unsigned char)(len >> 8);
+	end[-pre + 9] = (unsigned char)len;
+
+	return pre;
+}
+
 static int
 rops_write_role_protocol_ws(struct lws *wsi, unsigned char *buf, size_t len,
 			    enum lws_write_protocol *wp)
@@ -1680,66 +1776,10 @@ rops_write_role_protocol_ws(struct lws *wsi, unsigned char *buf, size_t len,
 			is_masked_bit = 0x80;
 		}
 
-		switch ((*wp) & 0xf) {
-		case LWS_WRITE_TEXT:
-			n = LWSWSOPC_TEXT_FRAME;
-			break;
-		case LWS_WRITE_BINARY:
-			n = LWSWSOPC_BINARY_FRAME;
-			break;
-		case LWS_WRITE_CONTINUATION:
-			n = LWSWSOPC_CONTINUATION;
-			break;
-
-		case LWS_WRITE_CLOSE:
-			n = LWSWSOPC_CLOSE;
-			break;
-		case LWS_WRITE_PING:
-			n = LWSWSOPC_PING;
-			break;
-		case LWS_WRITE_PONG:
-			n = LWSWSOPC_PONG;
-			break;
-		default:
-			lwsl_warn("lws_write: unknown write opc / wp\n");
+		n = lws_ws_frame_header(&buf[-pre], *wp, len, is_masked_bit);
+		if (n < 0)
 			return -1;
-		}
-
-		if (!((*wp) & LWS_WRITE_NO_FIN))
-			n |= 1 << 7;
-
-		if (len < 126) {
-			pre += 2;
-			buf[-pre] = n;
-			buf[-pre + 1] = (unsigned char)(len | is_masked_bit);
-		} else {
-			if (len < 65536) {
-				pre += 4;
-				buf[-pre] = n;
-				buf[-pre + 1] = 126 | is_masked_bit;
-				buf[-pre + 2] = (unsigned char)(len >> 8);
-				buf[-pre + 3] = (unsigned char)len;
-			} else {
-				pre += 10;
-				buf[-pre] = n;
-				buf[-pre + 1] = 127 | is_masked_bit;
-#if defined __LP64__
-					buf[-pre + 2] = (len >> 56) & 0x7f;
-					buf[-pre + 3] = len >> 48;
-					buf[-pre + 4] = len >> 40;
-					buf[-pre + 5] = len >> 32;
-#else
-					buf[-pre + 2] = 0;
-					buf[-pre + 3] = 0;
-					buf[-pre + 4] = 0;
-					buf[-pre + 5] = 0;
-#endif
-				buf[-pre + 6] = (unsigned char)(len >> 24);
-				buf[-pre + 7] = (unsigned char)(len >> 16);
-				buf[-pre + 8] = (unsigned char)(len >> 8);
-				buf[-pre + 9] = (unsigned char)len;
-			}
-		}
+		pre += n;
 		break;
 	}
 
@@ -1761,9 +1801,10 @@ do_more_inside_frame:
 		 * in v7, just mask the payload
 		 */
 		if (dropmask) { /* never set if already inside frame */
-			for (n = 4; n < (int)len + 4; n++)
-				dropmask[n] = dropmask[n] ^ wsi->ws->mask[
-					(wsi->ws->mask_idx++) & 3];
+			wsi->ws->mask_idx = lws_ws_mask_payload(dropmask + 4,
+						dropmask + 4, len,
+						wsi->ws->mask,
+						wsi->ws->mask_idx);
 
 			/* copy the frame nonce into place */
 			memcpy(dropmask, wsi->ws->mask, 4);
@@ -1837,6 +1878,40 @@ send_raw:
 	return lws_issue_raw(wsi, (unsigned char *)buf - pre, len + pre);
 }
 
+static int
+rops_write_role_protocol_iov_ws(struct lws *wsi, unsigned char *hdr,
+				size_t len, enum lws_write_protocol *wp)
+{
+	/*
+	 * client masking and extensions change the payload, and ws-over-h2
+	 * needs h2 framing as well, so those need it all in one buffer
+	 */
+	if (lwsi_role_client(wsi) || lwsi_role_h2_ENCAPSULATION(wsi) ||
+	    wsi->ws->inside_frame || wsi->ws->tx_draining_ext ||
+	    wsi->ws->stashed_write_pending ||
+	    wsi->ws->ietf_spec_revision != 13)
+		return -1;
+
+	switch ((*wp) & 0x1f) {
+	case LWS_WRITE_HTTP:
+	case LWS_WRITE_HTTP_FINAL:
+	case LWS_WRITE_HTTP_HEADERS:
+	case LWS_WRITE_HTTP_HEADERS_CONTINUATION:
+		lws_restart_ws_ping_pong_timer(wsi);
+		return 0;
+	case LWS_WRITE_TEXT:
+	case LWS_WRITE_BINARY:
+	case LWS_WRITE_CONTINUATION:
+		break;
+	default:
+		return -1;
+	}
+
+	lws_restart_ws_ping_pong_timer(wsi);
+
+	return lws_ws_frame_header(hdr + LWS_PRE, *wp, len, 0);
+}
+
 struct lws_role_ops role_ops_ws = {
 	"ws",
 	rops_handle_POLLIN_ws,
@@ -1846,5 +1921,6 @@ struct lws_role_ops role_ops_ws = {
 	rops_close_via_role_protocol_ws,
 	rops_close_role_ws,
 	rops_write_role_protocol_ws,
-	NULL
+	NULL,
+	rops_write_role_protocol_iov_ws
 };
@@ -78,7 +78,9 @@ lws_extension_server_handshake(struct lws *wsi, char **p, int budget)
 		if (*c && (*c != ',' && *c != '\t')) {
 			if (*c == ';') {
 				ignore = 1;
-				args = c + 1;
+				/* the options start after the first ; */
+				if (!args)
+					args = c + 1;
 			}
 			if (ignore || *c == ' ') {
 				c++;
@@ -211,6 +213,8 @@ lws_extension_server_handshake(struct lws *wsi, char **p, int budget)
 				}
 				while (*args && *args != ',' && *args != ';')
 					args++;
+				if (*args == ';')
+					args++;
 			}
 
 			wsi->count_act_ext++;
@@ -223,6 +227,8 @@ lws_extension_server_handshake(struct lws *wsi, char **p, int budget)
 		args = NULL;
 	}
 
+	lws_ext_1hz_track(wsi);
+
 	return 0;
 }
 #endif
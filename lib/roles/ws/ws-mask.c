@@ -0,0 +1,183 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010-2018 Andy Green <andy@warmcat.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation:
+ *  version 2.1 of the License.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA  02110-1301  USA
+ *
+ * ws payload masking / unmasking, shared by the rx parsers and tx framing.
+ *
+ * The mask is applied a word or vector at a time, with a runtime choice of
+ * AVX2 on x86 cpus that have it.  SSE2 (x86_64) and NEON (aarch64, or arm
+ * built with neon) are used unconditionally when the compiler targets them.
+ */
+
+#include <private-libwebsockets.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    !defined(LWS_MASK_NO_AVX2)
+#define LWS_MASK_HAVE_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+typedef void (*lws_mask_fn_t)(uint8_t *dst, const uint8_t *src, size_t len,
+			      const uint8_t *m);
+
+/*
+ * m[] is the 4-byte mask already rotated to start at the right phase, so
+ * every kernel starts at phase 0 and processes a multiple of 4 per step.
+ */
+
+static void
+lws_mask_generic(uint8_t *dst, const uint8_t *src, size_t len,
+		 const uint8_t *m)
+{
+	uint8_t m8[8];
+	uint64_t w, mw;
+	size_t n = 0;
+
+	memcpy(m8, m, 4);
+	memcpy(m8 + 4, m, 4);
+	memcpy(&mw, m8, 8);
+
+	for (; n + 8 <= len; n += 8) {
+		memcpy(&w, src + n, 8);
+		w ^= mw;
+		memcpy(dst + n, &w, 8);
+	}
+
+	for (; n < len; n++)
+		dst[n] = src[n] ^ m[n & 3];
+}
+
+#if defined(__SSE2__)
+static void
+lws_mask_sse2(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t *m)
+{
+	__m128i v, mv;
+	size_t n = 0;
+	int32_t m32;
+
+	memcpy(&m32, m, 4);
+	mv = _mm_set1_epi32(m32);
+
+	for (; n + 16 <= len; n += 16) {
+		v = _mm_loadu_si128((const __m128i *)(src + n));
+		_mm_storeu_si128((__m128i *)(dst + n), _mm_xor_si128(v, mv));
+	}
+
+	lws_mask_generic(dst + n, src + n, len - n, m);
+}
+#endif
+
+#if defined(LWS_MASK_HAVE_AVX2)
+__attribute__((target("avx2"))) static void
+lws_mask_avx2(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t *m)
+{
+	__m256i v, mv;
+	size_t n = 0;
+	int32_t m32;
+
+	memcpy(&m32, m, 4);
+	mv = _mm256_set1_epi32(m32);
+
+	for (; n + 64 <= len; n += 64) {
+		v = _mm256_loadu_si256((const __m256i *)(src + n));
+		_mm256_storeu_si256((__m256i *)(dst + n),
+				    _mm256_xor_si256(v, mv));
+		v = _mm256_loadu_si256((const __m256i *)(src + n + 32));
+		_mm256_storeu_si256((__m256i *)(dst + n + 32),
+				    _mm256_xor_si256(v, mv));
+	}
+	for (; n + 32 <= len; n += 32) {
+		v = _mm256_loadu_si256((const __m256i *)(src + n));
+		_mm256_storeu_si256((__m256i *)(dst + n),
+				    _mm256_xor_si256(v, mv));
+	}
+
+	lws_mask_generic(dst + n, src + n, len - n, m);
+}
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+static void
+lws_mask_neon(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t *m)
+{
+	uint8x16_t mv;
+	size_t n = 0;
+	uint32_t m32;
+
+	memcpy(&m32, m, 4);
+	mv = vreinterpretq_u8_u32(vdupq_n_u32(m32));
+
+	for (; n + 16 <= len; n += 16)
+		vst1q_u8(dst + n, veorq_u8(vld1q_u8(src + n), mv));
+
+	lws_mask_generic(dst + n, src + n, len - n, m);
+}
+#endif
+
+/*
+ * What the compiler targets is always safe to use.  lws_ws_mask_init()
+ * swaps in something better for this cpu, if there is one, when the first
+ * context is created, before it has any service threads using this.
+ */
+static lws_mask_fn_t lws_mask_fn =
+#if defined(__SSE2__)
+	lws_mask_sse2;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	lws_mask_neon;
+#else
+	lws_mask_generic;
+#endif
+
+void
+lws_ws_mask_init(void)
+{
+#if defined(LWS_MASK_HAVE_AVX2)
+	if (lws_mask_fn == lws_mask_avx2)
+		return;
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		lws_mask_fn = lws_mask_avx2;
+#endif
+}
+
+LWS_VISIBLE int
+lws_ws_mask_payload(uint8_t *dst, const uint8_t *src, size_t len,
+		    const uint8_t *mask, int mask_idx)
+{
+	uint8_t m[4];
+	int n;
+
+	for (n = 0; n < 4; n++)
+		m[n] = mask[(mask_idx + n) & 3];
+
+	/* short runs aren't worth the indirect call */
+	if (len < 16)
+		lws_mask_generic(dst, src, len, m);
+	else
+		lws_mask_fn(dst, src, len, m);
+
+	return (int)((mask_idx + len) & 3);
+}
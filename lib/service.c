@@ -98,15 +98,25 @@ lws_handle_POLLOUT_event(struct lws *wsi, struct lws_pollfd *pollfd)
 	 *	       corrupted.
 	 */
 
-	if (wsi->trunc_len) {
+	if (lws_has_buffered_out(wsi)) {
 		//lwsl_notice("%s: completing partial\n", __func__);
-		if (lws_issue_raw(wsi, wsi->trunc_alloc + wsi->trunc_offset,
-				  wsi->trunc_len) < 0) {
+		if (lws_flush_buffered_out(wsi) < 0) {
 			lwsl_info("%s signalling to close\n", __func__);
 			goto bail_die;
 		}
-		/* leave POLLOUT active either way */
-		goto bail_ok;
+		/*
+		 * With a buffered_out_limit, if it all went or there's still
+		 * room to queue more behind what's left, carry on to the other
+		 * things that want to write, they don't need to wait for
+		 * another POLLOUT.  Otherwise, and always without a limit,
+		 * leave POLLOUT active and wait for it.
+		 */
+		if (!wsi->context->buffered_out_limit ||
+		    (lws_has_buffered_out(wsi) &&
+		     wsi->buflist_out_len >= wsi->context->buffered_out_limit))
+			goto bail_ok;
+
+		wsi->could_have_pending = 0;
 	} else
 		if (lwsi_state(wsi) == LRS_FLUSHING_BEFORE_CLOSE) {
 			wsi->socket_is_permanently_unusable = 1;
@@ -232,70 +242,56 @@ bail_die:
 	return -1;
 }
 
-static int
-__lws_service_timeout_check(struct lws *wsi, time_t sec)
+/*
+ * wsi has come off the pt timeout wheel, ie, it went beyond the allowed
+ * time: kill the connection
+ */
+
+static void
+__lws_service_timeout_expired(struct lws *wsi)
 {
 	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
 	int n = 0;
 
 	(void)n;
 
-	/*
-	 * if extensions want in on it (eg, we are a mux parent)
-	 * give them a chance to service child timeouts
-	 */
-	if (lws_ext_cb_active(wsi, LWS_EXT_CB_1HZ, NULL, sec) < 0)
-		return 0;
-
-	/*
-	 * if we went beyond the allowed time, kill the
-	 * connection
-	 */
-	if (wsi->dll_timeout.prev &&
-	    lws_compare_time_t(wsi->context, sec, wsi->pending_timeout_set) >
-			       wsi->pending_timeout_limit) {
-
-		if (wsi->desc.sockfd != LWS_SOCK_INVALID &&
-		    wsi->position_in_fds_table >= 0)
-			n = pt->fds[wsi->position_in_fds_table].events;
-
-		lws_stats_atomic_bump(wsi->context, pt, LWSSTATS_C_TIMEOUTS, 1);
-
-		/* no need to log normal idle keepalive timeout */
-		if (wsi->pending_timeout != PENDING_TIMEOUT_HTTP_KEEPALIVE_IDLE)
-			lwsl_info("wsi %p: TIMEDOUT WAITING on %d "
-				  "(did hdr %d, ah %p, wl %d, pfd "
-				  "events %d) %llu vs %llu\n",
-				  (void *)wsi, wsi->pending_timeout,
-				  wsi->hdr_parsing_completed, wsi->ah,
-				  pt->ah_wait_list_length, n,
-				  (unsigned long long)sec,
-				  (unsigned long long)wsi->pending_timeout_limit);
+	if (wsi->desc.sockfd != LWS_SOCK_INVALID &&
+	    wsi->position_in_fds_table >= 0)
+		n = pt->fds[wsi->position_in_fds_table].events;
+
+	lws_stats_atomic_bump(wsi->context, pt, LWSSTATS_C_TIMEOUTS, 1);
+
+	/* no need to log normal idle keepalive timeout */
+	if (wsi->pending_timeout != PENDING_TIMEOUT_HTTP_KEEPALIVE_IDLE)
+		lwsl_info("wsi %p: TIMEDOUT WAITING on %d "
+			  "(did hdr %d, ah %p, wl %d, pfd "
+			  "events %d) %llu vs %llu\n",
+			  (void *)wsi, wsi->pending_timeout,
+			  wsi->hdr_parsing_completed, wsi->ah,
+			  pt->ah_wait_list_length, n,
+			  (unsigned long long)
+					(lws_plat_monotonic_us() / 1000000),
+			  (unsigned long long)wsi->pending_timeout_limit);
 #if defined(LWS_WITH_CGI)
-		if (wsi->cgi)
-			lwsl_notice("CGI timeout: %s\n", wsi->cgi->summary);
+	if (wsi->cgi)
+		lwsl_notice("CGI timeout: %s\n", wsi->cgi->summary);
 #endif
 
-		/*
-		 * Since he failed a timeout, he already had a chance to do
-		 * something and was unable to... that includes situations like
-		 * half closed connections.  So process this "failed timeout"
-		 * close as a violent death and don't try to do protocol
-		 * cleanup like flush partials.
-		 */
-		wsi->socket_is_permanently_unusable = 1;
-		if (lwsi_state(wsi) == LRS_WAITING_SSL && wsi->protocol)
-			wsi->protocol->callback(wsi,
-				LWS_CALLBACK_CLIENT_CONNECTION_ERROR,
-				wsi->user_space,
-				(void *)"Timed out waiting SSL", 21);
-
-		__lws_close_free_wsi(wsi, LWS_CLOSE_STATUS_NOSTATUS, "timeout");
-
-		return 1;
-	}
-
-	return 0;
+	/*
+	 * Since he failed a timeout, he already had a chance to do
+	 * something and was unable to... that includes situations like
+	 * half closed connections.  So process this "failed timeout"
+	 * close as a violent death and don't try to do protocol
+	 * cleanup like flush partials.
+	 */
+	wsi->socket_is_permanently_unusable = 1;
+	if (lwsi_state(wsi) == LRS_WAITING_SSL && wsi->protocol)
+		wsi->protocol->callback(wsi,
+			LWS_CALLBACK_CLIENT_CONNECTION_ERROR,
+			wsi->user_space,
+			(void *)"Timed out waiting SSL", 21);
+
+	__lws_close_free_wsi(wsi, LWS_CLOSE_STATUS_NOSTATUS, "timeout");
 }
 
 int lws_rxflow_cache(struct lws *wsi, unsigned char *buf, int n, int len)
@@ -501,10 +497,11 @@ lws_service_periodic_checks(struct lws_context *context,
 			    struct lws_pollfd *pollfd, int tsi)
 {
 	struct lws_context_per_thread *pt = &context->pt[tsi];
+	struct lws_dll_lws expired = { NULL, NULL };
 	lws_sockfd_type our_fd = 0, tmp_fd;
 	struct allocated_headers *ah;
 	struct lws *wsi;
-	int timed_out = 0;
+	int timed_out = 0, ctx_due;
 	time_t now;
 #if defined(LWS_WITH_TLS)
 	int n = 0;
@@ -548,58 +545,71 @@ lws_service_periodic_checks(struct lws_context *context,
 		context->last_timeout_check_s = now - 1;
 	}
 
-	if (!lws_compare_time_t(context, context->last_timeout_check_s, now))
+	/*
+	 * Each pt checks its own timers once a second, and whichever pt gets
+	 * here first in the second does the context-wide checks as well
+	 */
+
+	if (pt->last_timeout_check_s == now)
 		return 0;
 
-	context->last_timeout_check_s = now;
+	pt->last_timeout_check_s = now;
+
+	ctx_due = !!lws_compare_time_t(context, context->last_timeout_check_s,
+				       now);
+	if (ctx_due) {
+		context->last_timeout_check_s = now;
 
 #if defined(LWS_WITH_STATS)
-	if (!tsi && now - context->last_dump > 10) {
-		lws_stats_log_dump(context);
-		context->last_dump = now;
-	}
+		if (!tsi && now - context->last_dump > 10) {
+			lws_stats_log_dump(context);
+			context->last_dump = now;
+		}
 #endif
 
-	lws_plat_service_periodic(context);
-	lws_check_deferred_free(context, 0);
+		lws_plat_service_periodic(context);
+		lws_check_deferred_free(context, 0);
 
 #if defined(LWS_WITH_PEER_LIMITS)
-	lws_peer_cull_peer_wait_list(context);
+		lws_peer_cull_peer_wait_list(context);
 #endif
 
-	/* retire unused deprecated context */
+		/* retire unused deprecated context */
 #if !defined(LWS_PLAT_OPTEE) && !defined(LWS_WITH_ESP32)
 #if LWS_POSIX && !defined(_WIN32)
-	if (context->deprecated && !context->count_wsi_allocated) {
-		lwsl_notice("%s: ending deprecated context\n", __func__);
-		kill(getpid(), SIGINT);
-		return 0;
-	}
+		if (context->deprecated && !context->count_wsi_allocated) {
+			lwsl_notice("%s: ending deprecated context\n",
+				    __func__);
+			kill(getpid(), SIGINT);
+			return 0;
+		}
 #endif
 #endif
-	/* global timeout check once per second */
+	}
 
 	if (pollfd)
 		our_fd = pollfd->fd;
 
 	/*
-	 * Phase 1: check every wsi on the timeout check list
+	 * Phase 1: close every wsi whose timeout has come up on the wheel
 	 */
 
 	lws_pt_lock(pt, __func__);
 
-	lws_start_foreach_dll_safe(struct lws_dll_lws *, d, d1,
-				   context->pt[tsi].dll_head_timeout.next) {
-		wsi = lws_container_of(d, struct lws, dll_timeout);
+	lws_tw_advance(&pt->tw_timeout, lws_plat_monotonic_us() / 1000000,
+		       &expired);
+	while (expired.next) {
+		wsi = lws_container_of(expired.next, struct lws,
+				       tw_timeout.list);
+		lws_dll_lws_remove(expired.next);
+
 		tmp_fd = wsi->desc.sockfd;
-		if (__lws_service_timeout_check(wsi, now)) {
-			/* he did time out... */
-			if (tmp_fd == our_fd)
-				/* it was the guy we came to service! */
-				timed_out = 1;
-			/* he's gone, no need to mark as handled */
-		}
-	} lws_end_foreach_dll_safe(d, d1);
+		__lws_service_timeout_expired(wsi);
+		if (tmp_fd == our_fd)
+			/* it was the guy we came to service! */
+			timed_out = 1;
+		/* he's gone, no need to mark as handled */
+	}
 
 	/*
 	 * Phase 2: double-check active ah timeouts independent of wsi
@@ -700,7 +710,22 @@ lws_service_periodic_checks(struct lws_context *context,
 	}
 #endif
 	/*
-	 * Phase 3: vhost / protocol timer callbacks
+	 * Phase 3: role periodic checks
+	 */
+#if defined(LWS_ROLE_WS)
+	role_ops_ws.periodic_checks(context, tsi, now);
+#endif
+#if defined(LWS_ROLE_CGI)
+	role_ops_cgi.periodic_checks(context, tsi, now);
+#endif
+
+	/* the rest is context-wide */
+
+	if (!ctx_due)
+		return timed_out;
+
+	/*
+	 * Phase 4: vhost / protocol timer callbacks
 	 */
 
 	wsi = NULL;
@@ -729,7 +754,7 @@ lws_service_periodic_checks(struct lws_context *context,
 		lws_free(wsi);
 
 	/*
-	 * Phase 4: check for unconfigured vhosts due to required
+	 * Phase 5: check for unconfigured vhosts due to required
 	 *	    interface missing before
 	 */
 
@@ -748,16 +773,6 @@ lws_service_periodic_checks(struct lws_context *context,
 	} lws_end_foreach_llp(pv, no_listener_vhost_list);
 	lws_context_unlock(context);
 
-	/*
-	 * Phase 5: role periodic checks
-	 */
-#if defined(LWS_ROLE_WS)
-	role_ops_ws.periodic_checks(context, tsi, now);
-#endif
-#if defined(LWS_ROLE_CGI)
-	role_ops_cgi.periodic_checks(context, tsi, now);
-#endif
-
 	/*
 	 * Phase 6: check the remaining cert lifetime daily
 	 */
@@ -768,6 +783,11 @@ lws_service_periodic_checks(struct lws_context *context,
 		context->last_cert_check_s = now;
 #endif
 
+	/*
+	 * Phase 7: give vhosts that are due one a new session ticket key
+	 */
+	lws_tls_ticket_keys_check(context, now);
+
 	return timed_out;
 }
 
@@ -793,6 +813,32 @@ lws_service_fd_tsi(struct lws_context *context, struct lws_pollfd *pollfd,
 	 * zero down pollfd->revents after handling
 	 */
 
+#if defined(LWS_WITH_ASYNC_DNS)
+	/*
+	 * On a dns query's udp socket, an error is just an icmp from the
+	 * server.  Its POLLIN handler's recv() clears it, and the query
+	 * retries later as usual.
+	 */
+	if (lwsi_role(wsi) == LWSI_ROLE_DNS)
+		pollfd->revents |= LWS_POLLIN;
+#endif
+
+#if defined(LWS_WITH_TLS_HANDSHAKE_POOL)
+	/*
+	 * The pool has it, so we aren't polling it for anything, but a hangup
+	 * still comes every time round.  If a worker has it, closing would
+	 * have to wait for the worker, so it leaves the fds until it's back.
+	 */
+	if (wsi->tls_hs_state && (pollfd->revents & LWS_POLLHUP)) {
+		wsi->socket_is_permanently_unusable = 1;
+		if (!lws_tls_hs_pool_hangup(wsi))
+			goto close_and_handled;
+
+		/* like a close, pollfd is somebody else's now */
+		return 1;
+	}
+#endif
+
 #if LWS_POSIX
 	/* handle session socket closed */
 
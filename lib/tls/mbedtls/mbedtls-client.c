@@ -103,6 +103,22 @@ lws_ssl_client_bio_create(struct lws *wsi)
 	return 0;
 }
 
+/*
+ * The mbedtls wrapper can't hand us a session to keep, so nothing is ever
+ * stored in the vhost's session cache and nothing is offered
+ */
+
+int
+lws_tls_session_set(struct lws *wsi, lws_tls_session *session)
+{
+	return 1;
+}
+
+void
+lws_tls_session_free(lws_tls_session *session)
+{
+}
+
 int ERR_get_error(void)
 {
 	return 0;
@@ -131,6 +147,8 @@ lws_tls_client_connect(struct lws *wsi)
 			 */
 			wsi->keepalive_active = 1;
 
+		lws_tls_session_handshake_done(wsi, 0);
+
 		return LWS_SSL_CAPABLE_DONE;
 	}
 
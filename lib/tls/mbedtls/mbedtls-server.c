@@ -253,6 +253,21 @@ lws_tls_server_vhost_backend_init(struct lws_context_creation_info *info,
 	return 0;
 }
 
+int
+lws_tls_server_ticket_keys_enable(struct lws_vhost *vh)
+{
+	/* the wrapper has no way to give mbedtls our ticket keys */
+	lwsl_err("%s: ticket keys are not supported with mbedtls\n", __func__);
+
+	return 1;
+}
+
+void
+lws_tls_server_session_cache_stats(struct lws_vhost *vh,
+				   struct lws_tls_server_session_stats *stats)
+{
+}
+
 int
 lws_tls_server_new_nonblocking(struct lws *wsi, lws_sockfd_type accept_fd)
 {
@@ -306,6 +321,10 @@ lws_tls_server_accept(struct lws *wsi)
 				    __func__, ir.ns.name);
 		else
 			lwsl_info("%s: couldn't get client cert CN\n", __func__);
+
+		/* the wrapper can't tell us if it resumed */
+		lws_tls_server_handshake_done(wsi, 0);
+
 		return LWS_SSL_CAPABLE_DONE;
 	}
 
@@ -101,7 +101,7 @@ lws_ssl_client_bio_create(struct lws *wsi)
 #if defined LWS_HAVE_X509_VERIFY_PARAM_set1_host
 	X509_VERIFY_PARAM *param;
 #endif
-	char hostname[128], *p;
+	char hostname[128], key[256], *p;
 #if defined(LWS_HAVE_SSL_set_alpn_protos) && defined(LWS_HAVE_SSL_get0_alpn_selected)
 	const unsigned char *plist = client_alpn_protocols;
 	int n = sizeof(client_alpn_protocols);
@@ -189,6 +189,11 @@ lws_ssl_client_bio_create(struct lws *wsi)
 #ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
 	SSL_set_tlsext_host_name(wsi->ssl, hostname);
 #endif
+
+	/* if we have a session for the same place, ask to resume it */
+	if (wsi->vhost->tls_session_cache_max &&
+	    !lws_tls_session_key(wsi, hostname, key, sizeof(key)))
+		lws_tls_session_offer(wsi, key);
 #endif
 
 #ifdef USE_WOLFSSL
@@ -262,6 +267,8 @@ lws_tls_client_connect(struct lws *wsi)
 
 		lwsl_info("client connect OK\n");
 #endif
+		lws_tls_session_handshake_done(wsi, SSL_session_reused(wsi->ssl));
+
 		return LWS_SSL_CAPABLE_DONE;
 	}
 
@@ -332,6 +339,36 @@ lws_tls_client_confirm_peer_cert(struct lws *wsi, char *ebuf, int ebuf_len)
 #endif
 }
 
+int
+lws_tls_session_set(struct lws *wsi, lws_tls_session *session)
+{
+	return !SSL_set_session(wsi->ssl, session);
+}
+
+void
+lws_tls_session_free(lws_tls_session *session)
+{
+	SSL_SESSION_free(session);
+}
+
+#if !defined(USE_WOLFSSL)
+static int
+lws_tls_session_new_cb(SSL *ssl, SSL_SESSION *session)
+{
+	struct lws *wsi = SSL_get_ex_data(ssl,
+					  openssl_websocket_private_data_index);
+	char key[256];
+
+	if (!wsi || lws_tls_session_key(wsi, SSL_get_servername(ssl,
+					TLSEXT_NAMETYPE_host_name),
+					key, sizeof(key)))
+		return 0;
+
+	/* 1 tells openssl we kept his reference */
+	return !lws_tls_session_store(wsi->vhost, key, session);
+}
+#endif
+
 int
 lws_tls_client_create_vhost_context(struct lws_vhost *vh,
 				    struct lws_context_creation_info *info,
@@ -382,6 +419,21 @@ lws_tls_client_create_vhost_context(struct lws_vhost *vh,
 	if (cipher_list)
 		SSL_CTX_set_cipher_list(vh->ssl_client_ctx, cipher_list);
 
+#if !defined(USE_WOLFSSL)
+	if (info->tls_session_cache_max) {
+		/*
+		 * The sessions are kept per vhost by lws, not in the ctx, and
+		 * we are told about each one as it arrives... with TLS 1.3 the
+		 * tickets come after the handshake completed
+		 */
+		SSL_CTX_set_session_cache_mode(vh->ssl_client_ctx,
+					       SSL_SESS_CACHE_CLIENT |
+					       SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_sess_set_new_cb(vh->ssl_client_ctx,
+					lws_tls_session_new_cb);
+	}
+#endif
+
 #ifdef LWS_SSL_CLIENT_USE_OS_CA_CERTS
 	if (!lws_check_opt(vh->options, LWS_SERVER_OPTION_DISABLE_OS_CA_CERTS))
 		/* loads OS default CA certs */
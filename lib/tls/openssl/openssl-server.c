@@ -20,6 +20,9 @@
  */
 
 #include "private-libwebsockets.h"
+#if defined(LWS_HAVE_SSL_CTX_set_tlsext_ticket_key_evp_cb)
+#include <openssl/core_names.h>
+#endif
 
 extern int openssl_websocket_private_data_index,
 	   openssl_SSL_CTX_private_data_index;
@@ -92,6 +95,12 @@ lws_ssl_server_name_cb(SSL *ssl, int *ad, void *arg)
 	if (!ssl)
 		return SSL_TLSEXT_ERR_NOACK;
 
+	/*
+	 * We may be on a handshake pool thread, so hold the vhost list still
+	 * until we are done with whatever vhost we find on it
+	 */
+	lws_vhost_list_lock(context);
+
 	/*
 	 * We can only get ssl accepted connections by using a vhost's ssl_ctx
 	 * find out which listening one took us and only match vhosts on the
@@ -106,12 +115,14 @@ lws_ssl_server_name_cb(SSL *ssl, int *ad, void *arg)
 	}
 
 	if (!vh) {
+		lws_vhost_list_unlock(context);
 		assert(vh); /* can't match the incoming vh? */
 		return SSL_TLSEXT_ERR_OK;
 	}
 
 	servername = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
 	if (!servername) {
+		lws_vhost_list_unlock(context);
 		/* the client doesn't know what hostname it wants */
 		lwsl_info("SNI: Unknown ServerName: %s\n", servername);
 
@@ -121,6 +132,7 @@ lws_ssl_server_name_cb(SSL *ssl, int *ad, void *arg)
 	vhost = lws_select_vhost(context, vh->listen_port, servername);
 	if (!vhost) {
 		lwsl_info("SNI: none: %s:%d\n", servername, vh->listen_port);
+		lws_vhost_list_unlock(context);
 
 		return SSL_TLSEXT_ERR_OK;
 	}
@@ -129,6 +141,7 @@ lws_ssl_server_name_cb(SSL *ssl, int *ad, void *arg)
 
 	/* select the ssl ctx from the selected vhost for this conn */
 	SSL_set_SSL_CTX(ssl, vhost->ssl_ctx);
+	lws_vhost_list_unlock(context);
 
 	return SSL_TLSEXT_ERR_OK;
 }
@@ -361,6 +374,10 @@ lws_tls_server_vhost_backend_init(struct lws_context_creation_info *info,
 	if (info->ssl_cipher_list)
 		SSL_CTX_set_cipher_list(vhost->ssl_ctx, info->ssl_cipher_list);
 
+	if (info->tls_server_session_cache_max)
+		SSL_CTX_sess_set_cache_size(vhost->ssl_ctx,
+					    info->tls_server_session_cache_max);
+
 #if !defined(OPENSSL_NO_TLSEXT)
 	SSL_CTX_set_tlsext_servername_callback(vhost->ssl_ctx,
 					       lws_ssl_server_name_cb);
@@ -394,6 +411,111 @@ lws_tls_server_vhost_backend_init(struct lws_context_creation_info *info,
 					 NULL, 0, NULL, 0);
 }
 
+#if defined(LWS_HAVE_SSL_CTX_set_tlsext_ticket_key_evp_cb) || \
+    (defined(SSL_CTX_set_tlsext_ticket_key_cb) && !defined(USE_WOLFSSL))
+#define LWS_TLS_TICKET_KEY_CB
+/*
+ * The session ctx, and so this, belongs to the vhost that accepted the
+ * connection, which is still wsi->vhost until the handshake completes.
+ */
+static int
+#if defined(LWS_HAVE_SSL_CTX_set_tlsext_ticket_key_evp_cb)
+lws_tls_ticket_key_cb(SSL *ssl, unsigned char *name, unsigned char *iv,
+		      EVP_CIPHER_CTX *cctx, EVP_MAC_CTX *hctx, int enc)
+#else
+lws_tls_ticket_key_cb(SSL *ssl, unsigned char *name, unsigned char *iv,
+		      EVP_CIPHER_CTX *cctx, HMAC_CTX *hctx, int enc)
+#endif
+{
+	struct lws *wsi = SSL_get_ex_data(ssl,
+					  openssl_websocket_private_data_index);
+	struct lws_tls_ticket_key key;
+	const EVP_CIPHER *cipher;
+#if defined(LWS_HAVE_SSL_CTX_set_tlsext_ticket_key_evp_cb)
+	OSSL_PARAM params[3];
+#endif
+	int n, m;
+
+	if (!wsi)
+		return -1;
+
+	n = lws_tls_ticket_key_find(wsi->vhost, enc ? NULL : name, &key);
+	if (!enc)
+		wsi->tls_ticket = n < 0 ? 4 : n + 1;
+	if (n < 0)
+		/* no key to issue with, or do a full handshake */
+		return 0;
+
+	cipher = key.len == 32 ? EVP_aes_256_cbc() : EVP_aes_128_cbc();
+
+	if (enc) {
+		memcpy(name, key.name, sizeof(key.name));
+		m = EVP_CIPHER_iv_length(cipher);
+		m = lws_get_random(wsi->context, iv, m) == m &&
+		    EVP_EncryptInit_ex(cctx, cipher, NULL, key.aes, iv) == 1;
+	} else
+		m = EVP_DecryptInit_ex(cctx, cipher, NULL, key.aes, iv) == 1;
+
+#if defined(LWS_HAVE_SSL_CTX_set_tlsext_ticket_key_evp_cb)
+	params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY,
+						      key.hmac, key.len);
+	params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+						     (char *)"SHA256", 0);
+	params[2] = OSSL_PARAM_construct_end();
+	m = m && EVP_MAC_CTX_set_params(hctx, params) == 1;
+#else
+	m = m && HMAC_Init_ex(hctx, key.hmac, key.len, EVP_sha256(), NULL) == 1;
+#endif
+	memset(&key, 0, sizeof(key));
+
+	if (!m)
+		return -1;
+
+	if (enc)
+		return 1;
+
+	/*
+	 * 2 accepts the ticket and issues a new one.  Tickets under the
+	 * previous key want replacing, and tls 1.3 clients use each ticket
+	 * once, so they need a new one after every resume.  Tickets under the
+	 * next key are newer than any we could give
+	 */
+#if defined(TLS1_3_VERSION)
+	if (SSL_version(ssl) == TLS1_3_VERSION)
+		return 2;
+#endif
+
+	return n == 1 ? 2 : 1;
+}
+#endif
+
+int
+lws_tls_server_ticket_keys_enable(struct lws_vhost *vh)
+{
+#if defined(LWS_HAVE_SSL_CTX_set_tlsext_ticket_key_evp_cb)
+	SSL_CTX_set_tlsext_ticket_key_evp_cb(vh->ssl_ctx,
+					     lws_tls_ticket_key_cb);
+#elif defined(LWS_TLS_TICKET_KEY_CB)
+	SSL_CTX_set_tlsext_ticket_key_cb(vh->ssl_ctx, lws_tls_ticket_key_cb);
+#else
+	lwsl_err("%s: tls library can't use our ticket keys\n", __func__);
+
+	return 1;
+#endif
+
+	return 0;
+}
+
+void
+lws_tls_server_session_cache_stats(struct lws_vhost *vh,
+				   struct lws_tls_server_session_stats *stats)
+{
+	stats->cache_misses = SSL_CTX_sess_misses(vh->ssl_ctx);
+	stats->cache_timeouts = SSL_CTX_sess_timeouts(vh->ssl_ctx);
+	stats->cache_full = SSL_CTX_sess_cache_full(vh->ssl_ctx);
+	stats->cached = SSL_CTX_sess_number(vh->ssl_ctx);
+}
+
 int
 lws_tls_server_new_nonblocking(struct lws *wsi, lws_sockfd_type accept_fd)
 {
@@ -452,12 +574,21 @@ lws_tls_server_abort_connection(struct lws *wsi)
 	return 0;
 }
 
+/*
+ * This may run on a handshake pool thread, so it only tells the caller what
+ * SSL_accept() wants next; lws_tls_server_accept_poll() acts on it.
+ */
+
 enum lws_ssl_capable_status
-lws_tls_server_accept(struct lws *wsi)
+lws_tls_server_accept_step(struct lws *wsi)
 {
 	union lws_tls_cert_info_results ir;
-	int m, n = SSL_accept(wsi->ssl);
+	int m, n;
 
+	/* the error queue is per-thread, and SSL_get_error() looks at it */
+	ERR_clear_error();
+
+	n = SSL_accept(wsi->ssl);
 	if (n == 1) {
 		n = lws_tls_peer_cert_info(wsi, LWS_TLS_CERT_INFO_COMMON_NAME, &ir,
 					   sizeof(ir.ns.name));
@@ -466,6 +597,9 @@ lws_tls_server_accept(struct lws *wsi)
 				    __func__, ir.ns.name);
 		else
 			lwsl_info("%s: couldn't get client cert CN\n", __func__);
+
+		lws_tls_server_handshake_done(wsi, SSL_session_reused(wsi->ssl));
+
 		return LWS_SSL_CAPABLE_DONE;
 	}
 
@@ -474,30 +608,21 @@ lws_tls_server_accept(struct lws *wsi)
 	if (m == SSL_ERROR_SYSCALL || m == SSL_ERROR_SSL)
 		return LWS_SSL_CAPABLE_ERROR;
 
-	if (m == SSL_ERROR_WANT_READ || SSL_want_read(wsi->ssl)) {
-		if (lws_change_pollfd(wsi, 0, LWS_POLLIN)) {
-			lwsl_info("%s: WANT_READ change_pollfd failed\n",
-				  __func__);
-			return LWS_SSL_CAPABLE_ERROR;
-		}
-
-		lwsl_info("SSL_ERROR_WANT_READ\n");
+	if (m == SSL_ERROR_WANT_READ || SSL_want_read(wsi->ssl))
 		return LWS_SSL_CAPABLE_MORE_SERVICE_READ;
-	}
-	if (m == SSL_ERROR_WANT_WRITE || SSL_want_write(wsi->ssl)) {
-		lwsl_debug("%s: WANT_WRITE\n", __func__);
 
-		if (lws_change_pollfd(wsi, 0, LWS_POLLOUT)) {
-			lwsl_info("%s: WANT_WRITE change_pollfd failed\n",
-				  __func__);
-			return LWS_SSL_CAPABLE_ERROR;
-		}
+	if (m == SSL_ERROR_WANT_WRITE || SSL_want_write(wsi->ssl))
 		return LWS_SSL_CAPABLE_MORE_SERVICE_WRITE;
-	}
 
 	return LWS_SSL_CAPABLE_ERROR;
 }
 
+enum lws_ssl_capable_status
+lws_tls_server_accept(struct lws *wsi)
+{
+	return lws_tls_server_accept_poll(wsi, lws_tls_server_accept_step(wsi));
+}
+
 #if defined(LWS_WITH_ACME)
 static int
 lws_tls_openssl_rsa_new_key(RSA **rsa, int bits)
@@ -148,3 +148,208 @@ int lws_context_init_client_ssl(struct lws_context_creation_info *info,
 
 	return 0;
 }
+
+/*
+ * The vhost can remember the sessions (or TLS 1.3 tickets) servers gave its
+ * client connections, and offer them when it connects to the same place
+ * again, so the server can skip the full handshake.  The tls backend hands
+ * us the sessions, we just keep them in a small lru list.
+ */
+
+struct lws_tls_session_entry {
+	struct lws_dll_lws list; /* vh->tls_sessions, most recently used first */
+	lws_tls_session *session;
+	time_t expires;
+	char key[1]; /* overallocated */
+};
+
+static void
+__lws_tls_session_destroy(struct lws_vhost *vh,
+			  struct lws_tls_session_entry *e)
+{
+	lws_dll_lws_remove(&e->list);
+	vh->tls_session_stats.count--;
+	lws_tls_session_free(e->session);
+	lws_free(e);
+}
+
+static struct lws_tls_session_entry *
+__lws_tls_session_lookup(struct lws_vhost *vh, const char *key)
+{
+	time_t now = lws_now_secs();
+
+	lws_start_foreach_dll_safe(struct lws_dll_lws *, d, d1,
+				   vh->tls_sessions.next) {
+		struct lws_tls_session_entry *e = lws_container_of(d,
+					struct lws_tls_session_entry, list);
+
+		if (!strcmp(e->key, key)) {
+			if (e->expires > now)
+				return e;
+
+			vh->tls_session_stats.expired++;
+			__lws_tls_session_destroy(vh, e);
+
+			return NULL;
+		}
+	} lws_end_foreach_dll_safe(d, d1);
+
+	return NULL;
+}
+
+/*
+ * The same server name may resolve differently, and the same address may
+ * serve several names, so the session belongs to all three.
+ *
+ * A resumed session skips checking the server's certificate, so it must also
+ * belong to the checks the connection that got it asked for.  Otherwise a
+ * connection that does check the certificate could resume a session from one
+ * that allowed a selfsigned, expired or misnamed one.
+ */
+
+#define LWS_TLS_SESSION_RELAXED (LCCSCF_ALLOW_SELFSIGNED | \
+				 LCCSCF_SKIP_SERVER_CERT_HOSTNAME_CHECK | \
+				 LCCSCF_ALLOW_EXPIRED)
+
+int
+lws_tls_session_key(struct lws *wsi, const char *sni, char *key, int len)
+{
+	const char *address = wsi->client_hostname_copy;
+
+	if (!address)
+		address = lws_hdr_simple_ptr(wsi, _WSI_TOKEN_CLIENT_PEER_ADDRESS);
+	if (!address || !sni)
+		return 1;
+
+	return lws_snprintf(key, len, "%s:%u:%s:%x", address, wsi->c_port, sni,
+			    wsi->use_ssl & LWS_TLS_SESSION_RELAXED) >= len - 1;
+}
+
+int
+lws_tls_session_offer(struct lws *wsi, const char *key)
+{
+	struct lws_vhost *vh = wsi->vhost;
+	struct lws_tls_session_entry *e;
+	int n = 1;
+
+	if (!vh->tls_session_cache_max)
+		return 1;
+
+	lws_vhost_lock(vh);
+
+	e = __lws_tls_session_lookup(vh, key);
+	if (e) {
+		/* move it to the front */
+		lws_dll_lws_remove(&e->list);
+		lws_dll_lws_add_front(&e->list, &vh->tls_sessions);
+
+		n = lws_tls_session_set(wsi, e->session);
+		if (!n)
+			vh->tls_session_stats.offered++;
+	}
+
+	lws_vhost_unlock(vh);
+
+	if (!n)
+		lwsl_info("%s: %p: offering session for %s\n", __func__, wsi,
+			  key);
+
+	return n;
+}
+
+/*
+ * returns 0 if the cache took the session, otherwise the caller still owns it
+ */
+
+int
+lws_tls_session_store(struct lws_vhost *vh, const char *key,
+		      lws_tls_session *session)
+{
+	struct lws_tls_session_entry *e, *last = NULL;
+	int n = (int)strlen(key);
+
+	if (!vh->tls_session_cache_max)
+		return 1;
+
+	lws_vhost_lock(vh);
+
+	/* a newer ticket replaces any older one */
+	e = __lws_tls_session_lookup(vh, key);
+	if (e) {
+		lws_tls_session_free(e->session);
+		lws_dll_lws_remove(&e->list);
+		goto fill;
+	}
+
+	if (vh->tls_session_stats.count >= vh->tls_session_cache_max) {
+		lws_start_foreach_dll_safe(struct lws_dll_lws *, d, d1,
+					   vh->tls_sessions.next) {
+			last = lws_container_of(d,
+					struct lws_tls_session_entry, list);
+		} lws_end_foreach_dll_safe(d, d1);
+
+		if (last) {
+			vh->tls_session_stats.evicted++;
+			__lws_tls_session_destroy(vh, last);
+		}
+	}
+
+	e = lws_malloc(sizeof(*e) + n, "tls session");
+	if (!e) {
+		lws_vhost_unlock(vh);
+
+		return 1;
+	}
+	memset(&e->list, 0, sizeof(e->list));
+	memcpy(e->key, key, n + 1);
+	vh->tls_session_stats.count++;
+
+fill:
+	e->session = session;
+	e->expires = lws_now_secs() + vh->tls_session_timeout;
+	lws_dll_lws_add_front(&e->list, &vh->tls_sessions);
+	vh->tls_session_stats.stored++;
+
+	lws_vhost_unlock(vh);
+
+	return 0;
+}
+
+void
+lws_tls_session_handshake_done(struct lws *wsi, int resumed)
+{
+	struct lws_vhost *vh = wsi->vhost;
+
+	if (!vh->tls_session_cache_max)
+		return;
+
+	lws_vhost_lock(vh);
+	vh->tls_session_stats.handshakes++;
+	if (resumed)
+		vh->tls_session_stats.resumed++;
+	lws_vhost_unlock(vh);
+}
+
+void
+lws_tls_session_cache_destroy(struct lws_vhost *vh)
+{
+	lws_start_foreach_dll_safe(struct lws_dll_lws *, d, d1,
+				   vh->tls_sessions.next) {
+		__lws_tls_session_destroy(vh, lws_container_of(d,
+					struct lws_tls_session_entry, list));
+	} lws_end_foreach_dll_safe(d, d1);
+}
+
+LWS_VISIBLE int
+lws_tls_session_cache_stats(struct lws_vhost *vh,
+			    struct lws_tls_session_cache_stats *stats)
+{
+	if (!vh->tls_session_cache_max)
+		return -1;
+
+	lws_vhost_lock(vh);
+	*stats = vh->tls_session_stats;
+	lws_vhost_unlock(vh);
+
+	return 0;
+}
@@ -0,0 +1,330 @@
+/*
+ * libwebsockets - server tls handshakes on worker threads
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation:
+ *  version 2.1 of the License.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA  02110-1301  USA
+ *
+ * A full server handshake costs a millisecond or more of cpu in SSL_accept(),
+ * mostly the private key operation.  Done on the service thread, a burst of
+ * new connections stalls everything else that thread serves.
+ *
+ * With info->tls_handshake_threads, the service thread still accepts the
+ * socket and does everything around the handshake, but each SSL_accept()
+ * goes to a pool of worker threads, see struct lws_tls_hs_pool.  The pt
+ * stops polling the socket until the worker is done, then the worker puts
+ * the wsi on the pt's done list and wakes it through its pt queue.  The pt
+ * acts on what SSL_accept() said exactly as if it had called it itself.
+ *
+ * The accept only uses the wsi's SSL and reads its vhost's config, but the
+ * tls library calls back into lws from inside it.  Session tickets use the
+ * vhost's ticket keys and count its tls stats under vh->tls_lock, and SNI
+ * looks through the vhost list under the pool's vh_lock, which the service
+ * thread takes to add, index or remove a vhost.  Both are real mutexes even
+ * without SMP.  Handshakes that would call user code, ie, client cert
+ * verification or LWS_CALLBACK_SSL_INFO, stay on the service thread.
+ *
+ * Closing a wsi the pool has removes it, or for the short time a worker is
+ * in SSL_accept() on it, waits for that to finish first.  If the peer hangs
+ * up while a worker has it, the pt takes it out of its fds instead of
+ * waiting, and closes it when the worker is done.
+ */
+
+#include "private-libwebsockets.h"
+
+static void
+__lws_tls_hs_unlink(struct lws_tls_hs_pool *p, struct lws *wsi)
+{
+	if (p->queue_tail == &wsi->dll_tls_hs)
+		p->queue_tail = wsi->dll_tls_hs.prev;
+
+	lws_dll_lws_remove(&wsi->dll_tls_hs);
+}
+
+static void *
+lws_tls_hs_worker(void *d)
+{
+	struct lws_context *context = (struct lws_context *)d;
+	struct lws_tls_hs_pool *p = &context->tls_hs;
+	struct lws_context_per_thread *pt;
+	struct lws *wsi;
+	int n;
+
+	pthread_mutex_lock(&p->lock);
+
+	while (!p->stop) {
+		if (!p->queue.next) {
+			pthread_cond_wait(&p->work, &p->lock);
+			continue;
+		}
+
+		wsi = lws_container_of(p->queue.next, struct lws, dll_tls_hs);
+		__lws_tls_hs_unlink(p, wsi);
+		wsi->tls_hs_state = LWS_TLS_HS_RUNNING;
+		pthread_mutex_unlock(&p->lock);
+
+		/* the pt won't touch the SSL, or free the wsi, until DONE */
+		n = lws_tls_server_accept_step(wsi);
+
+		pt = &context->pt[(int)wsi->tsi];
+
+		pthread_mutex_lock(&p->lock);
+		wsi->tls_hs_result = (char)n;
+		wsi->tls_hs_state = LWS_TLS_HS_DONE;
+		lws_dll_lws_add_front(&wsi->dll_tls_hs, &pt->tls_hs_done);
+		/* somebody closing it may be waiting for us */
+		pthread_cond_broadcast(&p->done);
+		pthread_mutex_unlock(&p->lock);
+
+		lws_pt_queue_signal(pt, 0);
+
+		pthread_mutex_lock(&p->lock);
+	}
+
+	pthread_mutex_unlock(&p->lock);
+
+	return NULL;
+}
+
+int
+lws_tls_hs_pool_init(struct lws_context *context,
+		     const struct lws_context_creation_info *info)
+{
+	struct lws_tls_hs_pool *p = &context->tls_hs;
+	int n, count = (int)info->tls_handshake_threads;
+
+	if (!count)
+		return 0;
+
+	if (count > LWS_TLS_HS_POOL_MAX_THREADS)
+		count = LWS_TLS_HS_POOL_MAX_THREADS;
+
+	p->threads = lws_zalloc(count * sizeof(pthread_t), "tls hs pool");
+	if (!p->threads) {
+		lwsl_err("OOM\n");
+
+		return 1;
+	}
+
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_mutex_init(&p->vh_lock, NULL);
+	pthread_cond_init(&p->work, NULL);
+	pthread_cond_init(&p->done, NULL);
+	p->queue_tail = &p->queue;
+
+	for (n = 0; n < count; n++)
+		if (pthread_create(&p->threads[n], NULL, lws_tls_hs_worker,
+				   context))
+			break;
+
+	p->count_threads = n;
+	if (n < count)
+		lwsl_warn("%s: only started %d of %d threads\n", __func__,
+			  n, count);
+	if (!n)
+		/* the service threads just do the handshakes themselves */
+		return 1;
+
+	lwsl_info("%s: %d tls handshake threads\n", __func__, n);
+
+	return 0;
+}
+
+/*
+ * Called from the service thread when wsi is ready for SSL_accept().  Returns
+ * 0 if the pool took it, or nonzero to do the accept on the service thread
+ * as usual.
+ */
+
+int
+lws_tls_hs_pool_queue(struct lws *wsi)
+{
+	struct lws_tls_hs_pool *p = &wsi->context->tls_hs;
+
+	/*
+	 * verifying a client cert, and LWS_CALLBACK_SSL_INFO during the
+	 * handshake, call back into user code, which only expects to be
+	 * called from the service thread
+	 */
+	if (!p->count_threads ||
+	    wsi->vhost->ssl_info_event_mask ||
+	    lws_check_opt(wsi->vhost->options,
+			  LWS_SERVER_OPTION_REQUIRE_VALID_OPENSSL_CLIENT_CERT))
+		return 1;
+
+	/* the pt mustn't service the socket while a worker may be using it */
+	if (lws_change_pollfd(wsi, LWS_POLLIN | LWS_POLLOUT, 0))
+		return 1;
+
+	pthread_mutex_lock(&p->lock);
+
+	wsi->tls_hs_state = LWS_TLS_HS_QUEUED;
+
+	/* add at the tail, so the oldest handshake goes first */
+	wsi->dll_tls_hs.prev = p->queue_tail;
+	wsi->dll_tls_hs.next = NULL;
+	p->queue_tail->next = &wsi->dll_tls_hs;
+	p->queue_tail = &wsi->dll_tls_hs;
+
+	pthread_cond_signal(&p->work);
+	pthread_mutex_unlock(&p->lock);
+
+	return 0;
+}
+
+/* the pt was woken... finish off the handshakes the pool did for it */
+
+void
+lws_tls_hs_pool_service(struct lws_context *context,
+			struct lws_context_per_thread *pt)
+{
+	struct lws_tls_hs_pool *p = &context->tls_hs;
+	struct lws *wsi;
+	int n;
+
+	if (!p->count_threads)
+		return;
+
+	pthread_mutex_lock(&p->lock);
+
+	while (pt->tls_hs_done.next) {
+		wsi = lws_container_of(pt->tls_hs_done.next, struct lws,
+				       dll_tls_hs);
+		lws_dll_lws_remove(&wsi->dll_tls_hs);
+		wsi->tls_hs_state = LWS_TLS_HS_NONE;
+		n = wsi->tls_hs_result;
+		pthread_mutex_unlock(&p->lock);
+
+		if (wsi->tls_hs_hangup ||
+		    lws_tls_server_accept_resume(wsi, n))
+			lws_close_free_wsi(wsi, LWS_CLOSE_STATUS_NOSTATUS,
+					   "tls hs pool");
+
+		pthread_mutex_lock(&p->lock);
+	}
+
+	pthread_mutex_unlock(&p->lock);
+}
+
+/* wsi is closing, make sure the pool is done with it */
+
+void
+lws_tls_hs_pool_forget(struct lws *wsi)
+{
+	struct lws_tls_hs_pool *p = &wsi->context->tls_hs;
+
+	/* only the pt sets it back to NONE, so we can look without the lock */
+	if (!wsi->tls_hs_state)
+		return;
+
+	pthread_mutex_lock(&p->lock);
+
+	/* SSL_accept() on a nonblocking socket only needs cpu, so not long */
+	while (wsi->tls_hs_state == LWS_TLS_HS_RUNNING)
+		pthread_cond_wait(&p->done, &p->lock);
+
+	__lws_tls_hs_unlink(p, wsi);
+	wsi->tls_hs_state = LWS_TLS_HS_NONE;
+
+	pthread_mutex_unlock(&p->lock);
+}
+
+/*
+ * The peer hung up, or the socket has an error, while the pool has wsi.
+ * poll() reports that whatever events we ask for, so we can't just wait for
+ * the pool to be done.  Returns 0 if the pool let go of it and it can be
+ * closed now.  Otherwise a worker is using it, or already finished, and we
+ * don't want to wait for it here: we take it out of the fds, and close it
+ * when it comes back to the pt.
+ */
+
+int
+lws_tls_hs_pool_hangup(struct lws *wsi)
+{
+	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
+	struct lws_tls_hs_pool *p = &wsi->context->tls_hs;
+
+	pthread_mutex_lock(&p->lock);
+
+	if (wsi->tls_hs_state == LWS_TLS_HS_QUEUED) {
+		__lws_tls_hs_unlink(p, wsi);
+		wsi->tls_hs_state = LWS_TLS_HS_NONE;
+		pthread_mutex_unlock(&p->lock);
+
+		return 0;
+	}
+
+	wsi->tls_hs_hangup = 1;
+
+	pthread_mutex_unlock(&p->lock);
+
+	lws_pt_lock(pt, __func__);
+	__remove_wsi_socket_from_fds(wsi);
+	lws_pt_unlock(pt);
+
+	return 1;
+}
+
+/*
+ * Called at context destroy before the connections are closed: stop the
+ * workers, and leave anything they didn't get to for the close
+ */
+
+void
+lws_tls_hs_pool_destroy(struct lws_context *context)
+{
+	struct lws_tls_hs_pool *p = &context->tls_hs;
+	struct lws *wsi;
+	int n;
+
+	if (!p->threads)
+		return;
+
+	pthread_mutex_lock(&p->lock);
+	p->stop = 1;
+	pthread_cond_broadcast(&p->work);
+	pthread_mutex_unlock(&p->lock);
+
+	for (n = 0; n < p->count_threads; n++)
+		pthread_join(p->threads[n], NULL);
+	p->count_threads = 0;
+
+	while (p->queue.next) {
+		wsi = lws_container_of(p->queue.next, struct lws, dll_tls_hs);
+		__lws_tls_hs_unlink(p, wsi);
+		wsi->tls_hs_state = LWS_TLS_HS_NONE;
+	}
+
+	for (n = 0; n < context->count_threads; n++)
+		while (context->pt[n].tls_hs_done.next) {
+			wsi = lws_container_of(context->pt[n].tls_hs_done.next,
+					       struct lws, dll_tls_hs);
+			lws_dll_lws_remove(&wsi->dll_tls_hs);
+			wsi->tls_hs_state = LWS_TLS_HS_NONE;
+			if (wsi->tls_hs_hangup)
+				/* not in the fds, so nobody else will */
+				lws_close_free_wsi(wsi,
+						   LWS_CLOSE_STATUS_NOSTATUS,
+						   "tls hs pool");
+		}
+
+	pthread_cond_destroy(&p->done);
+	pthread_cond_destroy(&p->work);
+	pthread_mutex_destroy(&p->vh_lock);
+	pthread_mutex_destroy(&p->lock);
+
+	lws_free_set_NULL(p->threads);
+}
@@ -92,6 +92,15 @@ lws_context_init_server_ssl(struct lws_context_creation_info *info,
 			    LWS_CALLBACK_OPENSSL_LOAD_EXTRA_SERVER_VERIFY_CERTS,
 			    vhost->ssl_ctx, vhost, 0))
 			return -1;
+
+		/* with no key to start with, ticket keys are a config error */
+		if (vhost->tls_ticket_key_rotate_secs) {
+			if (lws_tls_ticket_key_rotate(vhost) ||
+			    lws_tls_server_ticket_keys_enable(vhost))
+				return -1;
+			vhost->tls_ticket_key_next = time(NULL) +
+					vhost->tls_ticket_key_rotate_secs;
+		}
 	}
 
 	if (vhost->use_ssl)
@@ -104,11 +113,131 @@ lws_context_init_server_ssl(struct lws_context_creation_info *info,
 	return 0;
 }
 
+/*
+ * Make the socket wait for what SSL_accept() said it wants next
+ */
+
+int
+lws_tls_server_accept_poll(struct lws *wsi, int n)
+{
+	switch (n) {
+	case LWS_SSL_CAPABLE_MORE_SERVICE_READ:
+		if (lws_change_pollfd(wsi, 0, LWS_POLLIN)) {
+			lwsl_info("%s: WANT_READ change_pollfd failed\n",
+				  __func__);
+			return LWS_SSL_CAPABLE_ERROR;
+		}
+
+		lwsl_info("SSL_ERROR_WANT_READ\n");
+		break;
+
+	case LWS_SSL_CAPABLE_MORE_SERVICE_WRITE:
+		lwsl_debug("%s: WANT_WRITE\n", __func__);
+
+		if (lws_change_pollfd(wsi, 0, LWS_POLLOUT)) {
+			lwsl_info("%s: WANT_WRITE change_pollfd failed\n",
+				  __func__);
+			return LWS_SSL_CAPABLE_ERROR;
+		}
+		break;
+	}
+
+	return n;
+}
+
+static int
+lws_tls_server_accepted(struct lws *wsi)
+{
+	struct lws_context *context = wsi->context;
+	struct lws_vhost *vh;
+
+	/* adapt our vhost to match the SNI SSL_CTX that was chosen */
+	vh = context->vhost_list;
+	while (vh) {
+		if (!vh->being_destroyed && wsi->ssl &&
+		    vh->ssl_ctx == lws_tls_ctx_from_wsi(wsi)) {
+			lwsl_info("setting wsi to vh %s\n", vh->name);
+			wsi->vhost = vh;
+			break;
+		}
+		vh = vh->vhost_next;
+	}
+
+	/* OK, we are accepted... give him some time to negotiate */
+	lws_set_timeout(wsi, PENDING_TIMEOUT_ESTABLISH_WITH_SERVER,
+			context->timeout_secs);
+
+	lwsi_set_state(wsi, LRS_ESTABLISHED);
+
+#if defined(LWS_WITH_HTTP2)
+	if (lws_h2_configure_if_upgraded(wsi))
+		return 1;
+#endif
+	lwsl_debug("accepted new SSL conn\n");
+
+	return 0;
+}
+
+/* what to do after SSL_accept(), wherever it ran.  Nonzero means close */
+
+static int
+lws_tls_server_accept_result(struct lws *wsi, int n)
+{
+	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
+
+	(void)pt;
+
+	lwsl_info("SSL_accept says %d\n", n);
+	switch (n) {
+	case LWS_SSL_CAPABLE_DONE:
+		break;
+	case LWS_SSL_CAPABLE_ERROR:
+		lws_stats_atomic_bump(wsi->context, pt,
+				      LWSSTATS_C_SSL_CONNECTIONS_FAILED, 1);
+		lwsl_info("SSL_accept failed socket %u: %d\n",
+			  wsi->desc.sockfd, n);
+		wsi->socket_is_permanently_unusable = 1;
+
+		return 1;
+
+	default: /* MORE_SERVICE */
+		return 0;
+	}
+
+	lws_stats_atomic_bump(wsi->context, pt,
+			      LWSSTATS_C_SSL_CONNECTIONS_ACCEPTED, 1);
+#if defined(LWS_WITH_STATS)
+	lws_stats_atomic_bump(wsi->context, pt,
+			      LWSSTATS_MS_SSL_CONNECTIONS_ACCEPTED_DELAY,
+			      time_in_microseconds() - wsi->accept_start_us);
+	wsi->accept_start_us = time_in_microseconds();
+#endif
+
+	return lws_tls_server_accepted(wsi);
+}
+
+#if defined(LWS_WITH_TLS_HANDSHAKE_POOL)
+/*
+ * A pool thread has done SSL_accept() for wsi, carry on from there as if it
+ * had run on the service thread
+ */
+
+int
+lws_tls_server_accept_resume(struct lws *wsi, int n)
+{
+	/* we stopped listening to the socket while the pool had it */
+	if (lws_change_pollfd(wsi, 0, LWS_POLLIN))
+		return 1;
+
+	return lws_tls_server_accept_result(wsi,
+					    lws_tls_server_accept_poll(wsi, n));
+}
+#endif
+
 LWS_VISIBLE int
 lws_server_socket_service_ssl(struct lws *wsi, lws_sockfd_type accept_fd)
 {
 	struct lws_context *context = wsi->context;
-	struct lws_vhost *vh;
 	struct lws_context_per_thread *pt = &context->pt[(int)wsi->tsi];
 	int n;
         char buf[256];
@@ -170,6 +299,15 @@ lws_server_socket_service_ssl(struct lws *wsi, lws_sockfd_type accept_fd)
 
 	case LRS_SSL_ACK_PENDING:
 
+#if defined(LWS_WITH_TLS_HANDSHAKE_POOL)
+		if (wsi->tls_hs_state) {
+			/* a pool thread has it, we hear when it's done */
+			if (lws_change_pollfd(wsi, LWS_POLLIN | LWS_POLLOUT, 0))
+				goto fail;
+
+			return 0;
+		}
+#endif
 		if (lws_change_pollfd(wsi, LWS_POLLOUT, 0)) {
 			lwsl_err("%s: lws_change_pollfd failed\n", __func__);
 			goto fail;
@@ -212,7 +350,8 @@ lws_server_socket_service_ssl(struct lws *wsi, lws_sockfd_type accept_fd)
 				    LWS_SERVER_OPTION_REDIRECT_HTTP_TO_HTTPS))
 					wsi->redirect_to_https = 1;
 				lwsl_debug("accepted as non-ssl\n");
-				goto accepted;
+
+				return lws_tls_server_accepted(wsi);
 			}
 			if (!n) {
 				/*
@@ -246,71 +385,269 @@ lws_server_socket_service_ssl(struct lws *wsi, lws_sockfd_type accept_fd)
 		if (!wsi->accept_start_us)
 			wsi->accept_start_us = time_in_microseconds();
 #endif
-		errno = 0;
 		lws_stats_atomic_bump(wsi->context, pt,
 				      LWSSTATS_C_SSL_CONNECTIONS_ACCEPT_SPIN, 1);
+#if defined(LWS_WITH_TLS_HANDSHAKE_POOL)
+		/* let a pool thread do the cpu-heavy part, if we have them */
+		if (!lws_tls_hs_pool_queue(wsi))
+			return 0;
+#endif
+		errno = 0;
 		n = lws_tls_server_accept(wsi);
 		lws_latency(context, wsi,
 			"SSL_accept LRS_SSL_ACK_PENDING\n", n, n == 1);
-		lwsl_info("SSL_accept says %d\n", n);
-		switch (n) {
-		case LWS_SSL_CAPABLE_DONE:
-			break;
-		case LWS_SSL_CAPABLE_ERROR:
-			lws_stats_atomic_bump(wsi->context, pt,
-					      LWSSTATS_C_SSL_CONNECTIONS_FAILED, 1);
-	                lwsl_info("SSL_accept failed socket %u: %d\n",
-	                		wsi->desc.sockfd, n);
-			wsi->socket_is_permanently_unusable = 1;
-			goto fail;
 
-		default: /* MORE_SERVICE */
-			return 0;
-		}
+		return lws_tls_server_accept_result(wsi, n);
 
-		lws_stats_atomic_bump(wsi->context, pt,
-				      LWSSTATS_C_SSL_CONNECTIONS_ACCEPTED, 1);
-#if defined(LWS_WITH_STATS)
-		lws_stats_atomic_bump(wsi->context, pt,
-				      LWSSTATS_MS_SSL_CONNECTIONS_ACCEPTED_DELAY,
-				      time_in_microseconds() - wsi->accept_start_us);
-		wsi->accept_start_us = time_in_microseconds();
-#endif
+	default:
+		break;
+	}
 
-accepted:
+	return 0;
 
-		/* adapt our vhost to match the SNI SSL_CTX that was chosen */
-		vh = context->vhost_list;
-		while (vh) {
-			if (!vh->being_destroyed && wsi->ssl &&
-			    vh->ssl_ctx == lws_tls_ctx_from_wsi(wsi)) {
-				lwsl_info("setting wsi to vh %s\n", vh->name);
-				wsi->vhost = vh;
-				break;
-			}
-			vh = vh->vhost_next;
-		}
+fail:
+	return 1;
+}
 
-		/* OK, we are accepted... give him some time to negotiate */
-		lws_set_timeout(wsi, PENDING_TIMEOUT_ESTABLISH_WITH_SERVER,
-				context->timeout_secs);
 
-		lwsi_set_state(wsi, LRS_ESTABLISHED);
+/*
+ * Session ticket keys
+ *
+ * By default the tls library makes its own ticket key in each process, so a
+ * ticket from one process is useless to the next one behind the same port,
+ * and to the same process after a restart.  When the vhost manages the keys,
+ * they come from user code or a file every process can share, and a new key
+ * takes over every tls_ticket_key_rotate_secs.  The key it replaced is still
+ * accepted until the next rotation, so tickets issued just before it don't
+ * all fail at once.
+ *
+ * Processes read the file on their own timers, so for up to a rotation period
+ * some issue tickets under the new key while others don't know it yet.  So
+ * the file may also hold the next key after the current one.  We accept
+ * tickets under it but don't issue any, and when every process has it, it
+ * can be made current in the file with a new next key after it.
+ */
 
-#if defined(LWS_WITH_HTTP2)
-		if (lws_h2_configure_if_upgraded(wsi))
-			goto fail;
-#endif
-		lwsl_debug("accepted new SSL conn\n");
-		break;
+static int
+lws_tls_ticket_key_parse(struct lws_tls_ticket_key *key, const uint8_t *buf,
+			 size_t len)
+{
+	/* 48 bytes has 16-byte hmac and aes keys, 80 bytes has 32-byte ones */
+	if (len != 48 && len != LWS_TLS_TICKET_KEY_LEN)
+		return 1;
 
-	default:
-		break;
+	memset(key, 0, sizeof(*key));
+	key->len = (uint8_t)((len - sizeof(key->name)) / 2);
+	memcpy(key->name, buf, sizeof(key->name));
+	memcpy(key->hmac, buf + sizeof(key->name), key->len);
+	memcpy(key->aes, buf + sizeof(key->name) + key->len, key->len);
+
+	return 0;
+}
+
+/* a key file has the current key, optionally followed by the next one */
+
+static int
+lws_tls_ticket_key_parse_file(struct lws_tls_ticket_key *key,
+			      struct lws_tls_ticket_key *next, int *staged,
+			      const uint8_t *buf, size_t len)
+{
+	*staged = 0;
+	if (!lws_tls_ticket_key_parse(key, buf, len))
+		return 0;
+
+	if ((len & 1) || lws_tls_ticket_key_parse(key, buf, len / 2) ||
+	    lws_tls_ticket_key_parse(next, buf + (len / 2), len / 2))
+		return 1;
+
+	*staged = 1;
+
+	return 0;
+}
+
+int
+lws_tls_ticket_key_rotate(struct lws_vhost *vh)
+{
+	uint8_t buf[LWS_TLS_TICKET_KEY_LEN], *file = NULL;
+	struct lws_tls_ticket_key key, next;
+	lws_filepos_t len = sizeof(buf);
+	int n = 1, staged = 0;
+	struct lws wsi;
+
+	/*
+	 * give him a fake wsi with context + vhost set, so he can use
+	 * lws_get_context() in the callback
+	 */
+	memset(&wsi, 0, sizeof(wsi));
+	wsi.context = vh->context;
+	wsi.vhost = vh;
+
+	memset(buf, 0, sizeof(buf));
+	if (vh->protocols[0].callback(&wsi, LWS_CALLBACK_VHOST_TLS_TICKET_KEY,
+				      NULL, buf, sizeof(buf)))
+		n = lws_tls_ticket_key_parse(&key, buf, sizeof(buf));
+	else
+		if (vh->tls_ticket_key_filepath) {
+			if (alloc_file(vh->context, vh->tls_ticket_key_filepath,
+				       &file, &len)) {
+				lwsl_err("%s: vh %s: unable to read %s\n",
+					 __func__, vh->name,
+					 vh->tls_ticket_key_filepath);
+				return 1;
+			}
+			n = lws_tls_ticket_key_parse_file(&key, &next, &staged,
+							  file, (size_t)len);
+			memset(file, 0, (size_t)len);
+			lws_free(file);
+		} else
+			if (lws_get_random(vh->context, buf, sizeof(buf)) ==
+							    sizeof(buf))
+				n = lws_tls_ticket_key_parse(&key, buf,
+							     sizeof(buf));
+	memset(buf, 0, sizeof(buf));
+
+	if (n) {
+		lwsl_err("%s: vh %s: ticket key must be 48 or %d bytes (or "
+			 "two of those), not %d\n", __func__, vh->name,
+			 LWS_TLS_TICKET_KEY_LEN, (int)len);
+		return 1;
 	}
 
+	lws_vhost_tls_lock(vh);
+	if (!vh->tls_ticket_keys ||
+	    memcmp(&vh->tls_ticket_key[0], &key, sizeof(key))) {
+		vh->tls_ticket_key[1] = vh->tls_ticket_key[0];
+		vh->tls_ticket_key[0] = key;
+		if (vh->tls_ticket_keys++)
+			vh->tls_server_stats.key_rotations++;
+		if (vh->tls_ticket_keys > 2)
+			vh->tls_ticket_keys = 2;
+		n = 1;
+	}
+	if (staged)
+		vh->tls_ticket_key[2] = next;
+	vh->tls_ticket_key_staged = (char)staged;
+	lws_vhost_tls_unlock(vh);
+
+	memset(&key, 0, sizeof(key));
+	memset(&next, 0, sizeof(next));
+
+	if (n)
+		lwsl_info("%s: vh %s: new ticket key\n", __func__, vh->name);
+
 	return 0;
+}
 
-fail:
-	return 1;
+/*
+ * Copies out the key to encrypt a new ticket with (name NULL), or the one
+ * matching the name in a ticket we were given.  Returns 0 for the current
+ * key, 1 for the previous one, 2 for the staged next one, or -1 if we have no
+ * such key.
+ */
+
+int
+lws_tls_ticket_key_find(struct lws_vhost *vh, const uint8_t *name,
+			struct lws_tls_ticket_key *key)
+{
+	int n;
+
+	lws_vhost_tls_lock(vh);
+
+	for (n = 0; n < vh->tls_ticket_keys; n++)
+		if (!name || !memcmp(name, vh->tls_ticket_key[n].name,
+				     sizeof(key->name)))
+			break;
+
+	if (n == vh->tls_ticket_keys) {
+		n = -1;
+		if (name && vh->tls_ticket_key_staged &&
+		    !memcmp(name, vh->tls_ticket_key[2].name, sizeof(key->name)))
+			n = 2;
+	}
+	if (n >= 0)
+		*key = vh->tls_ticket_key[n];
+
+	/*
+	 * tickets coming back are counted when the handshake completes, since
+	 * the tls library may look at the same one more than once
+	 */
+	if (!name && !n)
+		vh->tls_server_stats.tickets_issued++;
+
+	lws_vhost_tls_unlock(vh);
+
+	return n;
+}
+
+/*
+ * With SMP, more than one service thread may decide the once-a-second
+ * context checks are theirs to do.  Whoever moves tls_ticket_key_next on
+ * first does the rotation, so each period gets exactly one.
+ */
+
+void
+lws_tls_ticket_keys_check(struct lws_context *context, time_t now)
+{
+	int due;
+
+	lws_context_lock(context);
+
+	lws_start_foreach_ll(struct lws_vhost *, v, context->vhost_list) {
+		lws_vhost_tls_lock(v);
+		due = v->tls_ticket_keys && !v->being_destroyed &&
+		      now >= v->tls_ticket_key_next;
+		if (due)
+			v->tls_ticket_key_next = now +
+						 v->tls_ticket_key_rotate_secs;
+		lws_vhost_tls_unlock(v);
+
+		/* if we can't get a new key, keep the one we have */
+		if (due && lws_tls_ticket_key_rotate(v))
+			lwsl_warn("%s: vh %s: keeping old ticket key\n",
+				  __func__, v->name);
+	} lws_end_foreach_ll(v, vhost_next);
+
+	lws_context_unlock(context);
+}
+
+void
+lws_tls_server_handshake_done(struct lws *wsi, int resumed)
+{
+	struct lws_vhost *vh = wsi->vhost;
+
+	lws_vhost_tls_lock(vh);
+	vh->tls_server_stats.handshakes++;
+	if (resumed)
+		vh->tls_server_stats.resumed++;
+	switch (wsi->tls_ticket) {
+	case 1:
+		vh->tls_server_stats.tickets_current++;
+		break;
+	case 2:
+		vh->tls_server_stats.tickets_previous++;
+		break;
+	case 3:
+		vh->tls_server_stats.tickets_next++;
+		break;
+	case 4:
+		vh->tls_server_stats.tickets_unknown++;
+		break;
+	}
+	lws_vhost_tls_unlock(vh);
 }
 
+LWS_VISIBLE int
+lws_tls_server_session_stats(struct lws_vhost *vhost,
+			     struct lws_tls_server_session_stats *stats)
+{
+	if (!vhost->use_ssl || !vhost->ssl_ctx)
+		return -1;
+
+	lws_vhost_tls_lock(vhost);
+	*stats = vhost->tls_server_stats;
+	lws_vhost_tls_unlock(vhost);
+
+	lws_tls_server_session_cache_stats(vhost, stats);
+
+	return 0;
+}
@@ -460,6 +460,7 @@ int
 lws_gate_accepts(struct lws_context *context, int on)
 {
 	struct lws_vhost *v = context->vhost_list;
+	int n;
 
 	lwsl_notice("%s: on = %d\n", __func__, on);
 	context->ssl_gate_accepts = !on;
@@ -468,10 +469,13 @@ lws_gate_accepts(struct lws_context *context, int on)
 #endif
 
 	while (v) {
-		if (v->use_ssl && v->lserv_wsi &&
-		    lws_change_pollfd(v->lserv_wsi, (LWS_POLLIN) * !on,
-				      (LWS_POLLIN) * on))
-			lwsl_notice("Unable to set accept POLLIN %d\n", on);
+		for (n = 0; n < context->count_threads; n++)
+			if (v->use_ssl && v->lserv_wsi[n] &&
+			    lws_change_pollfd(v->lserv_wsi[n],
+					      (LWS_POLLIN) * !on,
+					      (LWS_POLLIN) * on))
+				lwsl_notice("Unable to set accept POLLIN %d\n",
+					    on);
 
 		v = v->vhost_next;
 	}
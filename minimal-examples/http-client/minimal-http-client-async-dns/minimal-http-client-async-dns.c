@@ -0,0 +1,393 @@
+/*
+ * lws-minimal-http-client-async-dns
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This demonstrates client connections whose addresses are resolved by lws'
+ * nonblocking resolver (lws built with -DLWS_WITH_ASYNC_DNS=1).
+ *
+ * Everything runs in one event loop: a tiny http server on :7681, a stub
+ * DNS server on udp :5399 that answers every A query with 127.0.0.1 after a
+ * delay, and lots of client connections to made-up names pointed at the
+ * server.  Each name is connected to twice concurrently.
+ *
+ * The stub server sends its delayed answers from a 10ms hrtimer, and tracks
+ * how late that timer fires.  If the resolver blocked the loop (like
+ * getaddrinfo() would, waiting on a server that is itself in the loop...)
+ * that would show up as very late ticks; instead they stay on time.
+ *
+ * It then
+ *
+ *  - repeats the connections straight away, which should be answered from
+ *    the cache without any new queries, and
+ *
+ *  - waits for the TTL to pass and repeats them again, which should query
+ *    each name once again
+ *
+ * Each round also counts how many different source ports the queries came
+ * from: lws sends each query from its own socket, so nearly all of them
+ * should differ.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#define DNS_PORT 5399
+#define TICK_US 10000
+#define MAX_PENDING 256
+
+struct pending {
+	struct lws_udp udp;
+	uint64_t due;
+	uint8_t pkt[512];
+	int len;
+};
+
+static struct pending pending[MAX_PENDING];
+static int count = 32, delay_ms = 100, ttl = 2, interrupted, npending,
+	   queries, started, done, failed;
+static uint16_t ports[MAX_PENDING];
+static uint64_t last_tick, max_late;
+
+static uint64_t
+us_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+/*
+ * turn the query into an answer for 127.0.0.1 in place, return the length
+ * or 0 if we didn't understand it
+ */
+
+static int
+stub_answer(uint8_t *p, int len, int max)
+{
+	int n = 12;
+
+	if (len < 17 || ((p[4] << 8) | p[5]) != 1)
+		return 0;
+
+	while (n < len && p[n])
+		n += p[n] + 1;
+	n += 5; /* the terminal 0, qtype, qclass */
+	if (n > len || n + 16 > max)
+		return 0;
+
+	p[2] = 0x81; /* response, rd */
+	p[3] = 0x80; /* ra, noerror */
+	p[6] = 0;
+	p[7] = 1; /* ancount */
+	memset(p + 8, 0, 4);
+
+	p[n++] = 0xc0; /* name: pointer to the question name */
+	p[n++] = 12;
+	p[n++] = 0;
+	p[n++] = 1; /* A */
+	p[n++] = 0;
+	p[n++] = 1; /* IN */
+	p[n++] = (uint8_t)(ttl >> 24);
+	p[n++] = (uint8_t)(ttl >> 16);
+	p[n++] = (uint8_t)(ttl >> 8);
+	p[n++] = (uint8_t)ttl;
+	p[n++] = 0;
+	p[n++] = 4;
+	p[n++] = 127;
+	p[n++] = 0;
+	p[n++] = 0;
+	p[n++] = 1;
+
+	return n;
+}
+
+static int
+callback_dns_stub(struct lws *wsi, enum lws_callback_reasons reason,
+		  void *user, void *in, size_t len)
+{
+	struct pending *pe;
+	uint64_t now;
+	int n;
+
+	switch (reason) {
+	case LWS_CALLBACK_RAW_ADOPT:
+		last_tick = us_now();
+		lws_set_timer_usecs(wsi, TICK_US);
+		break;
+
+	case LWS_CALLBACK_RAW_RX:
+		if (npending == MAX_PENDING || len > sizeof(pe->pkt))
+			break;
+		pe = &pending[npending];
+		memcpy(pe->pkt, in, len);
+		pe->len = stub_answer(pe->pkt, (int)len, sizeof(pe->pkt));
+		if (!pe->len)
+			break;
+		pe->udp = *(lws_get_udp(wsi));
+		pe->due = us_now() + (delay_ms * 1000);
+		npending++;
+		if (pe->udp.sa.sa_family == AF_INET)
+			ports[queries % MAX_PENDING] =
+				((struct sockaddr_in *)&pe->udp.sa)->sin_port;
+		queries++;
+		break;
+
+	case LWS_CALLBACK_TIMER:
+		now = us_now();
+		if (now - last_tick > TICK_US &&
+		    now - last_tick - TICK_US > max_late)
+			max_late = now - last_tick - TICK_US;
+		last_tick = now;
+
+		n = 0;
+		while (n < npending) {
+			pe = &pending[n];
+			if (pe->due > now) {
+				n++;
+				continue;
+			}
+			/* udp is always writeable... see minimal-raw-adopt-udp */
+			sendto(lws_get_socket_fd(wsi), pe->pkt, pe->len, 0,
+			       &pe->udp.sa, pe->udp.salen);
+			*pe = pending[--npending];
+		}
+
+		lws_set_timer_usecs(wsi, TICK_US);
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static int
+callback_http(struct lws *wsi, enum lws_callback_reasons reason,
+	      void *user, void *in, size_t len)
+{
+	switch (reason) {
+
+	/* the server side */
+
+	case LWS_CALLBACK_HTTP:
+		if (lws_return_http_status(wsi, HTTP_STATUS_OK, "ok"))
+			return -1;
+		if (lws_http_transaction_completed(wsi))
+			return -1;
+		return 0;
+
+	/* the client side */
+
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		lwsl_err("CLIENT_CONNECTION_ERROR: %s\n",
+			 in ? (char *)in : "(null)");
+		failed++;
+		done++;
+		break;
+
+	case LWS_CALLBACK_RECEIVE_CLIENT_HTTP_READ:
+		return 0; /* don't passthru */
+
+	case LWS_CALLBACK_RECEIVE_CLIENT_HTTP:
+		{
+			char buffer[1024 + LWS_PRE];
+			char *px = buffer + LWS_PRE;
+			int lenx = sizeof(buffer) - LWS_PRE;
+
+			if (lws_http_client_read(wsi, &px, &lenx) < 0)
+				return -1;
+		}
+		return 0; /* don't passthru */
+
+	case LWS_CALLBACK_COMPLETED_CLIENT_HTTP:
+		done++;
+		return -1; /* we are finished with the connection */
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static struct lws_protocols protocols[] = {
+	{ "http", callback_http, 0, 0 },
+	{ "dns-stub", callback_dns_stub, 0, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static void
+start_round(struct lws_context *context)
+{
+	struct lws_client_connect_info i;
+	char name[64];
+	int n;
+
+	done = started = 0;
+
+	for (n = 0; n < count * 2; n++) {
+		lws_snprintf(name, sizeof(name), "host-%d.lws-adns.test",
+			     n % count);
+
+		memset(&i, 0, sizeof i); /* otherwise uninitialized garbage */
+		i.context = context;
+		i.port = 7681;
+		i.address = name;
+		i.path = "/";
+		i.host = i.address;
+		i.origin = i.address;
+		i.method = "GET";
+		i.protocol = protocols[0].name;
+
+		started++;
+		if (!lws_client_connect_via_info(&i)) {
+			failed++;
+			done++;
+		}
+	}
+}
+
+/* how many different source ports the queries since q came from */
+
+static int
+distinct_ports(int q)
+{
+	int n, m, d = 0;
+
+	for (n = q; n < queries && n - q < MAX_PENDING; n++) {
+		for (m = q; m < n; m++)
+			if (ports[m % MAX_PENDING] == ports[n % MAX_PENDING])
+				break;
+		if (m == n)
+			d++;
+	}
+
+	return d;
+}
+
+static int
+run_round(struct lws_context *context, const char *what, int expect)
+{
+	int q = queries, n = 0, d;
+	uint64_t t = us_now();
+
+	max_late = 0;
+	start_round(context);
+	while (n >= 0 && done < started && !interrupted)
+		n = lws_service(context, 1000);
+
+	d = distinct_ports(q);
+	lwsl_user("%s: %d connections in %.1fms, %d dns queries (expected %d) "
+		  "from %d source ports, latest hrtimer tick %.1fms late\n",
+		  what, started, (double)(us_now() - t) / 1000.0, queries - q,
+		  expect, d, (double)max_late / 1000.0);
+
+	/* allow for the odd random port coming up twice */
+
+	return queries - q != expect || d < (queries - q) * 3 / 4;
+}
+
+void sigint_handler(int sig)
+{
+	interrupted = 1;
+}
+
+static const char *findarg(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc - 1], val))
+			return argv[argc];
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct lws_context_creation_info info;
+	struct lws_context *context;
+	struct lws_vhost *vh;
+	int n = 0, bad = 0;
+	const char *p;
+	uint64_t t;
+
+	signal(SIGINT, sigint_handler);
+
+	lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN | LLL_NOTICE, NULL);
+
+	lwsl_user("LWS minimal http client async dns\n");
+	lwsl_user("   %s [-n <names>] [-w <answer delay ms>] [-t <ttl secs>]\n",
+		  argv[0]);
+
+	p = findarg(argc, argv, "-n");
+	if (p)
+		count = atoi(p);
+	p = findarg(argc, argv, "-w");
+	if (p)
+		delay_ms = atoi(p);
+	p = findarg(argc, argv, "-t");
+	if (p)
+		ttl = atoi(p);
+	if (count < 1)
+		count = 1;
+	if (count > MAX_PENDING)
+		count = MAX_PENDING;
+	if (ttl < 1)
+		ttl = 1;
+
+	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
+	info.options = LWS_SERVER_OPTION_EXPLICIT_VHOSTS;
+	/*
+	 * client and server side of each connection each need an ah, and the
+	 * server side ones from the last round may still be closing
+	 */
+	info.max_http_header_pool = count * 8;
+	info.async_dns_server = "127.0.0.1:5399";
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	info.port = 7681;
+	info.protocols = protocols;
+
+	vh = lws_create_vhost(context, &info);
+	if (!vh || !lws_create_adopt_udp(vh, DNS_PORT, LWS_CAUDP_BIND,
+					 "dns-stub", NULL)) {
+		lwsl_err("unable to create the server or stub dns server\n");
+		lws_context_destroy(context);
+		return 1;
+	}
+
+	bad |= run_round(context, "cold", count);
+	bad |= run_round(context, "cached", 0);
+
+	lwsl_user("waiting %ds for the ttl to pass\n", ttl + 1);
+	t = us_now();
+	while (n >= 0 && !interrupted &&
+	       us_now() - t < (uint64_t)(ttl + 1) * 1000000)
+		n = lws_service(context, 100);
+
+	bad |= run_round(context, "expired", count);
+
+	lws_context_destroy(context);
+
+	bad |= !!failed;
+	lwsl_user("Completed: %s\n", bad ? "FAILED" : "OK");
+
+	return bad;
+}
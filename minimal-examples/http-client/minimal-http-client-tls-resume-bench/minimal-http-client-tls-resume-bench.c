@@ -0,0 +1,458 @@
+/*
+ * lws-minimal-http-client-tls-resume-bench
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This measures what the vhost's client tls session cache saves, when a
+ * client keeps making new connections to the same tls server.
+ *
+ * It forks a tls server on :7681 (using the selfsigned localhost cert here,
+ * so run it from this directory), and makes -n https requests to it, each on
+ * a new connection, -p at a time.  It does that twice, with a fresh server
+ * each time: first on a client vhost without a session cache, so every
+ * connection needs a full handshake, then on one with
+ * info.tls_session_cache_max set to -s, so connections can resume the
+ * session the server gave an earlier one.
+ *
+ * For each it reports the mean time from starting the connection until the
+ * response was complete, and the cpu time the client and the server spent on
+ * each connection.
+ *
+ * Those connections allow the selfsigned cert.  Last, still against the
+ * second server, the cached vhost makes -x connections that don't.  They
+ * must not resume the sessions the relaxed connections were given, since
+ * that would skip checking the cert: each must do a full handshake and fail
+ * it.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define MAX_CONNS 10000
+
+struct conn {
+	uint64_t start;
+};
+
+static struct conn conns[MAX_CONNS];
+static int count = 1000, parallel = 1, cache_max = 16, strict_count = 8,
+	   interrupted, started, inflight, done, failed, strict;
+static uint64_t latency_total;
+
+static uint64_t
+us_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+static uint64_t
+us_tv(const struct timeval *tv)
+{
+	return ((uint64_t)tv->tv_sec * 1000000) + tv->tv_usec;
+}
+
+/* the server, in a forked process */
+
+static int
+callback_server(struct lws *wsi, enum lws_callback_reasons reason,
+		void *user, void *in, size_t len)
+{
+	switch (reason) {
+	case LWS_CALLBACK_HTTP:
+		if (lws_return_http_status(wsi, HTTP_STATUS_OK, NULL))
+			return -1;
+		if (lws_http_transaction_completed(wsi))
+			return -1;
+
+		return 0;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static struct lws_protocols protocols_server[] = {
+	{ "http", callback_server, 0, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static void
+sigterm_handler(int sig)
+{
+	interrupted = 1;
+}
+
+static int
+run_server(int fd)
+{
+	struct lws_context_creation_info info;
+	struct lws_context *cx;
+	int n = 0;
+
+	signal(SIGTERM, sigterm_handler);
+
+	memset(&info, 0, sizeof info);
+	info.port = 7681;
+	info.protocols = protocols_server;
+	info.options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+	info.ssl_cert_filepath = "localhost-100y.cert";
+	info.ssl_private_key_filepath = "localhost-100y.key";
+	info.max_http_header_pool = 64;
+
+	cx = lws_create_context(&info);
+	if (!cx)
+		return 1;
+
+	/* tell the client we are listening */
+	if (write(fd, "", 1) != 1)
+		interrupted = 1;
+
+	while (n >= 0 && !interrupted)
+		n = lws_service(cx, 100);
+
+	lws_context_destroy(cx);
+
+	return 0;
+}
+
+/* the client, in this process */
+
+static int
+callback_client(struct lws *wsi, enum lws_callback_reasons reason,
+		void *user, void *in, size_t len)
+{
+	struct conn *conn = (struct conn *)user;
+	char buf[LWS_PRE + 1024], *px = buf + LWS_PRE;
+	int lenx = sizeof(buf) - LWS_PRE;
+
+	switch (reason) {
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		if (!strict)
+			lwsl_err("CLIENT_CONNECTION_ERROR: %s\n",
+				 in ? (char *)in : "(null)");
+		failed++;
+		inflight--;
+		break;
+
+	case LWS_CALLBACK_RECEIVE_CLIENT_HTTP:
+		if (lws_http_client_read(wsi, &px, &lenx) < 0)
+			return -1;
+		return 0;
+
+	case LWS_CALLBACK_RECEIVE_CLIENT_HTTP_READ:
+		return 0; /* we don't need the body */
+
+	case LWS_CALLBACK_COMPLETED_CLIENT_HTTP:
+		latency_total += us_now() - conn->start;
+		done++;
+		/* close it, so the next request makes a new connection */
+		return -1;
+
+	case LWS_CALLBACK_CLOSED_CLIENT_HTTP:
+		inflight--;
+		/* let the service loop start the next one straight away */
+		lws_cancel_service(lws_get_context(wsi));
+		break;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static const struct lws_protocols protocols[] = {
+	{ "http", callback_client, 0, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static int
+start_conn(struct lws_context *context, struct lws_vhost *vh)
+{
+	struct lws_client_connect_info i;
+	struct conn *conn = &conns[started];
+
+	memset(&i, 0, sizeof i);
+	i.context = context;
+	i.vhost = vh;
+	i.address = "127.0.0.1";
+	i.port = 7681;
+	/* one request per connection, so h2 would only add overhead */
+	i.ssl_connection = LCCSCF_USE_SSL | LCCSCF_NOT_H2;
+	if (!strict)
+		i.ssl_connection |= LCCSCF_ALLOW_SELFSIGNED;
+	i.path = "/";
+	i.host = "localhost";
+	i.origin = "localhost";
+	i.method = "GET";
+	i.protocol = protocols[0].name;
+	i.userdata = conn;
+
+	conn->start = us_now();
+	started++;
+	inflight++;
+
+	return !lws_client_connect_via_info(&i);
+}
+
+static pid_t
+start_server(void)
+{
+	int fds[2];
+	pid_t pid;
+	char c;
+
+	if (pipe(fds))
+		return -1;
+
+	pid = fork();
+	if (pid < 0)
+		return -1;
+	if (!pid) {
+		close(fds[0]);
+		exit(run_server(fds[1]));
+	}
+	close(fds[1]);
+
+	if (read(fds[0], &c, 1) != 1) {
+		lwsl_err("server failed to start\n");
+		close(fds[0]);
+		waitpid(pid, NULL, 0);
+
+		return -1;
+	}
+	close(fds[0]);
+
+	return pid;
+}
+
+/*
+ * make n connections, par at a time... unless they are the strict ones, which
+ * are meant to fail, stop at the first failure
+ */
+
+static int
+run_conns(struct lws_context *context, struct lws_vhost *vh, int n, int par)
+{
+	int m = 0;
+
+	started = done = failed = inflight = 0;
+	latency_total = 0;
+
+	while (m >= 0 && !interrupted && (strict || !failed) &&
+	       (started < n || inflight)) {
+		while (started < n && inflight < par)
+			if (start_conn(context, vh)) {
+				lwsl_err("%s: connect failed\n", __func__);
+				return 1;
+			}
+		m = lws_service(context, 1000);
+	}
+
+	return 0;
+}
+
+static int
+run_phase(struct lws_context *context, struct lws_vhost *vh, const char *name)
+{
+	struct lws_tls_session_cache_stats stats;
+	struct rusage ru_client, ru_server;
+	uint64_t client_us;
+	pid_t pid;
+
+	pid = start_server();
+	if (pid < 0)
+		return 1;
+
+	getrusage(RUSAGE_SELF, &ru_client);
+	client_us = us_tv(&ru_client.ru_utime) + us_tv(&ru_client.ru_stime);
+
+	if (run_conns(context, vh, count, parallel))
+		failed++;
+
+	getrusage(RUSAGE_SELF, &ru_client);
+	client_us = us_tv(&ru_client.ru_utime) + us_tv(&ru_client.ru_stime) -
+		    client_us;
+
+	kill(pid, SIGTERM);
+	if (wait4(pid, NULL, 0, &ru_server) != pid)
+		return 1;
+
+	if (failed || !done)
+		return 1;
+
+	lwsl_user("%s: %d connections, %.2fms mean, cpu per connection: "
+		  "client %.3fms, server %.3fms\n", name, done,
+		  (double)latency_total / done / 1000.0,
+		  (double)client_us / done / 1000.0,
+		  (double)(us_tv(&ru_server.ru_utime) +
+			   us_tv(&ru_server.ru_stime)) / done / 1000.0);
+
+	if (!lws_tls_session_cache_stats(vh, &stats)) {
+		lwsl_user("%s: %lu handshakes, %lu offered a session, "
+			  "%lu resumed (%lu%%), %lu stored, %lu evicted, "
+			  "%u cached\n", name, stats.handshakes,
+			  stats.offered, stats.resumed,
+			  stats.handshakes ? stats.resumed * 100 /
+					     stats.handshakes : 0,
+			  stats.stored, stats.evicted, stats.count);
+
+		/*
+		 * only the connections started before the first one finished
+		 * its handshake have nothing to offer... with -p, a few tls 1.3
+		 * tickets shared by connections in flight together may still
+		 * be refused, but most connections should resume
+		 */
+		if (stats.resumed * 2 + parallel < stats.handshakes)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * One connection that allows the selfsigned cert leaves a session in the
+ * cache.  Then connections that check the cert must not be offered it, and
+ * must fail their full handshake.
+ */
+
+static int
+run_strict(struct lws_context *context, struct lws_vhost *vh)
+{
+	struct lws_tls_session_cache_stats before, after;
+	int refused;
+	pid_t pid;
+
+	pid = start_server();
+	if (pid < 0)
+		return 1;
+
+	if (run_conns(context, vh, 1, 1) || failed ||
+	    lws_tls_session_cache_stats(vh, &before)) {
+		kill(pid, SIGTERM);
+		waitpid(pid, NULL, 0);
+
+		return 1;
+	}
+
+	strict = 1;
+	refused = run_conns(context, vh, strict_count, 1) ? -1 : failed;
+	strict = 0;
+
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+
+	if (lws_tls_session_cache_stats(vh, &after))
+		return 1;
+
+	lwsl_user("strict: %d connections checking the cert, %d refused it, "
+		  "%lu offered a session, %lu resumed\n", started, refused,
+		  after.offered - before.offered,
+		  after.resumed - before.resumed);
+
+	return refused != strict_count || after.offered != before.offered ||
+	       after.resumed != before.resumed;
+}
+
+void sigint_handler(int sig)
+{
+	interrupted = 1;
+}
+
+static const char *findarg(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc - 1], val))
+			return argv[argc];
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct lws_context_creation_info info;
+	struct lws_vhost *vh_plain, *vh_cache;
+	struct lws_context *context;
+	char name[32];
+	const char *p;
+	int bad = 1;
+
+	signal(SIGINT, sigint_handler);
+
+	if ((p = findarg(argc, argv, "-n")))
+		count = atoi(p);
+	if ((p = findarg(argc, argv, "-p")))
+		parallel = atoi(p);
+	if ((p = findarg(argc, argv, "-s")))
+		cache_max = atoi(p);
+	if ((p = findarg(argc, argv, "-x")))
+		strict_count = atoi(p);
+	if (count < 1 || count > MAX_CONNS)
+		count = 1000;
+	if (parallel < 1)
+		parallel = 1;
+	if (cache_max < 1)
+		cache_max = 1;
+	if (strict_count < 0 || strict_count > MAX_CONNS)
+		strict_count = 8;
+
+	lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN, NULL);
+	lwsl_user("LWS minimal http client tls resume bench\n");
+	lwsl_user("   %s [-n <connections>] [-p <parallel>] "
+		  "[-s <session cache max>] [-x <strict connections>]\n",
+		  argv[0]);
+
+	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
+	info.options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT |
+		       LWS_SERVER_OPTION_EXPLICIT_VHOSTS;
+	info.port = CONTEXT_PORT_NO_LISTEN; /* we do not run any server */
+	info.protocols = protocols;
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	info.vhost_name = "plain";
+	vh_plain = lws_create_vhost(context, &info);
+	info.vhost_name = "cache";
+	info.tls_session_cache_max = cache_max;
+	vh_cache = lws_create_vhost(context, &info);
+	if (!vh_plain || !vh_cache) {
+		lwsl_err("vhost creation failed\n");
+		goto bail;
+	}
+
+	lws_snprintf(name, sizeof(name), "session cache %d", cache_max);
+
+	if (run_phase(context, vh_plain, "no session cache") ||
+	    run_phase(context, vh_cache, name) ||
+	    (strict_count && run_strict(context, vh_cache)))
+		goto bail;
+
+	bad = 0;
+
+bail:
+	lws_context_destroy(context);
+
+	lwsl_user("Completed: %s\n", bad || interrupted ? "FAILED" : "OK");
+
+	return bad || interrupted;
+}
@@ -0,0 +1,331 @@
+/*
+ * lws-minimal-http-server-access-log-bench
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This measures what writing the access log costs the service thread.
+ *
+ * For each of
+ *
+ *  - no access log
+ *  - an access log in a file
+ *  - an access log on a "slow disk"... a fifo that a thread reads 4KB from
+ *    every -d us (default 2000)
+ *
+ * it creates a vhost on port 7681 answering every request with an empty 200,
+ * and a thread makes -r keepalive requests (default 20000) on one connection,
+ * reporting the requests/sec, the slowest request, and how many log lines
+ * made it out.
+ *
+ * Built against lws with LWS_WITH_ACCESS_LOG_ASYNC, the lines are buffered
+ * per service thread and written from a separate thread, by default dropping
+ * lines if the buffer fills; give -w to make the service thread wait instead.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define LOG_FILE "/tmp/lws-alog-bench.log"
+#define LOG_FIFO "/tmp/lws-alog-bench.fifo"
+
+static struct lws_context *context;
+static int interrupted, requests = 20000, slow_us = 2000, done;
+static unsigned long fifo_lines;
+
+static int
+callback_http(struct lws *wsi, enum lws_callback_reasons reason,
+	      void *user, void *in, size_t len)
+{
+	uint8_t buf[LWS_PRE + 256], *start = &buf[LWS_PRE], *p = start,
+		*end = &buf[sizeof(buf) - 1];
+
+	switch (reason) {
+	case LWS_CALLBACK_HTTP:
+		if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK,
+						"text/plain", 0, &p, end))
+			return 1;
+		if (lws_finalize_write_http_header(wsi, start, &p, end))
+			return 1;
+
+		if (lws_http_transaction_completed(wsi))
+			return -1;
+
+		return 0;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static struct lws_protocols protocols[] = {
+	{ "http", callback_http, 0, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static uint64_t
+us_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+static int
+request(int fd, int n)
+{
+	char buf[512];
+	int m, len = 0;
+
+	m = lws_snprintf(buf, sizeof(buf), "GET /api/v1/item%d HTTP/1.1\r\n"
+			 "Host: localhost\r\n"
+			 "User-Agent: lws-minimal-http-server-access-log-bench\r\n"
+			 "Referer: http://localhost:7681/index.html\r\n\r\n", n);
+	if (send(fd, buf, m, 0) != m)
+		return 1;
+
+	while (len < 4 || memcmp(buf + len - 4, "\r\n\r\n", 4)) {
+		if (len == sizeof(buf) - 1)
+			return 1;
+		m = recv(fd, buf + len, sizeof(buf) - 1 - len, 0);
+		if (m <= 0)
+			return 1;
+		len += m;
+	}
+
+	return strncmp(buf, "HTTP/1.1 200", 12);
+}
+
+static void *
+thread_client(void *d)
+{
+	const char *what = (const char *)d;
+	uint64_t t, t1, worst = 0;
+	struct sockaddr_in sa;
+	int fd, n;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		goto bail;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(7681);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, (struct sockaddr *)&sa, sizeof(sa))) {
+		lwsl_err("%s: unable to connect\n", __func__);
+		goto bail1;
+	}
+
+	t = us_now();
+	for (n = 0; n < requests && !interrupted; n++) {
+		t1 = us_now();
+		if (request(fd, n)) {
+			lwsl_err("%s: request failed\n", __func__);
+			goto bail1;
+		}
+		t1 = us_now() - t1;
+		if (t1 > worst)
+			worst = t1;
+	}
+	t = us_now() - t;
+
+	if (!interrupted) {
+		lwsl_user("%-10s %d requests: %8.0f req/s, slowest %6lluus\n",
+			  what, requests, (double)requests * 1000000.0 / t,
+			  (unsigned long long)worst);
+		done = 1;
+	}
+
+bail1:
+	close(fd);
+bail:
+	lws_cancel_service(context);
+
+	pthread_exit(NULL);
+
+	return NULL;
+}
+
+/* a disk that only takes 4KB every slow_us */
+
+static void *
+thread_slow_disk(void *unused)
+{
+	char buf[4096];
+	ssize_t n, m;
+	int fd;
+
+	fifo_lines = 0;
+
+	/* waits until the vhost opens the other end */
+	fd = open(LOG_FIFO, O_RDONLY);
+	if (fd < 0)
+		pthread_exit(NULL);
+
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		for (m = 0; m < n; m++)
+			if (buf[m] == '\n')
+				fifo_lines++;
+		usleep(slow_us);
+	}
+
+	close(fd);
+	pthread_exit(NULL);
+
+	return NULL;
+}
+
+static unsigned long
+count_lines(const char *path)
+{
+	unsigned long lines = 0;
+	char buf[4096];
+	ssize_t n, m;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		for (m = 0; m < n; m++)
+			if (buf[m] == '\n')
+				lines++;
+	close(fd);
+
+	return lines;
+}
+
+static int
+run(const char *what, const char *log, int wait)
+{
+	struct lws_context_creation_info info;
+	pthread_t pthread_client, pthread_disk;
+	int n = 0, slow = log && !strcmp(log, LOG_FIFO);
+	void *retval;
+
+	done = 0;
+
+	if (slow && pthread_create(&pthread_disk, NULL, thread_slow_disk,
+				   NULL)) {
+		lwsl_err("thread creation failed\n");
+		return 1;
+	}
+
+	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
+	info.port = 7681;
+	info.protocols = protocols;
+	info.log_filepath = log;
+	info.access_log_overflow = wait ? LWS_ALOG_OVERFLOW_WAIT :
+					  LWS_ALOG_OVERFLOW_DROP;
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		if (slow) {
+			/* let the reader's open() complete so it can exit */
+			close(open(LOG_FIFO, O_WRONLY));
+			pthread_join(pthread_disk, &retval);
+		}
+		return 1;
+	}
+
+	if (pthread_create(&pthread_client, NULL, thread_client,
+			   (void *)what)) {
+		lwsl_err("thread creation failed\n");
+		interrupted = 1;
+	} else {
+		while (n >= 0 && !done && !interrupted)
+			n = lws_service(context, 1000);
+
+		pthread_join(pthread_client, &retval);
+	}
+
+	/* closing the log means writing out everything still buffered */
+
+	lws_context_destroy(context);
+
+	if (slow) {
+		pthread_join(pthread_disk, &retval);
+		lwsl_user("%-10s %lu log lines written\n", what, fifo_lines);
+	} else if (log)
+		lwsl_user("%-10s %lu log lines written\n", what,
+			  count_lines(log));
+
+	return !done;
+}
+
+void sigint_handler(int sig)
+{
+	interrupted = 1;
+}
+
+static const char *findarg(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc - 1], val))
+			return argv[argc];
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	int n, wait = 0, result = 0;
+	const char *p;
+
+	signal(SIGINT, sigint_handler);
+
+	if ((p = findarg(argc, argv, "-r")))
+		requests = atoi(p);
+	if ((p = findarg(argc, argv, "-d")))
+		slow_us = atoi(p);
+	for (n = 1; n < argc; n++)
+		if (!strcmp(argv[n], "-w"))
+			wait = 1;
+	if (requests < 1)
+		requests = 1;
+
+	lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN, NULL);
+	lwsl_user("LWS minimal http server access log bench\n");
+	lwsl_user("   %s [-r <requests>] [-d <slow disk us per 4KB>] [-w]\n",
+		  argv[0]);
+
+	unlink(LOG_FILE);
+	unlink(LOG_FIFO);
+	if (mkfifo(LOG_FIFO, 0600)) {
+		lwsl_err("unable to create %s\n", LOG_FIFO);
+		return 1;
+	}
+
+	result |= run("no log", NULL, wait);
+	if (!interrupted)
+		result |= run("file", LOG_FILE, wait);
+	if (!interrupted)
+		result |= run("slow disk", LOG_FIFO, wait);
+
+	unlink(LOG_FILE);
+	unlink(LOG_FIFO);
+
+	lwsl_user("Completed: %s\n", result ? "FAILED" : "OK");
+
+	return result;
+}
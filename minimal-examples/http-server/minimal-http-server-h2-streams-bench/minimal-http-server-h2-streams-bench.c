@@ -0,0 +1,362 @@
+/*
+ * lws-minimal-http-server-h2-streams-bench
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This measures what it costs lws to process frames on an http/2 connection
+ * that has many streams open at once.
+ *
+ * It runs an lws server on port 7681 that holds every stream it is given
+ * open, and a thread that plays the part of a busy client on one plaintext
+ * (h2c upgraded) connection.  The client opens -s streams (default 1000),
+ * then sends -f stream WINDOW_UPDATE frames (default 200000) spread randomly
+ * across them, in batches each followed by a PING.  It reports the average
+ * time per frame, measured from sending each batch to getting the PING ack.
+ *
+ * Try it with -s 1 as well, to see how the per-frame cost changes with the
+ * number of open streams.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define BATCH 1000
+
+static struct lws_context *context;
+static int interrupted, streams = 1000, frames = 200000, held, result = 1;
+
+static int
+callback_http(struct lws *wsi, enum lws_callback_reasons reason,
+	      void *user, void *in, size_t len)
+{
+	switch (reason) {
+	case LWS_CALLBACK_HTTP:
+		/* don't reply... keep the stream open for the bench */
+		held++;
+		return 0;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static struct lws_protocols protocols[] = {
+	{ "http", callback_http, 0, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static uint64_t
+us_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+static uint8_t *
+frame_hdr(uint8_t *p, int len, int type, int flags, uint32_t sid)
+{
+	*p++ = len >> 16;
+	*p++ = len >> 8;
+	*p++ = len;
+	*p++ = type;
+	*p++ = flags;
+	*p++ = sid >> 24;
+	*p++ = sid >> 16;
+	*p++ = sid >> 8;
+	*p++ = sid;
+
+	return p;
+}
+
+/* hpack literal without indexing, literal name, short strings only */
+
+static uint8_t *
+hpack_lit(uint8_t *p, const char *name, const char *value)
+{
+	*p++ = 0;
+	*p++ = strlen(name);
+	memcpy(p, name, strlen(name));
+	p += strlen(name);
+	*p++ = strlen(value);
+	memcpy(p, value, strlen(value));
+
+	return p + strlen(value);
+}
+
+static int
+send_all(int fd, const uint8_t *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = send(fd, buf, len, 0);
+		if (n <= 0)
+			return 1;
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * read frames from the server until we see a PING ack, acking any SETTINGS
+ */
+
+static int
+wait_ping_ack(int fd)
+{
+	static uint8_t rx[65536];
+	static size_t rx_len;
+	uint8_t ack[9];
+	size_t flen;
+	ssize_t n;
+
+	while (!interrupted) {
+		while (rx_len >= 9) {
+			flen = (rx[0] << 16) | (rx[1] << 8) | rx[2];
+			if (rx_len < 9 + flen)
+				break;
+
+			if (rx[3] == 7) { /* GOAWAY */
+				lwsl_err("%s: server sent GOAWAY\n", __func__);
+				return 1;
+			}
+			if (rx[3] == 4 && !(rx[4] & 1)) { /* SETTINGS */
+				frame_hdr(ack, 0, 4, 1, 0);
+				if (send_all(fd, ack, sizeof(ack)))
+					return 1;
+			}
+			n = rx[3] == 6 && (rx[4] & 1); /* PING ack */
+
+			memmove(rx, rx + 9 + flen, rx_len - 9 - flen);
+			rx_len -= 9 + flen;
+
+			if (n)
+				return 0;
+		}
+
+		n = recv(fd, rx + rx_len, sizeof(rx) - rx_len, 0);
+		if (n <= 0) {
+			lwsl_err("%s: connection closed\n", __func__);
+			return 1;
+		}
+		rx_len += n;
+	}
+
+	return 1;
+}
+
+static uint8_t *
+ping(uint8_t *p)
+{
+	p = frame_hdr(p, 8, 6, 0, 0);
+	memset(p, 0, 8);
+
+	return p + 8;
+}
+
+static void *
+thread_client(void *unused)
+{
+	static const char upg[] = "GET / HTTP/1.1\r\n"
+				  "Host: localhost\r\n"
+				  "Connection: Upgrade, HTTP2-Settings\r\n"
+				  "Upgrade: h2c\r\n"
+				  /* MAX_CONCURRENT_STREAMS = 0x7fffffff */
+				  "HTTP2-Settings: AAN/////\r\n\r\n";
+	static const char preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+	uint8_t *buf, *p, *hb;
+	struct sockaddr_in sa;
+	uint64_t t, total = 0;
+	char rx[256];
+	size_t rxl = 0;
+	int fd, n, m;
+
+	buf = malloc(BATCH * 13 + 256);
+	if (!buf)
+		goto bail;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		goto bail1;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(7681);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, (struct sockaddr *)&sa, sizeof(sa))) {
+		lwsl_err("%s: unable to connect\n", __func__);
+		goto bail2;
+	}
+
+	/* upgrade to h2c, the server doesn't create a stream for it */
+
+	if (send_all(fd, (uint8_t *)upg, strlen(upg)))
+		goto bail2;
+	while (rxl < 4 || memcmp(rx + rxl - 4, "\r\n\r\n", 4)) {
+		if (rxl == sizeof(rx) || recv(fd, rx + rxl, 1, 0) != 1) {
+			lwsl_err("%s: h2c upgrade failed\n", __func__);
+			goto bail2;
+		}
+		rxl++;
+	}
+
+	p = buf;
+	memcpy(p, preface, strlen(preface));
+	p += strlen(preface);
+	p = frame_hdr(p, 6, 4, 0, 0); /* SETTINGS */
+	memcpy(p, "\x00\x03\x7f\xff\xff\xff", 6); /* MAX_CONCURRENT_STREAMS */
+	p += 6;
+	if (send_all(fd, buf, p - buf))
+		goto bail2;
+
+	/* open the streams, with END_HEADERS but not END_STREAM */
+
+	for (n = 0; n < streams; n++) {
+		hb = p = buf + 9;
+		p = hpack_lit(p, ":method", "GET");
+		p = hpack_lit(p, ":scheme", "http");
+		p = hpack_lit(p, ":path", "/");
+		p = hpack_lit(p, ":authority", "localhost");
+		frame_hdr(buf, (int)(p - hb), 1, 4, 3 + (2 * n));
+		if (send_all(fd, buf, p - buf))
+			goto bail2;
+	}
+
+	p = ping(buf);
+	if (send_all(fd, buf, p - buf) || wait_ping_ack(fd))
+		goto bail2;
+
+	lwsl_user("%d streams open, sending %d WINDOW_UPDATEs\n", streams,
+		  frames);
+
+	for (m = 0; m < frames && !interrupted; m += BATCH) {
+		p = buf;
+		for (n = 0; n < BATCH && m + n < frames; n++) {
+			p = frame_hdr(p, 4, 8, 0, 3 + (2 * (rand() % streams)));
+			*p++ = 0;
+			*p++ = 0;
+			*p++ = 0;
+			*p++ = 1;
+		}
+		p = ping(p);
+
+		t = us_now();
+		if (send_all(fd, buf, p - buf) || wait_ping_ack(fd))
+			goto bail2;
+		total += us_now() - t;
+	}
+
+	if (!interrupted) {
+		lwsl_user("%d streams (%d held by server): %llu frames in "
+			  "%lluus, %.3fus per frame\n", streams, held,
+			  (unsigned long long)frames, (unsigned long long)total,
+			  (double)total / (double)frames);
+		result = 0;
+	}
+
+bail2:
+	close(fd);
+bail1:
+	free(buf);
+bail:
+	interrupted = 1;
+	lws_cancel_service(context);
+
+	pthread_exit(NULL);
+
+	return NULL;
+}
+
+void sigint_handler(int sig)
+{
+	interrupted = 1;
+}
+
+static const char *findarg(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc - 1], val))
+			return argv[argc];
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct lws_context_creation_info info;
+	pthread_t pthread_client;
+	const char *p;
+	void *retval;
+	int n = 0;
+
+	signal(SIGINT, sigint_handler);
+
+	if ((p = findarg(argc, argv, "-s")))
+		streams = atoi(p);
+	if ((p = findarg(argc, argv, "-f")))
+		frames = atoi(p);
+	if (streams < 1)
+		streams = 1;
+
+	lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN, NULL);
+	lwsl_user("LWS minimal http server h2 streams bench\n");
+	lwsl_user("   %s [-s <streams>] [-f <frames>]\n", argv[0]);
+
+	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
+	info.options = LWS_SERVER_OPTION_EXPLICIT_VHOSTS;
+	/* each open stream keeps its ah */
+	info.max_http_header_pool = streams + 8;
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	info.port = 7681;
+	info.protocols = protocols;
+	/* context creation filled in the default h2 settings for us */
+	info.http2_settings[0] = 1;
+	info.http2_settings[3] = streams + 8; /* MAX_CONCURRENT_STREAMS */
+
+	if (!lws_create_vhost(context, &info)) {
+		lwsl_err("Failed to create vhost\n");
+		goto bail;
+	}
+
+	if (pthread_create(&pthread_client, NULL, thread_client, NULL)) {
+		lwsl_err("thread creation failed\n");
+		goto bail;
+	}
+
+	while (n >= 0 && !interrupted)
+		n = lws_service(context, 1000);
+
+	pthread_join(pthread_client, &retval);
+
+bail:
+	lws_context_destroy(context);
+
+	lwsl_user("Completed: %s\n", result ? "FAILED" : "OK");
+
+	return result;
+}
@@ -0,0 +1,265 @@
+/*
+ * lws-minimal-http-server-mounts-bench
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This measures how the cost of matching a request's url against the
+ * vhost's mounts changes with the number of mounts.
+ *
+ * It creates a vhost on port 7681 with -m callback mounts (default 2000) at
+ * /api/v1/route0, /api/v1/route1... that answer every request with an empty
+ * 200 carrying an x-rest: header, giving the part of the url after the
+ * mountpoint.  A thread then makes -r keepalive requests (default 20000) for
+ *
+ *  - /api/v1/route<random>/item<n>, which should give x-rest: /item<n>
+ *  - /static/file<n>, which matches no mount and gives the whole url
+ *
+ * checking each response, and reports the average time per request.  Try it
+ * with -m 1 too, to see the part that doesn't depend on the number of mounts.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static struct lws_context *context;
+static int interrupted, mounts = 2000, requests = 20000, result = 1;
+
+static int
+callback_http(struct lws *wsi, enum lws_callback_reasons reason,
+	      void *user, void *in, size_t len)
+{
+	uint8_t buf[LWS_PRE + 256], *start = &buf[LWS_PRE], *p = start,
+		*end = &buf[sizeof(buf) - 1];
+
+	switch (reason) {
+	case LWS_CALLBACK_HTTP:
+		if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK,
+						"text/plain", 0, &p, end))
+			return 1;
+		if (lws_add_http_header_by_name(wsi,
+				(const unsigned char *)"x-rest:",
+				(const unsigned char *)in,
+				(int)strlen((const char *)in), &p, end))
+			return 1;
+		if (lws_finalize_write_http_header(wsi, start, &p, end))
+			return 1;
+
+		if (lws_http_transaction_completed(wsi))
+			return -1;
+
+		return 0;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static struct lws_protocols protocols[] = {
+	{ "http", callback_http, 0, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static uint64_t
+us_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+/*
+ * send one request for url, and check the response has x-rest: rest
+ */
+
+static int
+request(int fd, const char *url, const char *rest)
+{
+	char buf[512], want[128];
+	int n, len = 0;
+
+	n = lws_snprintf(buf, sizeof(buf), "GET %s HTTP/1.1\r\n"
+			 "Host: localhost\r\n\r\n", url);
+	if (send(fd, buf, n, 0) != n)
+		return 1;
+
+	while (len < 4 || memcmp(buf + len - 4, "\r\n\r\n", 4)) {
+		if (len == sizeof(buf) - 1)
+			return 1;
+		n = recv(fd, buf + len, sizeof(buf) - 1 - len, 0);
+		if (n <= 0)
+			return 1;
+		len += n;
+	}
+	buf[len] = '\0';
+
+	lws_snprintf(want, sizeof(want), "x-rest: %s\r\n", rest);
+	if (!strstr(buf, want)) {
+		lwsl_err("%s: %s: wrong mount\n", __func__, url);
+		return 1;
+	}
+
+	return 0;
+}
+
+static void *
+thread_client(void *unused)
+{
+	static const char * const kinds[] = { "mounted", "unmounted" };
+	char url[64], rest[64];
+	struct sockaddr_in sa;
+	uint64_t t;
+	int fd, k, n;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		goto bail;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(7681);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, (struct sockaddr *)&sa, sizeof(sa))) {
+		lwsl_err("%s: unable to connect\n", __func__);
+		goto bail1;
+	}
+
+	for (k = 0; k < (int)LWS_ARRAY_SIZE(kinds); k++) {
+		t = us_now();
+		for (n = 0; n < requests && !interrupted; n++) {
+			if (!k) {
+				lws_snprintf(rest, sizeof(rest), "/item%d", n);
+				lws_snprintf(url, sizeof(url),
+					     "/api/v1/route%d%s",
+					     rand() % mounts, rest);
+			} else {
+				lws_snprintf(url, sizeof(url),
+					     "/static/file%d", n);
+				lws_strncpy(rest, url, sizeof(rest));
+			}
+			if (request(fd, url, rest))
+				goto bail1;
+		}
+		if (interrupted)
+			goto bail1;
+		t = us_now() - t;
+
+		lwsl_user("%d mounts: %-9s url: %d requests in %lluus, "
+			  "%.3fus per request\n", mounts, kinds[k], requests,
+			  (unsigned long long)t, (double)t / (double)requests);
+	}
+
+	result = 0;
+
+bail1:
+	close(fd);
+bail:
+	interrupted = 1;
+	lws_cancel_service(context);
+
+	pthread_exit(NULL);
+
+	return NULL;
+}
+
+void sigint_handler(int sig)
+{
+	interrupted = 1;
+}
+
+static const char *findarg(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc - 1], val))
+			return argv[argc];
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct lws_context_creation_info info;
+	struct lws_http_mount *mount = NULL;
+	char (*mountpoints)[32] = NULL;
+	pthread_t pthread_client;
+	const char *p;
+	void *retval;
+	int n = 0;
+
+	signal(SIGINT, sigint_handler);
+
+	if ((p = findarg(argc, argv, "-m")))
+		mounts = atoi(p);
+	if ((p = findarg(argc, argv, "-r")))
+		requests = atoi(p);
+	if (mounts < 1)
+		mounts = 1;
+
+	lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN, NULL);
+	lwsl_user("LWS minimal http server mounts bench\n");
+	lwsl_user("   %s [-m <mounts>] [-r <requests>]\n", argv[0]);
+
+	/* the mounts must stay around as long as the vhost */
+
+	mount = calloc(mounts, sizeof(*mount));
+	mountpoints = malloc(sizeof(*mountpoints) * mounts);
+	if (!mount || !mountpoints)
+		goto bail;
+
+	for (n = 0; n < mounts; n++) {
+		lws_snprintf(mountpoints[n], sizeof(mountpoints[n]),
+			     "/api/v1/route%d", n);
+		mount[n].mount_next = n + 1 < mounts ? &mount[n + 1] : NULL;
+		mount[n].mountpoint = mountpoints[n];
+		mount[n].mountpoint_len = (unsigned char)strlen(mountpoints[n]);
+		mount[n].protocol = "http";
+		mount[n].origin_protocol = LWSMPRO_CALLBACK;
+	}
+
+	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
+	info.port = 7681;
+	info.protocols = protocols;
+	info.mounts = mount;
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		goto bail;
+	}
+
+	if (pthread_create(&pthread_client, NULL, thread_client, NULL)) {
+		lwsl_err("thread creation failed\n");
+		goto bail1;
+	}
+
+	n = 0;
+	while (n >= 0 && !interrupted)
+		n = lws_service(context, 1000);
+
+	pthread_join(pthread_client, &retval);
+
+bail1:
+	lws_context_destroy(context);
+bail:
+	free(mount);
+	free(mountpoints);
+
+	lwsl_user("Completed: %s\n", result ? "FAILED" : "OK");
+
+	return result;
+}
@@ -0,0 +1,335 @@
+/*
+ * lws-minimal-http-server-parse-bench
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This measures what parsing http/1 request headers costs the server.
+ *
+ * It forks a process that makes -r keepalive requests (default 50000) on one
+ * connection to an lws server in this process on port 7681, which answers
+ * each one with an empty 200.  The requests carry the kind of headers a
+ * browser sends, about 1.2KB of them with a long cookie, and cycle through a
+ * few urls that need urldecoding, ../ removal and splitting into args.
+ *
+ * With -f <bytes>, each request is sent in pieces of that size, so lws sees
+ * the headers arrive in several reads.
+ *
+ * It reports the server's cpu time per request, and a hash of everything the
+ * server saw in the parsed headers, which should be the same however the
+ * requests were split up (and whatever the lws version).  -v also shows what
+ * was parsed from the first request of each kind.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+static const char * const urls[] = {
+	"/static/js/app.3f9a1c2e.js?v=%d&lang=en-US",
+	"/search?q=web+sockets%%20and%%20http%%2F2&page=%d;sort=desc",
+	"/docs/api/../guide/./setup//install.html?rev=%d",
+	"/img/%%E2%%9C%%93/logo%d.png",
+};
+
+static const char *headers =
+	"Host: localhost:7681\r\n"
+	"Connection: keep-alive\r\n"
+	"Cache-Control: max-age=0\r\n"
+	"Upgrade-Insecure-Requests: 1\r\n"
+	"User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+		"(KHTML, like Gecko) Chrome/65.0.3325.181 Safari/537.36\r\n"
+	"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+		"image/webp,image/apng,*/*;q=0.8\r\n"
+	"Referer: http://localhost:7681/index.html\r\n"
+	"Accept-Encoding: gzip, deflate, br\r\n"
+	"Accept-Language: en-GB,en-US;q=0.9,en;q=0.8,de;q=0.7\r\n"
+	"Cookie: _ga=GA1.1.1827416376.1521027617; _gid=GA1.1.998273632."
+		"1523612215; sessionid=8c1f3b0a9e2d4c7f8a6b5e4d3c2b1a0f9e8d7c6b"
+		"5a4f3e2d1c0b9a8f7e6d5c4b3a2f1e0d; csrftoken=Zm9vYmFyYmF6cXV4cX"
+		"V1eHh5enp5eDEyMzQ1Njc4OTBhYmNkZWZnaGlqa2xtbm9wcXJzdHV2d3h5eg; "
+		"prefs=%7B%22theme%22%3A%22dark%22%2C%22tz%22%3A%22Europe%2FLon"
+		"don%22%2C%22lang%22%3A%22en%22%7D; _fbp=fb.1.1523612215373."
+		"1498873260\r\n"
+	"If-None-Match: \"5acf2c6e-1b7f\"\r\n"
+	"If-Modified-Since: Thu, 12 Apr 2018 09:41:02 GMT\r\n"
+	"\r\n";
+
+static int requests = 50000, frag, verbose, served, interrupted;
+static uint32_t hash = 0x811c9dc5;
+
+static void
+fnv(const void *p, int len)
+{
+	const uint8_t *u = (const uint8_t *)p;
+
+	while (len--)
+		hash = (hash ^ *u++) * 16777619;
+}
+
+/* fold everything lws parsed out of the request into the hash */
+
+static void
+account(struct lws *wsi)
+{
+	const unsigned char *name;
+	char buf[2048];
+	int n, f, len;
+
+	for (n = 0; n < WSI_TOKEN_COUNT; n++) {
+		for (f = 0; ; f++) {
+			len = lws_hdr_copy_fragment(wsi, buf, sizeof(buf), n, f);
+			if (len < 0)
+				break;
+
+			fnv(&n, sizeof(n));
+			fnv(buf, len);
+
+			if (!verbose || served >= (int)LWS_ARRAY_SIZE(urls))
+				continue;
+
+			name = lws_token_to_string(n);
+			lwsl_user("  %d.%d %s '%s'\n", n, f,
+				  name ? (const char *)name : "?", buf);
+		}
+	}
+}
+
+static int
+callback_http(struct lws *wsi, enum lws_callback_reasons reason,
+	      void *user, void *in, size_t len)
+{
+	uint8_t buf[LWS_PRE + 256], *start = &buf[LWS_PRE], *p = start,
+		*end = &buf[sizeof(buf) - 1];
+
+	switch (reason) {
+	case LWS_CALLBACK_HTTP:
+		if (verbose && served < (int)LWS_ARRAY_SIZE(urls))
+			lwsl_user("request %d:\n", served);
+		account(wsi);
+		served++;
+
+		if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK,
+						"text/plain", 0, &p, end))
+			return 1;
+		if (lws_finalize_write_http_header(wsi, start, &p, end))
+			return 1;
+
+		if (lws_http_transaction_completed(wsi))
+			return -1;
+
+		return 0;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static struct lws_protocols protocols[] = {
+	{ "http", callback_http, 0, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static uint64_t
+us_cpu(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	return ((uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000) +
+		ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+static int
+request(int fd, int n)
+{
+	char buf[2048];
+	int m, len, sent;
+
+	len = lws_snprintf(buf, sizeof(buf), "GET ");
+	len += lws_snprintf(buf + len, sizeof(buf) - len,
+			    urls[n % LWS_ARRAY_SIZE(urls)], n);
+	len += lws_snprintf(buf + len, sizeof(buf) - len, " HTTP/1.1\r\n%s",
+			    headers);
+
+	for (sent = 0; sent < len; sent += m) {
+		m = len - sent;
+		if (frag && m > frag)
+			m = frag;
+		if (send(fd, buf + sent, m, 0) != m)
+			return 1;
+	}
+
+	len = 0;
+	while (len < 4 || memcmp(buf + len - 4, "\r\n\r\n", 4)) {
+		if (len == sizeof(buf) - 1)
+			return 1;
+		m = recv(fd, buf + len, sizeof(buf) - 1 - len, 0);
+		if (m <= 0)
+			return 1;
+		len += m;
+	}
+
+	return strncmp(buf, "HTTP/1.1 200", 12);
+}
+
+static int
+run_client(int sp)
+{
+	struct sockaddr_in sa;
+	int fd, n = 1;
+	char c;
+
+	/* wait for the server to be listening */
+	if (read(sp, &c, 1) != 1)
+		return 1;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &n, sizeof(n));
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(7681);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, (struct sockaddr *)&sa, sizeof(sa))) {
+		lwsl_err("%s: unable to connect\n", __func__);
+		close(fd);
+		return 1;
+	}
+
+	for (n = 0; n < requests && !interrupted; n++)
+		if (request(fd, n)) {
+			lwsl_err("%s: request %d failed\n", __func__, n);
+			break;
+		}
+
+	close(fd);
+
+	return n != requests;
+}
+
+void sigint_handler(int sig)
+{
+	interrupted = 1;
+}
+
+static const char *findarg(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc - 1], val))
+			return argv[argc];
+	}
+
+	return NULL;
+}
+
+static int findswitch(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc], val))
+			return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct lws_context_creation_info info;
+	struct lws_context *context;
+	int n = 0, fds[2];
+	const char *p;
+	uint64_t cpu;
+	pid_t pid;
+	char c;
+
+	signal(SIGINT, sigint_handler);
+
+	if ((p = findarg(argc, argv, "-r")))
+		requests = atoi(p);
+	if ((p = findarg(argc, argv, "-f")))
+		frag = atoi(p);
+	verbose = findswitch(argc, argv, "-v");
+	if (requests < 1)
+		requests = 1;
+	if (frag < 0)
+		frag = 0;
+
+	lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN, NULL);
+	lwsl_user("LWS minimal http server parse bench\n");
+	lwsl_user("   %s [-r <requests>] [-f <send size>] [-v]\n", argv[0]);
+
+	/*
+	 * The client process tells us how it went over the socketpair, since
+	 * lws may reap it for us (cgi support does waitpid(-1, ...))
+	 */
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+		return 1;
+
+	pid = fork();
+	if (pid < 0)
+		return 1;
+	if (!pid) {
+		close(fds[1]);
+		c = (char)run_client(fds[0]);
+		if (write(fds[0], &c, 1) != 1)
+			exit(1);
+		exit(c);
+	}
+	close(fds[0]);
+
+	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
+	info.port = 7681;
+	info.protocols = protocols;
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		kill(pid, SIGTERM);
+		waitpid(pid, NULL, 0);
+		return 1;
+	}
+
+	cpu = us_cpu();
+
+	if (write(fds[1], "", 1) != 1)
+		interrupted = 1;
+
+	while (n >= 0 && served < requests && !interrupted)
+		n = lws_service(context, 1000);
+
+	cpu = us_cpu() - cpu;
+
+	lws_context_destroy(context);
+
+	n = read(fds[1], &c, 1) != 1 || c || interrupted ||
+	    served != requests;
+	waitpid(pid, NULL, 0);
+
+	if (!n)
+		lwsl_user("%d requests, sent in %d byte pieces: cpu %lluus, "
+			  "%.3fus per request, parsed hash %08x\n", requests,
+			  frag, (unsigned long long)cpu,
+			  (double)cpu / requests, hash);
+
+	lwsl_user("Completed: %s\n", n ? "FAILED" : "OK");
+
+	return n;
+}
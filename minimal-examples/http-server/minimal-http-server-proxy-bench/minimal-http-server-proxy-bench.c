@@ -0,0 +1,392 @@
+/*
+ * lws-minimal-http-server-proxy-bench
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This measures proxied requests/sec through a reverse proxy mount, with and
+ * without the vhost keeping idle connections to the origin for reuse.
+ *
+ * It forks an origin server process on port 7682, which answers every
+ * request with a -s byte body (default 1024).  This process runs a server on
+ * port 7681 with a proxy mount of / to the origin, and -c threads (default 4)
+ * that each make -r keepalive requests (default 5000) through it.
+ *
+ * -i <n> sets the vhost's proxy_pool_max_idle, the default of 0 means every
+ * proxied request makes its own connection to the origin, as before.
+ *
+ * It reports the requests/sec and how many connections the origin accepted.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MAX_CLIENTS 64
+
+static int interrupted, clients = 4, requests = 5000, size = 1024, bad;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile int done_clients;
+static struct lws_context *context;
+static unsigned int origin_conns;
+static uint8_t *body;
+
+/* the origin, in the forked process */
+
+struct pss_origin {
+	int body_pending;
+};
+
+static int
+callback_origin(struct lws *wsi, enum lws_callback_reasons reason,
+		void *user, void *in, size_t len)
+{
+	struct pss_origin *pss = (struct pss_origin *)user;
+	uint8_t buf[LWS_PRE + 256], *start = &buf[LWS_PRE], *p = start,
+		*end = &buf[sizeof(buf) - 1];
+
+	switch (reason) {
+	case LWS_CALLBACK_WSI_CREATE:
+		origin_conns++;
+		break;
+
+	case LWS_CALLBACK_HTTP:
+		if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK,
+						"text/plain", size, &p, end))
+			return 1;
+		if (lws_finalize_write_http_header(wsi, start, &p, end))
+			return 1;
+
+		/* write the body when it's writeable again */
+		pss->body_pending = 1;
+		lws_callback_on_writable(wsi);
+
+		return 0;
+
+	case LWS_CALLBACK_HTTP_WRITEABLE:
+		if (!pss || !pss->body_pending)
+			break;
+		pss->body_pending = 0;
+
+		if (lws_write(wsi, body + LWS_PRE, size,
+			      LWS_WRITE_HTTP_FINAL) != size)
+			return 1;
+
+		if (lws_http_transaction_completed(wsi))
+			return -1;
+
+		return 0;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static struct lws_protocols protocols_origin[] = {
+	{ "http", callback_origin, sizeof(struct pss_origin), 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static int
+run_origin(int fd)
+{
+	struct lws_context_creation_info info;
+	struct lws_context *cx;
+	int n = 0;
+
+	memset(&info, 0, sizeof info);
+	info.port = 7682;
+	info.protocols = protocols_origin;
+	info.fd_limit_per_thread = 4096;
+	info.max_http_header_pool = MAX_CLIENTS;
+
+	cx = lws_create_context(&info);
+	if (!cx)
+		return 1;
+
+	/* tell the proxy we are listening */
+	if (write(fd, "", 1) != 1)
+		interrupted = 1;
+
+	while (n >= 0 && !interrupted)
+		n = lws_service(cx, 100);
+
+	lws_context_destroy(cx);
+
+	/* tell the proxy how many connections we saw */
+	if (write(fd, &origin_conns, sizeof(origin_conns)) !=
+						sizeof(origin_conns))
+		return 1;
+
+	return 0;
+}
+
+/* the proxy, in this process */
+
+static const struct lws_http_mount mount = {
+	/* .mount_next */		NULL,		/* linked-list "next" */
+	/* .mountpoint */		"/",		/* mountpoint URL */
+	/* .origin */			"127.0.0.1:7682/", /* proxied origin */
+	/* .def */			NULL,		/* default filename */
+	/* .protocol */			NULL,
+	/* .cgienv */			NULL,
+	/* .extra_mimetypes */		NULL,
+	/* .interpret */		NULL,
+	/* .cgi_timeout */		0,
+	/* .cache_max_age */		0,
+	/* .auth_mask */		0,
+	/* .cache_reusable */		0,
+	/* .cache_revalidate */		0,
+	/* .cache_intermediaries */	0,
+	/* .origin_protocol */		LWSMPRO_HTTP,	/* proxy over http */
+	/* .mountpoint_len */		1,		/* char count */
+	/* .basic_auth_login_file */	NULL,
+};
+
+static struct lws_protocols protocols[] = {
+	{ "http", lws_callback_http_dummy, 0, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static uint64_t
+us_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+static int
+request(int fd, int n, char *buf, int len)
+{
+	int m, hl = 0, got = 0;
+	char *p;
+
+	m = lws_snprintf(buf, len, "GET /item/%d HTTP/1.1\r\n"
+			 "Host: localhost\r\n\r\n", n);
+	if (send(fd, buf, m, 0) != m)
+		return 1;
+
+	/* the headers, and whatever part of the body came with them */
+
+	do {
+		if (got == len - 1)
+			return 1;
+		m = recv(fd, buf + got, len - 1 - got, 0);
+		if (m <= 0)
+			return 1;
+		got += m;
+		buf[got] = '\0';
+		p = strstr(buf, "\r\n\r\n");
+	} while (!p);
+
+	hl = lws_ptr_diff(p, buf) + 4;
+	if (strncmp(buf, "HTTP/1.1 200", 12)) {
+		lwsl_err("%s: bad response %.12s\n", __func__, buf);
+		return 1;
+	}
+
+	/* the rest of the body */
+
+	got -= hl;
+	while (got < size) {
+		m = recv(fd, buf, len, 0);
+		if (m <= 0)
+			return 1;
+		got += m;
+	}
+
+	return got != size;
+}
+
+static void *
+thread_client(void *d)
+{
+	struct sockaddr_in sa;
+	char buf[4096];
+	int fd, n;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		goto bail;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(7681);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, (struct sockaddr *)&sa, sizeof(sa))) {
+		lwsl_err("%s: unable to connect\n", __func__);
+		goto bail1;
+	}
+
+	for (n = 0; n < requests && !interrupted; n++)
+		if (request(fd, n, buf, sizeof(buf))) {
+			lwsl_err("%s: request %d failed\n", __func__, n);
+			goto bail1;
+		}
+
+	close(fd);
+	goto out;
+
+bail1:
+	close(fd);
+bail:
+	bad = 1;
+out:
+	pthread_mutex_lock(&lock);
+	done_clients++;
+	pthread_mutex_unlock(&lock);
+	lws_cancel_service(context);
+
+	pthread_exit(NULL);
+
+	return NULL;
+}
+
+void sigint_handler(int sig)
+{
+	interrupted = 1;
+}
+
+static const char *findarg(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc - 1], val))
+			return argv[argc];
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct lws_context_creation_info info;
+	pthread_t pthread_client[MAX_CLIENTS];
+	int n = 0, fds[2], started = 0;
+	const char *p;
+	void *retval;
+	uint64_t t = 0;
+	pid_t pid;
+	char c;
+
+	signal(SIGINT, sigint_handler);
+
+	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
+
+	if ((p = findarg(argc, argv, "-c")))
+		clients = atoi(p);
+	if ((p = findarg(argc, argv, "-r")))
+		requests = atoi(p);
+	if ((p = findarg(argc, argv, "-s")))
+		size = atoi(p);
+	if ((p = findarg(argc, argv, "-i")))
+		info.proxy_pool_max_idle = atoi(p);
+	if (clients < 1)
+		clients = 1;
+	if (clients > MAX_CLIENTS)
+		clients = MAX_CLIENTS;
+	if (requests < 1)
+		requests = 1;
+	if (size < 1 || size > 65536)
+		size = 1024;
+
+	lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN, NULL);
+	lwsl_user("LWS minimal http server proxy bench\n");
+	lwsl_user("   %s [-c <clients>] [-r <requests each>] [-s <body size>] "
+		  "[-i <pool max idle>]\n", argv[0]);
+
+	body = malloc(LWS_PRE + size);
+	if (!body || socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+		return 1;
+	memset(body + LWS_PRE, 'x', size);
+
+	/*
+	 * The origin process tells us when it's listening, and at the end how
+	 * many connections it saw, over the socketpair
+	 */
+
+	pid = fork();
+	if (pid < 0)
+		return 1;
+	if (!pid) {
+		close(fds[1]);
+		signal(SIGTERM, sigint_handler);
+		exit(run_origin(fds[0]));
+	}
+	close(fds[0]);
+
+	if (read(fds[1], &c, 1) != 1) {
+		lwsl_err("origin failed to start\n");
+		waitpid(pid, NULL, 0);
+		return 1;
+	}
+
+	info.port = 7681;
+	info.protocols = protocols;
+	info.mounts = &mount;
+	info.fd_limit_per_thread = 4096;
+	/* each client holds an ah, and so does its connection to the origin */
+	info.max_http_header_pool = clients * 2;
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		bad = 1;
+		goto bail;
+	}
+
+	t = us_now();
+
+	for (started = 0; started < clients; started++)
+		if (pthread_create(&pthread_client[started], NULL,
+				   thread_client, NULL)) {
+			lwsl_err("thread creation failed\n");
+			bad = 1;
+			break;
+		}
+
+	while (n >= 0 && done_clients < started && !interrupted)
+		n = lws_service(context, 1000);
+
+	t = us_now() - t;
+
+	while (started--)
+		pthread_join(pthread_client[started], &retval);
+
+	lws_context_destroy(context);
+
+bail:
+	kill(pid, SIGTERM);
+	if (read(fds[1], &origin_conns, sizeof(origin_conns)) !=
+						sizeof(origin_conns))
+		bad = 1;
+	waitpid(pid, NULL, 0);
+
+	if (!bad && !interrupted && t)
+		lwsl_user("pool max idle %u: %d x %d requests of %dB: "
+			  "%.0f req/s, %u connections to the origin\n",
+			  info.proxy_pool_max_idle, clients, requests, size,
+			  (double)clients * requests * 1000000.0 / t,
+			  origin_conns);
+
+	free(body);
+
+	lwsl_user("Completed: %s\n", bad || interrupted ? "FAILED" : "OK");
+
+	return bad || interrupted;
+}
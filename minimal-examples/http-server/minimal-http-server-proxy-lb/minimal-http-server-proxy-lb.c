@@ -0,0 +1,515 @@
+/*
+ * lws-minimal-http-server-proxy-lb
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This demonstrates a reverse proxy mount spreading requests over several
+ * origins, and ejecting one that fails.
+ *
+ * It forks -o origin servers (default 3) on ports 7682 upwards, each answers
+ * with a body saying which origin it is, and answers its health check path
+ * /health with a 200.  This process serves port 7681 with a mount of / that
+ * lists all the origins, with active health checks every second, and -c
+ * threads (default 4) that each make -r keepalive requests (default 500)
+ * through it.
+ *
+ * With -f <n>, origin n starts failing after it served -k requests (default
+ * 50): it hangs up on requests without answering, and answers its health
+ * checks with a 503.  The proxy should eject it after the first failure and
+ * keep it out, with the clients only seeing a 502 for the few requests that
+ * were already on their way to it.  That's at most one per client, since
+ * each only has one request in flight.
+ *
+ * With -h, requests are spread by hashing their "session" cookie instead of
+ * by least outstanding requests.  The clients use 32 different sessions and
+ * check each one always gets the same origin, except the sessions that move
+ * away from a failed origin.
+ *
+ * With -i <n>, the proxy keeps idle origin connections in a pool and reuses
+ * them, and the origins hang up without answering the nth request on any
+ * connection, the way an origin's keepalive timeout closes a connection just
+ * as the proxy reuses it.  The proxy should retry those requests on a new
+ * connection, so the clients see no 502 and no origin is ejected.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MAX_ORIGINS 8
+#define MAX_CLIENTS 32
+#define SESSIONS 32
+
+static int interrupted, origins = 3, clients = 4, requests = 500, faulty = -1,
+	   fault_after = 50, hashed, idle_close, bad;
+static int served[MAX_ORIGINS], gateway_errors, session_origin[SESSIONS],
+	   session_moves;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile int done_clients;
+static struct lws_context *context;
+static int origin_index, origin_served;
+
+/*
+ * requests so far on each origin connection, by fd... the per-session data is
+ * freed at the end of each http transaction, so it can't keep count
+ */
+static int conn_requests[1024];
+
+/* the origins, in forked processes */
+
+static int
+callback_origin(struct lws *wsi, enum lws_callback_reasons reason,
+		void *user, void *in, size_t len)
+{
+	uint8_t buf[LWS_PRE + 256], *start = &buf[LWS_PRE], *p = start,
+		*end = &buf[sizeof(buf) - 1];
+	int *pending = (int *)user, n, failing, fd;
+
+	switch (reason) {
+	case LWS_CALLBACK_FILTER_NETWORK_CONNECTION:
+		fd = (int)(lws_intptr_t)in;
+		if (fd >= 0 && fd < (int)LWS_ARRAY_SIZE(conn_requests))
+			conn_requests[fd] = 0;
+		break;
+
+	case LWS_CALLBACK_HTTP:
+		failing = origin_index == faulty &&
+			  origin_served >= fault_after;
+
+		if (!strcmp((const char *)in, "/health")) {
+			if (lws_return_http_status(wsi, failing ?
+					HTTP_STATUS_SERVICE_UNAVAILABLE :
+					HTTP_STATUS_OK, NULL))
+				return -1;
+
+			goto completed;
+		}
+
+		if (failing)
+			/* hang up on it without answering */
+			return -1;
+
+		fd = lws_get_socket_fd(wsi);
+		if (idle_close && fd >= 0 &&
+		    fd < (int)LWS_ARRAY_SIZE(conn_requests) &&
+		    ++conn_requests[fd] == idle_close)
+			/* as if our keepalive timeout just closed it */
+			return -1;
+
+		origin_served++;
+		/* "origin n\n" */
+		if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK,
+						"text/plain", 9, &p, end))
+			return 1;
+		if (lws_finalize_write_http_header(wsi, start, &p, end))
+			return 1;
+
+		/* write the body when it's writeable again */
+		*pending = 1;
+		lws_callback_on_writable(wsi);
+
+		return 0;
+
+	case LWS_CALLBACK_HTTP_WRITEABLE:
+		if (!pending || !*pending)
+			break;
+		*pending = 0;
+
+		n = lws_snprintf((char *)start, 32, "origin %d\n",
+				 origin_index);
+		if (lws_write(wsi, start, n, LWS_WRITE_HTTP_FINAL) != n)
+			return 1;
+
+completed:
+		if (lws_http_transaction_completed(wsi))
+			return -1;
+
+		return 0;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static struct lws_protocols protocols_origin[] = {
+	{ "http", callback_origin, sizeof(int), 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static int
+run_origin(int fd)
+{
+	struct lws_context_creation_info info;
+	struct lws_context *cx;
+	int n = 0;
+
+	memset(&info, 0, sizeof info);
+	info.port = 7682 + origin_index;
+	info.protocols = protocols_origin;
+
+	cx = lws_create_context(&info);
+	if (!cx)
+		return 1;
+
+	/* tell the proxy we are listening */
+	if (write(fd, "", 1) != 1)
+		interrupted = 1;
+
+	while (n >= 0 && !interrupted)
+		n = lws_service(cx, 100);
+
+	lws_context_destroy(cx);
+
+	return 0;
+}
+
+/* the proxy, in this process */
+
+static char origin_list[MAX_ORIGINS * 24];
+
+static struct lws_http_mount mount = {
+	/* .mount_next */		NULL,		/* linked-list "next" */
+	/* .mountpoint */		"/",		/* mountpoint URL */
+	/* .origin */			origin_list,	/* proxied origins */
+	/* .def */			NULL,		/* default filename */
+	/* .protocol */			NULL,
+	/* .cgienv */			NULL,
+	/* .extra_mimetypes */		NULL,
+	/* .interpret */		NULL,
+	/* .cgi_timeout */		0,
+	/* .cache_max_age */		0,
+	/* .auth_mask */		0,
+	/* .cache_reusable */		0,
+	/* .cache_revalidate */		0,
+	/* .cache_intermediaries */	0,
+	/* .origin_protocol */		LWSMPRO_HTTP,	/* proxy over http */
+	/* .mountpoint_len */		1,		/* char count */
+	/* .basic_auth_login_file */	NULL,
+	/* .proxy_lb_key */		"cookie:session",
+	/* .proxy_health_path */	"/health",
+	/* .proxy_health_secs */	1,
+	/* .proxy_eject_secs */		5,
+};
+
+static struct lws_protocols protocols[] = {
+	{ "http", lws_callback_http_dummy, 0, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static int
+connect_proxy(void)
+{
+	struct sockaddr_in sa;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(7681);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, (struct sockaddr *)&sa, sizeof(sa))) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*
+ * returns the origin that answered, -2 for a 502, or -1 if the connection
+ * failed
+ */
+
+static int
+request(int fd, int session, char *buf, int len)
+{
+	int m, got = 0, cl = 0, status;
+	char *p, *q;
+
+	m = lws_snprintf(buf, len, "GET /item HTTP/1.1\r\n"
+			 "Host: localhost\r\n"
+			 "Cookie: theme=dark; session=user%d\r\n\r\n", session);
+	if (send(fd, buf, m, 0) != m)
+		return -1;
+
+	do {
+		if (got == len - 1)
+			return -1;
+		m = recv(fd, buf + got, len - 1 - got, 0);
+		if (m <= 0)
+			return -1;
+		got += m;
+		buf[got] = '\0';
+		p = strstr(buf, "\r\n\r\n");
+	} while (!p);
+
+	status = atoi(buf + 9);
+	q = strstr(buf, "content-length: ");
+	if (q && q < p)
+		cl = atoi(q + 16);
+
+	/* the rest of the body */
+
+	p += 4;
+	while (lws_ptr_diff(buf + got, p) < cl) {
+		if (got == len - 1)
+			return -1;
+		m = recv(fd, buf + got, len - 1 - got, 0);
+		if (m <= 0)
+			return -1;
+		got += m;
+		buf[got] = '\0';
+	}
+
+	if (status == HTTP_STATUS_BAD_GATEWAY)
+		return -2;
+	if (status != HTTP_STATUS_OK || strncmp(p, "origin ", 7)) {
+		lwsl_err("%s: unexpected status %d\n", __func__, status);
+		return -1;
+	}
+
+	return atoi(p + 7);
+}
+
+static void *
+thread_client(void *d)
+{
+	int fd = -1, n, o, session;
+	char buf[4096];
+
+	for (n = 0; n < requests && !interrupted; n++) {
+		if (fd < 0)
+			fd = connect_proxy();
+		if (fd < 0) {
+			lwsl_err("%s: unable to connect\n", __func__);
+			goto bail;
+		}
+
+		session = (n + lws_ptr_diff(d, NULL)) % SESSIONS;
+		o = request(fd, session, buf, sizeof(buf));
+
+		pthread_mutex_lock(&lock);
+		if (o >= 0 && o < origins) {
+			served[o]++;
+			if (hashed && session_origin[session] != o) {
+				if (session_origin[session] >= 0)
+					session_moves++;
+				session_origin[session] = o;
+			}
+		} else
+			gateway_errors++;
+		pthread_mutex_unlock(&lock);
+
+		if (o == -1) {
+			/* the connection went down, start another */
+			lwsl_err("%s: request %d failed\n", __func__, n);
+			close(fd);
+			fd = -1;
+		}
+	}
+
+	goto out;
+
+bail:
+	bad = 1;
+out:
+	if (fd >= 0)
+		close(fd);
+
+	pthread_mutex_lock(&lock);
+	done_clients++;
+	pthread_mutex_unlock(&lock);
+	lws_cancel_service(context);
+
+	pthread_exit(NULL);
+
+	return NULL;
+}
+
+void sigint_handler(int sig)
+{
+	interrupted = 1;
+}
+
+static const char *findarg(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc - 1], val))
+			return argv[argc];
+	}
+
+	return NULL;
+}
+
+static int findswitch(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc], val))
+			return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct lws_context_creation_info info;
+	pthread_t pthread_client[MAX_CLIENTS];
+	int n = 0, m, fds[2], started = 0, limit;
+	pid_t pid[MAX_ORIGINS];
+	const char *p;
+	void *retval;
+	char c;
+
+	signal(SIGINT, sigint_handler);
+
+	if ((p = findarg(argc, argv, "-o")))
+		origins = atoi(p);
+	if ((p = findarg(argc, argv, "-c")))
+		clients = atoi(p);
+	if ((p = findarg(argc, argv, "-r")))
+		requests = atoi(p);
+	if ((p = findarg(argc, argv, "-f")))
+		faulty = atoi(p);
+	if ((p = findarg(argc, argv, "-k")))
+		fault_after = atoi(p);
+	if ((p = findarg(argc, argv, "-i")))
+		idle_close = atoi(p);
+	hashed = findswitch(argc, argv, "-h");
+	if (origins < 1 || origins > MAX_ORIGINS)
+		origins = 3;
+	if (clients < 1 || clients > MAX_CLIENTS)
+		clients = 4;
+	if (requests < 1)
+		requests = 1;
+	if (idle_close == 1)
+		/* a new connection must get its first request answered */
+		idle_close = 2;
+
+	lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN | LLL_NOTICE, NULL);
+	lwsl_user("LWS minimal http server proxy lb\n");
+	lwsl_user("   %s [-o <origins>] [-c <clients>] [-r <requests each>] "
+		  "[-f <faulty origin> [-k <after requests>]] [-h] "
+		  "[-i <requests per origin connection>]\n", argv[0]);
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+		return 1;
+
+	/* each origin tells us when it's listening over the socketpair */
+
+	for (n = 0; n < origins; n++) {
+		pid[n] = fork();
+		if (pid[n] < 0)
+			return 1;
+		if (!pid[n]) {
+			close(fds[1]);
+			signal(SIGTERM, sigint_handler);
+			origin_index = n;
+			exit(run_origin(fds[0]));
+		}
+
+		if (read(fds[1], &c, 1) != 1) {
+			lwsl_err("origin %d failed to start\n", n);
+			origins = n;
+			bad = 1;
+			goto bail;
+		}
+
+		lws_snprintf(origin_list + strlen(origin_list),
+			     sizeof(origin_list) - strlen(origin_list),
+			     "%s127.0.0.1:%d/", n ? "," : "", 7682 + n);
+	}
+
+	for (n = 0; n < SESSIONS; n++)
+		session_origin[n] = -1;
+
+	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
+	info.port = 7681;
+	info.protocols = protocols;
+	info.mounts = &mount;
+	/* each client holds an ah, and so does its connection to the origin */
+	info.max_http_header_pool = clients * 2 + origins;
+	mount.proxy_lb = hashed ? LWSPLB_HASH : LWSPLB_LEAST_OUTSTANDING;
+	if (idle_close) {
+		info.proxy_pool_max_idle = clients * 2;
+		info.max_http_header_pool += clients * 2;
+	}
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		bad = 1;
+		goto bail;
+	}
+
+	for (started = 0; started < clients; started++)
+		if (pthread_create(&pthread_client[started], NULL,
+				   thread_client,
+				   (char *)NULL + started * 7)) {
+			lwsl_err("thread creation failed\n");
+			bad = 1;
+			break;
+		}
+
+	n = 0;
+	while (n >= 0 && done_clients < started && !interrupted)
+		n = lws_service(context, 1000);
+
+	while (started--)
+		pthread_join(pthread_client[started], &retval);
+
+	lws_context_destroy(context);
+
+bail:
+	for (n = 0; n < origins; n++) {
+		kill(pid[n], SIGTERM);
+		waitpid(pid[n], NULL, 0);
+	}
+
+	if (!bad && !interrupted) {
+		for (n = 0, m = 0; n < origins; n++) {
+			lwsl_user("origin %d: %d requests\n", n, served[n]);
+			m += served[n];
+		}
+		lwsl_user("%d ok, %d 502, %d sessions moved origin\n", m,
+			  gateway_errors, session_moves);
+
+		/*
+		 * Only the requests already on their way to the faulty origin
+		 * when it started failing should have seen a 502, and after
+		 * that it should have got nothing.  Sessions should only have
+		 * moved away from it.
+		 */
+		limit = faulty >= 0 ? clients : 0;
+		if (gateway_errors > limit)
+			bad = 1;
+		if (faulty >= 0 && faulty < origins &&
+		    served[faulty] != fault_after)
+			bad = 1;
+		if (session_moves > (faulty >= 0 ? SESSIONS : 0))
+			bad = 1;
+		for (n = 0; n < origins; n++)
+			if (n != faulty && !served[n] && !hashed)
+				bad = 1;
+	}
+
+	lwsl_user("Completed: %s\n", bad || interrupted ? "FAILED" : "OK");
+
+	return bad || interrupted;
+}
@@ -16,11 +16,15 @@
  * the real number of threads possible is decided by the LWS_MAX_SMP that lws
  * was configured with, by default that is 1.  Lws will limit the number of
  * requested threads to the number possible.
+ *
+ * Give -l to keep each connection on the service thread whose listen socket
+ * accepted it, and -a to bind service thread n to cpu n.
  */
 
 #include <libwebsockets.h>
 #include <string.h>
 #include <signal.h>
+#include <unistd.h>
 #include <pthread.h>
 
 #define COUNT_THREADS 8
@@ -64,10 +68,21 @@ void sigint_handler(int sig)
 	lws_cancel_service(context);
 }
 
+static int findswitch(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc], val))
+			return argc;
+	}
+
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
 	pthread_t pthread_service[COUNT_THREADS];
 	struct lws_context_creation_info info;
+	int cpus[COUNT_THREADS];
 	void *retval;
 	int n = 0;
 
@@ -79,6 +94,16 @@ int main(int argc, char **argv)
 	// info.max_http_header_pool = 10;
 	info.count_threads = COUNT_THREADS;
 
+	if (findswitch(argc, argv, "-l"))
+		info.options |= LWS_SERVER_OPTION_SMP_ACCEPT_LOCAL;
+
+	if (findswitch(argc, argv, "-a")) {
+		for (n = 0; n < COUNT_THREADS; n++)
+			cpus[n] = n % sysconf(_SC_NPROCESSORS_ONLN);
+		info.pt_cpu_affinity = cpus;
+		n = 0;
+	}
+
 	lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN | LLL_NOTICE
 			/* for LLL_ verbosity above NOTICE to be built into lws,
 			 * lws must have been configured and built with
@@ -0,0 +1,543 @@
+/*
+ * lws-minimal-http-server-tls-handshake-storm-bench
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This measures how much a storm of new tls connections delays the
+ * connections a server already has, with the handshakes done on the service
+ * thread and then on a pool of -t worker threads (info.tls_handshake_threads).
+ *
+ * It forks a server listening on :7681 (using the selfsigned localhost cert
+ * here, so run it from this directory) with one service thread, which echoes
+ * ws messages and answers http GETs.  This process opens -c wss connections
+ * to it, and each sends a timestamp every 10ms and times the echo.  Then it
+ * forks -s storm processes that each keep -p https requests in flight, every
+ * one on a new connection with a full handshake, for -d seconds.
+ *
+ * For each it reports the echo round trip times during the storm and how
+ * many storm connections completed.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define MAX_CLIENTS 256
+#define MAX_STORMS 32
+#define MAX_SAMPLES 200000
+#define ECHO_INTERVAL_US 10000
+
+struct pss_echo {
+	unsigned char buf[LWS_PRE + 64];
+	size_t len;
+};
+
+struct conn {
+	int waiting;
+};
+
+static struct conn conns[MAX_CLIENTS];
+static uint32_t samples[MAX_SAMPLES];
+static int threads = 4, storms = 4, parallel = 4, clients = 16, secs = 5,
+	   interrupted, established, measuring, count_samples, failed,
+	   inflight, done;
+
+static uint64_t
+us_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+static void
+sigterm_handler(int sig)
+{
+	interrupted = 1;
+}
+
+/* the server, in a forked process */
+
+static int
+callback_server(struct lws *wsi, enum lws_callback_reasons reason,
+		void *user, void *in, size_t len)
+{
+	switch (reason) {
+	case LWS_CALLBACK_HTTP:
+		if (lws_return_http_status(wsi, HTTP_STATUS_OK, NULL))
+			return -1;
+		if (lws_http_transaction_completed(wsi))
+			return -1;
+
+		return 0;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static int
+callback_echo(struct lws *wsi, enum lws_callback_reasons reason,
+	      void *user, void *in, size_t len)
+{
+	struct pss_echo *pss = (struct pss_echo *)user;
+
+	switch (reason) {
+	case LWS_CALLBACK_RECEIVE:
+		if (len > sizeof(pss->buf) - LWS_PRE)
+			return -1;
+		memcpy(pss->buf + LWS_PRE, in, len);
+		pss->len = len;
+		lws_callback_on_writable(wsi);
+		break;
+
+	case LWS_CALLBACK_SERVER_WRITEABLE:
+		if (!pss->len)
+			break;
+		if (lws_write(wsi, pss->buf + LWS_PRE, pss->len,
+			      LWS_WRITE_BINARY) < (int)pss->len)
+			return -1;
+		pss->len = 0;
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static struct lws_protocols protocols_server[] = {
+	{ "http", callback_server, 0, 0 },
+	{ "echo", callback_echo, sizeof(struct pss_echo), 64 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static int
+run_server(int fd_ready, int pool_threads)
+{
+	struct lws_context_creation_info info;
+	struct lws_context *cx;
+	int n = 0;
+
+	signal(SIGTERM, sigterm_handler);
+
+	memset(&info, 0, sizeof info);
+	info.port = 7681;
+	info.protocols = protocols_server;
+	info.options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+	info.ssl_cert_filepath = "localhost-100y.cert";
+	info.ssl_private_key_filepath = "localhost-100y.key";
+	info.max_http_header_pool = 64;
+	info.tls_handshake_threads = pool_threads;
+
+	cx = lws_create_context(&info);
+	if (!cx)
+		return 1;
+
+	/* tell the bench we are listening */
+	if (write(fd_ready, "", 1) != 1)
+		interrupted = 1;
+
+	while (n >= 0 && !interrupted)
+		n = lws_service(cx, 100);
+
+	lws_context_destroy(cx);
+
+	return 0;
+}
+
+/* the storm, in forked processes: new https connections, one after another */
+
+static int
+callback_storm(struct lws *wsi, enum lws_callback_reasons reason,
+	       void *user, void *in, size_t len)
+{
+	char buf[LWS_PRE + 1024], *px = buf + LWS_PRE;
+	int lenx = sizeof(buf) - LWS_PRE;
+
+	switch (reason) {
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		failed++;
+		inflight--;
+		break;
+
+	case LWS_CALLBACK_RECEIVE_CLIENT_HTTP:
+		if (lws_http_client_read(wsi, &px, &lenx) < 0)
+			return -1;
+		return 0;
+
+	case LWS_CALLBACK_RECEIVE_CLIENT_HTTP_READ:
+		return 0; /* we don't need the body */
+
+	case LWS_CALLBACK_COMPLETED_CLIENT_HTTP:
+		done++;
+		/* close it, so the next request makes a new connection */
+		return -1;
+
+	case LWS_CALLBACK_CLOSED_CLIENT_HTTP:
+		inflight--;
+		/* let the service loop start the next one straight away */
+		lws_cancel_service(lws_get_context(wsi));
+		break;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static const struct lws_protocols protocols_storm[] = {
+	{ "http", callback_storm, 0, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static int
+run_storm(int fd_stats)
+{
+	struct lws_context_creation_info info;
+	struct lws_client_connect_info i;
+	struct lws_context *cx;
+	int n = 0;
+
+	signal(SIGTERM, sigterm_handler);
+
+	memset(&info, 0, sizeof info);
+	info.port = CONTEXT_PORT_NO_LISTEN;
+	info.protocols = protocols_storm;
+	info.options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+
+	cx = lws_create_context(&info);
+	if (!cx)
+		return 1;
+
+	memset(&i, 0, sizeof i);
+	i.context = cx;
+	i.address = "127.0.0.1";
+	i.port = 7681;
+	i.ssl_connection = LCCSCF_USE_SSL | LCCSCF_ALLOW_SELFSIGNED;
+	i.path = "/";
+	i.host = "localhost";
+	i.origin = "localhost";
+	i.method = "GET";
+	i.protocol = protocols_storm[0].name;
+
+	while (n >= 0 && !interrupted) {
+		while (inflight < parallel) {
+			inflight++;
+			if (!lws_client_connect_via_info(&i)) {
+				inflight--;
+				failed++;
+				break;
+			}
+		}
+		n = lws_service(cx, 1000);
+	}
+
+	if (write(fd_stats, &done, sizeof(done)) != sizeof(done))
+		lwsl_err("%s: stats write failed\n", __func__);
+
+	lws_context_destroy(cx);
+
+	return 0;
+}
+
+/* the echo clients, in this process */
+
+static int
+callback_client(struct lws *wsi, enum lws_callback_reasons reason,
+		void *user, void *in, size_t len)
+{
+	unsigned char buf[LWS_PRE + sizeof(uint64_t)];
+	struct conn *conn = (struct conn *)user;
+	uint64_t t;
+
+	switch (reason) {
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		lwsl_err("CLIENT_CONNECTION_ERROR: %s\n",
+			 in ? (char *)in : "(null)");
+		failed++;
+		break;
+
+	case LWS_CALLBACK_CLIENT_ESTABLISHED:
+		established++;
+		lws_set_timer_usecs(wsi, ECHO_INTERVAL_US);
+		break;
+
+	case LWS_CALLBACK_TIMER:
+		/* one echo outstanding at a time, a late one delays the next */
+		if (!conn->waiting)
+			lws_callback_on_writable(wsi);
+		lws_set_timer_usecs(wsi, ECHO_INTERVAL_US);
+		break;
+
+	case LWS_CALLBACK_CLIENT_WRITEABLE:
+		t = us_now();
+		memcpy(buf + LWS_PRE, &t, sizeof(t));
+		if (lws_write(wsi, buf + LWS_PRE, sizeof(t),
+			      LWS_WRITE_BINARY) < (int)sizeof(t))
+			return -1;
+		conn->waiting = 1;
+		break;
+
+	case LWS_CALLBACK_CLIENT_RECEIVE:
+		if (len != sizeof(t))
+			return -1;
+		memcpy(&t, in, sizeof(t));
+		if (measuring && count_samples < MAX_SAMPLES)
+			samples[count_samples++] = (uint32_t)(us_now() - t);
+		conn->waiting = 0;
+		break;
+
+	case LWS_CALLBACK_CLIENT_CLOSED:
+		if (measuring)
+			failed++;
+		established--;
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static const struct lws_protocols protocols[] = {
+	{ "echo", callback_client, 0, 64 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static int
+sample_cmp(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int
+run_phase(struct lws_context *context, const char *name, int pool_threads)
+{
+	struct lws_context_creation_info info;
+	struct lws_client_connect_info i;
+	int fds_ready[2], fds_stats[2], n = 0, m, s = 0, bad = 1, storm_done = 0;
+	pid_t server, pids[MAX_STORMS];
+	uint64_t total = 0, end;
+	struct lws_vhost *vh;
+	char c;
+
+	memset(&info, 0, sizeof info);
+	info.port = CONTEXT_PORT_NO_LISTEN;
+	info.protocols = protocols;
+	info.options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+	info.vhost_name = name;
+	vh = lws_create_vhost(context, &info);
+	if (!vh)
+		return 1;
+
+	if (pipe(fds_ready))
+		return 1;
+	if (pipe(fds_stats)) {
+		close(fds_ready[0]);
+		close(fds_ready[1]);
+		return 1;
+	}
+
+	server = fork();
+	if (!server) {
+		close(fds_ready[0]);
+		close(fds_stats[0]);
+		exit(run_server(fds_ready[1], pool_threads));
+	}
+	close(fds_ready[1]);
+
+	failed = server < 0 || read(fds_ready[0], &c, 1) != 1;
+	close(fds_ready[0]);
+	if (failed) {
+		lwsl_err("server failed to start\n");
+		goto reap;
+	}
+
+	/* get the echo connections up before the storm starts */
+
+	memset(&i, 0, sizeof i);
+	i.context = context;
+	i.vhost = vh;
+	i.address = "127.0.0.1";
+	i.port = 7681;
+	i.ssl_connection = LCCSCF_USE_SSL | LCCSCF_ALLOW_SELFSIGNED;
+	i.path = "/";
+	i.host = "localhost";
+	i.origin = "localhost";
+	i.protocol = protocols[0].name;
+
+	memset(conns, 0, sizeof(conns));
+	established = count_samples = 0;
+	for (m = 0; m < clients; m++) {
+		i.userdata = &conns[m];
+		if (!lws_client_connect_via_info(&i))
+			failed++;
+	}
+
+	end = us_now() + 5000000;
+	while (n >= 0 && !interrupted && !failed && established < clients &&
+	       us_now() < end)
+		n = lws_service(context, 100);
+
+	if (established < clients) {
+		lwsl_err("%s: only %d of %d echo connections came up\n",
+			 __func__, established, clients);
+		failed = 1;
+		goto close;
+	}
+
+	for (s = 0; s < storms; s++) {
+		pids[s] = fork();
+		if (pids[s] < 0)
+			break;
+		if (!pids[s]) {
+			close(fds_stats[0]);
+			exit(run_storm(fds_stats[1]));
+		}
+	}
+
+	measuring = 1;
+	end = us_now() + (uint64_t)secs * 1000000;
+	while (n >= 0 && !interrupted && !failed && us_now() < end)
+		n = lws_service(context, 100);
+	measuring = 0;
+
+	for (m = 0; m < s; m++) {
+		kill(pids[m], SIGTERM);
+		waitpid(pids[m], NULL, 0);
+		if (read(fds_stats[0], &n, sizeof(n)) == sizeof(n))
+			storm_done += n;
+	}
+
+close:
+	lws_vhost_destroy(vh);
+	/* let the echo connections close, before the server goes */
+	for (m = 0; m < 10; m++)
+		lws_service(context, 10);
+
+reap:
+	if (server > 0) {
+		kill(server, SIGTERM);
+		waitpid(server, NULL, 0);
+	}
+	close(fds_stats[1]);
+	close(fds_stats[0]);
+
+	if (failed || s != storms || !count_samples || !storm_done)
+		return 1;
+
+	qsort(samples, count_samples, sizeof(samples[0]), sample_cmp);
+	for (m = 0; m < count_samples; m++)
+		total += samples[m];
+
+	lwsl_user("%s: %d storm connections (%d/s), %d echoes\n", name,
+		  storm_done, storm_done / secs, count_samples);
+	lwsl_user("%s: echo rtt mean %.2fms, p50 %.2fms, p99 %.2fms, "
+		  "max %.2fms\n", name,
+		  (double)total / count_samples / 1000.0,
+		  samples[count_samples / 2] / 1000.0,
+		  samples[(count_samples * 99) / 100] / 1000.0,
+		  samples[count_samples - 1] / 1000.0);
+
+	bad = 0;
+
+	return bad;
+}
+
+void sigint_handler(int sig)
+{
+	interrupted = 1;
+}
+
+static const char *findarg(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc - 1], val))
+			return argv[argc];
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct lws_context_creation_info info;
+	struct lws_context *context;
+	const char *p;
+	char name[32];
+	int bad = 1;
+
+	signal(SIGINT, sigint_handler);
+
+	if ((p = findarg(argc, argv, "-t")))
+		threads = atoi(p);
+	if ((p = findarg(argc, argv, "-s")))
+		storms = atoi(p);
+	if ((p = findarg(argc, argv, "-p")))
+		parallel = atoi(p);
+	if ((p = findarg(argc, argv, "-c")))
+		clients = atoi(p);
+	if ((p = findarg(argc, argv, "-d")))
+		secs = atoi(p);
+	if (threads < 1)
+		threads = 4;
+	if (storms < 1 || storms > MAX_STORMS)
+		storms = 4;
+	if (parallel < 1)
+		parallel = 4;
+	if (clients < 1 || clients > MAX_CLIENTS)
+		clients = 16;
+	if (secs < 1)
+		secs = 5;
+
+	lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN, NULL);
+	lwsl_user("LWS minimal http server tls handshake storm bench\n");
+	lwsl_user("   %s [-t <pool threads>] [-s <storm processes>] "
+		  "[-p <parallel>] [-c <echo connections>] [-d <secs>]\n",
+		  argv[0]);
+
+	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
+	info.options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT |
+		       LWS_SERVER_OPTION_EXPLICIT_VHOSTS;
+	info.port = CONTEXT_PORT_NO_LISTEN; /* we do not run any server */
+	info.protocols = protocols;
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	lws_snprintf(name, sizeof(name), "%d pool threads", threads);
+
+	if (run_phase(context, "service thread", 0) ||
+	    run_phase(context, name, threads))
+		goto bail;
+
+	bad = 0;
+
+bail:
+	lws_context_destroy(context);
+
+	lwsl_user("Completed: %s\n", bad || interrupted ? "FAILED" : "OK");
+
+	return bad || interrupted;
+}
@@ -0,0 +1,515 @@
+/*
+ * lws-minimal-http-server-tls-ticket-bench
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This measures how often clients can resume their tls sessions when several
+ * server processes share one port, as when lwsws instances sit behind the
+ * same port.
+ *
+ * It forks -w server processes all listening on :7681 (using the selfsigned
+ * localhost cert here, so run it from this directory), and makes -n https
+ * requests to them, each on a new connection, -p at a time, from a client
+ * vhost that remembers the tickets it is given.  The kernel spreads the
+ * connections over the processes.
+ *
+ * It does that twice, with fresh servers each time: first with each process
+ * making its own ticket keys, so a ticket can only be resumed on the process
+ * that issued it, then with all the processes reading their ticket key from
+ * one file.  With -r, the file is replaced with a new key every -r seconds,
+ * and the servers check it every second.  With -s as well, each key is staged
+ * in the file as the next key for one period before it becomes current, so
+ * servers that haven't read the new file yet can still resume tickets from
+ * ones that have.
+ *
+ * For each it reports the resume rate, the mean time from starting a
+ * connection until its response was complete, and the cpu time the servers
+ * spent per connection.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define MAX_CONNS 10000
+#define MAX_WORKERS 32
+
+struct conn {
+	uint64_t start;
+};
+
+static struct conn conns[MAX_CONNS];
+static int count = 1000, parallel = 1, workers = 4, rotate_secs, staged,
+	   interrupted, started, inflight, done, failed;
+static uint8_t next_key[LWS_TLS_TICKET_KEY_LEN];
+static int have_next_key;
+static uint64_t latency_total;
+static char key_path[64], key_path_new[72];
+
+static uint64_t
+us_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+static uint64_t
+us_tv(const struct timeval *tv)
+{
+	return ((uint64_t)tv->tv_sec * 1000000) + tv->tv_usec;
+}
+
+/*
+ * replace the shared ticket key file atomically, so nobody reads half.  When
+ * staged, the file has the current key then the next one, and the next one
+ * becomes the current one in the following file.
+ */
+
+static int
+write_key(struct lws_context *context)
+{
+	uint8_t key[LWS_TLS_TICKET_KEY_LEN * 2];
+	int fd, n, len = LWS_TLS_TICKET_KEY_LEN;
+
+	if (lws_get_random(context, key, sizeof(key)) != sizeof(key))
+		return 1;
+
+	if (staged) {
+		if (have_next_key)
+			memcpy(key, next_key, sizeof(next_key));
+		memcpy(next_key, key + LWS_TLS_TICKET_KEY_LEN,
+		       sizeof(next_key));
+		have_next_key = 1;
+		len = sizeof(key);
+	}
+
+	fd = open(key_path_new, O_CREAT | O_TRUNC | O_WRONLY, 0600);
+	if (fd < 0)
+		return 1;
+	n = (int)write(fd, key, len);
+	close(fd);
+
+	if (n != len || rename(key_path_new, key_path)) {
+		unlink(key_path_new);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* the servers, in forked processes */
+
+static int
+callback_server(struct lws *wsi, enum lws_callback_reasons reason,
+		void *user, void *in, size_t len)
+{
+	switch (reason) {
+	case LWS_CALLBACK_HTTP:
+		if (lws_return_http_status(wsi, HTTP_STATUS_OK, NULL))
+			return -1;
+		if (lws_http_transaction_completed(wsi))
+			return -1;
+
+		return 0;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static struct lws_protocols protocols_server[] = {
+	{ "http", callback_server, 0, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static void
+sigterm_handler(int sig)
+{
+	interrupted = 1;
+}
+
+static int
+run_server(int fd_ready, int fd_stats, int shared)
+{
+	struct lws_tls_server_session_stats stats;
+	struct lws_context_creation_info info;
+	struct lws_context *cx;
+	struct lws_vhost *vh;
+	int n = 0;
+
+	signal(SIGTERM, sigterm_handler);
+
+	memset(&info, 0, sizeof info);
+	info.port = 7681;
+	info.protocols = protocols_server;
+	info.options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT |
+		       LWS_SERVER_OPTION_EXPLICIT_VHOSTS |
+		       LWS_SERVER_OPTION_ALLOW_LISTEN_SHARE;
+	info.ssl_cert_filepath = "localhost-100y.cert";
+	info.ssl_private_key_filepath = "localhost-100y.key";
+	info.max_http_header_pool = 64;
+	if (shared) {
+		info.tls_ticket_key_filepath = key_path;
+		if (rotate_secs)
+			info.tls_ticket_key_rotate_secs = 1;
+	}
+
+	cx = lws_create_context(&info);
+	if (!cx)
+		return 1;
+
+	vh = lws_create_vhost(cx, &info);
+	if (!vh) {
+		lws_context_destroy(cx);
+		return 1;
+	}
+
+	/* tell the client we are listening */
+	if (write(fd_ready, "", 1) != 1)
+		interrupted = 1;
+
+	while (n >= 0 && !interrupted)
+		n = lws_service(cx, 100);
+
+	memset(&stats, 0, sizeof(stats));
+	lws_tls_server_session_stats(vh, &stats);
+	/* smaller than PIPE_BUF, so it can't get mixed with another one */
+	if (write(fd_stats, &stats, sizeof(stats)) != sizeof(stats))
+		lwsl_err("%s: stats write failed\n", __func__);
+
+	lws_context_destroy(cx);
+
+	return 0;
+}
+
+/* the client, in this process */
+
+static int
+callback_client(struct lws *wsi, enum lws_callback_reasons reason,
+		void *user, void *in, size_t len)
+{
+	struct conn *conn = (struct conn *)user;
+	char buf[LWS_PRE + 1024], *px = buf + LWS_PRE;
+	int lenx = sizeof(buf) - LWS_PRE;
+
+	switch (reason) {
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		lwsl_err("CLIENT_CONNECTION_ERROR: %s\n",
+			 in ? (char *)in : "(null)");
+		failed++;
+		inflight--;
+		break;
+
+	case LWS_CALLBACK_RECEIVE_CLIENT_HTTP:
+		if (lws_http_client_read(wsi, &px, &lenx) < 0)
+			return -1;
+		return 0;
+
+	case LWS_CALLBACK_RECEIVE_CLIENT_HTTP_READ:
+		return 0; /* we don't need the body */
+
+	case LWS_CALLBACK_COMPLETED_CLIENT_HTTP:
+		latency_total += us_now() - conn->start;
+		done++;
+		/* close it, so the next request makes a new connection */
+		return -1;
+
+	case LWS_CALLBACK_CLOSED_CLIENT_HTTP:
+		inflight--;
+		/* let the service loop start the next one straight away */
+		lws_cancel_service(lws_get_context(wsi));
+		break;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static const struct lws_protocols protocols[] = {
+	{ "http", callback_client, 0, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static int
+start_conn(struct lws_context *context, struct lws_vhost *vh)
+{
+	struct lws_client_connect_info i;
+	struct conn *conn = &conns[started];
+
+	memset(&i, 0, sizeof i);
+	i.context = context;
+	i.vhost = vh;
+	i.address = "127.0.0.1";
+	i.port = 7681;
+	/* one request per connection, so h2 would only add overhead */
+	i.ssl_connection = LCCSCF_USE_SSL | LCCSCF_ALLOW_SELFSIGNED |
+			   LCCSCF_NOT_H2;
+	i.path = "/";
+	i.host = "localhost";
+	i.origin = "localhost";
+	i.method = "GET";
+	i.protocol = protocols[0].name;
+	i.userdata = conn;
+
+	conn->start = us_now();
+	started++;
+	inflight++;
+
+	return !lws_client_connect_via_info(&i);
+}
+
+static int
+run_phase(struct lws_context *context, const char *name, int shared)
+{
+	struct lws_tls_server_session_stats ss, total;
+	struct lws_tls_session_cache_stats stats;
+	struct lws_context_creation_info info;
+	int fds_ready[2], fds_stats[2], n = 0, m, w, bad = 1;
+	uint64_t server_us = 0;
+	pid_t pids[MAX_WORKERS];
+	struct lws_vhost *vh;
+	struct rusage ru;
+	time_t next = 0;
+	char c;
+
+	/* a fresh client vhost, so there are no tickets from before */
+
+	memset(&info, 0, sizeof info);
+	info.port = CONTEXT_PORT_NO_LISTEN;
+	info.protocols = protocols;
+	info.options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+	info.vhost_name = name;
+	info.tls_session_cache_max = 16;
+	vh = lws_create_vhost(context, &info);
+	if (!vh)
+		return 1;
+
+	if (shared) {
+		if (write_key(context))
+			return 1;
+		next = time(NULL) + rotate_secs;
+	}
+
+	if (pipe(fds_ready))
+		return 1;
+	if (pipe(fds_stats)) {
+		close(fds_ready[0]);
+		close(fds_ready[1]);
+		return 1;
+	}
+
+	for (w = 0; w < workers; w++) {
+		pids[w] = fork();
+		if (pids[w] < 0)
+			break;
+		if (!pids[w]) {
+			close(fds_ready[0]);
+			close(fds_stats[0]);
+			exit(run_server(fds_ready[1], fds_stats[1], shared));
+		}
+	}
+	close(fds_ready[1]);
+	close(fds_stats[1]);
+
+	for (m = 0; m < w; m++)
+		if (read(fds_ready[0], &c, 1) != 1) {
+			lwsl_err("server failed to start\n");
+			failed = 1;
+			break;
+		}
+	close(fds_ready[0]);
+
+	started = done = inflight = 0;
+	failed = w != workers || m != w;
+	latency_total = 0;
+
+	while (n >= 0 && !interrupted && !failed &&
+	       (started < count || inflight)) {
+		while (started < count && inflight < parallel)
+			if (start_conn(context, vh)) {
+				lwsl_err("%s: connect failed\n", __func__);
+				failed++;
+				break;
+			}
+		n = lws_service(context, 1000);
+
+		if (rotate_secs && shared && time(NULL) >= next) {
+			if (write_key(context))
+				failed++;
+			next = time(NULL) + rotate_secs;
+		}
+	}
+
+	memset(&total, 0, sizeof(total));
+	for (m = 0; m < w; m++) {
+		kill(pids[m], SIGTERM);
+		if (wait4(pids[m], NULL, 0, &ru) == pids[m])
+			server_us += us_tv(&ru.ru_utime) + us_tv(&ru.ru_stime);
+		if (read(fds_stats[0], &ss, sizeof(ss)) != sizeof(ss))
+			continue;
+		total.handshakes += ss.handshakes;
+		total.resumed += ss.resumed;
+		total.tickets_issued += ss.tickets_issued;
+		total.tickets_current += ss.tickets_current;
+		total.tickets_previous += ss.tickets_previous;
+		total.tickets_next += ss.tickets_next;
+		total.tickets_unknown += ss.tickets_unknown;
+		total.key_rotations += ss.key_rotations;
+	}
+	close(fds_stats[0]);
+
+	if (failed || !done)
+		goto bail;
+
+	lwsl_user("%s: %d connections, %.2fms mean, server cpu per "
+		  "connection %.3fms\n", name, done,
+		  (double)latency_total / done / 1000.0,
+		  (double)server_us / done / 1000.0);
+	lwsl_user("%s: servers: %lu handshakes, %lu resumed (%lu%%)\n", name,
+		  total.handshakes, total.resumed, total.handshakes ?
+				total.resumed * 100 / total.handshakes : 0);
+	if (shared)
+		lwsl_user("%s: tickets: %lu issued, back under current key "
+			  "%lu, previous key %lu, next key %lu, unknown key "
+			  "%lu, %lu key changes\n", name,
+			  total.tickets_issued, total.tickets_current,
+			  total.tickets_previous, total.tickets_next,
+			  total.tickets_unknown, total.key_rotations);
+
+	if (lws_tls_session_cache_stats(vh, &stats))
+		goto bail;
+
+	lwsl_user("%s: client: %lu offered a session, %lu resumed\n", name,
+		  stats.offered, stats.resumed);
+
+	/*
+	 * with the key shared, only the first connections have nothing to
+	 * offer, and a few tickets shared by connections in flight together
+	 * may be refused, but most connections should resume
+	 */
+	if (shared && stats.resumed * 2 + parallel < stats.handshakes)
+		goto bail;
+
+	/*
+	 * with the keys staged, a server only misses a ticket's key if it
+	 * fell a whole period behind reading the file
+	 */
+	if (shared && staged && total.tickets_unknown > (unsigned long)parallel)
+		goto bail;
+
+	bad = 0;
+
+bail:
+	lws_vhost_destroy(vh);
+
+	return bad;
+}
+
+void sigint_handler(int sig)
+{
+	interrupted = 1;
+}
+
+static const char *findarg(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc - 1], val))
+			return argv[argc];
+	}
+
+	return NULL;
+}
+
+static int findswitch(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc], val))
+			return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct lws_context_creation_info info;
+	struct lws_context *context;
+	const char *p;
+	int bad = 1;
+
+	signal(SIGINT, sigint_handler);
+
+	if ((p = findarg(argc, argv, "-n")))
+		count = atoi(p);
+	if ((p = findarg(argc, argv, "-p")))
+		parallel = atoi(p);
+	if ((p = findarg(argc, argv, "-w")))
+		workers = atoi(p);
+	if ((p = findarg(argc, argv, "-r")))
+		rotate_secs = atoi(p);
+	staged = findswitch(argc, argv, "-s");
+	if (staged && rotate_secs < 2)
+		/*
+		 * the servers read the file every second, so a key staged for
+		 * one second may be missed by one that reads it just before
+		 */
+		rotate_secs = 2;
+	if (count < 1 || count > MAX_CONNS)
+		count = 1000;
+	if (parallel < 1)
+		parallel = 1;
+	if (workers < 1 || workers > MAX_WORKERS)
+		workers = 4;
+
+	lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN, NULL);
+	lwsl_user("LWS minimal http server tls ticket bench\n");
+	lwsl_user("   %s [-w <server processes>] [-n <connections>] "
+		  "[-p <parallel>] [-r <key change secs> [-s]]\n", argv[0]);
+
+	lws_snprintf(key_path, sizeof(key_path), "/tmp/lws-ticket-%d.key",
+		     (int)getpid());
+	lws_snprintf(key_path_new, sizeof(key_path_new), "%s.new", key_path);
+
+	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
+	info.options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT |
+		       LWS_SERVER_OPTION_EXPLICIT_VHOSTS;
+	info.port = CONTEXT_PORT_NO_LISTEN; /* we do not run any server */
+	info.protocols = protocols;
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	if (run_phase(context, "per-process keys", 0) ||
+	    run_phase(context, "shared key file", 1))
+		goto bail;
+
+	bad = 0;
+
+bail:
+	unlink(key_path);
+	lws_context_destroy(context);
+
+	lwsl_user("Completed: %s\n", bad || interrupted ? "FAILED" : "OK");
+
+	return bad || interrupted;
+}
@@ -0,0 +1,274 @@
+/*
+ * lws-minimal-http-server-vhost-select-bench
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This measures how the cost of picking the vhost for an incoming request
+ * from its Host: header changes with the number of vhosts sharing a port.
+ *
+ * It creates -v vhosts (default 2000) named vh0.example.com,
+ * vh1.example.com... all listening on port 7681, that answer every request
+ * with an empty 200 carrying an x-vhost: header naming the vhost that served
+ * it.  A thread then makes -r keepalive requests (default 20000) for each of
+ *
+ *  - the exact name of a random vhost
+ *  - www. + the name of a random vhost, which matches it as a wildcard
+ *  - a name no vhost has, which goes to the first vhost on the port
+ *
+ * checking each is served by the right vhost, and reports the average time
+ * per request.  Try it with -v 1 too, to see the part that doesn't depend on
+ * the number of vhosts.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static struct lws_context *context;
+static int interrupted, vhosts = 2000, requests = 20000, result = 1;
+
+static int
+callback_http(struct lws *wsi, enum lws_callback_reasons reason,
+	      void *user, void *in, size_t len)
+{
+	uint8_t buf[LWS_PRE + 256], *start = &buf[LWS_PRE], *p = start,
+		*end = &buf[sizeof(buf) - 1];
+	const char *name;
+
+	switch (reason) {
+	case LWS_CALLBACK_HTTP:
+		name = lws_get_vhost_name(lws_get_vhost(wsi));
+
+		if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK,
+						"text/plain", 0, &p, end))
+			return 1;
+		if (lws_add_http_header_by_name(wsi,
+				(const unsigned char *)"x-vhost:",
+				(const unsigned char *)name, (int)strlen(name),
+				&p, end))
+			return 1;
+		if (lws_finalize_write_http_header(wsi, start, &p, end))
+			return 1;
+
+		if (lws_http_transaction_completed(wsi))
+			return -1;
+
+		return 0;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static struct lws_protocols protocols[] = {
+	{ "http", callback_http, 0, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static uint64_t
+us_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+/*
+ * send one request for host, and check the response came from vhost vh
+ */
+
+static int
+request(int fd, const char *host, int vh)
+{
+	char buf[512], want[64], *p;
+	int n, len = 0;
+
+	n = lws_snprintf(buf, sizeof(buf), "GET / HTTP/1.1\r\nHost: %s\r\n\r\n",
+			 host);
+	if (send(fd, buf, n, 0) != n)
+		return 1;
+
+	while (len < 4 || memcmp(buf + len - 4, "\r\n\r\n", 4)) {
+		if (len == sizeof(buf) - 1)
+			return 1;
+		n = recv(fd, buf + len, sizeof(buf) - 1 - len, 0);
+		if (n <= 0)
+			return 1;
+		len += n;
+	}
+	buf[len] = '\0';
+
+	lws_snprintf(want, sizeof(want), "x-vhost: vh%d.example.com\r\n", vh);
+	p = strstr(buf, want);
+	if (!p) {
+		lwsl_err("%s: %s: wrong vhost\n", __func__, host);
+		return 1;
+	}
+
+	return 0;
+}
+
+static void *
+thread_client(void *unused)
+{
+	static const char * const kinds[] = { "exact", "wildcard", "unknown" };
+	struct sockaddr_in sa;
+	char host[64];
+	uint64_t t;
+	int fd, k, n, v;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		goto bail;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(7681);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, (struct sockaddr *)&sa, sizeof(sa))) {
+		lwsl_err("%s: unable to connect\n", __func__);
+		goto bail1;
+	}
+
+	for (k = 0; k < (int)LWS_ARRAY_SIZE(kinds); k++) {
+		t = us_now();
+		for (n = 0; n < requests && !interrupted; n++) {
+			v = rand() % vhosts;
+			switch (k) {
+			case 0:
+				lws_snprintf(host, sizeof(host),
+					     "vh%d.example.com", v);
+				break;
+			case 1:
+				lws_snprintf(host, sizeof(host),
+					     "www.vh%d.example.com", v);
+				break;
+			default:
+				lws_snprintf(host, sizeof(host),
+					     "unknown%d.invalid", v);
+				v = 0;
+				break;
+			}
+			if (request(fd, host, v))
+				goto bail1;
+		}
+		if (interrupted)
+			goto bail1;
+		t = us_now() - t;
+
+		lwsl_user("%d vhosts: %-8s host: %d requests in %lluus, "
+			  "%.3fus per request\n", vhosts, kinds[k], requests,
+			  (unsigned long long)t, (double)t / (double)requests);
+	}
+
+	result = 0;
+
+bail1:
+	close(fd);
+bail:
+	interrupted = 1;
+	lws_cancel_service(context);
+
+	pthread_exit(NULL);
+
+	return NULL;
+}
+
+void sigint_handler(int sig)
+{
+	interrupted = 1;
+}
+
+static const char *findarg(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc - 1], val))
+			return argv[argc];
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct lws_context_creation_info info;
+	pthread_t pthread_client;
+	char (*names)[32] = NULL;
+	const char *p;
+	void *retval;
+	int n = 0;
+
+	signal(SIGINT, sigint_handler);
+
+	if ((p = findarg(argc, argv, "-v")))
+		vhosts = atoi(p);
+	if ((p = findarg(argc, argv, "-r")))
+		requests = atoi(p);
+	if (vhosts < 1)
+		vhosts = 1;
+
+	lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN, NULL);
+	lwsl_user("LWS minimal http server vhost select bench\n");
+	lwsl_user("   %s [-v <vhosts>] [-r <requests>]\n", argv[0]);
+
+	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
+	info.options = LWS_SERVER_OPTION_EXPLICIT_VHOSTS;
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	/* the vhost names must stay around as long as the vhosts */
+
+	names = malloc(sizeof(*names) * vhosts);
+	if (!names)
+		goto bail;
+
+	info.port = 7681;
+	info.protocols = protocols;
+
+	for (n = 0; n < vhosts; n++) {
+		lws_snprintf(names[n], sizeof(names[n]), "vh%d.example.com", n);
+		info.vhost_name = names[n];
+
+		if (!lws_create_vhost(context, &info)) {
+			lwsl_err("Failed to create vhost %s\n", names[n]);
+			goto bail;
+		}
+	}
+
+	if (pthread_create(&pthread_client, NULL, thread_client, NULL)) {
+		lwsl_err("thread creation failed\n");
+		goto bail;
+	}
+
+	n = 0;
+	while (n >= 0 && !interrupted)
+		n = lws_service(context, 1000);
+
+	pthread_join(pthread_client, &retval);
+
+bail:
+	lws_context_destroy(context);
+	free(names);
+
+	lwsl_user("Completed: %s\n", result ? "FAILED" : "OK");
+
+	return result;
+}
@@ -0,0 +1,281 @@
+/*
+ * lws-minimal-raw-pt-queue-bench
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This measures getting messages from other threads into the service thread.
+ *
+ * -p producer threads (default 8) each send -m messages (default 200000) to
+ * a protocol on the service thread, either
+ *
+ *  - with lws_pt_post_vhost_protocol(), which delivers them in
+ *    LWS_CALLBACK_PT_MESSAGE, or
+ *
+ *  - the way minimal-ws-server-threads does it: add them to a ring under a
+ *    mutex and call lws_cancel_service(), the service thread takes everything
+ *    in the ring under the mutex in LWS_CALLBACK_EVENT_WAIT_CANCELLED
+ *
+ * Both queues hold -d messages (default 1024), producers yield and retry
+ * when it's full.  The service thread checks every producer's messages
+ * arrive complete and in order, and we report messages/sec, and how many
+ * wakeups the service thread needed.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#define MAX_PRODUCERS 64
+
+struct producer {
+	pthread_t thread;
+	size_t next_rx; /* service thread: seq we expect next */
+	size_t full; /* producer: how often it found the queue full */
+	int index;
+};
+
+struct ring_msg {
+	struct producer *pr;
+	size_t seq;
+};
+
+static struct producer producers[MAX_PRODUCERS];
+static struct lws_context *context;
+static struct lws_vhost *vhost;
+static int interrupted, count_producers = 8, messages = 200000,
+	   depth = 1024, use_mutex, bad;
+static volatile int go;
+static unsigned long received, wakeups, loops, last_loop;
+
+/* the mutex + ring way */
+static pthread_mutex_t lock_ring = PTHREAD_MUTEX_INITIALIZER;
+static struct ring_msg *ring;
+static size_t ring_head, ring_tail;
+
+static uint64_t
+us_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+static void
+rx(struct producer *pr, size_t seq)
+{
+	if (seq != pr->next_rx) {
+		lwsl_err("producer %d: got %lu, expected %lu\n", pr->index,
+			 (unsigned long)seq, (unsigned long)pr->next_rx);
+		bad = 1;
+	}
+	pr->next_rx = seq + 1;
+	received++;
+
+	if (last_loop != loops) {
+		last_loop = loops;
+		wakeups++;
+	}
+}
+
+static int
+callback_bench(struct lws *wsi, enum lws_callback_reasons reason,
+	       void *user, void *in, size_t len)
+{
+	switch (reason) {
+	case LWS_CALLBACK_PT_MESSAGE:
+		rx((struct producer *)in, len);
+		break;
+
+	case LWS_CALLBACK_EVENT_WAIT_CANCELLED:
+		if (!use_mutex)
+			break;
+		pthread_mutex_lock(&lock_ring);
+		while (ring_tail != ring_head) {
+			struct ring_msg *m = &ring[ring_tail % depth];
+
+			rx(m->pr, m->seq);
+			ring_tail++;
+		}
+		pthread_mutex_unlock(&lock_ring);
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static struct lws_protocols protocols[] = {
+	{ "bench", callback_bench, 0, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static int
+post_mutex(struct producer *pr, size_t seq)
+{
+	pthread_mutex_lock(&lock_ring);
+	if (ring_head - ring_tail == (size_t)depth) {
+		pthread_mutex_unlock(&lock_ring);
+		return 1;
+	}
+	ring[ring_head % depth].pr = pr;
+	ring[ring_head % depth].seq = seq;
+	ring_head++;
+	pthread_mutex_unlock(&lock_ring);
+
+	lws_cancel_service(context);
+
+	return 0;
+}
+
+static void *
+thread_producer(void *d)
+{
+	struct producer *pr = (struct producer *)d;
+	size_t n;
+
+	while (!go && !interrupted)
+		sched_yield();
+
+	for (n = 0; n < (size_t)messages && !interrupted; n++)
+		while (use_mutex ? post_mutex(pr, n) :
+		       lws_pt_post_vhost_protocol(vhost, &protocols[0], 0,
+						  pr, n)) {
+			pr->full++;
+			sched_yield();
+		}
+
+	pthread_exit(NULL);
+
+	return NULL;
+}
+
+void sigint_handler(int sig)
+{
+	interrupted = 1;
+}
+
+static const char *findarg(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc - 1], val))
+			return argv[argc];
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long total, full = 0;
+	struct lws_context_creation_info info;
+	const char *p;
+	uint64_t t;
+	void *retval;
+	int n = 0;
+
+	signal(SIGINT, sigint_handler);
+
+	if ((p = findarg(argc, argv, "-p")))
+		count_producers = atoi(p);
+	if ((p = findarg(argc, argv, "-m")))
+		messages = atoi(p);
+	if ((p = findarg(argc, argv, "-d")))
+		depth = atoi(p);
+	for (n = 1; n < argc; n++)
+		if (!strcmp(argv[n], "-l"))
+			use_mutex = 1;
+	if (count_producers < 1)
+		count_producers = 1;
+	if (count_producers > MAX_PRODUCERS)
+		count_producers = MAX_PRODUCERS;
+	if (messages < 1)
+		messages = 1;
+	if (depth < 1)
+		depth = 1;
+
+	lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN, NULL);
+	lwsl_user("LWS minimal raw pt queue bench\n");
+	lwsl_user("   %s [-p <producers>] [-m <messages each>] [-d <depth>] "
+		  "[-l]\n", argv[0]);
+
+	ring = malloc(sizeof(*ring) * depth);
+	if (!ring)
+		return 1;
+
+	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
+	info.options = LWS_SERVER_OPTION_EXPLICIT_VHOSTS;
+	info.pt_queue_depth = depth;
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	info.port = CONTEXT_PORT_NO_LISTEN;
+	info.protocols = protocols;
+
+	vhost = lws_create_vhost(context, &info);
+	if (!vhost) {
+		lwsl_err("vhost creation failed\n");
+		goto bail;
+	}
+
+	for (n = 0; n < count_producers; n++) {
+		producers[n].index = n;
+		if (pthread_create(&producers[n].thread, NULL, thread_producer,
+				   &producers[n])) {
+			lwsl_err("thread creation failed\n");
+			interrupted = 1;
+			count_producers = n;
+			break;
+		}
+	}
+
+	total = (unsigned long)count_producers * messages;
+	t = us_now();
+	go = 1;
+
+	n = 0;
+	while (n >= 0 && received < total && !interrupted) {
+		loops++;
+		n = lws_service(context, 1000);
+	}
+
+	t = us_now() - t;
+
+	for (n = 0; n < count_producers; n++) {
+		pthread_join(producers[n].thread, &retval);
+		full += producers[n].full;
+	}
+
+	if (!interrupted)
+		lwsl_user("%s: %d producers x %d: %.0f msgs/s, %lu wakeups "
+			  "(%.1f msgs each), queue full %lu times\n",
+			  use_mutex ? "mutex + lws_cancel_service" :
+				      "lws_pt_post",
+			  count_producers, messages,
+			  (double)received * 1000000.0 / t, wakeups,
+			  wakeups ? (double)received / wakeups : 0.0, full);
+
+	bad |= received != total;
+
+bail:
+	lws_context_destroy(context);
+	free(ring);
+
+	lwsl_user("Completed: %s\n", bad ? "FAILED" : "OK");
+
+	return bad;
+}
@@ -0,0 +1,287 @@
+/*
+ * lws-minimal-raw-slow-consumers-bench
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This measures sending lots of small messages to clients that read them
+ * slowly, so the kernel socket buffers are full and sends are often partial.
+ *
+ * A raw vhost sends -m messages (default 400) of -s bytes (default 8000) to
+ * each of -c connections (default 32).  Each time it gets a writable callback
+ * it writes messages until lws_send_pipe_choked() says to stop.
+ *
+ * A client thread connects with a small receive buffer and reads at most -r
+ * bytes (default 512) from each connection per poll(), checking the bytes
+ * arrive complete and in order.
+ *
+ * With -l <bytes>, info.buffered_out_limit lets writes queue up to that much
+ * behind a partial send, instead of waiting for a writable callback after
+ * each one.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <pthread.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MAX_CONNS 256
+#define MAX_SIZE 65536
+
+struct pss {
+	size_t sent; /* messages */
+	size_t ofs; /* bytes */
+};
+
+static int interrupted, conns = 32, messages = 400, size = 8000,
+	   readsize = 512, port = 7681, bad;
+static volatile int done_clients;
+static struct lws_context *context;
+static unsigned long writeables, writes;
+
+static uint64_t
+us_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+static int
+callback_bench(struct lws *wsi, enum lws_callback_reasons reason,
+	       void *user, void *in, size_t len)
+{
+	struct pss *pss = (struct pss *)user;
+	static uint8_t buf[LWS_PRE + MAX_SIZE];
+	uint8_t *p = &buf[LWS_PRE];
+	int n, sndbuf = 4096;
+
+	switch (reason) {
+	case LWS_CALLBACK_RAW_ADOPT:
+		setsockopt(lws_get_socket_fd(wsi), SOL_SOCKET, SO_SNDBUF,
+			   &sndbuf, sizeof(sndbuf));
+		lws_callback_on_writable(wsi);
+		break;
+
+	case LWS_CALLBACK_RAW_WRITEABLE:
+		writeables++;
+		while (pss->sent < (size_t)messages) {
+			for (n = 0; n < size; n++)
+				p[n] = (uint8_t)((pss->ofs + n) % 251);
+
+			if (lws_write(wsi, p, size, LWS_WRITE_RAW) != size) {
+				lwsl_err("%s: write failed\n", __func__);
+				return -1;
+			}
+			writes++;
+			pss->sent++;
+			pss->ofs += size;
+
+			if (lws_send_pipe_choked(wsi))
+				break;
+		}
+		if (pss->sent < (size_t)messages)
+			lws_callback_on_writable(wsi);
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static struct lws_protocols protocols[] = {
+	{ "bench", callback_bench, sizeof(struct pss), 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static void *
+thread_clients(void *d)
+{
+	struct pollfd pfd[MAX_CONNS];
+	size_t rxed[MAX_CONNS], want = (size_t)messages * size;
+	struct sockaddr_in sa;
+	int n, m, i, live = 0, rcvbuf = 4096;
+	uint8_t buf[4096];
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(port);
+	sa.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+	for (n = 0; n < conns; n++)
+		pfd[n].fd = -1;
+
+	for (n = 0; n < conns; n++) {
+		rxed[n] = 0;
+		pfd[n].events = POLLIN;
+		pfd[n].fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (pfd[n].fd < 0)
+			goto fail;
+		setsockopt(pfd[n].fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+			   sizeof(rcvbuf));
+		if (connect(pfd[n].fd, (struct sockaddr *)&sa, sizeof(sa)))
+			goto fail;
+		fcntl(pfd[n].fd, F_SETFL, O_NONBLOCK);
+		live++;
+	}
+
+	while (live && !interrupted) {
+		if (poll(pfd, conns, 1000) < 0)
+			break;
+		for (n = 0; n < conns; n++) {
+			if (pfd[n].fd < 0 || !(pfd[n].revents & POLLIN))
+				continue;
+			m = read(pfd[n].fd, buf, readsize);
+			if (m <= 0) {
+				lwsl_err("conn %d: closed at %lu\n", n,
+					 (unsigned long)rxed[n]);
+				goto fail;
+			}
+			for (i = 0; i < m; i++)
+				if (buf[i] != (rxed[n] + i) % 251) {
+					lwsl_err("conn %d: bad data at %lu\n",
+						 n, (unsigned long)(rxed[n] + i));
+					goto fail;
+				}
+			rxed[n] += m;
+			if (rxed[n] == want) {
+				close(pfd[n].fd);
+				pfd[n].fd = -1;
+				live--;
+			}
+		}
+	}
+
+	goto out;
+
+fail:
+	bad = 1;
+out:
+	for (n = 0; n < conns; n++)
+		if (pfd[n].fd >= 0)
+			close(pfd[n].fd);
+
+	done_clients = 1;
+	lws_cancel_service(context);
+
+	pthread_exit(NULL);
+
+	return NULL;
+}
+
+void sigint_handler(int sig)
+{
+	interrupted = 1;
+}
+
+static const char *findarg(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc - 1], val))
+			return argv[argc];
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct lws_context_creation_info info;
+	pthread_t client;
+	const char *p;
+	void *retval;
+	uint64_t t;
+	int n = 0;
+
+	signal(SIGINT, sigint_handler);
+
+	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
+
+	if ((p = findarg(argc, argv, "-c")))
+		conns = atoi(p);
+	if ((p = findarg(argc, argv, "-m")))
+		messages = atoi(p);
+	if ((p = findarg(argc, argv, "-s")))
+		size = atoi(p);
+	if ((p = findarg(argc, argv, "-r")))
+		readsize = atoi(p);
+	if ((p = findarg(argc, argv, "-l")))
+		info.buffered_out_limit = atoi(p);
+	if (conns < 1)
+		conns = 1;
+	if (conns > MAX_CONNS)
+		conns = MAX_CONNS;
+	if (size < 1 || size > MAX_SIZE)
+		size = 8000;
+	if (readsize < 1 || readsize > 4096)
+		readsize = 512;
+
+	lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN, NULL);
+	lwsl_user("LWS minimal raw slow consumers bench\n");
+	lwsl_user("   %s [-c <conns>] [-m <messages each>] [-s <size>] "
+		  "[-r <read size>] [-l <buffered_out_limit>]\n", argv[0]);
+
+	info.port = port;
+	info.protocols = protocols;
+	info.options = LWS_SERVER_OPTION_ONLY_RAW;
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	t = us_now();
+
+	if (pthread_create(&client, NULL, thread_clients, NULL)) {
+		lwsl_err("thread creation failed\n");
+		bad = 1;
+		goto bail;
+	}
+
+	while (n >= 0 && !done_clients && !interrupted)
+		n = lws_service(context, 1000);
+
+	t = us_now() - t;
+
+	pthread_join(client, &retval);
+
+	if (!interrupted && !bad) {
+		lwsl_user("buffered_out_limit %u: %d conns x %d x %dB: "
+			  "%.0f msgs/s, %lu writeable callbacks "
+			  "(%.1f msgs each)\n", info.buffered_out_limit,
+			  conns, messages, size, (double)writes * 1000000.0 / t,
+			  writeables, writeables ?
+					(double)writes / writeables : 0.0);
+#if defined(LWS_WITH_STATS)
+		lwsl_user("   partial writes %llu, writes queued %llu "
+			  "(%llu bytes)\n", (unsigned long long)
+			  lws_stats_get(context, LWSSTATS_C_WRITE_PARTIALS),
+			  (unsigned long long)
+			  lws_stats_get(context, LWSSTATS_C_WRITE_QUEUED),
+			  (unsigned long long)
+			  lws_stats_get(context, LWSSTATS_B_WRITE_QUEUED));
+#endif
+	}
+
+bail:
+	lws_context_destroy(context);
+
+	lwsl_user("Completed: %s\n", bad ? "FAILED" : "OK");
+
+	return bad;
+}
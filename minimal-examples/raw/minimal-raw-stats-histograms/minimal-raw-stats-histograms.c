@@ -0,0 +1,233 @@
+/*
+ * lws-minimal-raw-stats-histograms
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This checks the delay percentiles lws keeps with -DLWS_WITH_STATS=1.
+ *
+ * It adopts one end of a socketpair as a raw wsi, which is always writeable.
+ * Each time it asks for a writeable callback, it then blocks the event loop
+ * for a pseudo-random time between 50us and 5ms, so the callback comes that
+ * late.  It times each of those delays itself too.
+ *
+ * At the end it reads LWSSTATS_US_WRITABLE_DELAY_P50 / P99 / P999 with
+ * lws_stats_get() and compares them with the exact percentiles of the delays
+ * it saw.  lws' histograms place each delay to within 1/16, so they should
+ * agree that closely, apart from a few us for the two of us taking our
+ * timestamps at slightly different places.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+
+static int count = 2000, done, interrupted, sv[2] = { -1, -1 };
+static uint64_t *delays, asked, seed = 1;
+
+static uint64_t
+us_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+/* log-uniform between 50us and 5ms, so every bucket size gets some */
+
+static uint64_t
+next_delay(void)
+{
+	uint64_t d = 50;
+	int n;
+
+	seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+	n = (int)((seed >> 33) % 1000);
+
+	/* 100x spread is about 6.64 powers of two */
+	while (n >= 150) {
+		d *= 2;
+		n -= 150;
+	}
+
+	return d + (d * n) / 150;
+}
+
+static void
+ask(struct lws *wsi)
+{
+	uint64_t until;
+
+	lws_callback_on_writable(wsi);
+	asked = us_now();
+
+	/* stand in for somebody hogging the event loop */
+	until = asked + next_delay();
+	while (us_now() < until)
+		;
+}
+
+static int
+callback_raw_test(struct lws *wsi, enum lws_callback_reasons reason,
+		  void *user, void *in, size_t len)
+{
+	lws_sock_file_fd_type u;
+
+	switch (reason) {
+	case LWS_CALLBACK_PROTOCOL_INIT:
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+			lwsl_err("socketpair failed\n");
+			return 1;
+		}
+		u.sockfd = sv[0];
+		if (!lws_adopt_descriptor_vhost(lws_get_vhost(wsi),
+						LWS_ADOPT_SOCKET, u,
+						"raw-test", NULL)) {
+			lwsl_err("Failed to adopt socket\n");
+			return 1;
+		}
+		break;
+
+	case LWS_CALLBACK_RAW_ADOPT:
+		ask(wsi);
+		break;
+
+	case LWS_CALLBACK_RAW_WRITEABLE:
+		delays[done++] = us_now() - asked;
+		if (done == count) {
+			interrupted = 1;
+			break;
+		}
+		ask(wsi);
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static struct lws_protocols protocols[] = {
+	{ "raw-test", callback_raw_test, 0, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+void sigint_handler(int sig)
+{
+	interrupted = 1;
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int
+check(struct lws_context *context)
+{
+	static const int index[] = { LWSSTATS_US_WRITABLE_DELAY_P50,
+				     LWSSTATS_US_WRITABLE_DELAY_P99,
+				     LWSSTATS_US_WRITABLE_DELAY_P999 };
+	static const char * const name[] = { "p50", "p99", "p999" };
+	static const int permille[] = { 500, 990, 999 };
+	uint64_t exact, got, slop = 25;
+	int n, bad = 0;
+
+	qsort(delays, count, sizeof(*delays), cmp_u64);
+
+	got = lws_stats_get(context, LWSSTATS_C_WRITEABLE_CB);
+	lwsl_user("%d delays, lws counted %llu writeable callbacks\n", count,
+		  (unsigned long long)got);
+	if (got != (uint64_t)count)
+		bad = 1;
+
+	for (n = 0; n < (int)LWS_ARRAY_SIZE(index); n++) {
+		/* the same rank lws uses */
+		exact = delays[((count * permille[n]) + 999) / 1000 - 1];
+		got = lws_stats_get(context, index[n]);
+
+		lwsl_user("writable delay %s: exact %lluus, lws %lluus\n",
+			  name[n], (unsigned long long)exact,
+			  (unsigned long long)got);
+
+		/* lws gives the top of the 1/16-wide bucket it's in */
+		if (got + slop < exact || got > exact + (exact / 16) + slop)
+			bad = 1;
+	}
+
+	return bad;
+}
+
+static const char *findarg(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc - 1], val))
+			return argv[argc];
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct lws_context_creation_info info;
+	struct lws_context *context;
+	int n = 0, bad = 1;
+	const char *p;
+
+	signal(SIGINT, sigint_handler);
+
+	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
+	info.port = CONTEXT_PORT_NO_LISTEN_SERVER; /* no listen socket for demo */
+	info.protocols = protocols;
+
+	lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN, NULL);
+
+	lwsl_user("LWS minimal raw stats histograms\n");
+	lwsl_user("   %s [-n <delays>]\n", argv[0]);
+
+	p = findarg(argc, argv, "-n");
+	if (p)
+		count = atoi(p);
+	if (count < 1)
+		count = 1;
+
+	delays = malloc(sizeof(*delays) * count);
+	if (!delays)
+		return 1;
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		free(delays);
+		return 1;
+	}
+
+	/* the socket is adopted when the protocol is initialized */
+	while (n >= 0 && !interrupted)
+		n = lws_service(context, 1000);
+
+	if (done == count)
+		bad = check(context);
+
+	lws_context_destroy(context);
+	if (sv[1] >= 0)
+		close(sv[1]);
+	free(delays);
+
+	lwsl_user("Completed: %s\n", bad ? "FAILED" : "OK");
+
+	return bad;
+}
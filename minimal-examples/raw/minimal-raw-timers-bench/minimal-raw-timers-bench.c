@@ -0,0 +1,220 @@
+/*
+ * lws-minimal-raw-timers-bench
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This measures what lws timers cost when very many wsi have them armed.
+ *
+ * It adopts many idle udp sockets, and gives each of them both an
+ * lws_set_timeout() and an lws_set_timer_usecs() a few minutes in the
+ * future.  Then it times
+ *
+ *  - rearming randomly picked hrtimers and timeouts
+ *
+ *  - the once-a-second timeout check lws does from the service loop
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+static int count = 10000, arms = 10000, ticks = 5, adopted, inited,
+	   interrupted;
+static struct lws **wsis;
+
+static int
+callback_raw_test(struct lws *wsi, enum lws_callback_reasons reason,
+			void *user, void *in, size_t len)
+{
+	lws_sock_file_fd_type u;
+
+	switch (reason) {
+	case LWS_CALLBACK_PROTOCOL_INIT:
+		inited = 1;
+		for (adopted = 0; adopted < count; adopted++) {
+			u.filefd = socket(AF_INET, SOCK_DGRAM, 0);
+			if (u.filefd < 0) {
+				lwsl_err("socket %d failed (raise ulimit -n?)\n",
+					 adopted);
+				return 1;
+			}
+			wsis[adopted] = lws_adopt_descriptor_vhost(
+					lws_get_vhost(wsi),
+					LWS_ADOPT_RAW_FILE_DESC, u,
+					"raw-test", NULL);
+			if (!wsis[adopted]) {
+				lwsl_err("Failed to adopt socket %d\n",
+					 adopted);
+				close(u.filefd);
+				return 1;
+			}
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static struct lws_protocols protocols[] = {
+	{ "raw-test", callback_raw_test, 0, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static uint64_t
+us_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+static void
+measure(struct lws_context *context)
+{
+	uint64_t t, d, total = 0;
+	int n;
+
+	/*
+	 * start them all off a few minutes out, so nothing expires while we
+	 * are measuring.  Each hrtimer is due a little before the last one.
+	 */
+
+	for (n = 0; n < adopted; n++) {
+		lws_set_timer_usecs(wsis[n], (300 * LWS_USEC_PER_SEC) +
+					     ((lws_usec_t)(adopted - n) * 1000));
+		lws_set_timeout(wsis[n], PENDING_TIMEOUT_HTTP_CONTENT,
+				300 + (rand() % 300));
+	}
+
+	t = us_now();
+	for (n = 0; n < arms; n++)
+		lws_set_timer_usecs(wsis[rand() % adopted],
+				    (300 * LWS_USEC_PER_SEC) +
+				    ((lws_usec_t)(rand() % 300000) * 1000));
+	d = us_now() - t;
+	lwsl_user("%d armed: hrtimer rearm %.3fus\n", adopted,
+		  (double)d / arms);
+
+	t = us_now();
+	for (n = 0; n < arms; n++)
+		lws_set_timeout(wsis[rand() % adopted],
+				PENDING_TIMEOUT_HTTP_CONTENT,
+				300 + (rand() % 300));
+	d = us_now() - t;
+	lwsl_user("%d armed: timeout rearm %.3fus\n", adopted,
+		  (double)d / arms);
+
+	/*
+	 * Servicing with no pollfd only does the periodic checks, and only
+	 * the first call in each new second does any real work... so wait for
+	 * the second to turn over and time that call
+	 */
+
+	for (n = 0; n < ticks && !interrupted; n++) {
+		usleep(1001000 - (us_now() % 1000000));
+		t = us_now();
+		lws_service_fd(context, NULL);
+		total += us_now() - t;
+	}
+
+	lwsl_user("%d armed: once-a-second check %.3fus\n", adopted,
+		  (double)total / ticks);
+}
+
+void sigint_handler(int sig)
+{
+	interrupted = 1;
+}
+
+static const char *findarg(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc - 1], val))
+			return argv[argc];
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct lws_context_creation_info info;
+	struct lws_context *context;
+	struct rlimit rl;
+	const char *p;
+	int n = 0;
+
+	signal(SIGINT, sigint_handler);
+
+	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
+	info.port = CONTEXT_PORT_NO_LISTEN_SERVER; /* no listen socket for demo */
+	info.protocols = protocols;
+
+	lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN | LLL_NOTICE, NULL);
+
+	lwsl_user("LWS minimal raw timers bench\n");
+	lwsl_user("   %s [-n <wsi>] [-a <rearms>] [-t <secs>]\n", argv[0]);
+
+	p = findarg(argc, argv, "-n");
+	if (p)
+		count = atoi(p);
+	p = findarg(argc, argv, "-a");
+	if (p)
+		arms = atoi(p);
+	p = findarg(argc, argv, "-t");
+	if (p)
+		ticks = atoi(p);
+	if (count < 1)
+		count = 1;
+	if (arms < 1)
+		arms = 1;
+	if (ticks < 1)
+		ticks = 1;
+
+	wsis = malloc(sizeof(*wsis) * count);
+	if (!wsis)
+		return 1;
+
+	/*
+	 * each wsi costs a fd, lws sizes its fd tables from the process limit
+	 * at context creation, so raise it first
+	 */
+	if (!getrlimit(RLIMIT_NOFILE, &rl)) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		free(wsis);
+		return 1;
+	}
+
+	/* the sockets are adopted when the protocol is initialized */
+	while (n >= 0 && !inited && !interrupted)
+		n = lws_service(context, 100);
+
+	if (adopted == count)
+		measure(context);
+
+	lws_context_destroy(context);
+	free(wsis);
+
+	lwsl_user("Completed: %s\n", adopted == count ? "OK" : "FAILED");
+
+	return adopted != count;
+}
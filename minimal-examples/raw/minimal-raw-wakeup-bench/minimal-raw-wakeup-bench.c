@@ -0,0 +1,235 @@
+/*
+ * lws-minimal-raw-wakeup-bench
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This measures the cost of one event loop wakeup when a large number of
+ * idle descriptors are also being serviced.  It adopts many dups of the read
+ * side of a pipe that never becomes readable, then bounces a single byte
+ * around one "active" pipe and times how long each round trip takes.
+ *
+ * Run it with and without -e to compare the default poll() loop against
+ * the epoll() backend.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+struct raw_vhd {
+	int quiet[2];		/* never written, the idle fds are dups of [0] */
+	int idle_count;
+	int active[2];
+	int wakeups;
+	struct timeval start;
+};
+
+static int idle_count = 1000, wakeups = 100000, interrupted;
+
+static int
+kick(struct raw_vhd *vhd)
+{
+	char c = 'x';
+
+	return write(vhd->active[1], &c, 1) != 1;
+}
+
+static int
+adopt(struct lws_vhost *vh, int fd)
+{
+	lws_sock_file_fd_type u;
+
+	u.filefd = fd;
+
+	return !lws_adopt_descriptor_vhost(vh, LWS_ADOPT_RAW_FILE_DESC, u,
+					   "raw-test", NULL);
+}
+
+static int
+callback_raw_test(struct lws *wsi, enum lws_callback_reasons reason,
+			void *user, void *in, size_t len)
+{
+	struct raw_vhd *vhd = (struct raw_vhd *)lws_protocol_vh_priv_get(
+				     lws_get_vhost(wsi), lws_get_protocol(wsi));
+	struct timeval now;
+	uint64_t us;
+	char c;
+	int n, fd;
+
+	switch (reason) {
+	case LWS_CALLBACK_PROTOCOL_INIT:
+		vhd = lws_protocol_vh_priv_zalloc(lws_get_vhost(wsi),
+				lws_get_protocol(wsi), sizeof(struct raw_vhd));
+		if (pipe(vhd->quiet)) {
+			vhd->quiet[1] = -1;
+			goto bail;
+		}
+
+		/*
+		 * each idle fd is its own entry for poll() / epoll() to look
+		 * at, but as dups of one pipe they only cost one fd each
+		 */
+		for (n = 0; n < idle_count; n++) {
+			fd = dup(vhd->quiet[0]);
+			if (fd < 0) {
+				lwsl_err("dup %d failed (raise ulimit -n?)\n",
+					 n);
+				goto bail;
+			}
+			if (adopt(lws_get_vhost(wsi), fd)) {
+				close(fd);
+				lwsl_err("Failed to adopt idle fd %d\n", n);
+				goto bail;
+			}
+			vhd->idle_count++;
+		}
+
+		if (pipe(vhd->active) ||
+		    adopt(lws_get_vhost(wsi), vhd->active[0])) {
+			lwsl_err("Failed to create active pipe\n");
+			goto bail;
+		}
+
+		lwsl_user("%d idle fds adopted, starting %d wakeups\n",
+			  vhd->idle_count, wakeups);
+		gettimeofday(&vhd->start, NULL);
+
+		return kick(vhd);
+
+	case LWS_CALLBACK_PROTOCOL_DESTROY:
+		if (!vhd)
+			break;
+		/* the idle fds were closed along with their wsi */
+		if (vhd->quiet[1] >= 0) {
+			close(vhd->quiet[0]);
+			close(vhd->quiet[1]);
+		}
+		close(vhd->active[1]);
+		break;
+
+	case LWS_CALLBACK_RAW_RX_FILE:
+		if (lws_get_socket_fd(wsi) != vhd->active[0])
+			break;
+
+		if (read(vhd->active[0], &c, 1) != 1)
+			return 1;
+
+		if (++vhd->wakeups < wakeups)
+			return kick(vhd);
+
+		gettimeofday(&now, NULL);
+		us = ((uint64_t)(now.tv_sec - vhd->start.tv_sec) * 1000000) +
+		     now.tv_usec - vhd->start.tv_usec;
+		lwsl_user("%d wakeups with %d idle fds: %lluus total, "
+			  "%.3fus / wakeup\n", vhd->wakeups, vhd->idle_count,
+			  (unsigned long long)us, (double)us / vhd->wakeups);
+		interrupted = 1;
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+
+bail:
+	/* no point sitting in the event loop without a working setup */
+	interrupted = 1;
+
+	return 1;
+}
+
+static struct lws_protocols protocols[] = {
+	{ "raw-test", callback_raw_test, 0, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+void sigint_handler(int sig)
+{
+	interrupted = 1;
+}
+
+static const char *findarg(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc - 1], val))
+			return argv[argc];
+	}
+
+	return NULL;
+}
+
+static int findswitch(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc], val))
+			return argc;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct lws_context_creation_info info;
+	struct lws_context *context;
+	struct rlimit rl;
+	const char *p;
+	int n = 0;
+
+	signal(SIGINT, sigint_handler);
+
+	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
+	info.port = CONTEXT_PORT_NO_LISTEN_SERVER; /* no listen socket for demo */
+	info.protocols = protocols;
+
+	lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN | LLL_NOTICE
+			/* for LLL_ verbosity above NOTICE to be built into lws,
+			 * lws must have been configured and built with
+			 * -DCMAKE_BUILD_TYPE=DEBUG instead of =RELEASE */
+			/* | LLL_INFO */ /* | LLL_PARSER */ /* | LLL_HEADER */
+			/* | LLL_EXT */ /* | LLL_CLIENT */ /* | LLL_LATENCY */
+			/* | LLL_DEBUG */, NULL);
+
+	lwsl_user("LWS minimal raw wakeup bench\n");
+	lwsl_user("   %s [-n <idle fds>] [-c <wakeups>] [-e (use epoll)]\n",
+		  argv[0]);
+
+	p = findarg(argc, argv, "-n");
+	if (p)
+		idle_count = atoi(p);
+	p = findarg(argc, argv, "-c");
+	if (p)
+		wakeups = atoi(p);
+	if (findswitch(argc, argv, "-e"))
+		info.options |= LWS_SERVER_OPTION_EPOLL;
+
+	/*
+	 * each idle fd counts against the limit, lws sizes its fd tables from
+	 * the process limit at context creation, so raise it first
+	 */
+	if (!getrlimit(RLIMIT_NOFILE, &rl)) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	while (n >= 0 && !interrupted)
+		n = lws_service(context, 1000);
+
+	lws_context_destroy(context);
+
+	return 0;
+}
@@ -0,0 +1,437 @@
+/*
+ * lws-minimal-ws-client-rx-fragments
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This checks the ws client rx parser delivers exactly what the server sent
+ * however the stream is chopped up on the way in.
+ *
+ * One vhost is a raw socket "server" that answers the ws upgrade by hand,
+ * then dribbles out a precomputed stream of frames of random sizes, some of
+ * them masked, in randomly-sized writes from 1 byte to 16KiB.  The other
+ * vhost holds an lws ws client that connects to it and compares every
+ * RECEIVE against the payload the frames were built from, including where
+ * lws_is_final_fragment() says each frame ends.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#define PORT 7681
+
+struct test {
+	uint8_t *stream;	/* everything the raw server will send */
+	size_t stream_len;
+	size_t hs_len;		/* how much of the stream is the 101 */
+	size_t sent;
+
+	uint8_t *payload;	/* the frame payloads, unmasked */
+	size_t payload_len;
+	size_t *frame_end;	/* offset in payload where each frame ends */
+	int frames;
+
+	size_t rx;		/* how much payload the client has checked */
+	int rx_frame;
+	int writes;
+
+	struct timeval established;
+	struct lws *client_wsi;
+};
+
+static struct test t;
+static int interrupted, bad, count_frames = 300, seed = 1, fixed_chunk;
+static struct lws_vhost *vh_client;
+
+static uint32_t rng_state;
+
+static uint32_t
+rng(void)
+{
+	/* xorshift32, so the run is repeatable for a given seed */
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+
+	return rng_state;
+}
+
+static int
+build_frames(void)
+{
+	size_t cap = 16 * 1024 * 1024, len, n;
+	uint8_t *p, mask[4];
+	int f, masked;
+
+	t.stream = malloc(cap + 1024);
+	t.payload = malloc(cap);
+	t.frame_end = malloc(sizeof(size_t) * count_frames);
+	if (!t.stream || !t.payload || !t.frame_end)
+		return 1;
+
+	/* the 101 goes in front later, once we have seen the client key */
+	p = t.stream + 1024;
+
+	for (f = 0; f < count_frames; f++) {
+		switch (rng() & 3) {
+		case 0:
+			len = 1 + (rng() % 125);
+			break;
+		case 1:
+		case 2:
+			len = 126 + (rng() % (65536 - 126));
+			break;
+		default:
+			len = 65536 + (rng() % 65536);
+			break;
+		}
+		if (t.payload_len + len > cap - 14)
+			break;
+
+		masked = !(rng() % 3);
+
+		*p++ = 0x82; /* FIN + binary */
+		if (len < 126)
+			*p++ = (uint8_t)len | (masked << 7);
+		else if (len < 65536) {
+			*p++ = 126 | (masked << 7);
+			*p++ = (uint8_t)(len >> 8);
+			*p++ = (uint8_t)len;
+		} else {
+			*p++ = 127 | (masked << 7);
+			for (n = 0; n < 8; n++)
+				*p++ = (uint8_t)((uint64_t)len >> (56 - (n * 8)));
+		}
+		if (masked)
+			for (n = 0; n < 4; n++)
+				*p++ = mask[n] = (uint8_t)rng();
+
+		for (n = 0; n < len; n++) {
+			t.payload[t.payload_len + n] = (uint8_t)rng();
+			*p++ = t.payload[t.payload_len + n] ^
+					(masked ? mask[n & 3] : 0);
+		}
+
+		t.payload_len += len;
+		t.frame_end[f] = t.payload_len;
+	}
+
+	t.frames = f;
+	t.stream_len = lws_ptr_diff(p, t.stream);
+
+	return 0;
+}
+
+static int
+prepend_handshake(const char *key)
+{
+	static const char *guid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+	char buf[256], hash[20], accept[64], hs[512];
+	int n;
+
+	n = lws_snprintf(buf, sizeof(buf), "%s%s", key, guid);
+	lws_SHA1((unsigned char *)buf, n, (unsigned char *)hash);
+	lws_b64_encode_string(hash, 20, accept, sizeof(accept));
+
+	n = lws_snprintf(hs, sizeof(hs),
+			 "HTTP/1.1 101 Switching Protocols\x0d\x0a"
+			 "Upgrade: websocket\x0d\x0a"
+			 "Connection: Upgrade\x0d\x0a"
+			 "Sec-WebSocket-Accept: %s\x0d\x0a"
+			 "Sec-WebSocket-Protocol: lws-fragments-test\x0d\x0a"
+			 "\x0d\x0a", accept);
+
+	/* there's 1024 bytes of room left in front of the frames */
+	t.hs_len = n;
+	t.sent = 1024 - n;
+	memcpy(t.stream + t.sent, hs, n);
+
+	return 0;
+}
+
+/* the raw socket "server" side */
+
+static int
+callback_raw_server(struct lws *wsi, enum lws_callback_reasons reason,
+		    void *user, void *in, size_t len)
+{
+	static char req[2048];
+	static size_t req_len;
+	char *p, *e;
+	size_t chunk;
+	int n;
+
+	switch (reason) {
+	case LWS_CALLBACK_RAW_RX:
+		if (t.hs_len)
+			break;
+		if (req_len + len >= sizeof(req))
+			return -1;
+		memcpy(req + req_len, in, len);
+		req_len += len;
+		req[req_len] = '\0';
+
+		if (!strstr(req, "\x0d\x0a\x0d\x0a"))
+			break;
+
+		p = strstr(req, "Sec-WebSocket-Key:");
+		if (!p)
+			return -1;
+		p += 18;
+		while (*p == ' ')
+			p++;
+		e = strchr(p, '\x0d');
+		if (!e)
+			return -1;
+		*e = '\0';
+
+		prepend_handshake(p);
+		lws_callback_on_writable(wsi);
+		break;
+
+	case LWS_CALLBACK_RAW_WRITEABLE:
+		if (t.sent == t.stream_len)
+			break;
+
+		/* anything from 1 byte to 16KiB, weighted towards small */
+		chunk = 1 + (rng() % (1 << (rng() % 15)));
+		if (fixed_chunk)
+			chunk = fixed_chunk;
+		if (chunk > t.stream_len - t.sent)
+			chunk = t.stream_len - t.sent;
+
+		/*
+		 * write on the fd directly, so each chunk goes out on its own
+		 * without lws buffering or coalescing it
+		 */
+		n = (int)send(lws_get_socket_fd(wsi), t.stream + t.sent,
+			      chunk, 0);
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				n = 0;
+			else
+				return -1;
+		}
+		t.sent += n;
+		t.writes++;
+
+		if (t.sent != t.stream_len)
+			lws_callback_on_writable(wsi);
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/* the ws client side */
+
+static int
+callback_client(struct lws *wsi, enum lws_callback_reasons reason,
+		void *user, void *in, size_t len)
+{
+	struct timeval now;
+	int final;
+
+	switch (reason) {
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		lwsl_err("CLIENT_CONNECTION_ERROR: %s\n",
+			 in ? (char *)in : "(null)");
+		bad = 1;
+		interrupted = 1;
+		break;
+
+	case LWS_CALLBACK_CLIENT_ESTABLISHED:
+		lwsl_user("%s: established\n", __func__);
+		gettimeofday(&t.established, NULL);
+		break;
+
+	case LWS_CALLBACK_CLIENT_RECEIVE:
+		if (t.rx_frame >= t.frames ||
+		    t.rx + len > t.frame_end[t.rx_frame] ||
+		    memcmp(in, t.payload + t.rx, len)) {
+			lwsl_err("%s: payload mismatch at %lu (frame %d)\n",
+				 __func__, (unsigned long)t.rx, t.rx_frame);
+			bad = 1;
+			interrupted = 1;
+			return -1;
+		}
+		t.rx += len;
+
+		final = t.rx == t.frame_end[t.rx_frame];
+		if (final != lws_is_final_fragment(wsi)) {
+			lwsl_err("%s: frame %d end in wrong place (%lu)\n",
+				 __func__, t.rx_frame, (unsigned long)t.rx);
+			bad = 1;
+			interrupted = 1;
+			return -1;
+		}
+		if (final)
+			t.rx_frame++;
+
+		if (t.rx_frame == t.frames) {
+			gettimeofday(&now, NULL);
+			lwsl_user("%s: %d frames, %lu payload bytes matched "
+				  "over %d writes in %lldus\n", __func__,
+				  t.frames, (unsigned long)t.rx, t.writes,
+				  ((long long)(now.tv_sec - t.established.tv_sec) *
+				   1000000) + now.tv_usec -
+				   t.established.tv_usec);
+			interrupted = 1;
+		}
+		break;
+
+	case LWS_CALLBACK_CLIENT_CLOSED:
+		t.client_wsi = NULL;
+		if (t.rx_frame != t.frames)
+			bad = 1;
+		interrupted = 1;
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static const struct lws_protocols protocols_raw[] = {
+	{ "raw-server", callback_raw_server, 0, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static const struct lws_protocols protocols_client[] = {
+	{ "lws-fragments-test", callback_client, 0, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static void
+sigint_handler(int sig)
+{
+	interrupted = 1;
+}
+
+static const char *findarg(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc - 1], val))
+			return argv[argc];
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct lws_context_creation_info info;
+	struct lws_client_connect_info i;
+	struct lws_context *context;
+	time_t start;
+	const char *p;
+	int n = 0;
+
+	signal(SIGINT, sigint_handler);
+
+	lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN | LLL_NOTICE, NULL);
+
+	lwsl_user("LWS minimal ws client rx fragments\n");
+	lwsl_user("   %s [-s <seed>] [-f <frames>] [-c <fixed write size>]\n",
+		  argv[0]);
+
+	p = findarg(argc, argv, "-s");
+	if (p)
+		seed = atoi(p);
+	p = findarg(argc, argv, "-f");
+	if (p)
+		count_frames = atoi(p);
+	p = findarg(argc, argv, "-c");
+	if (p)
+		fixed_chunk = atoi(p);
+
+	rng_state = seed ? (uint32_t)seed : 1;
+	if (build_frames()) {
+		lwsl_err("OOM\n");
+		return 1;
+	}
+
+	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
+	info.options = LWS_SERVER_OPTION_EXPLICIT_VHOSTS;
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	info.port = PORT;
+	info.protocols = protocols_raw;
+	info.options = LWS_SERVER_OPTION_ONLY_RAW;
+	info.vhost_name = "raw";
+	if (!lws_create_vhost(context, &info)) {
+		lwsl_err("Failed to create raw vhost\n");
+		bad = 1;
+		goto bail;
+	}
+
+	info.port = CONTEXT_PORT_NO_LISTEN;
+	info.protocols = protocols_client;
+	info.options = 0;
+	info.vhost_name = "client";
+	vh_client = lws_create_vhost(context, &info);
+	if (!vh_client) {
+		lwsl_err("Failed to create client vhost\n");
+		bad = 1;
+		goto bail;
+	}
+
+	memset(&i, 0, sizeof i); /* otherwise uninitialized garbage */
+	i.context = context;
+	i.vhost = vh_client;
+	i.port = PORT;
+	i.address = "127.0.0.1";
+	i.path = "/";
+	i.host = i.address;
+	i.origin = i.address;
+	i.protocol = protocols_client[0].name;
+	i.pwsi = &t.client_wsi;
+
+	if (!lws_client_connect_via_info(&i)) {
+		lwsl_err("Client connect failed\n");
+		bad = 1;
+		goto bail;
+	}
+
+	start = time(NULL);
+	while (n >= 0 && !interrupted) {
+		n = lws_service(context, 1000);
+		if (time(NULL) - start > 60) {
+			lwsl_err("Timed out\n");
+			bad = 1;
+			break;
+		}
+	}
+
+	if (t.rx_frame != t.frames)
+		bad = 1;
+
+bail:
+	lws_context_destroy(context);
+
+	free(t.stream);
+	free(t.payload);
+	free(t.frame_end);
+
+	lwsl_user("Completed: %s\n", bad ? "FAILED" : "OK");
+
+	return bad;
+}
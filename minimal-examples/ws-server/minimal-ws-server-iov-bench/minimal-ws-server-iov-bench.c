@@ -0,0 +1,410 @@
+/*
+ * lws-minimal-ws-server-iov-bench
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This measures sending ws messages whose payload is in several pieces, the
+ * way a server with a small per-connection header and a shared body held in
+ * a few ring entries would have it.
+ *
+ * It forks a process that opens -c ws client connections (default 50) to an
+ * lws server in this process on port 7681.  Once they are all up, the
+ * server sends each of them -m messages (default 2000).  Each message is a
+ * 16-byte header with the message's sequence number, followed by a shared
+ * -s byte body (default 8192) held in -p pieces (default 4).  The clients
+ * check what they get and close after the last message.
+ *
+ * By default each message is copied into one buffer with LWS_PRE in front
+ * of it and sent with lws_write().  With -i, the header and pieces are given
+ * to lws_write_iov() where they are.
+ *
+ * It reports the server's cpu time from starting to send until the last
+ * client closed.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define HDR 16
+
+struct pss {
+	int msg;
+	size_t pos;
+	int failed;
+	char hdr[HDR + 1];
+};
+
+static int clients = 50, messages = 2000, size = 8192, pieces = 4, use_iov,
+	   interrupted, established, closed, completed, done, failed;
+static uint8_t *body, *copybuf;
+
+static int
+callback_server(struct lws *wsi, enum lws_callback_reasons reason,
+		void *user, void *in, size_t len)
+{
+	struct lws_iovec iov[LWS_WRITE_IOV_MAX];
+	struct pss *pss = (struct pss *)user;
+	size_t ofs, l;
+	uint8_t *p;
+	int n;
+
+	switch (reason) {
+	case LWS_CALLBACK_ESTABLISHED:
+		established++;
+		break;
+
+	case LWS_CALLBACK_CLOSED:
+		closed++;
+		break;
+
+	case LWS_CALLBACK_SERVER_WRITEABLE:
+		if (pss->msg == messages)
+			break;
+
+		lws_snprintf(pss->hdr, sizeof(pss->hdr), "%015d\n", pss->msg);
+
+		if (use_iov) {
+			iov[0].base = pss->hdr;
+			iov[0].len = HDR;
+			for (n = 0, ofs = 0; n < pieces; n++, ofs += l) {
+				l = size / pieces;
+				if (n == pieces - 1)
+					l = size - ofs;
+				iov[n + 1].base = body + ofs;
+				iov[n + 1].len = l;
+			}
+			if (lws_write_iov(wsi, iov, pieces + 1,
+					  LWS_WRITE_BINARY) < HDR + size)
+				return -1;
+		} else {
+			/* what you have to do without lws_write_iov() */
+			p = copybuf + LWS_PRE;
+			memcpy(p, pss->hdr, HDR);
+			p += HDR;
+			for (n = 0, ofs = 0; n < pieces; n++, ofs += l) {
+				l = size / pieces;
+				if (n == pieces - 1)
+					l = size - ofs;
+				memcpy(p, body + ofs, l);
+				p += l;
+			}
+			if (lws_write(wsi, copybuf + LWS_PRE, HDR + size,
+				      LWS_WRITE_BINARY) < HDR + size)
+				return -1;
+		}
+
+		if (++pss->msg != messages)
+			lws_callback_on_writable(wsi);
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static int
+callback_client(struct lws *wsi, enum lws_callback_reasons reason,
+		void *user, void *in, size_t len)
+{
+	struct pss *pss = (struct pss *)user;
+	const uint8_t *p = (const uint8_t *)in;
+	size_t n;
+
+	switch (reason) {
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		lwsl_err("client connection error: %s\n",
+			 in ? (char *)in : "(null)");
+		done++;
+		break;
+
+	case LWS_CALLBACK_CLIENT_RECEIVE:
+		if (!pss || pss->msg == messages)
+			return -1;
+
+		if (pss->pos + len > (size_t)HDR + size) {
+			lwsl_err("message %d too long\n", pss->msg);
+			goto bail;
+		}
+
+		if (!pss->pos)
+			lws_snprintf(pss->hdr, sizeof(pss->hdr), "%015d\n",
+				     pss->msg);
+
+		/* the part of the header in this fragment */
+		if (pss->pos < HDR) {
+			n = HDR - pss->pos;
+			if (n > len)
+				n = len;
+			if (memcmp(p, pss->hdr + pss->pos, n)) {
+				lwsl_err("message %d bad header\n", pss->msg);
+				goto bail;
+			}
+			pss->pos += n;
+			p += n;
+			len -= n;
+		}
+
+		if (len && memcmp(p, body + pss->pos - HDR, len)) {
+			lwsl_err("message %d differs at %d\n", pss->msg,
+				 (int)pss->pos);
+			goto bail;
+		}
+		pss->pos += len;
+
+		if (!lws_is_final_fragment(wsi) ||
+		    lws_remaining_packet_payload(wsi))
+			break;
+
+		if (pss->pos != (size_t)HDR + size) {
+			lwsl_err("message %d short\n", pss->msg);
+			goto bail;
+		}
+		pss->pos = 0;
+		if (++pss->msg == messages) {
+			completed++;
+			done++;
+			return -1;
+		}
+		break;
+
+	case LWS_CALLBACK_CLIENT_CLOSED:
+		if (pss && pss->msg != messages && !pss->failed) {
+			lwsl_err("closed early\n");
+			failed++;
+			done++;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+
+bail:
+	pss->failed = 1;
+	failed++;
+	done++;
+
+	return -1;
+}
+
+static struct lws_protocols protocols_server[] = {
+	{ "http", lws_callback_http_dummy, 0, 0 },
+	{ "iov-bench", callback_server, sizeof(struct pss), 4096, 0, NULL,
+	  65536 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static struct lws_protocols protocols_client[] = {
+	{ "iov-bench", callback_client, sizeof(struct pss), 4096, 0, NULL, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static uint64_t
+us_cpu(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	return ((uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000) +
+		ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+static int
+run_clients(int fd)
+{
+	struct lws_client_connect_info i;
+	struct lws_context_creation_info info;
+	struct lws_context *context;
+	char c;
+	int n = 0;
+
+	/* wait for the server to be listening */
+	if (read(fd, &c, 1) != 1)
+		return 1;
+
+	memset(&info, 0, sizeof info);
+	info.port = CONTEXT_PORT_NO_LISTEN;
+	info.protocols = protocols_client;
+	info.fd_limit_per_thread = clients + 16;
+
+	context = lws_create_context(&info);
+	if (!context)
+		return 1;
+
+	memset(&i, 0, sizeof i);
+	i.context = context;
+	i.port = 7681;
+	i.address = "localhost";
+	i.path = "/";
+	i.host = i.address;
+	i.origin = i.address;
+	i.protocol = protocols_client[0].name;
+
+	for (n = 0; n < clients; n++)
+		if (!lws_client_connect_via_info(&i))
+			done++;
+
+	n = 0;
+	while (n >= 0 && done < clients && !interrupted)
+		n = lws_service(context, 1000);
+
+	lws_context_destroy(context);
+
+	if (completed != clients)
+		lwsl_err("%d of %d clients got all the messages\n",
+			 completed, clients);
+
+	return completed != clients || failed;
+}
+
+void sigint_handler(int sig)
+{
+	interrupted = 1;
+}
+
+static const char *findarg(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc - 1], val))
+			return argv[argc];
+	}
+
+	return NULL;
+}
+
+static int findswitch(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc], val))
+			return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct lws_context_creation_info info;
+	struct lws_context *context;
+	int n = 0, fds[2];
+	const char *p;
+	uint64_t cpu;
+	pid_t pid;
+	char c;
+
+	signal(SIGINT, sigint_handler);
+
+	if ((p = findarg(argc, argv, "-c")))
+		clients = atoi(p);
+	if ((p = findarg(argc, argv, "-m")))
+		messages = atoi(p);
+	if ((p = findarg(argc, argv, "-s")))
+		size = atoi(p);
+	if ((p = findarg(argc, argv, "-p")))
+		pieces = atoi(p);
+	use_iov = findswitch(argc, argv, "-i");
+	if (clients < 1)
+		clients = 1;
+	if (messages < 1)
+		messages = 1;
+	if (size < 1 || size > 60000)
+		size = 8192;
+	if (pieces < 1)
+		pieces = 1;
+	if (pieces > LWS_WRITE_IOV_MAX - 1)
+		pieces = LWS_WRITE_IOV_MAX - 1;
+
+	lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN, NULL);
+	lwsl_user("LWS minimal ws server iov bench\n");
+	lwsl_user("   %s [-c <clients>] [-m <messages>] [-s <size>] "
+		  "[-p <pieces>] [-i]\n", argv[0]);
+
+	body = malloc(size);
+	copybuf = malloc(LWS_PRE + HDR + size);
+	if (!body || !copybuf || socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+		return 1;
+	for (n = 0; n < size; n++)
+		body[n] = (uint8_t)(n * 7 + (n >> 8));
+
+	/*
+	 * The client process tells us how it went over the socketpair, since
+	 * lws may reap it for us (cgi support does waitpid(-1, ...))
+	 */
+
+	pid = fork();
+	if (pid < 0)
+		return 1;
+	if (!pid) {
+		close(fds[1]);
+		c = (char)run_clients(fds[0]);
+		if (write(fds[0], &c, 1) != 1)
+			exit(1);
+		exit(c);
+	}
+	close(fds[0]);
+
+	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
+	info.port = 7681;
+	info.protocols = protocols_server;
+	info.fd_limit_per_thread = clients + 16;
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		kill(pid, SIGTERM);
+		waitpid(pid, NULL, 0);
+		return 1;
+	}
+
+	if (write(fds[1], "", 1) != 1)
+		interrupted = 1;
+
+	n = 0;
+	while (n >= 0 && established < clients && closed < clients &&
+	       !interrupted)
+		n = lws_service(context, 1000);
+
+	cpu = us_cpu();
+
+	lws_callback_on_writable_all_protocol(context, &protocols_server[1]);
+
+	while (n >= 0 && closed < clients && !interrupted)
+		n = lws_service(context, 1000);
+
+	cpu = us_cpu() - cpu;
+
+	lws_context_destroy(context);
+
+	n = read(fds[1], &c, 1) != 1 || c || interrupted;
+	waitpid(pid, NULL, 0);
+
+	if (!n)
+		lwsl_user("%d x %d messages of %d + %d in %d pieces (%s): "
+			  "cpu %lluus, %.3fus per message sent\n",
+			  clients, messages, HDR, size, pieces,
+			  use_iov ? "lws_write_iov" : "copy + lws_write",
+			  (unsigned long long)cpu,
+			  (double)cpu / ((double)clients * messages));
+
+	free(body);
+	free(copybuf);
+
+	lwsl_user("Completed: %s\n", n ? "FAILED" : "OK");
+
+	return n;
+}
@@ -0,0 +1,476 @@
+/*
+ * lws-minimal-ws-server-pmd-bulk broadcast bench mode (-b)
+ *
+ * Copyright (C) 2018 Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This is included by minimal-ws-server-pmd-bulk.c, which uses it instead of
+ * its usual server when given -b.  It measures what it costs a server to
+ * send the same permessage-deflate messages to many connections at once.
+ *
+ * It forks a process that opens -c ws client connections (default 200) with
+ * permessage-deflate to an lws server in this process on port 7681.  Once
+ * they are all up, the server sends each of them the same -m messages
+ * (default 50) of -s bytes (default 16384) of compressible text, in 1KiB
+ * fragments like minimal-ws-server-pmd-bulk does.  The clients check what
+ * they get and close after the last message.
+ *
+ * With -p, each message is compressed once with lws_pmd_predeflate() and
+ * sent to every connection with lws_write_pmd_predeflated() instead.
+ *
+ * The clients offer client_no_context_takeover unless you give -t.
+ *
+ * It reports the server's cpu time from starting to send until the last
+ * client closed, its RSS when all the connections are up and idle, and its
+ * peak RSS.
+ */
+
+#if !defined(LWS_WITHOUT_CLIENT)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define CHUNK 1024
+
+struct msg {
+	uint8_t *buf;
+	size_t len;
+	struct lws_pmd_predeflated *pd;
+};
+
+struct pss {
+	int msg;
+	size_t pos;
+	int failed;
+};
+
+static int clients = 200, messages = 50, size = 16384, predeflate, takeover,
+	   established, closed, completed, done, failed;
+static struct msg *msgs;
+
+static int
+callback_server(struct lws *wsi, enum lws_callback_reasons reason,
+		void *user, void *in, size_t len)
+{
+	struct pss *pss = (struct pss *)user;
+	uint8_t buf[LWS_PRE + CHUNK];
+	struct msg *m;
+	int n, flags;
+
+	switch (reason) {
+	case LWS_CALLBACK_ESTABLISHED:
+		established++;
+		break;
+
+	case LWS_CALLBACK_CLOSED:
+		closed++;
+		break;
+
+	case LWS_CALLBACK_SERVER_WRITEABLE:
+		if (pss->msg == messages)
+			break;
+		m = &msgs[pss->msg];
+
+		if (m->pd && !pss->pos) {
+			n = lws_write_pmd_predeflated(wsi, m->pd);
+			if (n < 0)
+				return -1;
+			if (!n) {
+				pss->msg++;
+				goto next;
+			}
+			/* this one can't take it, send it the usual way */
+		}
+
+		n = CHUNK;
+		if ((size_t)n > m->len - pss->pos)
+			n = (int)(m->len - pss->pos);
+		memcpy(buf + LWS_PRE, m->buf + pss->pos, n);
+		flags = lws_write_ws_flags(LWS_WRITE_TEXT, !pss->pos,
+					   pss->pos + n == m->len);
+		if (lws_write(wsi, buf + LWS_PRE, n, flags) < n)
+			return -1;
+
+		pss->pos += n;
+		if (pss->pos == m->len) {
+			pss->pos = 0;
+			pss->msg++;
+		}
+next:
+		if (pss->msg != messages)
+			lws_callback_on_writable(wsi);
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static int
+callback_client(struct lws *wsi, enum lws_callback_reasons reason,
+		void *user, void *in, size_t len)
+{
+	struct pss *pss = (struct pss *)user;
+	struct msg *m;
+
+	switch (reason) {
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		lwsl_err("client connection error: %s\n",
+			 in ? (char *)in : "(null)");
+		done++;
+		break;
+
+	case LWS_CALLBACK_CLIENT_RECEIVE:
+		if (!pss || pss->msg == messages)
+			return -1;
+		m = &msgs[pss->msg];
+
+		if (pss->pos + len > m->len ||
+		    memcmp(in, m->buf + pss->pos, len)) {
+			lwsl_err("message %d differs at %d\n", pss->msg,
+				 (int)pss->pos);
+			goto bail;
+		}
+		pss->pos += len;
+
+		if (!lws_is_final_fragment(wsi) ||
+		    lws_remaining_packet_payload(wsi))
+			break;
+
+		if (pss->pos != m->len) {
+			lwsl_err("message %d short\n", pss->msg);
+			goto bail;
+		}
+		pss->pos = 0;
+		if (++pss->msg == messages) {
+			completed++;
+			done++;
+			return -1;
+		}
+		break;
+
+	case LWS_CALLBACK_CLIENT_CLOSED:
+		if (pss && pss->msg != messages && !pss->failed) {
+			lwsl_err("closed early\n");
+			failed++;
+			done++;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+
+bail:
+	pss->failed = 1;
+	failed++;
+	done++;
+
+	return -1;
+}
+
+static struct lws_protocols protocols_server[] = {
+	{ "http", lws_callback_http_dummy, 0, 0 },
+	{ "pmd-bench", callback_server, sizeof(struct pss), 4096, 0, NULL, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static struct lws_protocols protocols_client[] = {
+	{ "pmd-bench", callback_client, sizeof(struct pss), 4096, 0, NULL, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+static const struct lws_extension extensions_server[] = {
+	{
+		"permessage-deflate",
+		lws_extension_callback_pm_deflate,
+		"permessage-deflate"
+		 "; client_no_context_takeover"
+		 "; client_max_window_bits"
+	},
+	{ NULL, NULL, NULL /* terminator */ }
+};
+
+static struct lws_extension extensions_client[] = {
+	{
+		"permessage-deflate",
+		lws_extension_callback_pm_deflate,
+		"permessage-deflate"
+		 "; client_no_context_takeover"
+		 "; client_max_window_bits"
+	},
+	{ NULL, NULL, NULL /* terminator */ }
+};
+
+static uint64_t
+us_cpu(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	return ((uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000) +
+		ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+static long
+rss_kib(void)
+{
+	long pages = 0, rss = 0;
+	FILE *f = fopen("/proc/self/statm", "r");
+
+	if (!f)
+		return 0;
+	if (fscanf(f, "%ld %ld", &pages, &rss) != 2)
+		rss = 0;
+	fclose(f);
+
+	return rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* something like a feed of price updates: compressible, but not trivially */
+
+static int
+make_messages(void)
+{
+	static const char * const sym[] = {
+		"AAPL", "MSFT", "GOOG", "AMZN", "NFLX", "TSLA", "INTC", "ORCL"
+	};
+	uint32_t r = 1;
+	size_t n;
+	int m;
+
+	msgs = calloc(messages, sizeof(*msgs));
+	if (!msgs)
+		return 1;
+
+	for (m = 0; m < messages; m++) {
+		msgs[m].buf = malloc(size + 128);
+		if (!msgs[m].buf)
+			return 1;
+		n = 0;
+		while (n < (size_t)size) {
+			r = r * 1103515245 + 12345;
+			n += lws_snprintf((char *)msgs[m].buf + n, 128,
+				"{\"seq\":%d,\"sym\":\"%s\",\"bid\":%u.%02u,"
+				"\"ask\":%u.%02u,\"vol\":%u}\n",
+				(int)n, sym[(r >> 8) & 7], (r >> 12) & 255,
+				(r >> 4) % 100, ((r >> 12) & 255) + 1,
+				(r >> 20) % 100, (r >> 16) & 4095);
+		}
+		msgs[m].len = size;
+	}
+
+	return 0;
+}
+
+static int
+run_clients(int fd)
+{
+	struct lws_client_connect_info i;
+	struct lws_context_creation_info info;
+	struct lws_context *context;
+	char c;
+	int n = 0;
+
+	/* wait for the server to be listening */
+	if (read(fd, &c, 1) != 1)
+		return 1;
+
+	if (takeover)
+		extensions_client[0].client_offer = "permessage-deflate"
+						    "; client_max_window_bits";
+
+	memset(&info, 0, sizeof info);
+	info.port = CONTEXT_PORT_NO_LISTEN;
+	info.protocols = protocols_client;
+	info.extensions = extensions_client;
+	info.fd_limit_per_thread = clients + 16;
+
+	context = lws_create_context(&info);
+	if (!context)
+		return 1;
+
+	memset(&i, 0, sizeof i);
+	i.context = context;
+	i.port = 7681;
+	i.address = "localhost";
+	i.path = "/";
+	i.host = i.address;
+	i.origin = i.address;
+	i.protocol = protocols_client[0].name;
+
+	for (n = 0; n < clients; n++)
+		if (!lws_client_connect_via_info(&i))
+			done++;
+
+	n = 0;
+	while (n >= 0 && done < clients && !interrupted)
+		n = lws_service(context, 1000);
+
+	lws_context_destroy(context);
+
+	if (completed != clients)
+		lwsl_err("%d of %d clients got all the messages\n",
+			 completed, clients);
+
+	return completed != clients || failed;
+}
+
+static const char *findarg(int argc, char **argv, const char *val)
+{
+	while (--argc > 0) {
+		if (!strcmp(argv[argc - 1], val))
+			return argv[argc];
+	}
+
+	return NULL;
+}
+
+static int
+broadcast_bench(int argc, char **argv)
+{
+	struct lws_context_creation_info info;
+	uint64_t cpu, pd_cpu = 0;
+	struct lws_context *context;
+	int n = 0, m, fds[2];
+	long rss_idle;
+	struct rusage ru;
+	const char *p;
+	pid_t pid;
+	char c;
+
+	if ((p = findarg(argc, argv, "-c")))
+		clients = atoi(p);
+	if ((p = findarg(argc, argv, "-m")))
+		messages = atoi(p);
+	if ((p = findarg(argc, argv, "-s")))
+		size = atoi(p);
+	predeflate = findswitch(argc, argv, "-p");
+	takeover = findswitch(argc, argv, "-t");
+	if (clients < 1)
+		clients = 1;
+	if (messages < 1)
+		messages = 1;
+	if (size < 1)
+		size = 1;
+
+	lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN, NULL);
+	lwsl_user("LWS minimal ws server + permessage-deflate broadcast bench\n");
+	lwsl_user("   %s -b [-c <clients>] [-m <messages>] [-s <size>] [-p] "
+		  "[-t]\n", argv[0]);
+
+	if (make_messages() || socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+		return 1;
+
+	/*
+	 * The client process tells us how it went over the socketpair, since
+	 * lws may reap it for us (cgi support does waitpid(-1, ...))
+	 */
+
+	pid = fork();
+	if (pid < 0)
+		return 1;
+	if (!pid) {
+		close(fds[1]);
+		c = (char)run_clients(fds[0]);
+		if (write(fds[0], &c, 1) != 1)
+			exit(1);
+		exit(c);
+	}
+	close(fds[0]);
+
+	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
+	info.port = 7681;
+	info.protocols = protocols_server;
+	info.extensions = extensions_server;
+	info.fd_limit_per_thread = clients + 16;
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		kill(pid, SIGTERM);
+		waitpid(pid, NULL, 0);
+		return 1;
+	}
+
+	if (write(fds[1], "", 1) != 1)
+		interrupted = 1;
+
+	while (n >= 0 && established < clients && closed < clients &&
+	       !interrupted)
+		n = lws_service(context, 1000);
+
+	rss_idle = rss_kib();
+	lwsl_user("%d connections up, RSS %ldKiB\n", established, rss_idle);
+
+	cpu = us_cpu();
+
+	if (predeflate)
+		for (m = 0; m < messages; m++) {
+			msgs[m].pd = lws_pmd_predeflate(msgs[m].buf,
+							msgs[m].len, 0, 15, 1);
+			if (!msgs[m].pd) {
+				lwsl_err("predeflate failed\n");
+				interrupted = 1;
+			}
+		}
+	pd_cpu = us_cpu() - cpu;
+
+	lws_callback_on_writable_all_protocol(context, &protocols_server[1]);
+
+	while (n >= 0 && closed < clients && !interrupted)
+		n = lws_service(context, 1000);
+
+	cpu = us_cpu() - cpu;
+	getrusage(RUSAGE_SELF, &ru);
+
+	lws_context_destroy(context);
+
+	n = read(fds[1], &c, 1) != 1 || c || interrupted;
+	waitpid(pid, NULL, 0);
+
+	if (!n) {
+		lwsl_user("%d x %d messages of %d (%s, %s): cpu %lluus "
+			  "(predeflate %lluus), %.3fus per message sent\n",
+			  clients, messages, size,
+			  predeflate ? "predeflated" : "lws_write",
+			  takeover ? "context takeover" : "no context takeover",
+			  (unsigned long long)cpu, (unsigned long long)pd_cpu,
+			  (double)cpu / ((double)clients * messages));
+		lwsl_user("RSS idle %ldKiB, peak %ldKiB\n", rss_idle,
+			  ru.ru_maxrss);
+	}
+
+	for (m = 0; m < messages; m++) {
+		lws_pmd_predeflated_destroy(&msgs[m].pd);
+		free(msgs[m].buf);
+	}
+	free(msgs);
+
+	lwsl_user("Completed: %s\n", n ? "FAILED" : "OK");
+
+	return n;
+}
+
+#else
+
+static int
+broadcast_bench(int argc, char **argv)
+{
+	lwsl_err("The broadcast bench needs lws built with client support\n");
+
+	return 1;
+}
+
+#endif
@@ -97,6 +97,9 @@ static int findswitch(int argc, char **argv, const char *val)
 	return 0;
 }
 
+/* -b: time fanning the same messages out to many connections instead */
+#include "broadcast-bench.c"
+
 int main(int argc, char **argv)
 {
 	struct lws_context_creation_info info;
@@ -105,6 +108,9 @@ int main(int argc, char **argv)
 
 	signal(SIGINT, sigint_handler);
 
+	if (findswitch(argc, argv, "-b"))
+		return broadcast_bench(argc, argv);
+
 	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
 	info.port = 7681;
 	info.mounts = &mount;
@@ -128,7 +134,8 @@ int main(int argc, char **argv)
 			/* | LLL_DEBUG */, NULL);
 
 	lwsl_user("LWS minimal ws server + permessage-deflate | visit http://localhost:7681\n");
-	lwsl_user("   %s [-n (no exts)] [-c (compressible)]\n", argv[0]);
+	lwsl_user("   %s [-n (no exts)] [-c (compressible)] [-b (broadcast bench)]\n",
+		  argv[0]);
 	context = lws_create_context(&info);
 	if (!context) {
 		lwsl_err("lws init failed\n");